@@ -0,0 +1,374 @@
+/*
+ * cAdvisor/kubelet Scrape Benchmark for fuse_cgroupfs
+ *
+ * Builds N pods x M containers below every subsystem of a cgroup tree,
+ * then replays a cAdvisor housekeeping pass from K threads: for each
+ * cgroup, in every subsystem, readdir the cgroup directory, stat each
+ * entry and open/read/close every controller file. One scrape = one
+ * cgroup across all subsystems.
+ *
+ * Reports scrapes/sec, scrape latency percentiles and the CPU used by the
+ * emulator process (-P) and by the benchmark itself.
+ *
+ * With -T the same run works against a plain tmpfs tree as a baseline:
+ * new cgroup directories are populated by copying the parent's files, as
+ * the kernel (and the emulator's mkdir) would.
+ *
+ * Build: gcc -O2 -Wall bench_scrape.c -o bench_scrape -lpthread
+ * Usage: ./bench_scrape -p 100 -c 4 -t 8 -d 10 -P $(pidof fuse_cgroupfs) /tmp/fuse-cgroup
+ *        ./bench_scrape -p 100 -c 4 -t 8 -d 10 -T /tmp/tmpfs-cgroup
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define MAX_PATH 4096
+#define MAX_SUBSYS 32
+
+static const char *root;
+static int n_pods = 10, n_containers = 2, n_threads = 4, duration_s = 5;
+static int tmpfs_mode = 0, keep_tree = 0;
+static pid_t emulator_pid = 0;
+
+static char *subsys[MAX_SUBSYS];
+static int n_subsys;
+
+// Cgroup paths relative to a subsystem root
+static char **cgroups;
+static size_t n_cgroups;
+
+static volatile int stop;
+
+typedef struct {
+    int id;
+    unsigned long long *lat_ns;
+    size_t n_lat, cap_lat;
+    unsigned long long files, bytes, errors;
+} worker_t;
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Copy the parent directory's regular files into a new tmpfs cgroup
+static int populate_like_parent(const char *dir) {
+    char parent[MAX_PATH];
+    snprintf(parent, sizeof(parent), "%s", dir);
+    char *slash = strrchr(parent, '/');
+    if (!slash)
+        return -1;
+    *slash = '\0';
+
+    int pfd = open(parent, O_RDONLY | O_DIRECTORY);
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    DIR *d = pfd >= 0 ? fdopendir(pfd) : NULL;
+    if (!d || dfd < 0) {
+        if (d) closedir(d); else if (pfd >= 0) close(pfd);
+        if (dfd >= 0) close(dfd);
+        return -1;
+    }
+
+    struct dirent *de;
+    char buf[8192];
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_type != DT_REG)
+            continue;
+        int in = openat(pfd, de->d_name, O_RDONLY);
+        int out = openat(dfd, de->d_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ssize_t n;
+        while (in >= 0 && out >= 0 && (n = read(in, buf, sizeof(buf))) > 0)
+            if (write(out, buf, n) != n)
+                break;
+        if (in >= 0) close(in);
+        if (out >= 0) close(out);
+    }
+    closedir(d);
+    close(dfd);
+    return 0;
+}
+
+static int make_cgroup(const char *sub, const char *rel) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, sub, rel);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (tmpfs_mode)
+        populate_like_parent(path);
+    return 0;
+}
+
+static void remove_cgroup(const char *sub, const char *rel) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, sub, rel);
+
+    if (tmpfs_mode) {
+        DIR *d = opendir(path);
+        struct dirent *de;
+        while (d && (de = readdir(d)) != NULL) {
+            if (de->d_type == DT_REG)
+                unlinkat(dirfd(d), de->d_name, 0);
+        }
+        if (d) closedir(d);
+    }
+    rmdir(path);
+}
+
+static void add_cgroup(const char *fmt, int a, int b) {
+    char rel[256];
+    snprintf(rel, sizeof(rel), fmt, a, b);
+    cgroups = realloc(cgroups, (n_cgroups + 1) * sizeof(char *));
+    cgroups[n_cgroups++] = strdup(rel);
+}
+
+// Discover subsystems and build kubepods/pod<i>/c<j> in each
+static int build_tree(void) {
+    DIR *d = opendir(root);
+    if (!d) {
+        perror(root);
+        return -1;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL && n_subsys < MAX_SUBSYS) {
+        struct stat st;
+        if (de->d_name[0] == '.')
+            continue;
+        if (de->d_type != DT_DIR &&
+            (de->d_type != DT_UNKNOWN || fstatat(dirfd(d), de->d_name, &st, 0) < 0 ||
+             !S_ISDIR(st.st_mode)))
+            continue;
+        subsys[n_subsys++] = strdup(de->d_name);
+    }
+    closedir(d);
+
+    add_cgroup("kubepods", 0, 0);
+    for (int p = 0; p < n_pods; p++) {
+        add_cgroup("kubepods/pod%04d", p, 0);
+        for (int c = 0; c < n_containers; c++)
+            add_cgroup("kubepods/pod%04d/c%02d", p, c);
+    }
+
+    for (int s = 0; s < n_subsys; s++)
+        for (size_t i = 0; i < n_cgroups; i++)
+            if (make_cgroup(subsys[s], cgroups[i]) < 0)
+                return -1;
+    return 0;
+}
+
+static void teardown_tree(void) {
+    for (int s = 0; s < n_subsys; s++)
+        for (size_t i = n_cgroups; i-- > 0; )
+            remove_cgroup(subsys[s], cgroups[i]);
+}
+
+// One cAdvisor-style scrape of a cgroup across all subsystems
+static void scrape(worker_t *w, const char *rel) {
+    char path[MAX_PATH], buf[4096];
+
+    for (int s = 0; s < n_subsys; s++) {
+        snprintf(path, sizeof(path), "%s/%s/%s", root, subsys[s], rel);
+        DIR *d = opendir(path);
+        if (!d) {
+            w->errors++;
+            continue;
+        }
+
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.')
+                continue;
+
+            struct stat st;
+            if (fstatat(dirfd(d), de->d_name, &st, 0) < 0) {
+                w->errors++;
+                continue;
+            }
+            if (!S_ISREG(st.st_mode))
+                continue;
+
+            int fd = openat(dirfd(d), de->d_name, O_RDONLY);
+            if (fd < 0) {
+                w->errors++;
+                continue;
+            }
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                w->bytes += n;
+            if (n < 0)
+                w->errors++;
+            close(fd);
+            w->files++;
+        }
+        closedir(d);
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    size_t i = w->id % n_cgroups;
+
+    while (!stop) {
+        unsigned long long t0 = now_ns();
+        scrape(w, cgroups[i]);
+        unsigned long long dt = now_ns() - t0;
+
+        if (w->n_lat == w->cap_lat) {
+            w->cap_lat = w->cap_lat ? w->cap_lat * 2 : 4096;
+            w->lat_ns = realloc(w->lat_ns, w->cap_lat * sizeof(*w->lat_ns));
+        }
+        w->lat_ns[w->n_lat++] = dt;
+
+        i += n_threads;
+        if (i >= n_cgroups)
+            i = w->id % n_cgroups;
+    }
+    return NULL;
+}
+
+// utime + stime of a process in clock ticks
+static long long proc_cpu_ticks(pid_t pid) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    // Fields after the comm: state(3) ... utime(14) stime(15)
+    char *p = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                     &utime, &stime) != 2)
+        return -1;
+    return utime + stime;
+}
+
+static double self_cpu_s(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int cmp_ull(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-p pods] [-c containers] [-t threads] [-d seconds]\n"
+        "          [-P emulator-pid] [-T] [-k] <cgroup-root>\n"
+        "  -T  tmpfs baseline: populate new cgroups by copying parent files\n"
+        "  -k  keep the pod tree after the run\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:t:d:P:Tk")) != -1) {
+        switch (opt) {
+        case 'p': n_pods = atoi(optarg); break;
+        case 'c': n_containers = atoi(optarg); break;
+        case 't': n_threads = atoi(optarg); break;
+        case 'd': duration_s = atoi(optarg); break;
+        case 'P': emulator_pid = atoi(optarg); break;
+        case 'T': tmpfs_mode = 1; break;
+        case 'k': keep_tree = 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || n_threads < 1 || duration_s < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    root = argv[optind];
+
+    unsigned long long t_build = now_ns();
+    if (build_tree() < 0)
+        return 1;
+    t_build = now_ns() - t_build;
+
+    printf("Scrape Benchmark\n");
+    printf("================\n");
+    printf("mode:        %s\n", tmpfs_mode ? "tmpfs" : "fuse");
+    printf("tree:        %d subsystems x %zu cgroups (%d pods x %d containers)\n",
+           n_subsys, n_cgroups, n_pods, n_containers);
+    printf("build:       %.3f ms\n", t_build / 1e6);
+    printf("threads:     %d\n", n_threads);
+    printf("duration:    %d s\n\n", duration_s);
+
+    worker_t *workers = calloc(n_threads, sizeof(worker_t));
+    pthread_t *tids = calloc(n_threads, sizeof(pthread_t));
+
+    long ticks_per_s = sysconf(_SC_CLK_TCK);
+    long long emu0 = emulator_pid ? proc_cpu_ticks(emulator_pid) : -1;
+    double self0 = self_cpu_s();
+    unsigned long long t0 = now_ns();
+
+    for (int i = 0; i < n_threads; i++) {
+        workers[i].id = i;
+        pthread_create(&tids[i], NULL, worker_main, &workers[i]);
+    }
+    sleep(duration_s);
+    stop = 1;
+    for (int i = 0; i < n_threads; i++)
+        pthread_join(tids[i], NULL);
+
+    double elapsed = (now_ns() - t0) / 1e9;
+    double self_cpu = self_cpu_s() - self0;
+    long long emu1 = emulator_pid ? proc_cpu_ticks(emulator_pid) : -1;
+
+    size_t n = 0;
+    unsigned long long files = 0, bytes = 0, errors = 0;
+    for (int i = 0; i < n_threads; i++) {
+        n += workers[i].n_lat;
+        files += workers[i].files;
+        bytes += workers[i].bytes;
+        errors += workers[i].errors;
+    }
+    unsigned long long *lat = malloc((n ? n : 1) * sizeof(*lat));
+    for (int i = 0, k = 0; i < n_threads; i++) {
+        memcpy(lat + k, workers[i].lat_ns, workers[i].n_lat * sizeof(*lat));
+        k += workers[i].n_lat;
+        free(workers[i].lat_ns);
+    }
+    qsort(lat, n, sizeof(*lat), cmp_ull);
+
+#define PCT(q) (n ? lat[(size_t)((q) * (n - 1))] / 1e3 : 0.0)
+    printf("scrapes:     %zu (%.1f/s)\n", n, n / elapsed);
+    printf("files read:  %llu (%.1f/s, %.1f KiB/s)\n", files, files / elapsed,
+           bytes / elapsed / 1024);
+    printf("errors:      %llu\n", errors);
+    printf("latency us:  p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+           PCT(0.50), PCT(0.99), PCT(0.999), PCT(1.0));
+#undef PCT
+    printf("client cpu:  %.1f%%\n", 100.0 * self_cpu / elapsed);
+    if (emu0 >= 0 && emu1 >= 0)
+        printf("emulator cpu: %.1f%% (pid %d)\n",
+               100.0 * (emu1 - emu0) / ticks_per_s / elapsed, emulator_pid);
+
+    if (!keep_tree)
+        teardown_tree();
+
+    free(lat);
+    free(workers);
+    free(tids);
+    return errors ? 2 : 0;
+}
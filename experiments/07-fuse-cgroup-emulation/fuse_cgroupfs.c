@@ -5,30 +5,76 @@
  * allowing cAdvisor to read cgroup files even when real cgroups are
  * unavailable or restricted in sandboxed environments.
  *
- * Build: gcc -Wall fuse_cgroupfs.c -o fuse_cgroupfs `pkg-config fuse --cflags --libs`
- * Usage: ./fuse_cgroupfs /tmp/fuse-cgroup
+ * Uses the FUSE low-level API so the emulator owns inode numbers and can
+ * push poll wakeups and page cache invalidations to the kernel when the
+ * background sampler sees an event (OOM kill, populated/empty transition,
+ * memory.high breach).
+ *
+ * Self-metrics (ops and latency per opcode, per-file reads, snapshot age)
+ * are served at /.emulator/stats inside the mount and, with
+ * -o metrics_socket=<path>, as Prometheus text over a Unix socket. Ops and
+ * time per opcode also go to the live stats segment read by
+ * ../37-live-stats/intercept_top (INTERCEPT_STATS=off disables).
+ *
+ * memory/cgroup.events reports populated while any process other than the
+ * emulator is in its own cgroup, or in the one named by -o procs=<file>.
+ *
+ * -o tree=<dir> takes file contents from a tree built by fake_tree
+ * (experiment 34) from the shared fake-tree.spec: a file there replaces a
+ * static entry below, or adds one to its subsystem. Dynamic files keep
+ * being generated.
+ *
+ * Build: gcc -Wall fuse_cgroupfs.c -o fuse_cgroupfs -lpthread `pkg-config fuse --cflags --libs`
+ * Usage: ./fuse_cgroupfs /tmp/fuse-cgroup [-o sample_ms=1000,memory_high=<bytes>]
+ *                                         [-o metrics_socket=/run/fuse-cgroupfs.sock]
+ *                                         [-o tree=/tmp/fake-cgroup]
+ *                                         [-o procs=/sys/fs/cgroup/<cgroup>/cgroup.procs]
  */
 
-#define FUSE_USE_VERSION 26
+#define FUSE_USE_VERSION 29
 
-#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <fuse_opt.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../37-live-stats/intercept_stats.h"
 
 // cgroup filesystem magic number
 #define CGROUP_SUPER_MAGIC 0x27e0eb
 
+// Upper bound for a rendered file (memory.stat is the largest)
+#define RENDER_BUF_SIZE 4096
+
+// Upper bound for the rendered self-metrics
+#define STATS_BUF_SIZE 32768
+
+// Most-read files listed in the self-metrics
+#define STATS_TOP_FILES 10
+
+// Attribute/entry cache timeout handed to the kernel (seconds)
+#define ATTR_TIMEOUT 1.0
+
 // Cgroup file data structure
 typedef struct {
     const char *path;
     const char *data;
     int dynamic;  // 1 if data changes over time
+    int events;   // 1 if pollable: changes only when the sampler sees an event
 } cgroup_file_t;
 
 // Emulated cgroup files with static/dynamic data
@@ -49,6 +95,11 @@ static cgroup_file_t cgroup_files[] = {
     {"/memory/memory.max_usage_in_bytes", NULL, 1},  // Dynamic
     {"/memory/memory.stat", NULL, 1},  // Dynamic: detailed stats
 
+    // Memory events (v1 oom_control plus the v2 keys kubelet/containerd poll)
+    {"/memory/memory.oom_control", NULL, 1, 1},
+    {"/memory/memory.events", NULL, 1, 1},
+    {"/memory/cgroup.events", NULL, 1, 1},
+
     // Block I/O
     {"/blkio/blkio.throttle.io_service_bytes", "", 0},
     {"/blkio/blkio.throttle.io_serviced", "", 0},
@@ -77,6 +128,114 @@ static const char *subsystems[] = {
     NULL
 };
 
+// Self-metrics file, in its own directory at the mount root
+static cgroup_file_t stats_file = {"/.emulator/stats", NULL, 1, 0};
+
+// Files from -o tree= that cgroup_files has no entry for
+static cgroup_file_t *tree_files;
+static size_t n_tree_files;
+
+// Command line options (-o sample_ms=N,memory_high=N,metrics_socket=PATH,tree=DIR,procs=PATH)
+struct cgroupfs_options {
+    int sample_ms;
+    unsigned long long memory_high;  // 0 = "max", never breached
+    char *metrics_socket;            // Prometheus endpoint, off if NULL
+    char *tree;                      // fake_tree output, off if NULL
+    char *procs;                     // cgroup.procs behind populated, NULL = own cgroup
+};
+
+static struct cgroupfs_options options = { 1000, 0, NULL, NULL, NULL };
+
+static const struct fuse_opt cgroupfs_opts[] = {
+    { "sample_ms=%d", offsetof(struct cgroupfs_options, sample_ms), 0 },
+    { "memory_high=%llu", offsetof(struct cgroupfs_options, memory_high), 0 },
+    { "metrics_socket=%s", offsetof(struct cgroupfs_options, metrics_socket), 0 },
+    { "tree=%s", offsetof(struct cgroupfs_options, tree), 0 },
+    { "procs=%s", offsetof(struct cgroupfs_options, procs), 0 },
+    FUSE_OPT_END
+};
+
+// Self-metrics: per-opcode count and latency histogram
+enum {
+    OP_LOOKUP, OP_FORGET, OP_GETATTR, OP_MKDIR, OP_RMDIR, OP_READDIR,
+    OP_OPEN, OP_READ, OP_RELEASE, OP_POLL, OP_STATFS, OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+    "lookup", "forget", "getattr", "mkdir", "rmdir", "readdir",
+    "open", "read", "release", "poll", "statfs"
+};
+
+// Histogram bucket upper bounds in nanoseconds (last bucket is +Inf)
+static const unsigned long long latency_bounds_ns[] = {
+    10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 100000000
+};
+#define N_LATENCY_BUCKETS (sizeof(latency_bounds_ns) / sizeof(latency_bounds_ns[0]) + 1)
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long sum_ns;
+    unsigned long long buckets[N_LATENCY_BUCKETS];
+} op_stats_t;
+
+static op_stats_t op_stats[OP_COUNT];
+static unsigned long long bytes_served;
+static unsigned long long sampler_runs, sampler_last_ns, sampler_max_ns;
+
+// Values sampled from the host by the sampler thread
+typedef struct {
+    unsigned long long mem_usage;      // MemTotal - MemAvailable
+    unsigned long long mem_max_usage;  // Peak of mem_usage since mount
+    unsigned long long oom_kill;       // /proc/vmstat oom_kill since mount
+    unsigned long long high_events;    // Transitions above memory_high
+    int populated;                     // Any process but ours in the procs cgroup
+    long long taken_ns;                // CLOCK_MONOTONIC time of the sample
+} snapshot_t;
+
+static snapshot_t snapshot = { 209715200, 262144000, 0, 0, 1, 0 };
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// cgroup.procs the sampler derives populated from, "" if none was found
+static char procs_path[PATH_MAX];
+
+// Inode table: root is FUSE_ROOT_ID (1), node i has inode i + 1
+//
+// Subsystem roots are built at startup; mkdir() below a subsystem adds a
+// child cgroup carrying a copy of that subsystem's file set, like the
+// kernel does. Slots of removed cgroups are recycled once the kernel has
+// forgotten them (nlookup drops to 0).
+typedef struct {
+    fuse_ino_t parent;
+    char *name;
+    cgroup_file_t *file;            // NULL for directories
+    fuse_ino_t first_child;         // Child list, 0-terminated
+    fuse_ino_t next_sibling;
+    fuse_ino_t hash_next;           // (parent, name) hash chain
+    unsigned long nlookup;          // Kernel references (lookup - forget)
+    int dead;                       // Removed by rmdir(), awaiting forget
+    int owns_name;                  // name was strdup()ed by mkdir()
+    struct fuse_pollhandle *ph;     // Pending poll waiter, if any
+    unsigned event_gen;             // Bumped by the sampler on each event
+    unsigned long long reads;       // read() calls served (self-metrics)
+    unsigned long long read_bytes;
+} cg_node_t;
+
+#define NODE_HASH_SIZE 65536
+
+static cg_node_t *nodes;
+static size_t n_nodes, cap_nodes;
+static fuse_ino_t node_hash[NODE_HASH_SIZE];
+static fuse_ino_t free_list;        // Recyclable slots, chained via next_sibling
+static fuse_ino_t emulator_dir;     // /.emulator, not a cgroup hierarchy
+
+// Table structure (nodes, hash, child lists) vs per-node poll state
+static pthread_rwlock_t table_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t node_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Channel used for kernel notifications (set once mounted)
+static struct fuse_chan *notify_chan;
+
 // Get current time in nanoseconds (for dynamic values)
 static long long get_time_ns() {
     struct timespec ts;
@@ -86,6 +245,11 @@ static long long get_time_ns() {
 
 // Generate dynamic data for cgroup files
 static int get_dynamic_data(const char *path, char *buf, size_t size) {
+    snapshot_t s;
+    pthread_mutex_lock(&snapshot_lock);
+    s = snapshot;
+    pthread_mutex_unlock(&snapshot_lock);
+
     if (strcmp(path, "/cpuacct/cpuacct.usage") == 0) {
         // Return current time as CPU usage
         snprintf(buf, size, "%lld\n", get_time_ns());
@@ -102,14 +266,12 @@ static int get_dynamic_data(const char *path, char *buf, size_t size) {
     }
 
     if (strcmp(path, "/memory/memory.usage_in_bytes") == 0) {
-        // Return modest memory usage (200 MB)
-        snprintf(buf, size, "209715200\n");
+        snprintf(buf, size, "%llu\n", s.mem_usage);
         return 0;
     }
 
     if (strcmp(path, "/memory/memory.max_usage_in_bytes") == 0) {
-        // Return slightly higher max usage (250 MB)
-        snprintf(buf, size, "262144000\n");
+        snprintf(buf, size, "%llu\n", s.mem_max_usage);
         return 0;
     }
 
@@ -117,7 +279,7 @@ static int get_dynamic_data(const char *path, char *buf, size_t size) {
         // Return detailed memory statistics
         snprintf(buf, size,
             "cache 0\n"
-            "rss 209715200\n"
+            "rss %llu\n"
             "rss_huge 0\n"
             "mapped_file 0\n"
             "swap 0\n"
@@ -126,209 +288,1128 @@ static int get_dynamic_data(const char *path, char *buf, size_t size) {
             "pgfault 0\n"
             "pgmajfault 0\n"
             "inactive_anon 0\n"
-            "active_anon 209715200\n"
+            "active_anon %llu\n"
             "inactive_file 0\n"
             "active_file 0\n"
-            "unevictable 0\n");
+            "unevictable 0\n",
+            s.mem_usage, s.mem_usage);
+        return 0;
+    }
+
+    if (strcmp(path, "/memory/memory.oom_control") == 0) {
+        snprintf(buf, size, "oom_kill_disable 0\nunder_oom 0\noom_kill %llu\n",
+                 s.oom_kill);
+        return 0;
+    }
+
+    if (strcmp(path, "/memory/memory.events") == 0) {
+        snprintf(buf, size, "low 0\nhigh %llu\nmax 0\noom %llu\noom_kill %llu\n",
+                 s.high_events, s.oom_kill, s.oom_kill);
+        return 0;
+    }
+
+    if (strcmp(path, "/memory/cgroup.events") == 0) {
+        snprintf(buf, size, "populated %d\nfrozen 0\n", s.populated);
         return 0;
     }
 
     return -1;
 }
 
-// Check if path is a subsystem directory
-static int is_subsystem(const char *name) {
-    for (int i = 0; subsystems[i] != NULL; i++) {
-        if (strcmp(name, subsystems[i]) == 0)
-            return 1;
+// Per-open render buffer, stored in fi->fh
+//
+// The file content is rendered once at open() and every read() on that
+// handle slices from the same buffer, so chunked or offset reads see one
+// consistent sample instead of re-rendering (and possibly tearing) per call.
+// Event files re-render on a read at offset 0 once the sampler has moved
+// on, which is the lseek(0)+read that follows a poll wakeup.
+typedef struct {
+    pthread_mutex_t lock;
+    cgroup_file_t *file;
+    unsigned gen;
+    size_t len, cap;
+    char data[];
+} open_buf_t;
+
+static int render_stats(char *buf, size_t size, int prometheus);
+
+static size_t render_buf_size(const cgroup_file_t *file) {
+    return file == &stats_file ? STATS_BUF_SIZE : RENDER_BUF_SIZE;
+}
+
+// Render file content into buf, returns length or -1
+static int render_file(const cgroup_file_t *file, char *buf, size_t size) {
+    if (file == &stats_file) {
+        return render_stats(buf, size, 0);
+    } else if (file->dynamic) {
+        if (get_dynamic_data(file->path, buf, size) < 0)
+            return -1;
+    } else {
+        snprintf(buf, size, "%s", file->data ? file->data : "");
     }
-    return 0;
+    return strlen(buf);
 }
 
-// Find cgroup file entry
-static cgroup_file_t *find_cgroup_file(const char *path) {
-    for (int i = 0; cgroup_files[i].path != NULL; i++) {
-        if (strcmp(path, cgroup_files[i].path) == 0)
-            return &cgroup_files[i];
+// Look up a live node by inode number (table_lock held)
+static cg_node_t *get_node(fuse_ino_t ino) {
+    if (ino < FUSE_ROOT_ID || ino - FUSE_ROOT_ID >= n_nodes)
+        return NULL;
+    cg_node_t *node = &nodes[ino - FUSE_ROOT_ID];
+    return node->name && !node->dead ? node : NULL;
+}
+
+static fuse_ino_t node_ino(const cg_node_t *node) {
+    return (fuse_ino_t)(node - nodes) + FUSE_ROOT_ID;
+}
+
+static unsigned node_hash_key(fuse_ino_t parent, const char *name) {
+    unsigned h = 2166136261u ^ (unsigned)parent;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h & (NODE_HASH_SIZE - 1);
+}
+
+// Find a live child by name (table_lock held)
+static cg_node_t *find_child(fuse_ino_t parent, const char *name) {
+    fuse_ino_t ino = node_hash[node_hash_key(parent, name)];
+    while (ino) {
+        cg_node_t *node = &nodes[ino - FUSE_ROOT_ID];
+        if (node->parent == parent && !node->dead && strcmp(node->name, name) == 0)
+            return node;
+        ino = node->hash_next;
     }
     return NULL;
 }
 
-// FUSE: Get file attributes
-static int cgroupfs_getattr(const char *path, struct stat *stbuf) {
-    memset(stbuf, 0, sizeof(struct stat));
+// Add a node below parent (table_lock held for writing), returns inode or 0
+static fuse_ino_t add_node(fuse_ino_t parent, const char *name, int copy_name,
+                           cgroup_file_t *file) {
+    fuse_ino_t ino;
+    char *node_name = copy_name ? strdup(name) : (char *)name;
 
-    // Root directory
-    if (strcmp(path, "/") == 0) {
-        stbuf->st_mode = S_IFDIR | 0755;
-        stbuf->st_nlink = 2 + (sizeof(subsystems) / sizeof(char*)) - 1;
+    if (!node_name)
         return 0;
+    if (free_list) {
+        ino = free_list;
+        free_list = nodes[ino - FUSE_ROOT_ID].next_sibling;
+    } else {
+        if (n_nodes == cap_nodes) {
+            size_t cap = cap_nodes ? cap_nodes * 2 : 256;
+            cg_node_t *grown = realloc(nodes, cap * sizeof(cg_node_t));
+            if (!grown) {
+                if (copy_name)
+                    free(node_name);
+                return 0;
+            }
+            nodes = grown;
+            cap_nodes = cap;
+        }
+        ino = FUSE_ROOT_ID + n_nodes++;
     }
 
-    // Subsystem directories
-    if (path[0] == '/' && path[1] != '\0') {
-        char subsys[256];
-        const char *slash = strchr(path + 1, '/');
-        if (slash) {
-            strncpy(subsys, path + 1, slash - path - 1);
-            subsys[slash - path - 1] = '\0';
-        } else {
-            strcpy(subsys, path + 1);
-        }
+    cg_node_t *node = &nodes[ino - FUSE_ROOT_ID];
+    memset(node, 0, sizeof(cg_node_t));
+    node->parent = parent;
+    node->name = node_name;
+    node->owns_name = copy_name;
+    node->file = file;
 
-        if (is_subsystem(subsys)) {
-            if (!slash) {
-                // Subsystem directory itself
-                stbuf->st_mode = S_IFDIR | 0755;
-                stbuf->st_nlink = 2;
-                return 0;
-            } else {
-                // File within subsystem
-                cgroup_file_t *file = find_cgroup_file(path);
-                if (file) {
-                    stbuf->st_mode = S_IFREG | 0644;
-                    stbuf->st_nlink = 1;
-
-                    // Estimate size
-                    if (file->dynamic) {
-                        stbuf->st_size = 256;  // Reasonable estimate
-                    } else {
-                        stbuf->st_size = file->data ? strlen(file->data) : 0;
-                    }
-                    return 0;
+    if (ino != FUSE_ROOT_ID) {
+        cg_node_t *p = &nodes[parent - FUSE_ROOT_ID];
+        node->next_sibling = p->first_child;
+        p->first_child = ino;
+
+        unsigned h = node_hash_key(parent, node->name);
+        node->hash_next = node_hash[h];
+        node_hash[h] = ino;
+    }
+    return ino;
+}
+
+// Unlink a node from its parent and hash chain (table_lock held for writing)
+static void remove_node(cg_node_t *node) {
+    fuse_ino_t ino = node_ino(node);
+    fuse_ino_t *link;
+
+    link = &nodes[node->parent - FUSE_ROOT_ID].first_child;
+    while (*link && *link != ino)
+        link = &nodes[*link - FUSE_ROOT_ID].next_sibling;
+    if (*link)
+        *link = node->next_sibling;
+
+    link = &node_hash[node_hash_key(node->parent, node->name)];
+    while (*link && *link != ino)
+        link = &nodes[*link - FUSE_ROOT_ID].hash_next;
+    if (*link)
+        *link = node->hash_next;
+
+    node->dead = 1;
+}
+
+// Recycle a dead node once the kernel holds no references (table_lock held for writing)
+static void maybe_free_node(cg_node_t *node) {
+    if (!node->dead || node->nlookup > 0)
+        return;
+
+    if (node->owns_name)
+        free(node->name);
+    if (node->ph)
+        fuse_pollhandle_destroy(node->ph);
+    memset(node, 0, sizeof(cg_node_t));
+    node->dead = 1;
+    node->next_sibling = free_list;
+    free_list = node_ino(node);
+}
+
+// Subsystem root directory a node belongs to (table_lock held)
+static fuse_ino_t subsystem_of(fuse_ino_t ino) {
+    while (ino != FUSE_ROOT_ID && nodes[ino - FUSE_ROOT_ID].parent != FUSE_ROOT_ID)
+        ino = nodes[ino - FUSE_ROOT_ID].parent;
+    return ino;
+}
+
+// Load -o tree=<dir>: each regular file in a subsystem directory replaces
+// the static content of its entry, or becomes a new static entry. Content
+// is rendered into RENDER_BUF_SIZE buffers, so a longer file is refused
+// (EFBIG) rather than served cut short.
+static int load_tree(const char *dir) {
+    for (size_t i = 0; subsystems[i] != NULL; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, subsystems[i]);
+        DIR *d = opendir(path);
+        if (d == NULL)
+            continue;
+
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            struct stat st;
+            int fd = openat(dirfd(d), de->d_name, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                continue;
+            if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                continue;
+            }
+
+            // One byte more than fits, to tell a full file from a long one
+            char *data = malloc(RENDER_BUF_SIZE + 1);
+            ssize_t len = data ? read(fd, data, RENDER_BUF_SIZE) : -1;
+            close(fd);
+            if (len >= RENDER_BUF_SIZE) {
+                fprintf(stderr, "%s/%s: longer than %d bytes\n", path, de->d_name,
+                        RENDER_BUF_SIZE - 1);
+                errno = EFBIG;
+                len = -1;
+            }
+            if (len < 0) {
+                free(data);
+                closedir(d);
+                return -1;
+            }
+            data[len] = '\0';
+
+            snprintf(path, sizeof(path), "/%s/%s", subsystems[i], de->d_name);
+            cgroup_file_t *file = NULL;
+            for (size_t j = 0; cgroup_files[j].path != NULL; j++) {
+                if (strcmp(cgroup_files[j].path, path) == 0) {
+                    file = &cgroup_files[j];
+                    break;
+                }
+            }
+
+            if (file == NULL) {
+                cgroup_file_t *grown = realloc(tree_files, (n_tree_files + 1) * sizeof(cgroup_file_t));
+                if (!grown) {
+                    free(data);
+                    closedir(d);
+                    return -1;
                 }
+                tree_files = grown;
+                file = &tree_files[n_tree_files++];
+                memset(file, 0, sizeof(cgroup_file_t));
+                file->path = strdup(path);
             }
+            if (file->dynamic)
+                free(data);
+            else
+                file->data = data;
         }
+        closedir(d);
     }
+    return 0;
+}
 
-    return -ENOENT;
+// Subsystem root a file path like /cpu/cpu.shares belongs in, or 0
+static fuse_ino_t file_parent(const char *path, const fuse_ino_t *subsys_ino) {
+    const char *slash = strchr(path + 1, '/');
+    for (size_t j = 0; subsystems[j] != NULL; j++) {
+        if (strlen(subsystems[j]) == (size_t)(slash - path - 1) &&
+            strncmp(path + 1, subsystems[j], slash - path - 1) == 0)
+            return subsys_ino[j];
+    }
+    return 0;
 }
 
-// FUSE: Read directory
-static int cgroupfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                           off_t offset, struct fuse_file_info *fi) {
-    (void) offset;
-    (void) fi;
+// Build the inode table: root, then subsystems, then files
+static int build_nodes(void) {
+    fuse_ino_t subsys_ino[sizeof(subsystems) / sizeof(subsystems[0])];
+
+    add_node(FUSE_ROOT_ID, "/", 0, NULL);
+    for (size_t i = 0; subsystems[i] != NULL; i++) {
+        subsys_ino[i] = add_node(FUSE_ROOT_ID, subsystems[i], 0, NULL);
+        if (!subsys_ino[i])
+            return -1;
+    }
 
-    filler(buf, ".", NULL, 0);
-    filler(buf, "..", NULL, 0);
+    for (size_t i = 0; cgroup_files[i].path != NULL; i++) {
+        fuse_ino_t parent = file_parent(cgroup_files[i].path, subsys_ino);
+        if (parent && !add_node(parent, strchr(cgroup_files[i].path + 1, '/') + 1, 0, &cgroup_files[i]))
+            return -1;
+    }
+    for (size_t i = 0; i < n_tree_files; i++) {
+        fuse_ino_t parent = file_parent(tree_files[i].path, subsys_ino);
+        if (parent && !add_node(parent, strchr(tree_files[i].path + 1, '/') + 1, 0, &tree_files[i]))
+            return -1;
+    }
 
-    // Root directory: list subsystems
-    if (strcmp(path, "/") == 0) {
-        for (int i = 0; subsystems[i] != NULL; i++) {
-            filler(buf, subsystems[i], NULL, 0);
+    emulator_dir = add_node(FUSE_ROOT_ID, ".emulator", 0, NULL);
+    if (!emulator_dir || !add_node(emulator_dir, "stats", 0, &stats_file))
+        return -1;
+    return 0;
+}
+
+// Fill in attributes for a node (table_lock held)
+static void node_stat(const cg_node_t *node, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+    stbuf->st_ino = node_ino(node);
+
+    if (node->file == NULL) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+        for (fuse_ino_t c = node->first_child; c; c = nodes[c - FUSE_ROOT_ID].next_sibling)
+            if (nodes[c - FUSE_ROOT_ID].file == NULL)
+                stbuf->st_nlink++;
+        return;
+    }
+
+    stbuf->st_mode = node->file == &stats_file ? S_IFREG | 0444 : S_IFREG | 0644;
+    stbuf->st_nlink = 1;
+
+    // Report the size of what an open() right now would serve
+    size_t size = render_buf_size(node->file);
+    char *data = malloc(size);
+    int len = data ? render_file(node->file, data, size) : -1;
+    stbuf->st_size = len < 0 ? 0 : len;
+    free(data);
+}
+
+// Record a finished operation in the self-metrics
+static void op_done(int op, long long start_ns) {
+    unsigned long long ns = get_time_ns() - start_ns;
+    size_t b = 0;
+    while (b < N_LATENCY_BUCKETS - 1 && ns > latency_bounds_ns[b])
+        b++;
+
+    __atomic_add_fetch(&op_stats[op].count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&op_stats[op].sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&op_stats[op].buckets[b], 1, __ATOMIC_RELAXED);
+
+    // Every op is served by the emulator: each opcode is a rule
+    istats_call();
+    istats_hit(op);
+    istats_time(ns);
+}
+
+// Full path of a node, for per-file metrics (table_lock held)
+static void node_path(const cg_node_t *node, char *buf, size_t size) {
+    const cg_node_t *chain[64];
+    int depth = 0;
+    size_t len = 0;
+
+    while (node_ino(node) != FUSE_ROOT_ID && depth < 64) {
+        chain[depth++] = node;
+        node = &nodes[node->parent - FUSE_ROOT_ID];
+    }
+    buf[0] = '\0';
+    while (depth-- > 0 && len < size)
+        len += snprintf(buf + len, size - len, "/%s", chain[depth]->name);
+}
+
+// Render self-metrics, as Prometheus text exposition or a plain summary
+//
+// Takes table_lock for reading; it may already be held by the caller
+// (getattr of the stats file), which is fine for a reader-preferring lock.
+static int render_stats(char *buf, size_t size, int prometheus) {
+    size_t len = 0;
+#define OUT(...) do { if (len < size) len += snprintf(buf + len, size - len, __VA_ARGS__); } while (0)
+
+    long long now = get_time_ns();
+    snapshot_t s;
+    pthread_mutex_lock(&snapshot_lock);
+    s = snapshot;
+    pthread_mutex_unlock(&snapshot_lock);
+    double age = s.taken_ns ? (now - s.taken_ns) / 1e9 : -1;
+
+    unsigned long long served = __atomic_load_n(&bytes_served, __ATOMIC_RELAXED);
+    unsigned long long runs = __atomic_load_n(&sampler_runs, __ATOMIC_RELAXED);
+    double last = __atomic_load_n(&sampler_last_ns, __ATOMIC_RELAXED) / 1e9;
+    double max = __atomic_load_n(&sampler_max_ns, __ATOMIC_RELAXED) / 1e9;
+
+    if (prometheus) {
+        OUT("# TYPE fuse_cgroupfs_ops_total counter\n");
+        for (int op = 0; op < OP_COUNT; op++)
+            OUT("fuse_cgroupfs_ops_total{op=\"%s\"} %llu\n", op_names[op],
+                __atomic_load_n(&op_stats[op].count, __ATOMIC_RELAXED));
+
+        OUT("# TYPE fuse_cgroupfs_op_duration_seconds histogram\n");
+        for (int op = 0; op < OP_COUNT; op++) {
+            unsigned long long cum = 0;
+            for (size_t b = 0; b < N_LATENCY_BUCKETS; b++) {
+                cum += __atomic_load_n(&op_stats[op].buckets[b], __ATOMIC_RELAXED);
+                if (b < N_LATENCY_BUCKETS - 1)
+                    OUT("fuse_cgroupfs_op_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n",
+                        op_names[op], latency_bounds_ns[b] / 1e9, cum);
+                else
+                    OUT("fuse_cgroupfs_op_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+                        op_names[op], cum);
+            }
+            OUT("fuse_cgroupfs_op_duration_seconds_sum{op=\"%s\"} %.9f\n", op_names[op],
+                __atomic_load_n(&op_stats[op].sum_ns, __ATOMIC_RELAXED) / 1e9);
+            OUT("fuse_cgroupfs_op_duration_seconds_count{op=\"%s\"} %llu\n", op_names[op], cum);
         }
-        return 0;
+
+        OUT("# TYPE fuse_cgroupfs_read_bytes_total counter\n");
+        OUT("fuse_cgroupfs_read_bytes_total %llu\n", served);
+        OUT("# TYPE fuse_cgroupfs_snapshot_age_seconds gauge\n");
+        OUT("fuse_cgroupfs_snapshot_age_seconds %.6f\n", age);
+        OUT("# TYPE fuse_cgroupfs_sampler_runs_total counter\n");
+        OUT("fuse_cgroupfs_sampler_runs_total %llu\n", runs);
+        OUT("# TYPE fuse_cgroupfs_sampler_duration_seconds gauge\n");
+        OUT("fuse_cgroupfs_sampler_duration_seconds %.9f\n", last);
+        OUT("# TYPE fuse_cgroupfs_sampler_duration_max_seconds gauge\n");
+        OUT("fuse_cgroupfs_sampler_duration_max_seconds %.9f\n", max);
+    } else {
+        OUT("%-8s %12s %12s %12s\n", "op", "count", "avg_us", "p99_us");
+        for (int op = 0; op < OP_COUNT; op++) {
+            unsigned long long count = __atomic_load_n(&op_stats[op].count, __ATOMIC_RELAXED);
+            unsigned long long sum = __atomic_load_n(&op_stats[op].sum_ns, __ATOMIC_RELAXED);
+
+            // p99 as the upper bound of the bucket holding the 99th percentile
+            unsigned long long cum = 0, target = count - count / 100;
+            size_t b = 0;
+            for (; b < N_LATENCY_BUCKETS; b++) {
+                cum += __atomic_load_n(&op_stats[op].buckets[b], __ATOMIC_RELAXED);
+                if (cum >= target)
+                    break;
+            }
+            if (b < N_LATENCY_BUCKETS - 1)
+                OUT("%-8s %12llu %12.1f %12.1f\n", op_names[op], count,
+                    count ? sum / 1e3 / count : 0.0, count ? latency_bounds_ns[b] / 1e3 : 0.0);
+            else
+                OUT("%-8s %12llu %12.1f %12s\n", op_names[op], count,
+                    count ? sum / 1e3 / count : 0.0, "inf");
+        }
+        OUT("\nbytes_served %llu\n", served);
+        OUT("snapshot_age_s %.3f\n", age);
+        OUT("sampler_runs %llu\n", runs);
+        OUT("sampler_last_s %.6f\n", last);
+        OUT("sampler_max_s %.6f\n", max);
     }
 
-    // Subsystem directory: list files
-    if (path[0] == '/' && path[1] != '\0') {
-        char subsys[256];
-        const char *slash = strchr(path + 1, '/');
-        if (slash) {
-            return 0;  // No subdirectories within subsystems for now
+    // Most-read files, to spot a client hammering one file
+    const cg_node_t *top[STATS_TOP_FILES] = { NULL };
+    pthread_rwlock_rdlock(&table_lock);
+    for (size_t i = 0; i < n_nodes; i++) {
+        const cg_node_t *node = &nodes[i];
+        unsigned long long reads = __atomic_load_n(&node->reads, __ATOMIC_RELAXED);
+        if (node->dead || !node->file || reads == 0)
+            continue;
+        for (int t = 0; t < STATS_TOP_FILES; t++) {
+            if (!top[t] || reads > top[t]->reads) {
+                memmove(&top[t + 1], &top[t], (STATS_TOP_FILES - t - 1) * sizeof(top[0]));
+                top[t] = node;
+                break;
+            }
         }
+    }
 
-        strcpy(subsys, path + 1);
-        if (is_subsystem(subsys)) {
-            // List files for this subsystem
-            char prefix[512];
-            snprintf(prefix, sizeof(prefix), "/%s/", subsys);
-            size_t prefix_len = strlen(prefix);
-
-            for (int i = 0; cgroup_files[i].path != NULL; i++) {
-                if (strncmp(cgroup_files[i].path, prefix, prefix_len) == 0) {
-                    const char *filename = cgroup_files[i].path + prefix_len;
-                    // Only add if it's a direct child (no further slashes)
-                    if (strchr(filename, '/') == NULL) {
-                        filler(buf, filename, NULL, 0);
-                    }
-                }
+    if (prometheus)
+        OUT("# TYPE fuse_cgroupfs_file_reads_total counter\n");
+    else
+        OUT("\n%-12s %12s  %s\n", "reads", "bytes", "top files");
+    for (int t = 0; t < STATS_TOP_FILES && top[t]; t++) {
+        char path[512];
+        node_path(top[t], path, sizeof(path));
+        if (prometheus)
+            OUT("fuse_cgroupfs_file_reads_total{path=\"%s\"} %llu\n", path, top[t]->reads);
+        else
+            OUT("%-12llu %12llu  %s\n", top[t]->reads, top[t]->read_bytes, path);
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+#undef OUT
+    return len < size ? (int)len : (int)size - 1;
+}
+
+// Sampler: read host counters into a new snapshot
+static void sample_host(snapshot_t *s, unsigned long long *oom_base) {
+    char line[256];
+    FILE *f;
+
+    unsigned long long total = 0, avail = 0;
+    if ((f = fopen("/proc/meminfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f)) {
+            sscanf(line, "MemTotal: %llu kB", &total);
+            sscanf(line, "MemAvailable: %llu kB", &avail);
+        }
+        fclose(f);
+        if (total >= avail)
+            s->mem_usage = (total - avail) * 1024;
+    }
+    if (s->mem_usage > s->mem_max_usage)
+        s->mem_max_usage = s->mem_usage;
+
+    unsigned long long oom = 0;
+    if ((f = fopen("/proc/vmstat", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "oom_kill %llu", &oom) == 1)
+                break;
+        }
+        fclose(f);
+        if (*oom_base == (unsigned long long)-1)
+            *oom_base = oom;
+        s->oom_kill = oom >= *oom_base ? oom - *oom_base : 0;
+    }
+
+    // Unreadable (no cgroups here at all): populated keeps its last value
+    if (procs_path[0] && (f = fopen(procs_path, "r")) != NULL) {
+        pid_t self = getpid();
+        int pid;
+        s->populated = 0;
+        while (fscanf(f, "%d", &pid) == 1) {
+            if (pid != self) {
+                s->populated = 1;
+                break;
             }
-            return 0;
         }
+        fclose(f);
     }
+}
+
+// cgroup.procs of the cgroup the emulator runs in, from /proc/self/cgroup:
+// the v1 memory hierarchy the file is emulated under if it is mounted, else
+// the v2 one (at the root or under unified/). The emulator itself is a member, so it is left out
+// when deciding populated.
+static void find_procs_path(void) {
+    char line[PATH_MAX], v2[PATH_MAX] = "", v1[PATH_MAX] = "", *cg;
+    FILE *f;
 
-    return -ENOENT;
+    if (options.procs) {
+        snprintf(procs_path, sizeof(procs_path), "%s", options.procs);
+        return;
+    }
+    if ((f = fopen("/proc/self/cgroup", "r")) == NULL)
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "0::", 3) == 0)
+            snprintf(v2, sizeof(v2), "%s", strcmp(line + 3, "/") == 0 ? "" : line + 3);
+        else if ((cg = strstr(line, ":memory:")) != NULL)
+            snprintf(v1, sizeof(v1), "%s", strcmp(cg + 8, "/") == 0 ? "" : cg + 8);
+    }
+    fclose(f);
+
+    const char *roots[] = { "/sys/fs/cgroup/memory", "/sys/fs/cgroup", "/sys/fs/cgroup/unified" };
+    for (int i = 0; i < 3 && !procs_path[0]; i++) {
+        int len = snprintf(procs_path, sizeof(procs_path), "%s%s/cgroup.procs",
+                           roots[i], i == 0 ? v1 : v2);
+        if (len >= (int)sizeof(procs_path) || access(procs_path, R_OK) != 0)
+            procs_path[0] = '\0';
+    }
 }
 
-// FUSE: Open file
-static int cgroupfs_open(const char *path, struct fuse_file_info *fi) {
-    cgroup_file_t *file = find_cgroup_file(path);
-    if (file == NULL)
-        return -ENOENT;
+// Wake poll waiters on every cgroup's copy of a file and drop the kernel's
+// cached pages/attrs for them
+static void notify_path_changed(const char *path) {
+    struct fuse_pollhandle **phs = NULL;
+    fuse_ino_t *inos = NULL;
+    size_t n = 0;
 
-    // Only allow reading
-    if ((fi->flags & O_ACCMODE) != O_RDONLY)
-        return -EACCES;
+    pthread_rwlock_rdlock(&table_lock);
+    for (size_t i = 0; i < n_nodes; i++) {
+        cg_node_t *node = &nodes[i];
+        if (node->dead || !node->file || strcmp(node->file->path, path) != 0)
+            continue;
+        if (n % 64 == 0) {
+            struct fuse_pollhandle **grown_phs = realloc(phs, (n + 64) * sizeof(*phs));
+            if (grown_phs)
+                phs = grown_phs;
+            fuse_ino_t *grown_inos = grown_phs ? realloc(inos, (n + 64) * sizeof(*inos)) : NULL;
+            if (!grown_inos)
+                break;  // Notify the copies found so far
+            inos = grown_inos;
+        }
+        pthread_mutex_lock(&node_lock);
+        node->event_gen++;
+        phs[n] = node->ph;
+        node->ph = NULL;
+        pthread_mutex_unlock(&node_lock);
+        inos[n++] = node_ino(node);
+    }
+    pthread_rwlock_unlock(&table_lock);
 
-    return 0;
+    // Notify outside the table lock: the kernel may need to call back in
+    for (size_t i = 0; i < n; i++) {
+        if (phs[i]) {
+            fuse_lowlevel_notify_poll(phs[i]);
+            fuse_pollhandle_destroy(phs[i]);
+        }
+        if (notify_chan)
+            fuse_lowlevel_notify_inval_inode(notify_chan, inos[i], 0, 0);
+    }
+    free(phs);
+    free(inos);
+}
+
+// Sampler thread: refresh the snapshot and fire events on change
+static void *sampler_main(void *arg) {
+    (void) arg;
+    unsigned long long oom_base = (unsigned long long)-1;
+
+    for (;;) {
+        snapshot_t prev, next;
+
+        pthread_mutex_lock(&snapshot_lock);
+        prev = snapshot;
+        pthread_mutex_unlock(&snapshot_lock);
+
+        next = prev;
+        long long t0 = get_time_ns();
+        sample_host(&next, &oom_base);
+        next.taken_ns = get_time_ns();
+
+        unsigned long long took = next.taken_ns - t0;
+        __atomic_add_fetch(&sampler_runs, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&sampler_last_ns, took, __ATOMIC_RELAXED);
+        if (took > __atomic_load_n(&sampler_max_ns, __ATOMIC_RELAXED))
+            __atomic_store_n(&sampler_max_ns, took, __ATOMIC_RELAXED);
+
+        if (options.memory_high && next.mem_usage > options.memory_high &&
+            prev.mem_usage <= options.memory_high)
+            next.high_events++;
+
+        pthread_mutex_lock(&snapshot_lock);
+        snapshot = next;
+        pthread_mutex_unlock(&snapshot_lock);
+
+        if (next.oom_kill != prev.oom_kill) {
+            notify_path_changed("/memory/memory.oom_control");
+            notify_path_changed("/memory/memory.events");
+        } else if (next.high_events != prev.high_events) {
+            notify_path_changed("/memory/memory.events");
+        }
+        if (next.populated != prev.populated)
+            notify_path_changed("/memory/cgroup.events");
+
+        usleep(options.sample_ms * 1000);
+    }
+    return NULL;
 }
 
-// FUSE: Read file
-static int cgroupfs_read(const char *path, char *buf, size_t size, off_t offset,
-                        struct fuse_file_info *fi) {
+// FUSE: Look up a directory entry
+static void cgroupfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    struct fuse_entry_param e;
+
+    pthread_rwlock_rdlock(&table_lock);
+    cg_node_t *node = find_child(parent, name);
+    if (node == NULL) {
+        pthread_rwlock_unlock(&table_lock);
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.ino = node_ino(node);
+    e.attr_timeout = ATTR_TIMEOUT;
+    e.entry_timeout = ATTR_TIMEOUT;
+    node_stat(node, &e.attr);
+    __atomic_add_fetch(&node->nlookup, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&table_lock);
+
+    fuse_reply_entry(req, &e);
+}
+
+// FUSE: Drop kernel references to an inode
+static void cgroupfs_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+    pthread_rwlock_wrlock(&table_lock);
+    if (ino > FUSE_ROOT_ID && ino - FUSE_ROOT_ID < n_nodes) {
+        cg_node_t *node = &nodes[ino - FUSE_ROOT_ID];
+        node->nlookup = node->nlookup > nlookup ? node->nlookup - nlookup : 0;
+        maybe_free_node(node);
+    }
+    pthread_rwlock_unlock(&table_lock);
+    fuse_reply_none(req);
+}
+
+// FUSE: Get file attributes
+static void cgroupfs_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
     (void) fi;
+    struct stat stbuf;
+
+    pthread_rwlock_rdlock(&table_lock);
+    cg_node_t *node = get_node(ino);
+    if (node)
+        node_stat(node, &stbuf);
+    pthread_rwlock_unlock(&table_lock);
+
+    if (node == NULL)
+        fuse_reply_err(req, ENOENT);
+    else
+        fuse_reply_attr(req, &stbuf, ATTR_TIMEOUT);
+}
+
+// FUSE: Create a child cgroup with the subsystem's file set
+static void cgroupfs_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+    (void) mode;
+    struct fuse_entry_param e;
+    int err = 0;
+
+    pthread_rwlock_wrlock(&table_lock);
+    cg_node_t *p = get_node(parent);
+    if (p == NULL)
+        err = ENOENT;
+    else if (p->file != NULL)
+        err = ENOTDIR;
+    else if (parent == FUSE_ROOT_ID || subsystem_of(parent) == emulator_dir)
+        err = EPERM;  // New hierarchies can't be created by mkdir
+    else if (find_child(parent, name))
+        err = EEXIST;
+
+    fuse_ino_t ino = 0;
+    if (!err && !(ino = add_node(parent, name, 1, NULL)))
+        err = ENOMEM;
+
+    if (!err) {
+        // add_node() may have moved the table; walk the template by inode
+        fuse_ino_t subsys = subsystem_of(ino);
+        for (fuse_ino_t c = nodes[subsys - FUSE_ROOT_ID].first_child; c;
+             c = nodes[c - FUSE_ROOT_ID].next_sibling) {
+            if (nodes[c - FUSE_ROOT_ID].file == NULL)
+                continue;
+            if (!add_node(ino, nodes[c - FUSE_ROOT_ID].name, 0,
+                          nodes[c - FUSE_ROOT_ID].file)) {
+                err = ENOMEM;
+                break;
+            }
+        }
+    }
+
+    if (err && ino) {
+        // Take the half-built cgroup back out; the kernel never saw it
+        cg_node_t *node = &nodes[ino - FUSE_ROOT_ID];
+        while (node->first_child) {
+            cg_node_t *child = &nodes[node->first_child - FUSE_ROOT_ID];
+            remove_node(child);
+            maybe_free_node(child);
+        }
+        remove_node(node);
+        maybe_free_node(node);
+    } else if (!err) {
+        // The entry reply is the lookup reference the kernel will forget
+        cg_node_t *node = &nodes[ino - FUSE_ROOT_ID];
+        memset(&e, 0, sizeof(e));
+        e.ino = ino;
+        e.attr_timeout = ATTR_TIMEOUT;
+        e.entry_timeout = ATTR_TIMEOUT;
+        node_stat(node, &e.attr);
+        node->nlookup++;
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    if (err)
+        fuse_reply_err(req, err);
+    else
+        fuse_reply_entry(req, &e);
+}
 
-    cgroup_file_t *file = find_cgroup_file(path);
-    if (file == NULL)
-        return -ENOENT;
+// FUSE: Remove a child cgroup (must have no child cgroups left)
+static void cgroupfs_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    int err = 0;
 
-    char data[1024];
-    const char *content;
-    size_t len;
+    pthread_rwlock_wrlock(&table_lock);
+    cg_node_t *node = find_child(parent, name);
+    if (node == NULL)
+        err = ENOENT;
+    else if (node->file != NULL)
+        err = ENOTDIR;
+    else if (parent == FUSE_ROOT_ID || subsystem_of(parent) == emulator_dir)
+        err = EBUSY;
 
-    if (file->dynamic) {
-        // Generate dynamic data
-        if (get_dynamic_data(path, data, sizeof(data)) < 0)
-            return -EIO;
-        content = data;
+    for (fuse_ino_t c = node && !err ? node->first_child : 0; c;
+         c = nodes[c - FUSE_ROOT_ID].next_sibling) {
+        if (nodes[c - FUSE_ROOT_ID].file == NULL) {
+            err = ENOTEMPTY;
+            break;
+        }
+    }
+
+    if (!err) {
+        while (node->first_child) {
+            cg_node_t *child = &nodes[node->first_child - FUSE_ROOT_ID];
+            remove_node(child);
+            maybe_free_node(child);
+        }
+        remove_node(node);
+        maybe_free_node(node);
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    fuse_reply_err(req, err);
+}
+
+// Directory listing buffer
+struct dirbuf {
+    char *p;
+    size_t size;
+};
+
+static void dirbuf_add(fuse_req_t req, struct dirbuf *b, const char *name,
+                       fuse_ino_t ino, int is_dir) {
+    struct stat stbuf;
+    size_t oldsize = b->size;
+
+    // st_mode supplies d_type so walkers can skip a stat() per entry
+    memset(&stbuf, 0, sizeof(stbuf));
+    stbuf.st_ino = ino;
+    stbuf.st_mode = is_dir ? S_IFDIR : S_IFREG;
+    b->size += fuse_add_direntry(req, NULL, 0, name, NULL, 0);
+    b->p = realloc(b->p, b->size);
+    fuse_add_direntry(req, b->p + oldsize, b->size - oldsize, name, &stbuf, b->size);
+}
+
+// FUSE: Read directory
+static void cgroupfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+                             off_t off, struct fuse_file_info *fi) {
+    (void) fi;
+    struct dirbuf b = { NULL, 0 };
+    int err = 0;
+
+    pthread_rwlock_rdlock(&table_lock);
+    cg_node_t *node = get_node(ino);
+    if (node == NULL) {
+        err = ENOENT;
+    } else if (node->file != NULL) {
+        err = ENOTDIR;
     } else {
-        // Use static data
-        content = file->data ? file->data : "";
+        dirbuf_add(req, &b, ".", ino, 1);
+        dirbuf_add(req, &b, "..", node->parent, 1);
+        for (fuse_ino_t c = node->first_child; c; c = nodes[c - FUSE_ROOT_ID].next_sibling)
+            dirbuf_add(req, &b, nodes[c - FUSE_ROOT_ID].name, c,
+                       nodes[c - FUSE_ROOT_ID].file == NULL);
     }
+    pthread_rwlock_unlock(&table_lock);
 
-    len = strlen(content);
+    if (err)
+        fuse_reply_err(req, err);
+    else if ((size_t)off < b.size)
+        fuse_reply_buf(req, b.p + off, b.size - off < size ? b.size - off : size);
+    else
+        fuse_reply_buf(req, NULL, 0);
+    free(b.p);
+}
 
-    if (offset < len) {
-        if (offset + size > len)
-            size = len - offset;
-        memcpy(buf, content + offset, size);
+// FUSE: Open file
+static void cgroupfs_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    // Only allow reading
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+
+    int err = 0, len = -1;
+    cgroup_file_t *file = NULL;
+    unsigned gen = 0;
+
+    pthread_rwlock_rdlock(&table_lock);
+    cg_node_t *node = get_node(ino);
+    if (node == NULL) {
+        err = ENOENT;
+    } else if (node->file == NULL) {
+        err = EISDIR;
     } else {
+        file = node->file;
+        pthread_mutex_lock(&node_lock);
+        gen = node->event_gen;
+        pthread_mutex_unlock(&node_lock);
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    open_buf_t *ob = NULL;
+    if (!err) {
+        size_t cap = render_buf_size(file);
+        ob = malloc(sizeof(open_buf_t) + cap);
+        if (ob == NULL)
+            err = ENOMEM;
+        else if ((len = render_file(file, ob->data, cap)) < 0)
+            err = EIO;
+        else
+            ob->cap = cap;
+    }
+    if (err) {
+        free(ob);
+        fuse_reply_err(req, err);
+        return;
+    }
+    pthread_mutex_init(&ob->lock, NULL);
+    ob->len = len;
+    ob->file = file;
+    ob->gen = gen;
+
+    fi->fh = (uint64_t)(uintptr_t)ob;
+
+    // Counters change on every read: bypass the page cache so the kernel
+    // never clamps a read to a stale st_size. Static and event files are
+    // cached; event files are invalidated by the sampler when they change.
+    if (file->dynamic && !file->events)
+        fi->direct_io = 1;
+    else
+        fi->keep_cache = 1;
+
+    fuse_reply_open(req, fi);
+}
+
+// FUSE: Read file (slices the buffer rendered at open)
+static void cgroupfs_read(fuse_req_t req, fuse_ino_t ino, size_t size,
+                          off_t off, struct fuse_file_info *fi) {
+    open_buf_t *ob = (open_buf_t *)(uintptr_t)fi->fh;
+    if (ob == NULL) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    pthread_mutex_lock(&ob->lock);
+
+    unsigned gen = ob->gen;
+    int check_gen = off == 0 && ob->file->events;
+
+    pthread_rwlock_rdlock(&table_lock);
+    cg_node_t *node = get_node(ino);
+    if (node && check_gen) {
+        pthread_mutex_lock(&node_lock);
+        gen = node->event_gen;
+        pthread_mutex_unlock(&node_lock);
+    }
+
+    if (gen != ob->gen) {
+        int len = render_file(ob->file, ob->data, ob->cap);
+        ob->len = len < 0 ? 0 : len;
+        ob->gen = gen;
+    }
+
+    if (off < 0 || (size_t)off >= ob->len)
         size = 0;
+    else if (size > ob->len - off)
+        size = ob->len - off;
+
+    if (node) {
+        __atomic_add_fetch(&node->reads, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&node->read_bytes, size, __ATOMIC_RELAXED);
     }
+    pthread_rwlock_unlock(&table_lock);
+    __atomic_add_fetch(&bytes_served, size, __ATOMIC_RELAXED);
 
-    return size;
+    fuse_reply_buf(req, size ? ob->data + off : NULL, size);
+    pthread_mutex_unlock(&ob->lock);
+}
+
+// FUSE: Release file (frees the per-open buffer)
+static void cgroupfs_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    open_buf_t *ob = (open_buf_t *)(uintptr_t)fi->fh;
+    if (ob) {
+        pthread_mutex_destroy(&ob->lock);
+        free(ob);
+    }
+    fuse_reply_err(req, 0);
+}
+
+// FUSE: Poll file
+//
+// Mirrors kernfs: always readable, plus POLLPRI|POLLERR once the file has
+// changed since this handle last rendered it.
+static void cgroupfs_poll(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi,
+                          struct fuse_pollhandle *ph) {
+    open_buf_t *ob = (open_buf_t *)(uintptr_t)fi->fh;
+    unsigned revents = POLLIN | POLLRDNORM;
+
+    pthread_rwlock_rdlock(&table_lock);
+    cg_node_t *node = get_node(ino);
+    if (node && ob && node->file->events) {
+        pthread_mutex_lock(&node_lock);
+        if (node->event_gen != ob->gen)
+            revents |= POLLPRI | POLLERR;
+        if (ph) {
+            // Keep only the latest waiter, as the kernel re-polls anyway
+            if (node->ph)
+                fuse_pollhandle_destroy(node->ph);
+            node->ph = ph;
+            ph = NULL;
+        }
+        pthread_mutex_unlock(&node_lock);
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    if (ph)
+        fuse_pollhandle_destroy(ph);
+    if (node == NULL || ob == NULL)
+        fuse_reply_err(req, EBADF);
+    else
+        fuse_reply_poll(req, revents);
 }
 
 // FUSE: Get filesystem statistics
-static int cgroupfs_statfs(const char *path, struct statvfs *stbuf) {
-    (void) path;
+static void cgroupfs_statfs(fuse_req_t req, fuse_ino_t ino) {
+    (void) ino;
 
-    memset(stbuf, 0, sizeof(struct statvfs));
+    struct statvfs stbuf;
+    memset(&stbuf, 0, sizeof(struct statvfs));
 
     // Return cgroup filesystem magic number
-    stbuf->f_bsize = 4096;
-    stbuf->f_frsize = 4096;
-    stbuf->f_blocks = 0;
-    stbuf->f_bfree = 0;
-    stbuf->f_bavail = 0;
-    stbuf->f_files = 1000;
-    stbuf->f_ffree = 1000;
-    stbuf->f_namemax = 255;
+    stbuf.f_bsize = 4096;
+    stbuf.f_frsize = 4096;
+    stbuf.f_blocks = 0;
+    stbuf.f_bfree = 0;
+    stbuf.f_bavail = 0;
+    stbuf.f_files = 1000;
+    stbuf.f_ffree = 1000;
+    stbuf.f_namemax = 255;
 
-    return 0;
+    fuse_reply_statfs(req, &stbuf);
 }
 
-static struct fuse_operations cgroupfs_ops = {
-    .getattr  = cgroupfs_getattr,
-    .readdir  = cgroupfs_readdir,
-    .open     = cgroupfs_open,
-    .read     = cgroupfs_read,
-    .statfs   = cgroupfs_statfs,
+// Timed wrappers feeding the per-opcode self-metrics
+#define TIMED_OP(op, fn, params, args) \
+    static void fn##_timed params {     \
+        long long t0 = get_time_ns();   \
+        fn args;                        \
+        op_done(op, t0);                \
+    }
+
+TIMED_OP(OP_LOOKUP, cgroupfs_lookup, (fuse_req_t req, fuse_ino_t parent, const char *name),
+         (req, parent, name))
+TIMED_OP(OP_FORGET, cgroupfs_forget, (fuse_req_t req, fuse_ino_t ino, unsigned long nlookup),
+         (req, ino, nlookup))
+TIMED_OP(OP_GETATTR, cgroupfs_getattr, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+         (req, ino, fi))
+TIMED_OP(OP_MKDIR, cgroupfs_mkdir, (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode),
+         (req, parent, name, mode))
+TIMED_OP(OP_RMDIR, cgroupfs_rmdir, (fuse_req_t req, fuse_ino_t parent, const char *name),
+         (req, parent, name))
+TIMED_OP(OP_READDIR, cgroupfs_readdir,
+         (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi),
+         (req, ino, size, off, fi))
+TIMED_OP(OP_OPEN, cgroupfs_open, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+         (req, ino, fi))
+TIMED_OP(OP_READ, cgroupfs_read,
+         (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi),
+         (req, ino, size, off, fi))
+TIMED_OP(OP_RELEASE, cgroupfs_release, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi),
+         (req, ino, fi))
+TIMED_OP(OP_POLL, cgroupfs_poll,
+         (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, struct fuse_pollhandle *ph),
+         (req, ino, fi, ph))
+TIMED_OP(OP_STATFS, cgroupfs_statfs, (fuse_req_t req, fuse_ino_t ino), (req, ino))
+
+static struct fuse_lowlevel_ops cgroupfs_ops = {
+    .lookup   = cgroupfs_lookup_timed,
+    .forget   = cgroupfs_forget_timed,
+    .getattr  = cgroupfs_getattr_timed,
+    .mkdir    = cgroupfs_mkdir_timed,
+    .rmdir    = cgroupfs_rmdir_timed,
+    .readdir  = cgroupfs_readdir_timed,
+    .open     = cgroupfs_open_timed,
+    .read     = cgroupfs_read_timed,
+    .release  = cgroupfs_release_timed,
+    .poll     = cgroupfs_poll_timed,
+    .statfs   = cgroupfs_statfs_timed,
 };
 
+// Prometheus endpoint: answers every connection on the Unix socket with
+// an HTTP/1.0 response carrying the text exposition, so both
+// `curl --unix-socket` and a plain `nc -U` work
+static void *metrics_main(void *arg) {
+    int lfd = (int)(intptr_t)arg;
+    char *body = malloc(STATS_BUF_SIZE);
+    if (!body)
+        return NULL;
+
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        // Drain the request line/headers without waiting on idle clients
+        char req[1024];
+        struct timeval tv = { 0, 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (recv(fd, req, sizeof(req), 0) < 0 && errno != EAGAIN) {
+            close(fd);
+            continue;
+        }
+
+        int len = render_stats(body, STATS_BUF_SIZE, 1);
+        char hdr[128];
+        int hlen = snprintf(hdr, sizeof(hdr),
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %d\r\n\r\n", len);
+        if (write(fd, hdr, hlen) == hlen)
+            (void) !write(fd, body, len);
+        close(fd);
+    }
+    free(body);
+    return NULL;
+}
+
+static int start_metrics_socket(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "metrics_socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("metrics socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, metrics_main, (void *)(intptr_t)fd);
+    pthread_detach(tid);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    char *mountpoint;
+    int multithreaded, foreground;
+    int err = -1;
+
     printf("FUSE cgroup Filesystem Emulator\n");
     printf("================================\n");
     printf("Emulating cgroup v1 filesystem for cAdvisor compatibility\n");
@@ -339,5 +1420,60 @@ int main(int argc, char *argv[]) {
     }
     printf("\n");
 
-    return fuse_main(argc, argv, &cgroupfs_ops, NULL);
+    if (fuse_opt_parse(&args, &options, cgroupfs_opts, NULL) == -1)
+        return 1;
+    if (options.sample_ms <= 0)
+        options.sample_ms = 1000;
+    find_procs_path();
+
+    if (options.tree && load_tree(options.tree) < 0) {
+        perror(options.tree);
+        return 1;
+    }
+    if (build_nodes() < 0) {
+        perror("build_nodes");
+        return 1;
+    }
+
+    if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) == -1)
+        return 1;
+
+    struct fuse_chan *ch = fuse_mount(mountpoint, &args);
+    if (ch == NULL)
+        return 1;
+
+    struct fuse_session *se = fuse_lowlevel_new(&args, &cgroupfs_ops,
+                                                sizeof(cgroupfs_ops), NULL);
+    if (se != NULL) {
+        if (fuse_set_signal_handlers(se) != -1) {
+            fuse_session_add_chan(se, ch);
+            fuse_daemonize(foreground);
+
+            // Publish under the pid that serves the mount
+            istats_open("fuse", op_names, OP_COUNT, 0);
+
+            // Start sampling only after daemonizing so the thread survives
+            notify_chan = ch;
+            pthread_t sampler;
+            pthread_create(&sampler, NULL, sampler_main, NULL);
+            pthread_detach(sampler);
+
+            if (options.metrics_socket)
+                start_metrics_socket(options.metrics_socket);
+
+            err = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+
+            notify_chan = NULL;
+            istats_close();
+            fuse_remove_signal_handlers(se);
+            fuse_session_remove_chan(ch);
+        }
+        fuse_session_destroy(se);
+    }
+    fuse_unmount(mountpoint, ch);
+    fuse_opt_free_args(&args);
+    if (options.metrics_socket)
+        unlink(options.metrics_socket);
+
+    return err ? 1 : 0;
 }
@@ -6,7 +6,16 @@
  * 2. Spoof statfs() results to return ext4 instead of 9p
  * 3. Provide fake cgroup files for cAdvisor
  *
- * Build: gcc -shared -fPIC -Wall ld_preload_interceptor.c -o ld_preload_interceptor.so -ldl
+ * Covers every libc path entry point a dynamic binary reaches (open/stat/
+ * access/readlink/opendir families, including 64-bit, fortified and
+ * pre-2.33 __xstat variants), so containerd-shim, iptables and runc
+ * helpers don't need the ptrace tracer.
+ *
+ * Each process publishes its hooked calls and rule hits to the live stats
+ * segment read by ../37-live-stats/intercept_top (INTERCEPT_STATS=off
+ * disables).
+ *
+ * Build: gcc -shared -fPIC -Wall ld_preload_interceptor.c -o ld_preload_interceptor.so -ldl -lpthread
  * Usage: LD_PRELOAD=/path/to/ld_preload_interceptor.so k3s server [args]
  */
 
@@ -21,6 +30,20 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include "../37-live-stats/intercept_stats.h"
 
 // Filesystem magic numbers
 #define NINE_P_FS_MAGIC    0x01021997  // 9p filesystem
@@ -38,25 +61,202 @@ static path_mapping_t path_mappings[] = {
     {NULL, NULL}
 };
 
-// Function pointer types for original libc functions
-typedef int (*orig_open_t)(const char *pathname, int flags, ...);
-typedef int (*orig_openat_t)(int dirfd, const char *pathname, int flags, ...);
-typedef int (*orig_stat_t)(const char *pathname, struct stat *statbuf);
-typedef int (*orig_lstat_t)(const char *pathname, struct stat *statbuf);
-typedef int (*orig_statfs_t)(const char *path, struct statfs *buf);
-typedef int (*orig_fstatfs_t)(int fd, struct statfs *buf);
-typedef FILE* (*orig_fopen_t)(const char *pathname, const char *mode);
-
-// Get original libc function
-static void *get_libc_func(const char *name) {
+// Rules as published to the live stats segment: the path mappings in
+// order, then the file store and the statfs spoof and cache
+enum { RULE_STORE = 2, RULE_STATFS_SPOOF, RULE_STATFS_CACHE, RULE_COUNT };
+
+static const char *rule_names[RULE_COUNT] = {
+    "cgroup", "procsys", "store", "statfs-spoof", "statfs-cache"
+};
+
+// Hooked entry points, one X() per libc symbol
+//
+// Every path-taking variant a dynamic binary can reach has to be listed:
+// the 64-bit aliases, the _FORTIFY_SOURCE __open_2 family, and the
+// __xstat family that binaries built against glibc < 2.33 call instead
+// of stat(). Each list expands into the dispatch table and the hooks.
+
+// open-style calls whose mode argument is variadic
+#define OPEN_HOOKS(X) \
+    X(open,     (const char *path, int flags, ...),            (path, flags, mode)) \
+    X(open64,   (const char *path, int flags, ...),            (path, flags, mode)) \
+    X(openat,   (int dirfd, const char *path, int flags, ...), (dirfd, path, flags, mode)) \
+    X(openat64, (int dirfd, const char *path, int flags, ...), (dirfd, path, flags, mode))
+
+// Calls forwarded unchanged apart from redirecting 'path'; the open-style
+// ones may be served from the in-memory file store
+#define PATH_HOOKS(X) \
+    X(__open_2,     redirect_open_path, int,     (const char *path, int flags), (path, flags)) \
+    X(__open64_2,   redirect_open_path, int,     (const char *path, int flags), (path, flags)) \
+    X(__openat_2,   redirect_open_path, int,     (int dirfd, const char *path, int flags), (dirfd, path, flags)) \
+    X(__openat64_2, redirect_open_path, int,     (int dirfd, const char *path, int flags), (dirfd, path, flags)) \
+    X(fopen,        redirect_open_path, FILE *,  (const char *path, const char *mode), (path, mode)) \
+    X(fopen64,      redirect_open_path, FILE *,  (const char *path, const char *mode), (path, mode)) \
+    X(opendir,      redirect_path,      DIR *,   (const char *path), (path)) \
+    X(stat,         redirect_path,      int,     (const char *path, struct stat *buf), (path, buf)) \
+    X(stat64,       redirect_path,      int,     (const char *path, struct stat64 *buf), (path, buf)) \
+    X(lstat,        redirect_path,      int,     (const char *path, struct stat *buf), (path, buf)) \
+    X(lstat64,      redirect_path,      int,     (const char *path, struct stat64 *buf), (path, buf)) \
+    X(fstatat,      redirect_path,      int,     (int dirfd, const char *path, struct stat *buf, int flags), \
+                                                 (dirfd, path, buf, flags)) \
+    X(fstatat64,    redirect_path,      int,     (int dirfd, const char *path, struct stat64 *buf, int flags), \
+                                                 (dirfd, path, buf, flags)) \
+    X(__xstat,      redirect_path,      int,     (int ver, const char *path, struct stat *buf), (ver, path, buf)) \
+    X(__xstat64,    redirect_path,      int,     (int ver, const char *path, struct stat64 *buf), (ver, path, buf)) \
+    X(__lxstat,     redirect_path,      int,     (int ver, const char *path, struct stat *buf), (ver, path, buf)) \
+    X(__lxstat64,   redirect_path,      int,     (int ver, const char *path, struct stat64 *buf), (ver, path, buf)) \
+    X(__fxstatat,   redirect_path,      int,     (int ver, int dirfd, const char *path, struct stat *buf, int flags), \
+                                                 (ver, dirfd, path, buf, flags)) \
+    X(__fxstatat64, redirect_path,      int,     (int ver, int dirfd, const char *path, struct stat64 *buf, int flags), \
+                                                 (ver, dirfd, path, buf, flags)) \
+    X(statx,        redirect_path,      int,     (int dirfd, const char *path, int flags, unsigned int mask, \
+                                                  struct statx *buf), (dirfd, path, flags, mask, buf)) \
+    X(access,       redirect_path,      int,     (const char *path, int mode), (path, mode)) \
+    X(faccessat,    redirect_path,      int,     (int dirfd, const char *path, int mode, int flags), \
+                                                 (dirfd, path, mode, flags)) \
+    X(readlink,     redirect_path,      ssize_t, (const char *path, char *buf, size_t size), (path, buf, size)) \
+    X(readlinkat,   redirect_path,      ssize_t, (int dirfd, const char *path, char *buf, size_t size), \
+                                                 (dirfd, path, buf, size))
+
+// statfs-style calls, not redirected; the result's f_type is spoofed and
+// cached per path or per fd (the (path, fd) key columns)
+#define STATFS_HOOKS(X) \
+    X(statfs,    (const char *path, struct statfs *buf),   (path, buf), path, -1,   "%s", path) \
+    X(statfs64,  (const char *path, struct statfs64 *buf), (path, buf), path, -1,   "%s", path) \
+    X(fstatfs,   (int fd, struct statfs *buf),             (fd, buf),   NULL, fd,   "fd=%d", fd) \
+    X(fstatfs64, (int fd, struct statfs64 *buf),           (fd, buf),   NULL, fd,   "fd=%d", fd)
+
+// fd-retiring calls, forwarded unchanged; any statfs result cached for
+// an fd in [first, last] is dropped once the fd is gone
+#define FD_HOOKS(X) \
+    X(close,       (int fd),                               (fd),                  fd,    fd) \
+    X(dup2,        (int oldfd, int newfd),                 (oldfd, newfd),        newfd, newfd) \
+    X(dup3,        (int oldfd, int newfd, int flags),      (oldfd, newfd, flags), newfd, newfd) \
+    X(close_range, (unsigned first, unsigned last, int flags), (first, last, flags), \
+                   first, (flags & CLOSE_RANGE_CLOEXEC) ? 0 : last)
+
+// Calls that hand out new fds, forwarded unchanged; a number they return
+// may have been closed behind the hooks' back (SYS_close, exit of a
+// library's own fd), so its cached statfs result is dropped
+#define NEWFD_HOOKS(X) \
+    X(dup,            (int fd),                                     (fd),                      result,  result) \
+    X(socket,         (int domain, int type, int protocol),         (domain, type, protocol),  result,  result) \
+    X(socketpair,     (int domain, int type, int protocol, int sv[2]), \
+                      (domain, type, protocol, sv),                                             sv[0],   sv[1]) \
+    X(accept,         (int fd, struct sockaddr *addr, socklen_t *len), (fd, addr, len),       result,  result) \
+    X(accept4,        (int fd, struct sockaddr *addr, socklen_t *len, int flags), \
+                      (fd, addr, len, flags),                                                   result,  result) \
+    X(pipe,           (int fds[2]),                                 (fds),                     fds[0],  fds[1]) \
+    X(pipe2,          (int fds[2], int flags),                      (fds, flags),              fds[0],  fds[1]) \
+    X(eventfd,        (unsigned int count, int flags),              (count, flags),            result,  result) \
+    X(memfd_create,   (const char *name, unsigned int flags),       (name, flags),             result,  result) \
+    X(epoll_create1,  (int flags),                                  (flags),                   result,  result) \
+    X(inotify_init1,  (int flags),                                  (flags),                   result,  result) \
+    X(timerfd_create, (int clockid, int flags),                     (clockid, flags),          result,  result)
+
+// fcntl-style calls: F_DUPFD and F_DUPFD_CLOEXEC hand out a new fd
+#define FCNTL_HOOKS(X) \
+    X(fcntl) \
+    X(fcntl64)
+
+// Stream closes, which close their fd inside libc where no hook sees it
+#define STREAM_HOOKS(X) \
+    X(fclose,   FILE *, fileno) \
+    X(closedir, DIR *,  dirfd)
+
+// Not declared by current glibc headers (or only under _FORTIFY_SOURCE)
+int __open_2(const char *path, int flags);
+int __open64_2(const char *path, int flags);
+int __openat_2(int dirfd, const char *path, int flags);
+int __openat64_2(int dirfd, const char *path, int flags);
+int __xstat(int ver, const char *path, struct stat *buf);
+int __xstat64(int ver, const char *path, struct stat64 *buf);
+int __lxstat(int ver, const char *path, struct stat *buf);
+int __lxstat64(int ver, const char *path, struct stat64 *buf);
+int __fxstatat(int ver, int dirfd, const char *path, struct stat *buf, int flags);
+int __fxstatat64(int ver, int dirfd, const char *path, struct stat64 *buf, int flags);
+
+// Dispatch table of original libc functions, indexed by HOOK_<name>
+#define HOOK_ID(name, ...) HOOK_##name,
+#define HOOK_NAME(name, ...) #name,
+
+enum {
+    OPEN_HOOKS(HOOK_ID)
+    PATH_HOOKS(HOOK_ID)
+    STATFS_HOOKS(HOOK_ID)
+    FD_HOOKS(HOOK_ID)
+    NEWFD_HOOKS(HOOK_ID)
+    FCNTL_HOOKS(HOOK_ID)
+    STREAM_HOOKS(HOOK_ID)
+    HOOK_COUNT
+};
+
+static const char *hook_names[HOOK_COUNT] = {
+    OPEN_HOOKS(HOOK_NAME)
+    PATH_HOOKS(HOOK_NAME)
+    STATFS_HOOKS(HOOK_NAME)
+    FD_HOOKS(HOOK_NAME)
+    NEWFD_HOOKS(HOOK_NAME)
+    FCNTL_HOOKS(HOOK_NAME)
+    STREAM_HOOKS(HOOK_NAME)
+};
+
+// Original functions, filled in once by resolve_originals() and then
+// sealed read-only. The table gets a page to itself so the hooks' one
+// load per call never shares a cache line with written data.
+#define ORIG_TABLE_SIZE 4096
+
+static union {
+    void *fn[HOOK_COUNT];
+    char page[ORIG_TABLE_SIZE];
+} orig_table __attribute__((aligned(ORIG_TABLE_SIZE)));
+
+// glibc 2.33 turned the __xstat family into compat-only symbols, which
+// plain dlsym() doesn't return
+static const char *compat_versions[] = {"GLIBC_2.2.5", "GLIBC_2.17", "GLIBC_2.0", NULL};
+
+// Look up an original libc function, NULL if libc doesn't have it
+static void *lookup_libc_func(const char *name) {
     void *func = dlsym(RTLD_NEXT, name);
+    for (int i = 0; !func && compat_versions[i] != NULL; i++)
+        func = dlvsym(RTLD_NEXT, name, compat_versions[i]);
+    return func;
+}
+
+// Slow path: a hook fired before the constructor (from another library's
+// constructor, or another thread while it runs) or for a symbol this libc
+// lacks. Only the constructor writes the table: a store here could land
+// after it sealed the page and fault.
+static void *resolve_early(int id) {
+    void *func = lookup_libc_func(hook_names[id]);
     if (!func) {
-        fprintf(stderr, "[LD_PRELOAD] Failed to get %s: %s\n", name, dlerror());
+        fprintf(stderr, "[LD_PRELOAD] Failed to get %s: %s\n", hook_names[id], dlerror());
         exit(1);
     }
     return func;
 }
 
+// Original function for a hook: one load once the table is filled
+static inline void *orig_func(int id) {
+    void *func = __atomic_load_n(&orig_table.fn[id], __ATOMIC_RELAXED);
+    if (__builtin_expect(func == NULL, 0))
+        func = resolve_early(id);
+    return func;
+}
+
+#define ORIG(name) orig_func(HOOK_##name)
+
+// Resolve every original before any other constructor in this library.
+// Symbols missing from this libc stay NULL; nothing can call them.
+__attribute__((constructor(101)))
+static void resolve_originals(void) {
+    for (int id = 0; id < HOOK_COUNT; id++)
+        __atomic_store_n(&orig_table.fn[id], lookup_libc_func(hook_names[id]), __ATOMIC_RELAXED);
+
+    // Best effort: fails harmlessly where pages are larger than 4 KiB
+    mprotect(&orig_table, sizeof(orig_table), PROT_READ);
+}
+
 // Redirect path if it matches our mappings
 static const char *redirect_path(const char *path) {
     if (!path) return path;
@@ -68,6 +268,7 @@ static const char *redirect_path(const char *path) {
             snprintf(redirected, sizeof(redirected), "%s%s",
                      path_mappings[i].redirect, path + len);
             fprintf(stderr, "[LD_PRELOAD] Redirect: %s → %s\n", path, redirected);
+            istats_hit(i);
             return redirected;
         }
     }
@@ -75,104 +276,437 @@ static const char *redirect_path(const char *path) {
     return path;
 }
 
-// Hook: open()
-int open(const char *pathname, int flags, ...) {
-    static orig_open_t orig_open = NULL;
-    if (!orig_open) orig_open = (orig_open_t)get_libc_func("open");
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Optional in-memory file store (../33-memfd-file-store), enabled by
+// VFILE_STORE_SOCK. A path's memfd is fetched once per process and then
+// reopened through /proc/self/fd, so each open gets its own offset while
+// writes stay shared with every other process. A path the store lacks is
+// asked again after STORE_MISS_TTL_NS, in case the store (re)started since.
+#define STORE_CACHE_SIZE 512
+#define STORE_MISS_TTL_NS 1000000000LL
 
-    const char *redirected = redirect_path(pathname);
+typedef struct {
+    char *path;     // NULL = free slot
+    int fd;         // -1 = not in the store
+    dev_t dev;      // Identity of fd, in case the program closed it
+    ino_t ino;
+    long long miss_ns;  // When the store last said it had no such file
+} store_entry_t;
+
+static const char *store_sock;
+static store_entry_t store_cache[STORE_CACHE_SIZE];
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Ask the store for a path's memfd, -1 if it doesn't have one
+static int store_fetch(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int err = ENOENT, fd = -1;
+
+    strncpy(addr.sun_path, store_sock, sizeof(addr.sun_path) - 1);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        send(sock, path, strlen(path), MSG_NOSIGNAL) >= 0) {
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = { &err, sizeof(err) };
+        struct msghdr msg = { 0 };
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg;
+        if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) > 0 && err == 0 &&
+            (cmsg = CMSG_FIRSTHDR(&msg)) != NULL && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    ((int (*)(int))ORIG(close))(sock);
+    return fd;
+}
 
-    mode_t mode = 0;
-    if (flags & O_CREAT) {
-        va_list args;
-        va_start(args, flags);
-        mode = va_arg(args, mode_t);
-        va_end(args);
-        return orig_open(redirected, flags, mode);
+// Cached memfd for a path, -1 to fall back to the on-disk redirect
+static int store_lookup(const char *path) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (const char *p = path; *p; p++)
+        h = (h ^ (unsigned char)*p) * 16777619u;
+
+    pthread_mutex_lock(&store_lock);
+    store_entry_t *e = NULL;
+    for (int i = 0; i < STORE_CACHE_SIZE; i++) {
+        store_entry_t *slot = &store_cache[(h + i) % STORE_CACHE_SIZE];
+        if (!slot->path || strcmp(slot->path, path) == 0) {
+            e = slot;
+            break;
+        }
     }
 
-    return orig_open(redirected, flags);
+    int fd = -1;
+    struct stat st;
+    if (e && e->path) {
+        fd = e->fd;
+        if (fd >= 0 && (fstat(fd, &st) != 0 || st.st_dev != e->dev || st.st_ino != e->ino))
+            fd = e->fd = -2;  // Closed or reused behind our back: refetch
+        else if (fd < 0 && monotonic_ns() - e->miss_ns >= STORE_MISS_TTL_NS)
+            fd = -2;          // Miss expired: ask again
+    }
+    if (!e || !e->path || fd == -2) {
+        fd = store_fetch(path);
+        if (e && (e->path || (e->path = strdup(path)))) {
+            e->fd = fd;
+            e->miss_ns = monotonic_ns();
+            if (fd >= 0 && fstat(fd, &st) == 0) {
+                e->dev = st.st_dev;
+                e->ino = st.st_ino;
+            }
+        }
+    }
+    pthread_mutex_unlock(&store_lock);
+    return fd;
 }
 
-// Hook: openat()
-int openat(int dirfd, const char *pathname, int flags, ...) {
-    static orig_openat_t orig_openat = NULL;
-    if (!orig_openat) orig_openat = (orig_openat_t)get_libc_func("openat");
+static void store_atfork_child(void) {
+    pthread_mutex_init(&store_lock, NULL);
+}
 
-    const char *redirected = redirect_path(pathname);
+// Like redirect_path(), but prefers the in-memory store for opens
+static const char *redirect_open_path(const char *path) {
+    if (store_sock && path) {
+        for (int i = 0; path_mappings[i].original != NULL; i++) {
+            if (strncmp(path, path_mappings[i].original, strlen(path_mappings[i].original)) != 0)
+                continue;
+            int fd = store_lookup(path);
+            if (fd >= 0) {
+                static __thread char procfd[32];
+                snprintf(procfd, sizeof(procfd), "/proc/self/fd/%d", fd);
+                istats_hit(RULE_STORE);
+                return procfd;
+            }
+            break;
+        }
+    }
+    return redirect_path(path);
+}
+
+// statfs cache: containerd's snapshotter and kubelet's volume code call
+// statfs/fstatfs on the same few mounts over and over, and each call is a
+// 9p round trip. Results are cached for STATFS_CACHE_TTL_MS (default 1000,
+// 0 disables), which bounds how stale the free-space fields can get.
+//
+// Entries are keyed by the caller's absolute path (statfs) or fd number
+// (fstatfs), not by st_dev: learning the device takes a stat()/fstat(),
+// another round trip, and a hit would then cost as much as the statfs it
+// replaces. So a hit makes no syscall. Validity is checked cheaply instead:
+// - Relative paths aren't cached: the same string names another file
+//   after a chdir().
+// - /proc/self/mountinfo is polled for a mount-table change at most once
+//   per TTL, and the whole cache is dropped when it reports one.
+// - An fd's entry is dropped when the fd is closed or replaced (FD_HOOKS,
+//   STREAM_HOOKS) or its number is handed out again (the open hooks,
+//   NEWFD_HOOKS, FCNTL_HOOKS). An fd that arrives any other way (SCM_RIGHTS,
+//   a raw syscall) can meet a stale entry until the TTL runs out.
+//
+// The mountinfo fd is the program's fd table too: it is moved up to
+// MOUNTINFO_FD_MIN, dropped when a hook sees its number closed or reused,
+// and its identity is checked with fstat() before it is polled or closed.
+#define STATFS_CACHE_SIZE 64
+#define MOUNTINFO_FD_MIN 512
+
+typedef struct {
+    int kind;           // HOOK_statfs etc.; 0 = empty (HOOK_open is never cached)
+    char *path;         // statfs/statfs64
+    int fd;             // fstatfs/fstatfs64
+    long long fetched_ns;
+    union {
+        struct statfs s;
+        struct statfs64 s64;
+    } buf;
+} statfs_entry_t;
 
-    mode_t mode = 0;
-    if (flags & O_CREAT) {
-        va_list args;
-        va_start(args, flags);
-        mode = va_arg(args, mode_t);
-        va_end(args);
-        return orig_openat(dirfd, redirected, flags, mode);
+typedef struct {
+    int kind;
+    const char *path;
+    int fd;
+    unsigned slot;
+} statfs_key_t;
+
+static statfs_entry_t statfs_cache[STATFS_CACHE_SIZE];
+static pthread_mutex_t statfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long statfs_ttl_ns = 1000000000LL;
+static int mountinfo_fd = -1;
+static dev_t mountinfo_dev;             // Identity of mountinfo_fd's file
+static ino_t mountinfo_ino;
+static long long mounts_checked_ns;     // Last mountinfo poll
+static int statfs_have_fds;             // Any fd entry since the last flush
+static unsigned long long statfs_hits, statfs_misses, statfs_expired, statfs_flushes;
+
+static void statfs_flush(void) {
+    for (int i = 0; i < STATFS_CACHE_SIZE; i++) {
+        free(statfs_cache[i].path);
+        statfs_cache[i].path = NULL;
+        statfs_cache[i].kind = 0;
     }
+    __atomic_store_n(&statfs_have_fds, 0, __ATOMIC_RELAXED);
+}
 
-    return orig_openat(dirfd, redirected, flags);
+// Drop the entries of fds in [first, last]: they were closed or reused.
+// One relaxed load each while no fstatfs result is cached and the
+// mountinfo fd is out of range.
+static void statfs_forget_fds(unsigned first, unsigned last) {
+    int mfd = __atomic_load_n(&mountinfo_fd, __ATOMIC_RELAXED);
+    int lost_mountinfo = mfd >= 0 && (unsigned)mfd >= first && (unsigned)mfd <= last;
+
+    if ((!lost_mountinfo && !__atomic_load_n(&statfs_have_fds, __ATOMIC_RELAXED)) || first > last)
+        return;
+    pthread_mutex_lock(&statfs_lock);
+    if (lost_mountinfo && mountinfo_fd == mfd) {
+        mountinfo_fd = -1;          // No longer ours: never poll or close it
+        mounts_checked_ns = 0;      // Reopen, and flush, on the next lookup
+    }
+    for (int i = 0; i < STATFS_CACHE_SIZE; i++) {
+        statfs_entry_t *e = &statfs_cache[i];
+        if (e->kind && !e->path && (unsigned)e->fd >= first && (unsigned)e->fd <= last)
+            e->kind = 0;
+    }
+    pthread_mutex_unlock(&statfs_lock);
 }
 
-// Hook: stat()
-int stat(const char *pathname, struct stat *statbuf) {
-    static orig_stat_t orig_stat = NULL;
-    if (!orig_stat) orig_stat = (orig_stat_t)get_libc_func("stat");
+// 1 if mountinfo_fd is still the file we opened (statfs_lock held, or
+// single-threaded after fork)
+static int mountinfo_fd_ours(void) {
+    struct stat st;
+    return mountinfo_fd >= 0 && fstat(mountinfo_fd, &st) == 0 &&
+           st.st_dev == mountinfo_dev && st.st_ino == mountinfo_ino;
+}
 
-    const char *redirected = redirect_path(pathname);
-    return orig_stat(redirected, statbuf);
+// Drop everything if the mount table changed (statfs_lock held). The
+// kernel flags a change with POLLPRI on mountinfo; if our fd is gone or
+// its number now belongs to the program, reopen it and flush to be safe.
+// The hooks aren't used here: they would take statfs_lock again.
+static void statfs_check_mounts(void) {
+    int ours = mountinfo_fd_ours();
+    struct pollfd pfd = { mountinfo_fd, POLLPRI, 0 };
+
+    if (ours && poll(&pfd, 1, 0) >= 0 && !(pfd.revents & (POLLPRI | POLLERR | POLLNVAL)))
+        return;
+    if (ours)
+        ((int (*)(int))ORIG(close))(mountinfo_fd);
+
+    struct stat st;
+    int fd = ((int (*)(const char *, int, ...))ORIG(open))("/proc/self/mountinfo",
+                                                           O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && fd < MOUNTINFO_FD_MIN) {
+        // Out of the range programs hand out, so a close loop or dup2()
+        // over low numbers leaves it alone
+        int high = ((int (*)(int, int, ...))ORIG(fcntl))(fd, F_DUPFD_CLOEXEC, MOUNTINFO_FD_MIN);
+        if (high >= 0) {
+            ((int (*)(int))ORIG(close))(fd);
+            fd = high;
+        }
+    }
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        mountinfo_dev = st.st_dev;
+        mountinfo_ino = st.st_ino;
+    } else if (fd >= 0) {
+        ((int (*)(int))ORIG(close))(fd);
+        fd = -1;
+    }
+    __atomic_store_n(&mountinfo_fd, fd, __ATOMIC_RELAXED);
+    statfs_flush();
+    statfs_flushes++;
 }
 
-// Hook: lstat()
-int lstat(const char *pathname, struct stat *statbuf) {
-    static orig_lstat_t orig_lstat = NULL;
-    if (!orig_lstat) orig_lstat = (orig_lstat_t)get_libc_func("lstat");
+// Fill buf from the cache; otherwise prepare key for statfs_cache_put()
+static int statfs_cache_get(int kind, const char *path, int fd, void *buf, size_t size,
+                            statfs_key_t *key) {
+    uint32_t h = 2166136261u ^ kind;  // FNV-1a
+
+    key->kind = 0;
+    if (statfs_ttl_ns <= 0 || (path && path[0] != '/') || (!path && fd < 0))
+        return 0;
+
+    key->kind = kind;
+    key->path = path;
+    key->fd = fd;
+    if (path) {
+        for (const char *p = path; *p; p++)
+            h = (h ^ (unsigned char)*p) * 16777619u;
+    } else {
+        h = (h ^ (unsigned)fd) * 16777619u;
+    }
+    key->slot = h % STATFS_CACHE_SIZE;
+
+    int hit = 0;
+    long long now = monotonic_ns();
+    pthread_mutex_lock(&statfs_lock);
+    if (now - mounts_checked_ns >= statfs_ttl_ns) {
+        statfs_check_mounts();
+        mounts_checked_ns = now;
+    }
+
+    statfs_entry_t *e = &statfs_cache[key->slot];
+    if (e->kind == kind && (path ? e->path && strcmp(e->path, path) == 0 : !e->path && e->fd == fd)) {
+        if (now - e->fetched_ns < statfs_ttl_ns) {
+            memcpy(buf, &e->buf, size);
+            hit = 1;
+        } else {
+            statfs_expired++;
+        }
+    }
+    if (hit)
+        statfs_hits++;
+    else
+        statfs_misses++;
+    pthread_mutex_unlock(&statfs_lock);
+    return hit;
+}
 
-    const char *redirected = redirect_path(pathname);
-    return orig_lstat(redirected, statbuf);
+// Store a (spoofed) result; the slot's previous entry is evicted
+static void statfs_cache_put(const statfs_key_t *key, const void *buf, size_t size) {
+    if (!key->kind)
+        return;
+
+    char *path = key->path ? strdup(key->path) : NULL;
+    if (key->path && !path)
+        return;
+
+    pthread_mutex_lock(&statfs_lock);
+    statfs_entry_t *e = &statfs_cache[key->slot];
+    free(e->path);
+    e->kind = key->kind;
+    e->path = path;
+    e->fd = key->fd;
+    e->fetched_ns = monotonic_ns();
+    if (!path)
+        __atomic_store_n(&statfs_have_fds, 1, __ATOMIC_RELAXED);
+    memcpy(&e->buf, buf, size);
+    pthread_mutex_unlock(&statfs_lock);
 }
 
-// Hook: statfs() - SPOOF FILESYSTEM TYPE
-int statfs(const char *path, struct statfs *buf) {
-    static orig_statfs_t orig_statfs = NULL;
-    if (!orig_statfs) orig_statfs = (orig_statfs_t)get_libc_func("statfs");
+static void statfs_atfork_child(void) {
+    pthread_mutex_init(&statfs_lock, NULL);
+    if (mountinfo_fd_ours())  // The parent's /proc/self: useless here
+        ((int (*)(int))ORIG(close))(mountinfo_fd);
+    mountinfo_fd = -1;
+    mounts_checked_ns = 0;
+}
 
-    int result = orig_statfs(path, buf);
+__attribute__((destructor))
+static void statfs_report(void) {
+    unsigned long long total = statfs_hits + statfs_misses;
+    if (total == 0)
+        return;
+    fprintf(stderr, "[LD_PRELOAD] statfs cache: %llu hits, %llu misses (%.1f%% hit rate), "
+            "%llu expired, %llu mount-table flushes\n", statfs_hits, statfs_misses,
+            100.0 * statfs_hits / total, statfs_expired, statfs_flushes);
+}
 
-    // If filesystem is 9p, spoof it as ext4
-    if (result == 0 && buf->f_type == NINE_P_FS_MAGIC) {
-        fprintf(stderr, "[LD_PRELOAD] statfs(%s): Spoofing 9p (0x%lx) as ext4 (0x%x)\n",
-                path, (unsigned long)buf->f_type, EXT4_SUPER_MAGIC);
-        buf->f_type = EXT4_SUPER_MAGIC;
+// Hooks: open() family - mode is only passed when the flags need one
+#define DEFINE_OPEN_HOOK(name, params, args) \
+    int name params { \
+        mode_t mode = 0; \
+        if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) { \
+            va_list ap; \
+            va_start(ap, flags); \
+            mode = va_arg(ap, mode_t); \
+            va_end(ap); \
+        } \
+        istats_call(); \
+        path = redirect_open_path(path); \
+        int fd = ((int (*) params)ORIG(name)) args; \
+        if (fd >= 0) \
+            statfs_forget_fds(fd, fd); \
+        return fd; \
     }
 
-    return result;
-}
+// Hooks: path-based calls - redirect and forward
+#define DEFINE_PATH_HOOK(name, redirect, ret, params, args) \
+    ret name params { \
+        istats_call(); \
+        path = redirect(path); \
+        return ((ret (*) params)ORIG(name)) args; \
+    }
 
-// Hook: fstatfs() - SPOOF FILESYSTEM TYPE
-int fstatfs(int fd, struct statfs *buf) {
-    static orig_fstatfs_t orig_fstatfs = NULL;
-    if (!orig_fstatfs) orig_fstatfs = (orig_fstatfs_t)get_libc_func("fstatfs");
+// Hooks: statfs() family - SPOOF FILESYSTEM TYPE
+#define DEFINE_STATFS_HOOK(name, params, args, key_path, key_fd, fmt, what) \
+    int name params { \
+        statfs_key_t key; \
+        istats_call(); \
+        if (statfs_cache_get(HOOK_##name, key_path, key_fd, buf, sizeof(*buf), &key)) { \
+            istats_hit(RULE_STATFS_CACHE); \
+            return 0; \
+        } \
+        int result = ((int (*) params)ORIG(name)) args; \
+        if (result == 0 && buf->f_type == NINE_P_FS_MAGIC) { \
+            fprintf(stderr, "[LD_PRELOAD] " #name "(" fmt "): Spoofing 9p (0x%lx) as ext4 (0x%x)\n", \
+                    what, (unsigned long)buf->f_type, EXT4_SUPER_MAGIC); \
+            buf->f_type = EXT4_SUPER_MAGIC; \
+            istats_hit(RULE_STATFS_SPOOF); \
+        } \
+        if (result == 0) \
+            statfs_cache_put(&key, buf, sizeof(*buf)); \
+        return result; \
+    }
 
-    int result = orig_fstatfs(fd, buf);
+// Hooks: fd-retiring calls - forward, then forget the fds' statfs results
+#define DEFINE_FD_HOOK(name, params, args, first, last) \
+    int name params { \
+        int result = ((int (*) params)ORIG(name)) args; \
+        if (result >= 0) \
+            statfs_forget_fds(first, last); \
+        return result; \
+    }
 
-    // If filesystem is 9p, spoof it as ext4
-    if (result == 0 && buf->f_type == NINE_P_FS_MAGIC) {
-        fprintf(stderr, "[LD_PRELOAD] fstatfs(fd=%d): Spoofing 9p (0x%lx) as ext4 (0x%x)\n",
-                fd, (unsigned long)buf->f_type, EXT4_SUPER_MAGIC);
-        buf->f_type = EXT4_SUPER_MAGIC;
+// Hooks: new-fd calls - forward, then forget what the returned numbers meant
+#define DEFINE_NEWFD_HOOK(name, params, args, fd_a, fd_b) \
+    int name params { \
+        int result = ((int (*) params)ORIG(name)) args; \
+        if (result >= 0) { \
+            statfs_forget_fds(fd_a, fd_a); \
+            statfs_forget_fds(fd_b, fd_b); \
+        } \
+        return result; \
     }
 
-    return result;
-}
+// Hooks: fcntl() family - the argument is an int or a pointer, passed on
+// as a pointer-sized value like glibc does
+#define DEFINE_FCNTL_HOOK(name) \
+    int name(int fd, int cmd, ...) { \
+        va_list ap; \
+        va_start(ap, cmd); \
+        void *arg = va_arg(ap, void *); \
+        va_end(ap); \
+        int result = ((int (*)(int, int, ...))ORIG(name))(fd, cmd, arg); \
+        if (result >= 0 && (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC)) \
+            statfs_forget_fds(result, result); \
+        return result; \
+    }
 
-// Hook: fopen()
-FILE *fopen(const char *pathname, const char *mode) {
-    static orig_fopen_t orig_fopen = NULL;
-    if (!orig_fopen) orig_fopen = (orig_fopen_t)get_libc_func("fopen");
+// Hooks: stream closes - the fd is gone once they return, whatever they return
+#define DEFINE_STREAM_HOOK(name, type, fd_of) \
+    int name(type stream) { \
+        int fd = fd_of(stream); \
+        int result = ((int (*)(type))ORIG(name))(stream); \
+        if (fd >= 0) \
+            statfs_forget_fds(fd, fd); \
+        return result; \
+    }
 
-    const char *redirected = redirect_path(pathname);
-    return orig_fopen(redirected, mode);
-}
+OPEN_HOOKS(DEFINE_OPEN_HOOK)
+PATH_HOOKS(DEFINE_PATH_HOOK)
+STATFS_HOOKS(DEFINE_STATFS_HOOK)
+FD_HOOKS(DEFINE_FD_HOOK)
+NEWFD_HOOKS(DEFINE_NEWFD_HOOK)
+FCNTL_HOOKS(DEFINE_FCNTL_HOOK)
+STREAM_HOOKS(DEFINE_STREAM_HOOK)
 
 // Constructor - runs when library is loaded
 __attribute__((constructor))
@@ -187,5 +721,27 @@ static void init_interceptor(void) {
                 path_mappings[i].redirect);
     }
     fprintf(stderr, "Filesystem type spoofing: 9p → ext4\n");
+    fprintf(stderr, "Hooked entry points: %d\n", HOOK_COUNT);
+
+    const char *ttl = getenv("STATFS_CACHE_TTL_MS");
+    if (ttl && *ttl)
+        statfs_ttl_ns = atoll(ttl) * 1000000LL;
+    pthread_atfork(NULL, NULL, statfs_atfork_child);
+    fprintf(stderr, "statfs cache TTL: %lld ms\n", statfs_ttl_ns / 1000000LL);
+
+    store_sock = getenv("VFILE_STORE_SOCK");
+    if (store_sock && *store_sock) {
+        pthread_atfork(NULL, NULL, store_atfork_child);
+        fprintf(stderr, "In-memory file store: %s\n", store_sock);
+    } else {
+        store_sock = NULL;
+    }
+    if (istats_open("preload", rule_names, RULE_COUNT, 1) == 0)
+        fprintf(stderr, "Live stats: %s\n", istats_path());
     fprintf(stderr, "========================================\n");
 }
+
+__attribute__((destructor))
+static void release_stats(void) {
+    istats_close();
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Build the LD_PRELOAD library and its conformance test from source and
+# run the test with and without the library
+#
+# Without the library every redirect case must fail, which shows the
+# cases really go through the hooks.
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+TEST_DIR="/tmp/ld-preload-test"
+
+rm -rf "$TEST_DIR"
+mkdir -p "$TEST_DIR"
+gcc -shared -fPIC -O2 -Wall "$SCRIPT_DIR/ld_preload_interceptor.c" \
+    -o "$TEST_DIR/ld_preload_interceptor.so" -ldl -lpthread
+gcc -Wall "$SCRIPT_DIR/test_interceptor.c" -o "$TEST_DIR/test_interceptor" -ldl
+
+failed=0
+check() {
+    if eval "$2"; then
+        echo "  ✓ $1"
+    else
+        echo "  ✗ $1"
+        failed=1
+    fi
+}
+
+INTERCEPT_STATS=off LD_PRELOAD="$TEST_DIR/ld_preload_interceptor.so" \
+    STATFS_CACHE_TTL_MS=200 "$TEST_DIR/test_interceptor" > "$TEST_DIR/preload.txt" 2> "$TEST_DIR/preload.err" || true
+"$TEST_DIR/test_interceptor" > "$TEST_DIR/native.txt" 2>&1 || true
+cat "$TEST_DIR/preload.txt"
+echo ""
+
+check "every entry point passes under the library" \
+    "grep -Eq '^[0-9]+ passed, 0 failed' '$TEST_DIR/preload.txt'"
+check "the library reports what it hooked" \
+    "grep -q 'Hooked entry points:' '$TEST_DIR/preload.err'"
+check "redirect cases fail without the library" \
+    "! grep -Eq '^[0-9]+ passed, 0 failed' '$TEST_DIR/native.txt'"
+
+echo ""
+if [ $failed -eq 0 ]; then
+    echo "All checks passed"
+else
+    echo "Some checks failed, output in $TEST_DIR"
+fi
+exit $failed
@@ -1,68 +1,474 @@
 /*
- * Test program for LD_PRELOAD interceptor
+ * Conformance test for the LD_PRELOAD interceptor
+ *
+ * One case per hooked entry point: each calls the libc function with a
+ * /sys/fs/cgroup path and checks it behaves exactly as on the matching
+ * /tmp/fake-cgroup path. The fd-retiring and fd-creating calls instead
+ * check that a cached fstatfs result doesn't outlive its fd, and two more
+ * cases cover relative statfs paths and the cache's own mountinfo fd.
+ * Symbols that new programs can't link against (the pre-2.33 __xstat
+ * family) are looked up with dlsym() and skipped when nothing provides
+ * them. Without LD_PRELOAD
+ * every redirect case fails, which doubles as a negative control.
+ * test-interceptor.sh builds both and runs both ways.
+ *
+ * Build: gcc -Wall test_interceptor.c -o test_interceptor -ldl
+ * Usage: LD_PRELOAD=./ld_preload_interceptor.so ./test_interceptor
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
-#include <sys/vfs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
 
-int main() {
+#define NINE_P_FS_MAGIC 0x01021997
+#define PROC_SUPER_MAGIC 0x9fa0
+
+#define FAKE_DIR  "/tmp/fake-cgroup/conformance"
+#define REAL_DIR  "/sys/fs/cgroup/conformance"
+#define PROBE     REAL_DIR "/probe"
+#define LINK      REAL_DIR "/link"
+#define CONTENT   "conformance\n"
+
+// Version argument of the __xstat family (_STAT_VER)
+#if defined(__x86_64__)
+#define STAT_VER 1
+#else
+#define STAT_VER 0
+#endif
+
+int __open_2(const char *path, int flags);
+int __open64_2(const char *path, int flags);
+int __openat_2(int dirfd, const char *path, int flags);
+int __openat64_2(int dirfd, const char *path, int flags);
+
+static ino_t probe_ino;
+
+// Create the fixture under the redirect target
+static int setup_fixture(void) {
+    struct stat st;
+
+    mkdir("/tmp/fake-cgroup", 0755);
+    mkdir(FAKE_DIR, 0755);
+    unlink(FAKE_DIR "/link");
+    unlink(FAKE_DIR "/created");
+
+    FILE *f = fopen(FAKE_DIR "/probe", "w");
+    if (!f || fputs(CONTENT, f) < 0 || fclose(f) != 0)
+        return -1;
+    if (symlink("probe", FAKE_DIR "/link") != 0 || stat(FAKE_DIR "/probe", &st) != 0)
+        return -1;
+    probe_ino = st.st_ino;
+    return 0;
+}
+
+// 1 if fd reads back the probe content; closes fd
+static int check_fd(int fd) {
+    char buf[64];
+    if (fd < 0)
+        return 0;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+    return n == (ssize_t)strlen(CONTENT) && memcmp(buf, CONTENT, n) == 0;
+}
+
+static int check_file(FILE *f) {
+    char buf[64];
+    if (!f)
+        return 0;
+    int ok = fgets(buf, sizeof(buf), f) && strcmp(buf, CONTENT) == 0;
+    fclose(f);
+    return ok;
+}
+
+// Cases return 1 on pass, 0 on fail, -1 if the entry point isn't available
+static int t_open(void)         { return check_fd(open(PROBE, O_RDONLY)); }
+static int t_open64(void)       { return check_fd(open64(PROBE, O_RDONLY)); }
+static int t_openat(void)       { return check_fd(openat(AT_FDCWD, PROBE, O_RDONLY)); }
+static int t_openat64(void)     { return check_fd(openat64(AT_FDCWD, PROBE, O_RDONLY)); }
+static int t___open_2(void)     { return check_fd(__open_2(PROBE, O_RDONLY)); }
+static int t___open64_2(void)   { return check_fd(__open64_2(PROBE, O_RDONLY)); }
+static int t___openat_2(void)   { return check_fd(__openat_2(AT_FDCWD, PROBE, O_RDONLY)); }
+static int t___openat64_2(void) { return check_fd(__openat64_2(AT_FDCWD, PROBE, O_RDONLY)); }
+static int t_fopen(void)        { return check_file(fopen(PROBE, "r")); }
+static int t_fopen64(void)      { return check_file(fopen64(PROBE, "r")); }
+
+// O_CREAT must pass the variadic mode through
+static int t_open_creat(void) {
+    struct stat st;
+    int fd = open(REAL_DIR "/created", O_CREAT | O_WRONLY | O_EXCL, 0640);
+    if (fd < 0)
+        return 0;
+    close(fd);
+    return stat(FAKE_DIR "/created", &st) == 0 && (st.st_mode & 0777) == 0640;
+}
+
+static int t_opendir(void) {
+    DIR *d = opendir(REAL_DIR);
+    struct dirent *de;
+    int found = 0;
+    if (!d)
+        return 0;
+    while ((de = readdir(d)) != NULL)
+        found |= strcmp(de->d_name, "probe") == 0;
+    closedir(d);
+    return found;
+}
+
+static int t_stat(void)    { struct stat st;   return stat(PROBE, &st) == 0 && st.st_ino == probe_ino; }
+static int t_stat64(void)  { struct stat64 st; return stat64(PROBE, &st) == 0 && st.st_ino == probe_ino; }
+static int t_lstat(void)   { struct stat st;   return lstat(LINK, &st) == 0 && S_ISLNK(st.st_mode); }
+static int t_lstat64(void) { struct stat64 st; return lstat64(LINK, &st) == 0 && S_ISLNK(st.st_mode); }
+
+static int t_fstatat(void) {
+    struct stat st;
+    return fstatat(AT_FDCWD, LINK, &st, 0) == 0 && st.st_ino == probe_ino;
+}
+
+static int t_fstatat64(void) {
+    struct stat64 st;
+    return fstatat64(AT_FDCWD, LINK, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(st.st_mode);
+}
+
+static int t_statx(void) {
+    struct statx stx;
+    return statx(AT_FDCWD, PROBE, 0, STATX_INO, &stx) == 0 && stx.stx_ino == probe_ino;
+}
+
+// Pre-2.33 entry points, only reachable through dlsym()
+static int t___xstat(void) {
+    int (*fn)(int, const char *, struct stat *) = dlsym(RTLD_DEFAULT, "__xstat");
+    struct stat st;
+    if (!fn) return -1;
+    return fn(STAT_VER, PROBE, &st) == 0 && st.st_ino == probe_ino;
+}
+
+static int t___xstat64(void) {
+    int (*fn)(int, const char *, struct stat64 *) = dlsym(RTLD_DEFAULT, "__xstat64");
+    struct stat64 st;
+    if (!fn) return -1;
+    return fn(STAT_VER, PROBE, &st) == 0 && st.st_ino == probe_ino;
+}
+
+static int t___lxstat(void) {
+    int (*fn)(int, const char *, struct stat *) = dlsym(RTLD_DEFAULT, "__lxstat");
+    struct stat st;
+    if (!fn) return -1;
+    return fn(STAT_VER, LINK, &st) == 0 && S_ISLNK(st.st_mode);
+}
+
+static int t___lxstat64(void) {
+    int (*fn)(int, const char *, struct stat64 *) = dlsym(RTLD_DEFAULT, "__lxstat64");
+    struct stat64 st;
+    if (!fn) return -1;
+    return fn(STAT_VER, LINK, &st) == 0 && S_ISLNK(st.st_mode);
+}
+
+static int t___fxstatat(void) {
+    int (*fn)(int, int, const char *, struct stat *, int) = dlsym(RTLD_DEFAULT, "__fxstatat");
+    struct stat st;
+    if (!fn) return -1;
+    return fn(STAT_VER, AT_FDCWD, PROBE, &st, 0) == 0 && st.st_ino == probe_ino;
+}
+
+static int t___fxstatat64(void) {
+    int (*fn)(int, int, const char *, struct stat64 *, int) = dlsym(RTLD_DEFAULT, "__fxstatat64");
+    struct stat64 st;
+    if (!fn) return -1;
+    return fn(STAT_VER, AT_FDCWD, PROBE, &st, 0) == 0 && st.st_ino == probe_ino;
+}
+
+static int t_access(void)    { return access(PROBE, R_OK) == 0; }
+static int t_faccessat(void) { return faccessat(AT_FDCWD, PROBE, R_OK, 0) == 0; }
+
+static int t_readlink(void) {
+    char buf[64];
+    ssize_t n = readlink(LINK, buf, sizeof(buf));
+    return n == 5 && memcmp(buf, "probe", 5) == 0;
+}
+
+static int t_readlinkat(void) {
+    char buf[64];
+    ssize_t n = readlinkat(AT_FDCWD, LINK, buf, sizeof(buf));
+    return n == 5 && memcmp(buf, "probe", 5) == 0;
+}
+
+// statfs family: never report 9p, and all variants agree
+static int t_statfs(void) {
     struct statfs buf;
-    int fd;
-    char content[256];
+    return statfs("/", &buf) == 0 && buf.f_type != NINE_P_FS_MAGIC;
+}
 
-    printf("Testing LD_PRELOAD interceptor...\n\n");
+static int t_statfs64(void) {
+    struct statfs64 buf;
+    struct statfs ref;
+    return statfs64("/", &buf) == 0 && statfs("/", &ref) == 0 &&
+           buf.f_type != NINE_P_FS_MAGIC && buf.f_type == ref.f_type;
+}
 
-    // Test 1: statfs() on root (should be spoofed to ext4)
-    printf("Test 1: statfs(\"/\") to check filesystem type spoofing\n");
-    if (statfs("/", &buf) == 0) {
-        printf("  f_type = 0x%lx", (unsigned long)buf.f_type);
-        if (buf.f_type == 0xEF53) {
-            printf(" (ext4 - SPOOFED ✓)\n");
-        } else if (buf.f_type == 0x01021997) {
-            printf(" (9p - NOT spoofed ✗)\n");
-        } else {
-            printf(" (other)\n");
-        }
-    } else {
-        perror("  statfs failed");
+static int t_fstatfs(void) {
+    struct statfs buf, ref;
+    int fd = open("/", O_RDONLY | O_DIRECTORY);
+    int ok = fd >= 0 && fstatfs(fd, &buf) == 0 && statfs("/", &ref) == 0 &&
+             buf.f_type != NINE_P_FS_MAGIC && buf.f_type == ref.f_type;
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+static int t_fstatfs64(void) {
+    struct statfs64 buf;
+    struct statfs ref;
+    int fd = open("/", O_RDONLY | O_DIRECTORY);
+    int ok = fd >= 0 && fstatfs64(fd, &buf) == 0 && statfs("/", &ref) == 0 &&
+             buf.f_type != NINE_P_FS_MAGIC && buf.f_type == ref.f_type;
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+// Relative paths name another file after a chdir(): no stale cache hit
+static int t_statfs_relative(void) {
+    struct statfs buf;
+    int cwd = open(".", O_RDONLY | O_DIRECTORY);
+    int ok = cwd >= 0 && chdir("/") == 0 && statfs(".", &buf) == 0 &&
+             buf.f_type != PROC_SUPER_MAGIC && chdir("/proc") == 0 &&
+             statfs(".", &buf) == 0 && buf.f_type == PROC_SUPER_MAGIC;
+    if (cwd >= 0) {
+        ok = fchdir(cwd) == 0 && ok;
+        close(cwd);
     }
+    return ok;
+}
 
-    printf("\n");
-
-    // Test 2: open() redirection
-    printf("Test 2: open(\"/sys/fs/cgroup/cpu/cpu.shares\") redirection\n");
-    fd = open("/sys/fs/cgroup/cpu/cpu.shares", O_RDONLY);
-    if (fd >= 0) {
-        ssize_t n = read(fd, content, sizeof(content) - 1);
-        if (n > 0) {
-            content[n] = '\0';
-            printf("  Content: %s", content);
-            printf("  ✓ Read successful (redirected to /tmp/fake-cgroup)\n");
-        }
+// The cache's mountinfo fd, found through /proc/self/fd; -1 if none
+static int find_mountinfo_fd(void) {
+    char target[256];
+    int found = -1;
+    DIR *d = opendir("/proc/self/fd");
+    struct dirent *de;
+    while (d && (de = readdir(d)) != NULL) {
+        ssize_t n = readlinkat(dirfd(d), de->d_name, target, sizeof(target) - 1);
+        if (n > 10 && memcmp(target + n - 10, "/mountinfo", 10) == 0)
+            found = atoi(de->d_name);
+    }
+    if (d) closedir(d);
+    return found;
+}
+
+// The program dup2()s a broken pipe over the mountinfo fd's number: the
+// cache must let go of it, not poll it (POLLERR) and close it
+static int t_mountinfo_fd(void) {
+    struct statfs buf;
+    const char *ttl = getenv("STATFS_CACHE_TTL_MS");
+    int p[2], mfd;
+
+    if (statfs("/", &buf) != 0 || (mfd = find_mountinfo_fd()) < 0)
+        return -1;
+    if (pipe(p) != 0)
+        return 0;
+    close(p[0]);
+    int ok = dup2(p[1], mfd) == mfd;
+    close(p[1]);
+    usleep(((ttl && *ttl ? atoi(ttl) : 1000) + 50) * 1000);  // Next lookup checks mounts
+    struct stat st;
+    ok = ok && statfs("/", &buf) == 0 && fstat(mfd, &st) == 0 && S_ISFIFO(st.st_mode);
+    close(mfd);
+    return ok;
+}
+
+// fstatfs on /proc caches procfs for an fd; -1 if that didn't happen
+static int cached_proc_fd(void) {
+    struct statfs buf;
+    int fd = open("/proc", O_RDONLY | O_DIRECTORY);
+    if (fd >= 0 && (fstatfs(fd, &buf) != 0 || buf.f_type != PROC_SUPER_MAGIC)) {
         close(fd);
-    } else {
-        perror("  open failed");
-        printf("  ✗ Redirection failed\n");
+        fd = -1;
     }
+    return fd;
+}
 
-    printf("\n");
+static int not_proc(int fd) {
+    struct statfs buf;
+    return fstatfs(fd, &buf) == 0 && buf.f_type != PROC_SUPER_MAGIC;
+}
+
+// fd-retiring calls: the cached fd is retired by the call under test and
+// its number reused by a raw SYS_dup of "/", which no hook sees; the
+// cached procfs result must not come back
+enum { RETIRE_CLOSE, RETIRE_DUP2, RETIRE_DUP3, RETIRE_CLOSE_RANGE, RETIRE_FCLOSE, RETIRE_CLOSEDIR };
 
-    // Test 3: fopen() redirection
-    printf("Test 3: fopen(\"/proc/sys/kernel/pid_max\") redirection\n");
-    FILE *f = fopen("/proc/sys/kernel/pid_max", "r");
-    if (f) {
-        if (fgets(content, sizeof(content), f)) {
-            printf("  Content: %s", content);
-            printf("  ✓ Read successful (redirected to /tmp/fake-procsys)\n");
+static int check_fd_retired(int how) {
+    int root = open("/", O_RDONLY | O_DIRECTORY);
+    int fd = cached_proc_fd(), ok = root >= 0 && fd >= 0;
+    FILE *f;
+    DIR *d;
+
+    if (ok) {
+        switch (how) {
+        case RETIRE_CLOSE:       ok = close(fd) == 0 && syscall(SYS_dup, root) == fd; break;
+        case RETIRE_DUP2:        ok = dup2(root, fd) == fd; break;
+        case RETIRE_DUP3:        ok = dup3(root, fd, 0) == fd; break;
+        case RETIRE_CLOSE_RANGE: ok = close_range(fd, fd, 0) == 0 && syscall(SYS_dup, root) == fd; break;
+        case RETIRE_FCLOSE:
+            ok = (f = fdopen(fd, "r")) != NULL && fclose(f) == 0 && syscall(SYS_dup, root) == fd;
+            break;
+        case RETIRE_CLOSEDIR:
+            ok = (d = fdopendir(fd)) != NULL && closedir(d) == 0 && syscall(SYS_dup, root) == fd;
+            break;
         }
-        fclose(f);
-    } else {
-        perror("  fopen failed");
-        printf("  ✗ Redirection failed\n");
     }
+    ok = ok && not_proc(fd);
+    if (fd >= 0) close(fd);
+    if (root >= 0) close(root);
+    return ok;
+}
 
-    printf("\nAll tests complete!\n");
-    return 0;
+static int t_close(void)       { return check_fd_retired(RETIRE_CLOSE); }
+static int t_dup2(void)        { return check_fd_retired(RETIRE_DUP2); }
+static int t_dup3(void)        { return check_fd_retired(RETIRE_DUP3); }
+static int t_close_range(void) { return check_fd_retired(RETIRE_CLOSE_RANGE); }
+static int t_fclose(void)      { return check_fd_retired(RETIRE_FCLOSE); }
+static int t_closedir(void)    { return check_fd_retired(RETIRE_CLOSEDIR); }
+
+// fd-creating calls: the cached fd is closed by a raw SYS_close, which no
+// hook sees, and the call under test gets its number (the lowest free)
+static int root_fd = -1, listen_fd = -1, extra_fd = -1;
+
+static int check_fd_handed_out(int (*make)(void)) {
+    int fd = cached_proc_fd();
+    if (fd < 0 || syscall(SYS_close, fd) != 0)
+        return 0;
+    int got = make();
+    int ok = got == fd && not_proc(got);
+    if (got >= 0) close(got);
+    if (extra_fd >= 0) close(extra_fd);
+    extra_fd = -1;
+    return ok;
+}
+
+// A pending connection on a listening socket, for the accept cases
+static int listen_once(void) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "test_interceptor.%d", getpid());
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr.sun_path + 1);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    extra_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return listen_fd >= 0 && extra_fd >= 0 && bind(listen_fd, (struct sockaddr *)&addr, len) == 0 &&
+           listen(listen_fd, 1) == 0 && connect(extra_fd, (struct sockaddr *)&addr, len) == 0;
+}
+
+static int (*fcntl64_fn)(int, int, ...);
+
+static int mk_dup(void)            { return dup(root_fd); }
+static int mk_socket(void)         { return socket(AF_UNIX, SOCK_DGRAM, 0); }
+static int mk_socketpair(void)     { int sv[2]; return socketpair(AF_UNIX, SOCK_STREAM, 0, sv) ? -1 : (extra_fd = sv[1], sv[0]); }
+static int mk_accept(void)         { return accept(listen_fd, NULL, NULL); }
+static int mk_accept4(void)        { return accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC); }
+static int mk_pipe(void)           { int p[2]; return pipe(p) ? -1 : (extra_fd = p[1], p[0]); }
+static int mk_pipe2(void)          { int p[2]; return pipe2(p, O_CLOEXEC) ? -1 : (extra_fd = p[1], p[0]); }
+static int mk_eventfd(void)        { return eventfd(0, 0); }
+static int mk_memfd_create(void)   { return memfd_create("test_interceptor", 0); }
+static int mk_epoll_create1(void)  { return epoll_create1(0); }
+static int mk_inotify_init1(void)  { return inotify_init1(0); }
+static int mk_timerfd_create(void) { return timerfd_create(CLOCK_MONOTONIC, 0); }
+static int mk_fcntl(void)          { return fcntl(root_fd, F_DUPFD, 0); }
+static int mk_fcntl64(void)        { return fcntl64_fn(root_fd, F_DUPFD_CLOEXEC, 0); }
+
+static int check_new_fd(int (*make)(void)) {
+    root_fd = open("/", O_RDONLY | O_DIRECTORY);
+    int ok = root_fd >= 0 && check_fd_handed_out(make);
+    if (root_fd >= 0) close(root_fd);
+    return ok;
+}
+
+static int check_accepted(int (*make)(void)) {
+    int ok = listen_once() && check_fd_handed_out(make);
+    if (listen_fd >= 0) close(listen_fd);
+    if (extra_fd >= 0) close(extra_fd);
+    listen_fd = extra_fd = -1;
+    return ok;
+}
+
+static int t_dup(void)            { return check_new_fd(mk_dup); }
+static int t_socket(void)         { return check_new_fd(mk_socket); }
+static int t_socketpair(void)     { return check_new_fd(mk_socketpair); }
+static int t_accept(void)         { return check_accepted(mk_accept); }
+static int t_accept4(void)        { return check_accepted(mk_accept4); }
+static int t_pipe(void)           { return check_new_fd(mk_pipe); }
+static int t_pipe2(void)          { return check_new_fd(mk_pipe2); }
+static int t_eventfd(void)        { return check_new_fd(mk_eventfd); }
+static int t_memfd_create(void)   { return check_new_fd(mk_memfd_create); }
+static int t_epoll_create1(void)  { return check_new_fd(mk_epoll_create1); }
+static int t_inotify_init1(void)  { return check_new_fd(mk_inotify_init1); }
+static int t_timerfd_create(void) { return check_new_fd(mk_timerfd_create); }
+static int t_fcntl(void)          { return check_new_fd(mk_fcntl); }
+
+static int t_fcntl64(void) {
+    fcntl64_fn = (int (*)(int, int, ...))dlsym(RTLD_DEFAULT, "fcntl64");
+    return fcntl64_fn ? check_new_fd(mk_fcntl64) : -1;
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(void);
+} cases[] = {
+    {"open", t_open}, {"open(O_CREAT)", t_open_creat}, {"open64", t_open64},
+    {"openat", t_openat}, {"openat64", t_openat64},
+    {"__open_2", t___open_2}, {"__open64_2", t___open64_2},
+    {"__openat_2", t___openat_2}, {"__openat64_2", t___openat64_2},
+    {"fopen", t_fopen}, {"fopen64", t_fopen64}, {"opendir", t_opendir},
+    {"stat", t_stat}, {"stat64", t_stat64}, {"lstat", t_lstat}, {"lstat64", t_lstat64},
+    {"fstatat", t_fstatat}, {"fstatat64", t_fstatat64}, {"statx", t_statx},
+    {"__xstat", t___xstat}, {"__xstat64", t___xstat64},
+    {"__lxstat", t___lxstat}, {"__lxstat64", t___lxstat64},
+    {"__fxstatat", t___fxstatat}, {"__fxstatat64", t___fxstatat64},
+    {"access", t_access}, {"faccessat", t_faccessat},
+    {"readlink", t_readlink}, {"readlinkat", t_readlinkat},
+    {"statfs", t_statfs}, {"statfs64", t_statfs64},
+    {"fstatfs", t_fstatfs}, {"fstatfs64", t_fstatfs64},
+    {"statfs-relative", t_statfs_relative}, {"mountinfo-fd", t_mountinfo_fd},
+    {"close", t_close}, {"dup2", t_dup2}, {"dup3", t_dup3}, {"close_range", t_close_range},
+    {"fclose", t_fclose}, {"closedir", t_closedir},
+    {"dup", t_dup}, {"socket", t_socket}, {"socketpair", t_socketpair},
+    {"accept", t_accept}, {"accept4", t_accept4}, {"pipe", t_pipe}, {"pipe2", t_pipe2},
+    {"eventfd", t_eventfd}, {"memfd_create", t_memfd_create},
+    {"epoll_create1", t_epoll_create1}, {"inotify_init1", t_inotify_init1},
+    {"timerfd_create", t_timerfd_create}, {"fcntl", t_fcntl}, {"fcntl64", t_fcntl64},
+};
+
+int main() {
+    int passed = 0, failed = 0, skipped = 0;
+
+    printf("Testing LD_PRELOAD interceptor...\n\n");
+
+    if (setup_fixture() != 0) {
+        perror("fixture " FAKE_DIR);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int r = cases[i].fn();
+        printf("  %-16s %s\n", cases[i].name, r > 0 ? "✓" : r < 0 ? "- (not available)" : "✗");
+        if (r > 0) passed++;
+        else if (r < 0) skipped++;
+        else failed++;
+    }
+
+    printf("\n%d passed, %d failed, %d skipped\n", passed, failed, skipped);
+    return failed ? 1 : 0;
 }
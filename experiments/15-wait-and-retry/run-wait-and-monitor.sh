@@ -5,9 +5,9 @@
 #
 # Strategy:
 # - Start k3s and let it run
-# - Monitor every 30 seconds for 5 minutes
+# - Follow it for 5 minutes with tools/k3s_launch (milestones as they happen)
 # - Check if k3s continues running after panic
-# - Attempt kubectl operations at each check
+# - Attempt kubectl operations at the end
 #
 
 set -e
@@ -23,9 +23,9 @@ echo "Question: Does k3s stabilize AFTER the post-start hook panic?"
 echo ""
 echo "Strategy:"
 echo "  - Start k3s in background"
-echo "  - Monitor every 30s for 5 minutes"
+echo "  - Follow readiness events for 5 minutes"
 echo "  - Check if process continues running"
-echo "  - Attempt kubectl operations"
+echo "  - Attempt kubectl operations at the end"
 echo ""
 
 # Build interceptor
@@ -40,29 +40,7 @@ echo "  ✓ Compiled"
 echo ""
 echo "[2/5] Creating fake /proc/sys files..."
 FAKE_PROCSYS="/tmp/fake-procsys"
-rm -rf "$FAKE_PROCSYS"
-mkdir -p "$FAKE_PROCSYS/kernel/keys"
-mkdir -p "$FAKE_PROCSYS/vm"
-mkdir -p "$FAKE_PROCSYS/net/ipv4/conf/all"
-mkdir -p "$FAKE_PROCSYS/net/ipv4/conf/default"
-mkdir -p "$FAKE_PROCSYS/net/ipv4"
-mkdir -p "$FAKE_PROCSYS/net/ipv6/conf/all"
-mkdir -p "$FAKE_PROCSYS/net/ipv6/conf/default"
-mkdir -p "$FAKE_PROCSYS/net/bridge"
-
-echo "1" > "$FAKE_PROCSYS/vm/panic_on_oom"
-echo "10" > "$FAKE_PROCSYS/kernel/panic"
-echo "1" > "$FAKE_PROCSYS/kernel/panic_on_oops"
-echo "1000000" > "$FAKE_PROCSYS/kernel/keys/root_maxkeys"
-echo "25000000" > "$FAKE_PROCSYS/kernel/keys/root_maxbytes"
-echo "1" > "$FAKE_PROCSYS/vm/overcommit_memory"
-echo "65536" > "$FAKE_PROCSYS/kernel/pid_max"
-echo "1" > "$FAKE_PROCSYS/net/ipv4/conf/all/route_localnet"
-echo "1" > "$FAKE_PROCSYS/net/ipv4/ip_forward"
-echo "1" > "$FAKE_PROCSYS/net/bridge/bridge-nf-call-iptables"
-echo "0" > "$FAKE_PROCSYS/net/ipv4/conf/all/rp_filter"
-echo "0" > "$FAKE_PROCSYS/net/ipv4/conf/default/rp_filter"
-echo "0" > "$FAKE_PROCSYS/net/ipv6/conf/all/forwarding"
+../34-fake-tree-spec/fake-tree.sh -c -q /proc/sys="$FAKE_PROCSYS"
 echo "  ✓ Created"
 
 # Setup CNI
@@ -92,7 +70,18 @@ echo ""
 echo "[5/5] Starting k3s..."
 export KUBECONFIG=/etc/rancher/k3s/k3s.yaml
 
-./ptrace_interceptor /usr/local/bin/k3s server \
+# k3s_launch follows k3s and its node watch for 5 minutes, printing each
+# milestone as it happens instead of checking every 30s
+LAUNCH=../../tools/k3s_launch
+[ -x "$LAUNCH" ] || gcc -O2 -Wall "$LAUNCH.c" -o "$LAUNCH" -lssl -lcrypto
+
+echo "========================================="
+echo "Monitoring k3s for 5 minutes..."
+echo "========================================="
+echo ""
+
+if ! "$LAUNCH" -f -i -t 300 -k "$KUBECONFIG" -l /tmp/exp15-k3s.log -p /tmp/exp15-k3s.pid -- \
+    ./ptrace_interceptor /usr/local/bin/k3s server \
     --snapshotter=native \
     --flannel-backend=none \
     --kubelet-arg=--fail-swap-on=false \
@@ -103,74 +92,24 @@ export KUBECONFIG=/etc/rancher/k3s/k3s.yaml
     --kubelet-arg=--image-gc-high-threshold=100 \
     --kubelet-arg=--image-gc-low-threshold=99 \
     --disable=coredns,servicelb,traefik,local-storage,metrics-server \
-    --write-kubeconfig-mode=644 \
-    > /tmp/exp15-k3s.log 2>&1 &
-
-K3S_PID=$!
-echo "  ✓ Started (PID $K3S_PID)"
-echo ""
-
-# Monitor function
-check_k3s() {
-    local elapsed=$1
-    echo "================================================"
-    echo "Check at ${elapsed}s"
-    echo "================================================"
-
-    # Check if process is running
-    if ps -p $K3S_PID > /dev/null 2>&1; then
-        echo "✅ k3s process STILL RUNNING (PID $K3S_PID)"
-
-        # Try kubectl
-        echo ""
-        echo "Testing kubectl operations..."
-        if kubectl get nodes --insecure-skip-tls-verify 2>/dev/null; then
-            echo "✅ kubectl get nodes WORKS!"
-        else
-            echo "⏳ kubectl get nodes not ready yet"
-        fi
-
-        if kubectl get pods -A --insecure-skip-tls-verify 2>/dev/null; then
-            echo "✅ kubectl get pods WORKS!"
-        else
-            echo "⏳ kubectl get pods not ready yet"
-        fi
-
-        # Check for panic in logs
-        if grep -q "PostStartHook.*failed" /tmp/exp15-k3s.log; then
-            echo "⚠️  Post-start hook panic occurred (but process continues!)"
-        fi
-
-        return 0
-    else
-        echo "❌ k3s process EXITED"
-        echo ""
-        echo "Last 30 lines of log:"
-        tail -30 /tmp/exp15-k3s.log
-        return 1
-    fi
-}
+    --write-kubeconfig-mode=644; then
+    echo ""
+    echo "========================================="
+    echo "RESULT: k3s exited before 5 minutes"
+    echo "========================================="
+    echo ""
+    echo "Last 30 lines of log:"
+    tail -30 /tmp/exp15-k3s.log
+    exit 1
+fi
+K3S_PID=$(cat /tmp/exp15-k3s.pid)
 
-# Monitoring loop
-echo "========================================="
-echo "Monitoring k3s for 5 minutes..."
-echo "========================================="
+# Check for panic in logs
+if grep -q "PostStartHook.*failed" /tmp/exp15-k3s.log; then
+    echo "⚠️  Post-start hook panic occurred (but process continues!)"
+fi
 echo ""
 
-for i in {1..10}; do
-    elapsed=$((i * 30))
-    sleep 30
-
-    if ! check_k3s $elapsed; then
-        echo ""
-        echo "========================================="
-        echo "RESULT: k3s exited at ${elapsed}s"
-        echo "========================================="
-        exit 1
-    fi
-    echo ""
-done
-
 # Final check
 echo "========================================="
 echo "FINAL RESULT (after 5 minutes)"
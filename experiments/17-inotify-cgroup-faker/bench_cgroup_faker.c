@@ -0,0 +1,155 @@
+/*
+ * Directory-creation-to-populated latency of cgroup_faker
+ *
+ * Does what runc does to a watched tree: creates a cgroup directory and
+ * waits until its controller files are there. Each sample runs from
+ * mkdir() returning to the last file (cpuset.mems, by default) being
+ * closed after its write. The wait is an inotify watch rather than a
+ * spin, so a single CPU is left to the daemon. Directories are removed
+ * between samples.
+ *
+ * Build: gcc -O2 -Wall bench_cgroup_faker.c -o bench_cgroup_faker
+ * Usage: ./bench_cgroup_faker [-n 1000] [-f cpuset.mems] /sys/fs/cgroup/memory/k8s.io
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define TIMEOUT_MS 1000
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int populated(const char *dir, const char *last) {
+    struct stat st;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int found = fd >= 0 && fstatat(fd, last, &st, 0) == 0 && st.st_size > 0;
+    if (fd >= 0)
+        close(fd);
+    return found;
+}
+
+// Wait for last to be written in dir. Returns 0, or -1 after the timeout.
+static int wait_populated(int ifd, const char *dir, const char *last) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int wd = inotify_add_watch(ifd, dir, IN_CLOSE_WRITE);
+    int result = -1;
+
+    // The daemon may have finished before the watch existed
+    if (wd < 0 || populated(dir, last)) {
+        result = wd < 0 ? -1 : 0;
+        goto out;
+    }
+
+    long long deadline = monotonic_ns() + TIMEOUT_MS * 1000000LL;
+    struct pollfd pfd = { .fd = ifd, .events = POLLIN };
+    while (result < 0) {
+        int left = (deadline - monotonic_ns()) / 1000000;
+        if (left <= 0 || poll(&pfd, 1, left) <= 0)
+            break;
+        ssize_t len = read(ifd, buf, sizeof(buf));
+        for (char *p = buf; len > 0 && p < buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->wd == wd && ev->len && strcmp(ev->name, last) == 0)
+                result = 0;
+        }
+    }
+out:
+    if (wd >= 0)
+        inotify_rm_watch(ifd, wd);
+    return result;
+}
+
+static void remove_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    while (d && (de = readdir(d)) != NULL)
+        if (de->d_type != DT_DIR)
+            unlinkat(dirfd(d), de->d_name, 0);
+    if (d)
+        closedir(d);
+    rmdir(dir);
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    const char *last = "cpuset.mems";
+    int n = 1000, opt;
+
+    while ((opt = getopt(argc, argv, "n:f:")) != -1) {
+        switch (opt) {
+        case 'n': n = atoi(optarg); break;
+        case 'f': last = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n count] [-f last-file] <watched-dir>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || n <= 0) {
+        fprintf(stderr, "Usage: %s [-n count] [-f last-file] <watched-dir>\n", argv[0]);
+        return 1;
+    }
+
+    int ifd = inotify_init1(IN_CLOEXEC);
+    long long *samples = calloc(n, sizeof(*samples));
+    if (ifd < 0 || !samples) {
+        perror("inotify_init1");
+        return 1;
+    }
+
+    int done = 0, timeouts = 0;
+    for (int i = 0; i < n; i++) {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/bench-%d-%d", argv[optind], getpid(), i);
+
+        if (mkdir(dir, 0755) < 0) {
+            perror(dir);
+            return 1;
+        }
+        long long start = monotonic_ns();
+        if (wait_populated(ifd, dir, last) == 0)
+            samples[done++] = monotonic_ns() - start;
+        else
+            timeouts++;
+        remove_dir(dir);
+    }
+
+    if (done == 0) {
+        fprintf(stderr, "No directory was populated within %d ms - is cgroup_faker watching %s?\n",
+                TIMEOUT_MS, argv[optind]);
+        return 1;
+    }
+
+    qsort(samples, done, sizeof(*samples), compare_ll);
+    long long total = 0;
+    int under_1ms = 0;
+    for (int i = 0; i < done; i++) {
+        total += samples[i];
+        under_1ms += samples[i] < 1000000;
+    }
+    printf("%d cgroups, %d timed out\n", done, timeouts);
+    printf("mkdir to populated: mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+           total / 1000.0 / done, samples[done / 2] / 1000.0, samples[done * 9 / 10] / 1000.0,
+           samples[done * 99 / 100] / 1000.0, samples[done - 1] / 1000.0);
+    printf("under 1 ms: %d of %d (%.1f%%)\n", under_1ms, done, 100.0 * under_1ms / done);
+    return 0;
+}
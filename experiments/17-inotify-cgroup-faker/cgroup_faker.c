@@ -0,0 +1,320 @@
+/*
+ * Single-process cgroup directory populator, replacing cgroup-faker-inotify.sh
+ *
+ * gVisor leaves new cgroup directories empty, and runc writes the new
+ * cgroup's cgroup.procs within a millisecond of creating it. The script
+ * ran one inotifywait pipeline per subsystem, watched only the top k8s.io
+ * directory and forked echo, chmod and date for every file. This daemon
+ * watches every <base>/<subsystem>/k8s.io tree recursively with a single
+ * inotify instance, reads events in batches, and fills each new directory
+ * with the same controller files through openat() relative to one
+ * directory fd. A new directory is populated first, then watched and
+ * scanned for subdirectories created before the watch existed.
+ *
+ * The time from reading the event to the last file written is kept per
+ * directory and reported on SIGUSR1 and at exit. bench_cgroup_faker.c
+ * measures the whole path, from mkdir() to fully populated.
+ *
+ * Build: gcc -O2 -Wall cgroup_faker.c -o cgroup_faker
+ * Usage: ./cgroup_faker [-b /sys/fs/cgroup] [-r k8s.io] [-s memory,cpu,...] [-v]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define DEFAULT_BASE "/sys/fs/cgroup"
+#define DEFAULT_ROOT "k8s.io"
+#define EVENT_BUF (64 * 1024)
+#define HIST_BUCKET_NS 10000  // 10 us buckets
+#define HIST_BUCKETS 1000     // Up to 10 ms; slower ones only count in the max
+
+// Controller files and their initial content, as the script wrote them
+static const struct {
+    const char *name;
+    const char *content;
+} cgroup_files[] = {
+    { "cgroup.procs", "\n" },  // First: runc writes it straight away
+    { "tasks", "\n" },
+    { "cgroup.clone_children", "0\n" },
+    { "cgroup.sane_behavior", "0\n" },
+    { "notify_on_release", "0\n" },
+    { "release_agent", "0\n" },
+    { "memory.limit_in_bytes", "9223372036854771712\n" },
+    { "memory.soft_limit_in_bytes", "9223372036854771712\n" },
+    { "memory.usage_in_bytes", "0\n" },
+    { "memory.max_usage_in_bytes", "0\n" },
+    { "memory.failcnt", "0\n" },
+    { "memory.stat", "cache 0\nrss 0\nmapped_file 0\n" },
+    { "memory.kmem.limit_in_bytes", "9223372036854771712\n" },
+    { "memory.kmem.usage_in_bytes", "0\n" },
+    { "memory.oom_control", "0\n" },
+    { "cpu.cfs_period_us", "100000\n" },
+    { "cpu.cfs_quota_us", "-1\n" },
+    { "cpu.shares", "1024\n" },
+    { "cpu.stat", "0\n" },
+    { "cpuset.cpus", "0-3\n" },
+    { "cpuset.mems", "0\n" },
+};
+#define N_CGROUP_FILES (sizeof(cgroup_files) / sizeof(cgroup_files[0]))
+
+static const char *default_subsystems =
+    "memory,cpu,cpuacct,cpuset,blkio,devices,freezer,net_cls,perf_event,net_prio,hugetlb,pids,rdma,misc";
+
+static int inotify_fd;
+static char **watch_paths;   // Indexed by watch descriptor
+static int n_watch_paths, n_watches;
+static int verbose;
+
+static unsigned long long n_populated, n_files_created, n_overflows;
+static unsigned long long hist[HIST_BUCKETS];
+static long long latency_total_ns, latency_max_ns;
+
+static volatile sig_atomic_t running = 1, report_requested;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void record_latency(long long ns) {
+    n_populated++;
+    latency_total_ns += ns;
+    if (ns > latency_max_ns)
+        latency_max_ns = ns;
+    if (ns / HIST_BUCKET_NS < HIST_BUCKETS)
+        hist[ns / HIST_BUCKET_NS]++;
+}
+
+// Upper bound of the bucket holding the given fraction of samples
+static double percentile_us(double fraction) {
+    unsigned long long want = (unsigned long long)(fraction * n_populated + 0.5), seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= want && seen > 0)
+            return (i + 1) * HIST_BUCKET_NS / 1000.0;
+    }
+    return latency_max_ns / 1000.0;
+}
+
+static void report(void) {
+    fprintf(stderr, "[cgroup_faker] %llu cgroups populated, %llu files created, %d watches, "
+            "%llu queue overflows\n", n_populated, n_files_created, n_watches, n_overflows);
+    if (n_populated)
+        fprintf(stderr, "[cgroup_faker] event to populated: mean %.1f us, p50 <%.0f us, "
+                "p99 <%.0f us, max %.1f us\n", latency_total_ns / 1000.0 / n_populated,
+                percentile_us(0.50), percentile_us(0.99), latency_max_ns / 1000.0);
+}
+
+// Create whichever controller files dirfd lacks. Returns how many it made.
+static int populate(int dirfd) {
+    int created = 0;
+    for (size_t i = 0; i < N_CGROUP_FILES; i++) {
+        int fd = openat(dirfd, cgroup_files[i].name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd < 0)
+            continue;  // EEXIST: the kernel, or an earlier pass, already made it
+        size_t len = strlen(cgroup_files[i].content);
+        if (write(fd, cgroup_files[i].content, len) != (ssize_t)len)
+            fprintf(stderr, "[cgroup_faker] Short write to %s: %s\n", cgroup_files[i].name, strerror(errno));
+        close(fd);
+        created++;
+    }
+    n_files_created += created;
+    return created;
+}
+
+static void watch_tree(const char *path, int dirfd);
+
+// Remember path under wd; the kernel reuses a wd for the same inode
+static void set_watch_path(int wd, const char *path) {
+    if (wd >= n_watch_paths) {
+        int n = n_watch_paths ? n_watch_paths : 64;
+        while (n <= wd)
+            n *= 2;
+        char **grown = realloc(watch_paths, n * sizeof(*grown));
+        if (!grown) {
+            fprintf(stderr, "[cgroup_faker] Out of memory tracking %s\n", path);
+            return;
+        }
+        memset(grown + n_watch_paths, 0, (n - n_watch_paths) * sizeof(*grown));
+        watch_paths = grown;
+        n_watch_paths = n;
+    }
+    n_watches += !watch_paths[wd];
+    free(watch_paths[wd]);
+    watch_paths[wd] = strdup(path);
+}
+
+// Watch dirfd (at path) and everything below it, populating each
+// subdirectory on the way. Takes ownership of dirfd.
+static void watch_tree(const char *path, int dirfd) {
+    int wd = inotify_add_watch(inotify_fd, path, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0) {
+        if (errno != ENOENT)  // Removed again already
+            fprintf(stderr, "[cgroup_faker] Can't watch %s: %s\n", path, strerror(errno));
+        close(dirfd);
+        return;
+    }
+    set_watch_path(wd, path);
+
+    DIR *d = fdopendir(dirfd);
+    if (!d) {
+        close(dirfd);
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_type != DT_DIR && de->d_type != DT_UNKNOWN)
+            continue;
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        int sub = openat(dirfd, de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (sub < 0)
+            continue;
+        char subpath[PATH_MAX];
+        snprintf(subpath, sizeof(subpath), "%s/%s", path, de->d_name);
+        populate(sub);
+        watch_tree(subpath, sub);
+    }
+    closedir(d);
+}
+
+// A directory appeared under a watched one: fill it, then watch it
+static void new_directory(const char *parent, const char *name, long long seen_ns) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", parent, name);
+
+    int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        return;  // Already gone again
+    int created = populate(dirfd);
+    long long ns = monotonic_ns() - seen_ns;
+    record_latency(ns);
+    if (verbose)
+        fprintf(stderr, "[cgroup_faker] %s: %d files in %.1f us\n", path, created, ns / 1000.0);
+
+    watch_tree(path, dirfd);
+}
+
+// Events were lost: go over every watched tree again
+static void rescan(void) {
+    n_overflows++;
+    fprintf(stderr, "[cgroup_faker] Event queue overflowed, rescanning\n");
+    for (int wd = 0; wd < n_watch_paths; wd++) {
+        if (!watch_paths[wd])
+            continue;
+        char *path = strdup(watch_paths[wd]);
+        int dirfd = path ? open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+        if (dirfd >= 0) {
+            populate(dirfd);
+            watch_tree(path, dirfd);
+        }
+        free(path);
+    }
+}
+
+static void handle_events(const char *buf, ssize_t len) {
+    long long seen_ns = monotonic_ns();
+
+    for (const char *p = buf; p < buf + len;) {
+        const struct inotify_event *ev = (const struct inotify_event *)p;
+        p += sizeof(*ev) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW) {
+            rescan();
+        } else if (ev->mask & IN_IGNORED) {
+            // The directory was removed (or unmounted)
+            if (ev->wd < n_watch_paths && watch_paths[ev->wd]) {
+                n_watches--;
+                free(watch_paths[ev->wd]);
+                watch_paths[ev->wd] = NULL;
+            }
+        } else if ((ev->mask & IN_ISDIR) && ev->len && ev->wd < n_watch_paths && watch_paths[ev->wd]) {
+            new_directory(watch_paths[ev->wd], ev->name, seen_ns);
+        }
+    }
+}
+
+static void handle_signal(int sig) {
+    if (sig == SIGUSR1)
+        report_requested = 1;
+    else
+        running = 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *base = DEFAULT_BASE, *root = DEFAULT_ROOT;
+    char *subsystems = strdup(default_subsystems);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:r:s:v")) != -1) {
+        switch (opt) {
+        case 'b': base = optarg; break;
+        case 'r': root = optarg; break;
+        case 's': free(subsystems); subsystems = strdup(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-b base] [-r root] [-s subsystem,...] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0 || !subsystems) {
+        perror("inotify_init1");
+        return 1;
+    }
+    umask(0);  // Files come out 0666 without a chmod each
+
+    // Populate and watch whatever exists already
+    int trees = 0;
+    long long start = monotonic_ns();
+    for (char *save, *s = strtok_r(subsystems, ",", &save); s; s = strtok_r(NULL, ",", &save)) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s/%s", base, s, root);
+        int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd < 0)
+            continue;
+        populate(dirfd);
+        watch_tree(path, dirfd);
+        trees++;
+    }
+    if (trees == 0) {
+        fprintf(stderr, "[cgroup_faker] No %s/<subsystem>/%s directories to watch\n", base, root);
+        return 1;
+    }
+    fprintf(stderr, "[cgroup_faker] Watching %d trees, %llu files created at startup in %.1f ms\n",
+            trees, n_files_created, (monotonic_ns() - start) / 1e6);
+
+    struct sigaction sa = { .sa_handler = handle_signal };  // No SA_RESTART: read() returns
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    static char buf[EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (running) {
+        ssize_t len = read(inotify_fd, buf, sizeof(buf));
+        if (len > 0)
+            handle_events(buf, len);
+        else if (len < 0 && errno != EINTR)
+            break;
+        if (report_requested) {
+            report_requested = 0;
+            report();
+        }
+    }
+
+    report();
+    return 0;
+}
@@ -0,0 +1,325 @@
+/*
+ * Data-plane cost of the netlink interposer
+ *
+ * Drives loopback UDP and TCP traffic through every socket I/O entry point
+ * netlink_intercept_v3 hooks (sendto/recvfrom, send/recv, sendmsg/recvmsg,
+ * sendmmsg/recvmmsg) and reports operations per second. With -p each
+ * repeat runs the workloads in two fresh processes, without and with the
+ * library preloaded, alternating so host noise hits both sides alike; the
+ * best of each side is compared.
+ *
+ * Build: gcc -O2 -Wall bench_socket_io.c -o bench_socket_io
+ * Usage: ./bench_socket_io [-n iterations] [-r repeats] [-p netlink_intercept_v3.so]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define DGRAM_SIZE 64
+#define BATCH 32
+#define TCP_CHUNK 4096
+#define MAX_WORKLOADS 8
+#define CHILD_ENV "BENCH_SOCKET_IO_CHILD"
+
+static long iterations = 200000;
+static int repeats = 3;
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    double (*run)(long n);  // Returns operations per second
+} workload_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+// Two UDP sockets on 127.0.0.1 connected to each other
+static void udp_pair(int fds[2], struct sockaddr_in addrs[2]) {
+    for (int i = 0; i < 2; i++) {
+        socklen_t len = sizeof(addrs[i]);
+        addrs[i] = (struct sockaddr_in){ .sin_family = AF_INET,
+                                         .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        if ((fds[i] = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+            bind(fds[i], (struct sockaddr *)&addrs[i], sizeof(addrs[i])) < 0 ||
+            getsockname(fds[i], (struct sockaddr *)&addrs[i], &len) < 0)
+            die("udp socket");
+    }
+    if (connect(fds[0], (struct sockaddr *)&addrs[1], sizeof(addrs[1])) < 0 ||
+        connect(fds[1], (struct sockaddr *)&addrs[0], sizeof(addrs[0])) < 0)
+        die("udp connect");
+}
+
+static double udp_sendto_recvfrom(long n) {
+    int fds[2];
+    struct sockaddr_in addrs[2];
+    char buf[DGRAM_SIZE] = { 0 };
+    udp_pair(fds, addrs);
+
+    double start = now_sec();
+    for (long i = 0; i < n; i++) {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        if (sendto(fds[0], buf, sizeof(buf), 0, (struct sockaddr *)&addrs[1], sizeof(addrs[1])) < 0 ||
+            recvfrom(fds[1], buf, sizeof(buf), 0, (struct sockaddr *)&from, &len) < 0)
+            die("sendto/recvfrom");
+    }
+    double elapsed = now_sec() - start;
+    close(fds[0]);
+    close(fds[1]);
+    return n / elapsed;
+}
+
+static double udp_send_recv(long n) {
+    int fds[2];
+    struct sockaddr_in addrs[2];
+    char buf[DGRAM_SIZE] = { 0 };
+    udp_pair(fds, addrs);
+
+    double start = now_sec();
+    for (long i = 0; i < n; i++)
+        if (send(fds[0], buf, sizeof(buf), 0) < 0 || recv(fds[1], buf, sizeof(buf), 0) < 0)
+            die("send/recv");
+    double elapsed = now_sec() - start;
+    close(fds[0]);
+    close(fds[1]);
+    return n / elapsed;
+}
+
+static double udp_sendmsg_recvmsg(long n) {
+    int fds[2];
+    struct sockaddr_in addrs[2];
+    char buf[DGRAM_SIZE] = { 0 };
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    udp_pair(fds, addrs);
+
+    double start = now_sec();
+    for (long i = 0; i < n; i++)
+        if (sendmsg(fds[0], &msg, 0) < 0 || recvmsg(fds[1], &msg, 0) < 0)
+            die("sendmsg/recvmsg");
+    double elapsed = now_sec() - start;
+    close(fds[0]);
+    close(fds[1]);
+    return n / elapsed;
+}
+
+static double udp_sendmmsg_recvmmsg(long n) {
+    int fds[2];
+    struct sockaddr_in addrs[2];
+    char bufs[BATCH][DGRAM_SIZE];
+    struct iovec iov[BATCH];
+    struct mmsghdr msgs[BATCH];
+    udp_pair(fds, addrs);
+
+    memset(bufs, 0, sizeof(bufs));
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BATCH; i++) {
+        iov[i] = (struct iovec){ bufs[i], DGRAM_SIZE };
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    long batches = (n + BATCH - 1) / BATCH;
+    double start = now_sec();
+    for (long i = 0; i < batches; i++) {
+        int sent = sendmmsg(fds[0], msgs, BATCH, 0);
+        if (sent < 0)
+            die("sendmmsg");
+        for (int got = 0; got < sent;) {
+            int r = recvmmsg(fds[1], msgs + got, sent - got, MSG_WAITFORONE, NULL);
+            if (r < 0)
+                die("recvmmsg");
+            got += r;
+        }
+    }
+    double elapsed = now_sec() - start;
+    close(fds[0]);
+    close(fds[1]);
+    return batches * BATCH / elapsed;
+}
+
+// Cheapest path through a hook: no data, the syscall fails with EAGAIN
+static double udp_recv_empty(long n) {
+    int fds[2];
+    struct sockaddr_in addrs[2];
+    char buf[DGRAM_SIZE];
+    udp_pair(fds, addrs);
+
+    double start = now_sec();
+    for (long i = 0; i < n; i++)
+        if (recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT) >= 0 || errno != EAGAIN)
+            die("recv(MSG_DONTWAIT)");
+    double elapsed = now_sec() - start;
+    close(fds[0]);
+    close(fds[1]);
+    return n / elapsed;
+}
+
+static double tcp_send_recv(long n) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    char buf[TCP_CHUNK] = { 0 };
+    int one = 1;
+
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    int cfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0 || cfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(lfd, 1) < 0 || getsockname(lfd, (struct sockaddr *)&addr, &len) < 0 ||
+        connect(cfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        die("tcp socket");
+    int sfd = accept(lfd, NULL, NULL);
+    if (sfd < 0)
+        die("accept");
+    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    double start = now_sec();
+    for (long i = 0; i < n; i++) {
+        if (send(cfd, buf, sizeof(buf), 0) != sizeof(buf))
+            die("send");
+        for (size_t got = 0; got < sizeof(buf);) {
+            ssize_t r = recv(sfd, buf + got, sizeof(buf) - got, 0);
+            if (r <= 0)
+                die("recv");
+            got += r;
+        }
+    }
+    double elapsed = now_sec() - start;
+    close(sfd);
+    close(cfd);
+    close(lfd);
+    return n * (double)TCP_CHUNK / elapsed / (1 << 20);
+}
+
+static const workload_t workloads[] = {
+    { "udp sendto/recvfrom", "ops/s", udp_sendto_recvfrom },
+    { "udp send/recv", "ops/s", udp_send_recv },
+    { "udp sendmsg/recvmsg", "ops/s", udp_sendmsg_recvmsg },
+    { "udp sendmmsg/recvmmsg", "ops/s", udp_sendmmsg_recvmmsg },
+    { "udp recv EAGAIN", "ops/s", udp_recv_empty },
+    { "tcp send/recv 4K", "MiB/s", tcp_send_recv },
+};
+#define N_WORKLOADS (int)(sizeof(workloads) / sizeof(workloads[0]))
+
+// Best of the repeats, after one untimed warm-up pass
+static void run_all(double results[]) {
+    for (int w = 0; w < N_WORKLOADS; w++) {
+        workloads[w].run(iterations / 10 + 1);
+        results[w] = 0;
+        for (int r = 0; r < repeats; r++) {
+            double v = workloads[w].run(iterations);
+            if (v > results[w])
+                results[w] = v;
+        }
+    }
+}
+
+// Re-run this binary in a fresh process for one repeat, optionally with a
+// preload, and fold its results into the best seen so far
+static int run_child(const char *argv0, const char *preload, double best[]) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0)
+        die("pipe");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        die("fork");
+    if (pid == 0) {
+        char iters[32];
+        snprintf(iters, sizeof(iters), "%ld", iterations);
+        dup2(pipefd[1], STDOUT_FILENO);
+        close(pipefd[0]);
+        setenv(CHILD_ENV, "1", 1);
+        if (preload)
+            setenv("LD_PRELOAD", preload, 1);
+        else
+            unsetenv("LD_PRELOAD");
+        execl("/proc/self/exe", argv0, "-n", iters, "-r", "1", (char *)NULL);
+        _exit(127);
+    }
+
+    close(pipefd[1]);
+    FILE *f = fdopen(pipefd[0], "r");
+    int got = 0;
+    double v;
+    while (got < N_WORKLOADS && fscanf(f, "%lf", &v) == 1) {
+        if (v > best[got])
+            best[got] = v;
+        got++;
+    }
+    fclose(f);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return got == N_WORKLOADS && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *preload = NULL;
+    double unhooked[MAX_WORKLOADS] = { 0 }, hooked[MAX_WORKLOADS] = { 0 };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:p:")) != -1) {
+        switch (opt) {
+        case 'n': iterations = atol(optarg); break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'p': preload = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n iterations] [-r repeats] [-p preload.so]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations <= 0 || repeats <= 0) {
+        fprintf(stderr, "iterations and repeats must be positive\n");
+        return 1;
+    }
+
+    if (getenv(CHILD_ENV)) {
+        run_all(unhooked);
+        for (int w = 0; w < N_WORKLOADS; w++)
+            printf("%.1f\n", unhooked[w]);
+        return 0;
+    }
+
+    if (!preload) {
+        run_all(unhooked);
+        for (int w = 0; w < N_WORKLOADS; w++)
+            printf("%-24s %12.0f %s\n", workloads[w].name, unhooked[w], workloads[w].unit);
+        return 0;
+    }
+
+    if (access(preload, R_OK) != 0) {
+        perror(preload);
+        return 1;
+    }
+    printf("%ld iterations, best of %d, preload %s\n\n", iterations, repeats, preload);
+    for (int r = 0; r < repeats; r++) {
+        if (run_child(argv[0], NULL, unhooked) < 0 || run_child(argv[0], preload, hooked) < 0) {
+            fprintf(stderr, "Benchmark child failed\n");
+            return 1;
+        }
+    }
+
+    printf("%-24s %12s %12s %9s\n", "workload", "unhooked", "hooked", "overhead");
+    for (int w = 0; w < N_WORKLOADS; w++)
+        printf("%-24s %12.0f %12.0f %8.1f%%   (%s)\n", workloads[w].name, unhooked[w], hooked[w],
+               100.0 * (unhooked[w] - hooked[w]) / unhooked[w], workloads[w].unit);
+    return 0;
+}
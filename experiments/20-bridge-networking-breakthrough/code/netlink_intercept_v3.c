@@ -1,95 +1,417 @@
 // Ultimate LD_PRELOAD library for Docker bridge networking in gVisor
-// Intercepts netlink AND ioctl operations to fake bridge interface support
+// Intercepts netlink AND ioctl operations to fake bridge interface support:
+// bridges it sees created are modelled in memory and queries about them
+// answered locally, repeated rtnetlink dumps are served from a cache, and
+// multicast subscriptions the kernel refuses are emulated
+//
+// Netlink calls and what each feature answered are published per process
+// to the live stats segment read by ../../37-live-stats/intercept_top
+// (INTERCEPT_STATS=off disables); the non-netlink fast path isn't counted
 
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
 #include <dlfcn.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/if.h>
+#include <linux/if_arp.h>
+#include <linux/if_bridge.h>
+#include <linux/if_ether.h>
 #include <linux/sockios.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/close_range.h>
+#include "../../37-live-stats/intercept_stats.h"
 
-// Original functions
-static int (*real_socket)(int, int, int) = NULL;
-static int (*real_bind)(int, const struct sockaddr *, socklen_t) = NULL;
-static int (*real_setsockopt)(int, int, int, const void *, socklen_t) = NULL;
-static int (*real_ioctl)(int, unsigned long, ...) = NULL;
-static ssize_t (*real_sendto)(int, const void *, size_t, int, const struct sockaddr *, socklen_t) = NULL;
-static ssize_t (*real_recvfrom)(int, void *, size_t, int, struct sockaddr *, socklen_t *) = NULL;
+// Rules as published to the live stats segment
+enum { RULE_DUMP_CACHE, RULE_LINK_TABLE, RULE_LINK_IOCTL, RULE_MULTICAST, RULE_COUNT };
+
+static const char *rule_names[RULE_COUNT] = { "dump-cache", "link-table", "link-ioctl", "multicast" };
+
+// Original functions, resolved once by the constructor into a page of
+// their own that is then sealed read-only, so each hook's fast path is a
+// single load of a pointer that never shares a cache line with writes.
+// The netlink fd bitmap's address and size live in the same page.
+#define REAL_TABLE_SIZE 4096
+#define FD_WORD_BITS (8 * sizeof(unsigned long))
+
+static union {
+    struct {
+        struct {
+            int (*socket)(int, int, int);
+            int (*bind)(int, const struct sockaddr *, socklen_t);
+            int (*getsockname)(int, struct sockaddr *, socklen_t *);
+            int (*setsockopt)(int, int, int, const void *, socklen_t);
+            int (*ioctl)(int, unsigned long, ...);
+            ssize_t (*sendto)(int, const void *, size_t, int, const struct sockaddr *, socklen_t);
+            ssize_t (*recvfrom)(int, void *, size_t, int, struct sockaddr *, socklen_t *);
+            ssize_t (*send)(int, const void *, size_t, int);
+            ssize_t (*recv)(int, void *, size_t, int);
+            ssize_t (*sendmsg)(int, const struct msghdr *, int);
+            ssize_t (*recvmsg)(int, struct msghdr *, int);
+            int (*sendmmsg)(int, struct mmsghdr *, unsigned int, int);
+            int (*recvmmsg)(int, struct mmsghdr *, unsigned int, int, struct timespec *);
+            ssize_t (*__recv_chk)(int, void *, size_t, size_t, int);
+            ssize_t (*__recvfrom_chk)(int, void *, size_t, size_t, int, struct sockaddr *, socklen_t *);
+            int (*close)(int);
+            int (*dup)(int);
+            int (*dup2)(int, int);
+            int (*dup3)(int, int, int);
+            int (*fcntl)(int, int, ...);
+            int (*fcntl64)(int, int, ...);
+            int (*accept)(int, struct sockaddr *, socklen_t *);
+            int (*accept4)(int, struct sockaddr *, socklen_t *, int);
+            int (*socketpair)(int, int, int, int[2]);
+            int (*close_range)(unsigned int, unsigned int, int);
+            ssize_t (*read)(int, void *, size_t);
+            ssize_t (*__read_chk)(int, void *, size_t, size_t);
+            int (*poll)(struct pollfd *, nfds_t, int);
+            int (*ppoll)(struct pollfd *, nfds_t, const struct timespec *, const sigset_t *);
+            int (*__poll_chk)(struct pollfd *, nfds_t, int, size_t);
+            int (*__ppoll_chk)(struct pollfd *, nfds_t, const struct timespec *, const sigset_t *, size_t);
+            int (*epoll_ctl)(int, int, int, struct epoll_event *);
+        } fn;
+        unsigned long *netlink_fds;     // One bit per possible fd
+        unsigned long *rtnl_fds;        // Subset that is NETLINK_ROUTE
+        unsigned long netlink_fds_max;  // Bits in each map (fs.nr_open)
+    };
+    char page[REAL_TABLE_SIZE];
+} real_table __attribute__((aligned(REAL_TABLE_SIZE)));
+
+// Slow path for a hook that fires before init() has finished (another
+// library's constructor, or another thread while init() runs). Only
+// init() writes the table: a store here could land after it sealed the
+// page and fault.
+static void *resolve_early(const char *name) {
+    void *func = dlsym(RTLD_NEXT, name);
+    if (!func) {
+        fprintf(stderr, "[netlink_v3] Failed to get %s: %s\n", name, dlerror());
+        exit(1);
+    }
+    return func;
+}
+
+#define REAL(name) ({ \
+    __typeof__(real_table.fn.name) f_ = __atomic_load_n(&real_table.fn.name, __ATOMIC_RELAXED); \
+    if (__builtin_expect(f_ == NULL, 0)) \
+        f_ = (__typeof__(f_))resolve_early(#name); \
+    f_; })
+
+#define RESOLVE(name) \
+    __atomic_store_n(&real_table.fn.name, \
+                     (__typeof__(real_table.fn.name))dlsym(RTLD_NEXT, #name), __ATOMIC_RELAXED)
+
+// Map a bitmap covering every fd the kernel can hand out. MAP_NORESERVE
+// pages are only backed once written, so the table grows with the fds
+// actually marked: 1M fds cost 128 KiB of address space and one page per
+// 32768-fd range that ever held a netlink socket.
+static void netlink_fds_init(void) {
+    unsigned long max = 1UL << 20;
+    FILE *f = fopen("/proc/sys/fs/nr_open", "r");
+    if (f) {
+        if (fscanf(f, "%lu", &max) != 1 || max == 0)
+            max = 1UL << 20;
+        fclose(f);
+    }
+    max = (max + FD_WORD_BITS - 1) & ~(FD_WORD_BITS - 1);
+
+    void *map = mmap(NULL, 2 * max / 8, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "[netlink_v3] Can't map fd bitmap: %s\n", strerror(errno));
+        return;
+    }
+    real_table.netlink_fds = map;
+    real_table.rtnl_fds = real_table.netlink_fds + max / FD_WORD_BITS;
+    real_table.netlink_fds_max = max;
+}
+
+// The per-call check: one relaxed load of the fd's bitmap word
+static inline int test_fd_bit(unsigned long *map, int fd) {
+    return (unsigned long)fd < real_table.netlink_fds_max &&
+           ((__atomic_load_n(&map[fd / FD_WORD_BITS], __ATOMIC_RELAXED) >>
+             (fd % FD_WORD_BITS)) & 1);
+}
+
+#define is_netlink_fd(fd) test_fd_bit(real_table.netlink_fds, fd)
+#define is_rtnl_fd(fd) test_fd_bit(real_table.rtnl_fds, fd)
+
+static void set_fd_bit(unsigned long *map, int fd, int on) {
+    if ((unsigned long)fd >= real_table.netlink_fds_max)
+        return;
+    unsigned long bit = 1UL << (fd % FD_WORD_BITS);
+    unsigned long *word = &map[fd / FD_WORD_BITS];
+
+    // Skip the write (and the page fault) for the common non-netlink case
+    if (!on && !(__atomic_load_n(word, __ATOMIC_RELAXED) & bit))
+        return;
+    if (on)
+        __atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_and(word, ~bit, __ATOMIC_RELAXED);
+}
+
+static void sub_forget(int fd);
+static void dump_cache_drop_fd(int fd);
+
+// fd no longer names the netlink socket it did: drop the dump being
+// recorded or replayed on it and its subscription, so neither can reach
+// whatever reuses the number
+static void forget_netlink_fd(int fd) {
+    if (is_netlink_fd(fd))
+        dump_cache_drop_fd(fd);
+    if (is_rtnl_fd(fd))
+        sub_forget(fd);
+}
+
+// Record what kind of socket fd is: protocol is a NETLINK_* number, or
+// -1 for anything that isn't netlink
+static void set_netlink_fd(int fd, int protocol) {
+    forget_netlink_fd(fd);
+    set_fd_bit(real_table.netlink_fds, fd, protocol >= 0);
+    set_fd_bit(real_table.rtnl_fds, fd, protocol == NETLINK_ROUTE);
+}
+
+static void copy_netlink_fd(int newfd, int oldfd) {
+    forget_netlink_fd(newfd);
+    set_fd_bit(real_table.netlink_fds, newfd, is_netlink_fd(oldfd));
+    set_fd_bit(real_table.rtnl_fds, newfd, is_rtnl_fd(oldfd));
+}
+
+static void dump_cache_init(void);
+static void sub_init(void);
+static int sub_subscribe(int fd, uint64_t groups);
+static void sub_unsubscribe(int fd, uint64_t groups);
+static int sub_getsockname(int fd, struct sockaddr *addr, socklen_t *addrlen);
+static int link_ioctl(int fd, unsigned long request, void *argp);
+static void link_table_atfork_child(void);
 
 static void init() __attribute__((constructor));
 static void init() {
-    real_socket = dlsym(RTLD_NEXT, "socket");
-    real_bind = dlsym(RTLD_NEXT, "bind");
-    real_setsockopt = dlsym(RTLD_NEXT, "setsockopt");
-    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
-    real_sendto = dlsym(RTLD_NEXT, "sendto");
-    real_recvfrom = dlsym(RTLD_NEXT, "recvfrom");
+    RESOLVE(socket);
+    RESOLVE(bind);
+    RESOLVE(getsockname);
+    RESOLVE(setsockopt);
+    RESOLVE(ioctl);
+    RESOLVE(sendto);
+    RESOLVE(recvfrom);
+    RESOLVE(send);
+    RESOLVE(recv);
+    RESOLVE(sendmsg);
+    RESOLVE(recvmsg);
+    RESOLVE(sendmmsg);
+    RESOLVE(recvmmsg);
+    RESOLVE(__recv_chk);
+    RESOLVE(__recvfrom_chk);
+    RESOLVE(close);
+    RESOLVE(dup);
+    RESOLVE(dup2);
+    RESOLVE(dup3);
+    RESOLVE(fcntl);
+    RESOLVE(fcntl64);
+    RESOLVE(accept);
+    RESOLVE(accept4);
+    RESOLVE(socketpair);
+    RESOLVE(close_range);
+    RESOLVE(read);
+    RESOLVE(__read_chk);
+    RESOLVE(poll);
+    RESOLVE(ppoll);
+    RESOLVE(__poll_chk);
+    RESOLVE(__ppoll_chk);
+    RESOLVE(epoll_ctl);
+    netlink_fds_init();
+    dump_cache_init();
+    sub_init();
+    pthread_atfork(NULL, NULL, link_table_atfork_child);
+    istats_open("netlink", rule_names, RULE_COUNT, 1);
+
+    // Best effort: fails harmlessly where pages are larger than 4 KiB
+    mprotect(&real_table, sizeof(real_table), PROT_READ);
 
     fprintf(stderr, "[netlink_v3] Ultimate netlink+ioctl interceptor loaded\n");
 }
 
-// Track netlink sockets
-static int is_netlink_fd[1024] = {0};
-
 // Intercept socket() to track netlink sockets
 int socket(int domain, int type, int protocol) {
-    int fd = real_socket(domain, type, protocol);
+    int fd = REAL(socket)(domain, type, protocol);
 
-    if (fd >= 0 && domain == AF_NETLINK) {
-        if (fd < 1024) {
-            is_netlink_fd[fd] = 1;
+    if (fd >= 0) {
+        // Also clears a stale bit left by an fd closed behind our back
+        set_netlink_fd(fd, domain == AF_NETLINK ? protocol : -1);
+        if (domain == AF_NETLINK)
             fprintf(stderr, "[netlink_v3] Created netlink socket fd=%d\n", fd);
-        }
     }
 
     return fd;
 }
 
+// fd-duplicating calls: the new fd is netlink iff the old one was
+int dup(int oldfd) {
+    int fd = REAL(dup)(oldfd);
+    if (fd >= 0)
+        copy_netlink_fd(fd, oldfd);
+    return fd;
+}
+
+int dup2(int oldfd, int newfd) {
+    int fd = REAL(dup2)(oldfd, newfd);
+    if (fd >= 0 && fd != oldfd)
+        copy_netlink_fd(fd, oldfd);
+    return fd;
+}
+
+int dup3(int oldfd, int newfd, int flags) {
+    int fd = REAL(dup3)(oldfd, newfd, flags);
+    if (fd >= 0)
+        copy_netlink_fd(fd, oldfd);
+    return fd;
+}
+
+#define DEFINE_FCNTL_HOOK(name) \
+    int name(int fd, int cmd, ...) { \
+        va_list args; \
+        va_start(args, cmd); \
+        void *arg = va_arg(args, void *); \
+        va_end(args); \
+        int result = REAL(name)(fd, cmd, arg); \
+        if (result >= 0 && (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC)) \
+            copy_netlink_fd(result, fd); \
+        return result; \
+    }
+
+DEFINE_FCNTL_HOOK(fcntl)
+DEFINE_FCNTL_HOOK(fcntl64)
+
+// Calls that create non-netlink fds, clearing any stale bit
+int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+    int fd = REAL(accept)(sockfd, addr, addrlen);
+    if (fd >= 0)
+        set_netlink_fd(fd, -1);
+    return fd;
+}
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    int fd = REAL(accept4)(sockfd, addr, addrlen, flags);
+    if (fd >= 0)
+        set_netlink_fd(fd, -1);
+    return fd;
+}
+
+int socketpair(int domain, int type, int protocol, int sv[2]) {
+    int result = REAL(socketpair)(domain, type, protocol, sv);
+    if (result == 0) {
+        set_netlink_fd(sv[0], -1);
+        set_netlink_fd(sv[1], -1);
+    }
+    return result;
+}
+
+// Only the netlink fds in the range need forgetting: walk the bitmap a word
+// at a time, so close_range(3, ~0U, 0) doesn't visit a million fds
+int close_range(unsigned int first, unsigned int last, int flags) {
+    int result = REAL(close_range)(first, last, flags);
+    if (result != 0 || (flags & CLOSE_RANGE_CLOEXEC) || first >= real_table.netlink_fds_max)
+        return result;
+    if (last >= real_table.netlink_fds_max)
+        last = real_table.netlink_fds_max - 1;
+
+    for (unsigned long w = first / FD_WORD_BITS; w <= last / FD_WORD_BITS; w++) {
+        unsigned long word = __atomic_load_n(&real_table.netlink_fds[w], __ATOMIC_RELAXED);
+        while (word) {
+            unsigned long fd = w * FD_WORD_BITS + __builtin_ctzl(word);
+            word &= word - 1;
+            if (fd >= first && fd <= last)
+                set_netlink_fd(fd, -1);
+        }
+    }
+    return result;
+}
+
+static int sub_emulate_always;  // NETLINK_EMULATE_GROUPS=1: don't ask the kernel first
+
 // Intercept bind() for netlink sockets
 int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-    if (sockfd < 1024 && is_netlink_fd[sockfd] && addr && addr->sa_family == AF_NETLINK) {
+    if (is_netlink_fd(sockfd) && addr && addr->sa_family == AF_NETLINK) {
         struct sockaddr_nl *nl_addr = (struct sockaddr_nl *)addr;
 
         fprintf(stderr, "[netlink_v3] bind() on netlink fd=%d, groups=0x%x\n", sockfd, nl_addr->nl_groups);
 
-        // If trying to subscribe to any multicast group, fake success
+        // Multicast groups: the kernel's if it takes them, emulated if not
         if (nl_addr->nl_groups != 0) {
-            fprintf(stderr, "[netlink_v3] Intercepting multicast subscription - faking success\n");
+            if (!sub_emulate_always && REAL(bind)(sockfd, addr, addrlen) == 0)
+                return 0;
+            fprintf(stderr, "[netlink_v3] Intercepting multicast subscription - emulating it\n");
 
             // Clear groups and do minimal bind
             struct sockaddr_nl safe_addr = *nl_addr;
             safe_addr.nl_groups = 0;
 
-            real_bind(sockfd, (struct sockaddr*)&safe_addr, addrlen);
+            REAL(bind)(sockfd, (struct sockaddr*)&safe_addr, addrlen);
+            if (is_rtnl_fd(sockfd))
+                sub_subscribe(sockfd, nl_addr->nl_groups);
 
             // Always return success
             return 0;
         }
     }
 
-    return real_bind(sockfd, addr, addrlen);
+    return REAL(bind)(sockfd, addr, addrlen);
 }
 
-// Intercept setsockopt for netlink
+// Intercept setsockopt for netlink. Group membership changes the kernel
+// refuses are emulated like groups passed to bind(); anything else is
+// faked.
 int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
-    if (sockfd < 1024 && is_netlink_fd[sockfd]) {
+    if (is_netlink_fd(sockfd)) {
+        if (level == SOL_NETLINK && is_rtnl_fd(sockfd) && optval && optlen >= sizeof(int) &&
+            (optname == NETLINK_ADD_MEMBERSHIP || optname == NETLINK_DROP_MEMBERSHIP)) {
+            unsigned int group;
+            memcpy(&group, optval, sizeof(group));
+            if (!sub_emulate_always &&
+                REAL(setsockopt)(sockfd, level, optname, optval, optlen) == 0)
+                return 0;
+            if (group < 1 || group > 64) {
+                errno = EINVAL;
+                return -1;
+            }
+            fprintf(stderr, "[netlink_v3] %s group %u on fd=%d - emulating it\n",
+                    optname == NETLINK_ADD_MEMBERSHIP ? "Joining" : "Leaving", group, sockfd);
+            if (optname == NETLINK_ADD_MEMBERSHIP)
+                sub_subscribe(sockfd, 1ULL << (group - 1));
+            else
+                sub_unsubscribe(sockfd, 1ULL << (group - 1));
+            return 0;
+        }
         fprintf(stderr, "[netlink_v3] setsockopt() on netlink fd=%d, level=%d, optname=%d - faking success\n",
                 sockfd, level, optname);
         return 0; // Fake success
     }
 
-    return real_setsockopt(sockfd, level, optname, optval, optlen);
+    return REAL(setsockopt)(sockfd, level, optname, optval, optlen);
 }
 
-// Intercept ioctl - THIS IS THE KEY FOR BRIDGE DETECTION
+int getsockname(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+    if (is_rtnl_fd(sockfd))
+        return sub_getsockname(sockfd, addr, addrlen);
+    return REAL(getsockname)(sockfd, addr, addrlen);
+}
+
+// Intercept ioctl - THIS IS THE KEY FOR BRIDGE DETECTION. Interface and
+// bridge requests about links in the link table are answered from it.
 int ioctl(int fd, unsigned long request, ...) {
     va_list args;
     void *argp;
@@ -98,71 +420,1606 @@ int ioctl(int fd, unsigned long request, ...) {
     argp = va_arg(args, void *);
     va_end(args);
 
-    // Check if this is a bridge-related ioctl
-    if (request == SIOCBRADDBR || request == SIOCBRDELBR ||
-        request == SIOCBRADDIF || request == SIOCBRDELIF) {
+    switch (request) {
+    case SIOCBRADDBR: case SIOCBRDELBR: case SIOCBRADDIF: case SIOCBRDELIF:
+    case SIOCGIFFLAGS: case SIOCSIFFLAGS: case SIOCGIFINDEX: case SIOCGIFMTU:
+    case SIOCSIFMTU: case SIOCGIFHWADDR: case SIOCDEVPRIVATE: {
+        istats_call();
+        int result = link_ioctl(fd, request, argp);
+        if (result != -2) {
+            istats_hit(RULE_LINK_IOCTL);
+            return result;
+        }
+        break;
+    }
+    }
+
+    // Default: pass through
+    return REAL(ioctl)(fd, request, argp);
+}
+
+// Dump cache: kube-proxy, flannel and libnetwork re-dump links, addresses
+// and routes over and over, and inside gVisor every dump is a netstack
+// round trip. The first RTM_GETLINK/GETADDR/GETROUTE dump with a given
+// request body is recorded datagram by datagram as the caller reads it;
+// repeats are answered from the recording, with the caller's seq and port
+// id patched in, without reaching the kernel. Any RTM_NEW*/DEL*/SET* the
+// process sends, or any such notification it receives, drops the cache.
+// NETLINK_DUMP_CACHE_TTL_MS bounds staleness from changes made by other
+// processes (default 1000, 0 disables, negative never expires).
+#define DUMP_CACHE_SLOTS 16
+#define DUMP_KEY_MAX 256         // Request bytes after the nlmsghdr
+#define DUMP_PENDING_MAX 32      // Sockets mid-recording or mid-replay
+#define DUMP_BLOB_MAX (4 << 20)  // Larger dumps (huge route tables) aren't cached
+#define DUMP_SEND_INSPECT 8192   // sendmsg() bytes gathered for parsing
+
+typedef struct {
+    int refs;
+    size_t len;
+    unsigned char data[];    // Datagrams, each prefixed by its uint32_t length
+} dump_blob_t;
+
+typedef struct {
+    uint16_t type, flags;
+    uint32_t len;
+    unsigned char body[DUMP_KEY_MAX];
+} dump_key_t;
+
+typedef struct {
+    dump_key_t key;
+    dump_blob_t *blob;       // NULL when the slot is empty
+    long long stored_ns;
+} dump_entry_t;
+
+enum { DUMP_RECORDING = 1, DUMP_REPLAYING };
+
+typedef struct {
+    int fd;                  // -1 when the slot is free
+    int mode;
+    uint32_t seq;            // Of the request being answered
+    uint32_t portid;         // Replaying: the socket's nl_pid
+    uint32_t generation;     // Recording: cache generation at the miss
+    dump_key_t key;          // Recording: what the result is stored under
+    dump_blob_t *blob;       // Recording: growing; replaying: shared
+    size_t cap;              // Recording: bytes allocated for blob->data
+    size_t off;              // Replaying: next datagram in blob->data
+} dump_pending_t;
+
+static dump_entry_t dump_cache[DUMP_CACHE_SLOTS];
+static dump_pending_t dump_pending[DUMP_PENDING_MAX];
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long dump_ttl_ns = 1000000000LL;
+static uint32_t dump_generation;  // Bumped by invalidation so in-flight recordings are dropped
+static unsigned long long dump_hits, dump_misses, dump_expired, dump_invalidations;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// RTM_NEW*, RTM_DEL* and RTM_SET*; the rtnetlink types come in groups of
+// four starting at RTM_BASE, with GET third
+static int is_rtm_change(uint16_t type) {
+    return type >= RTM_BASE && type <= RTM_MAX && ((type - RTM_BASE) & 3) != 2;
+}
+
+static uint32_t dump_key_hash(const dump_key_t *k) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    h = (h ^ k->type) * 16777619u;
+    h = (h ^ k->flags) * 16777619u;
+    for (uint32_t i = 0; i < k->len; i++)
+        h = (h ^ k->body[i]) * 16777619u;
+    return h % DUMP_CACHE_SLOTS;
+}
+
+static int dump_key_eq(const dump_key_t *a, const dump_key_t *b) {
+    return a->type == b->type && a->flags == b->flags && a->len == b->len &&
+           memcmp(a->body, b->body, a->len) == 0;
+}
+
+static void dump_blob_put(dump_blob_t *blob) {
+    if (blob && --blob->refs == 0)
+        free(blob);
+}
+
+static dump_pending_t *dump_find_pending(int fd) {
+    for (int i = 0; i < DUMP_PENDING_MAX; i++)
+        if (dump_pending[i].fd == fd)
+            return &dump_pending[i];
+    return NULL;
+}
+
+static void dump_release_pending(dump_pending_t *p) {
+    dump_blob_put(p->blob);
+    p->blob = NULL;
+    p->fd = -1;
+}
+
+static void dump_invalidate_locked(void) {
+    for (int i = 0; i < DUMP_CACHE_SLOTS; i++) {
+        dump_blob_put(dump_cache[i].blob);
+        dump_cache[i].blob = NULL;
+    }
+    dump_generation++;
+    dump_invalidations++;
+}
+
+// A change answered without reaching dump_cache_send()
+static void dump_cache_invalidate(void) {
+    if (dump_ttl_ns == 0)
+        return;
+    pthread_mutex_lock(&dump_lock);
+    dump_invalidate_locked();
+    pthread_mutex_unlock(&dump_lock);
+}
+
+// The socket's port id, which replies must carry. An unbound socket is
+// bound the way the kernel would autobind it on its first send.
+static uint32_t netlink_portid(int fd) {
+    struct sockaddr_nl nl;
+    socklen_t len = sizeof(nl);
+    if (REAL(getsockname)(fd, (struct sockaddr *)&nl, &len) < 0 || nl.nl_family != AF_NETLINK)
+        return 0;
+    if (nl.nl_pid == 0) {
+        struct sockaddr_nl any = { .nl_family = AF_NETLINK };
+        len = sizeof(nl);
+        if (REAL(bind)(fd, (struct sockaddr *)&any, sizeof(any)) < 0 ||
+            REAL(getsockname)(fd, (struct sockaddr *)&nl, &len) < 0)
+            return 0;
+    }
+    return nl.nl_pid;
+}
+
+// Look at an outgoing rtnetlink buffer (len of its total bytes are in
+// buf). Returns 1 when the request was answered from the cache and must
+// not be sent, 0 to send it for real.
+static int dump_cache_send(int fd, const void *buf, size_t len, size_t total) {
+    if (dump_ttl_ns == 0)
+        return 0;
 
-        fprintf(stderr, "[netlink_v3] Intercepted bridge ioctl request=0x%lx\n", request);
+    const struct nlmsghdr *nlh = buf;
+    const struct nlmsghdr *dump = NULL;
+    int changes = total > len;  // Too big to inspect: assume it changes something
+    int left = len, count = 0;
 
-        // Let bridge operations through - they should work
-        return real_ioctl(fd, request, argp);
+    // iproute2 sends its whole request struct, so trailing bytes that
+    // don't parse as a message are ignored rather than rejected
+    for (; NLMSG_OK(nlh, left); nlh = NLMSG_NEXT(nlh, left), count++) {
+        if (is_rtm_change(nlh->nlmsg_type))
+            changes = 1;
+        else if (count == 0 && (nlh->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP &&
+                 (nlh->nlmsg_type == RTM_GETLINK || nlh->nlmsg_type == RTM_GETADDR ||
+                  nlh->nlmsg_type == RTM_GETROUTE) &&
+                 nlh->nlmsg_len - NLMSG_HDRLEN <= DUMP_KEY_MAX)
+            dump = nlh;
     }
+    if (count != 1)
+        dump = NULL;  // Only a lone dump request can be answered locally
 
-    // Check if this is checking if an interface is a bridge (SIOCGIFBR / SIOCDEVPRIVATE)
-    if (request == SIOCDEVPRIVATE || request == SIOCGIFFLAGS) {
-        struct ifreq *ifr = (struct ifreq *)argp;
+    uint32_t portid = dump ? netlink_portid(fd) : 0;
 
-        if (ifr && (strstr(ifr->ifr_name, "docker") || strstr(ifr->ifr_name, "br-"))) {
-            fprintf(stderr, "[netlink_v3] Intercepted interface check for %s - forcing bridge type\n", ifr->ifr_name);
+    pthread_mutex_lock(&dump_lock);
+    dump_pending_t *p = dump_find_pending(fd);
+    if (p)
+        dump_release_pending(p);  // A new request abandons whatever was in flight
+    if (changes)
+        dump_invalidate_locked();
+    if (!dump) {
+        pthread_mutex_unlock(&dump_lock);
+        return 0;
+    }
 
-            // Try the real ioctl
-            int result = real_ioctl(fd, request, argp);
+    dump_key_t key = { .type = dump->nlmsg_type, .flags = dump->nlmsg_flags,
+                       .len = dump->nlmsg_len - NLMSG_HDRLEN };
+    memcpy(key.body, NLMSG_DATA(dump), key.len);
+    dump_entry_t *e = &dump_cache[dump_key_hash(&key)];
+    p = dump_find_pending(-1);
 
-            // If it failed, fake success
-            if (result < 0) {
-                fprintf(stderr, "[netlink_v3] Real ioctl failed, faking success\n");
-                return 0;
+    if (e->blob && dump_key_eq(&e->key, &key) && dump_ttl_ns > 0 &&
+        monotonic_ns() - e->stored_ns > dump_ttl_ns) {
+        dump_blob_put(e->blob);
+        e->blob = NULL;
+        dump_expired++;
+    }
+
+    if (e->blob && dump_key_eq(&e->key, &key) && portid != 0 && p) {
+        *p = (dump_pending_t){ .fd = fd, .mode = DUMP_REPLAYING, .seq = dump->nlmsg_seq,
+                               .portid = portid, .blob = e->blob };
+        e->blob->refs++;
+        dump_hits++;
+        pthread_mutex_unlock(&dump_lock);
+        istats_hit(RULE_DUMP_CACHE);
+        fprintf(stderr, "[netlink_v3] Dump type=%u on fd=%d served from cache\n", key.type, fd);
+        return 1;
+    }
+
+    dump_misses++;
+    if (p)
+        *p = (dump_pending_t){ .fd = fd, .mode = DUMP_RECORDING, .seq = dump->nlmsg_seq,
+                               .generation = dump_generation, .key = key };
+    pthread_mutex_unlock(&dump_lock);
+    return 0;
+}
+
+static void dump_cache_drop_fd(int fd) {
+    pthread_mutex_lock(&dump_lock);
+    dump_pending_t *p = dump_find_pending(fd);
+    if (p)
+        dump_release_pending(p);
+    pthread_mutex_unlock(&dump_lock);
+}
+
+// Append one datagram to a blob being built, allocating it on first use
+static int blob_add(dump_blob_t **blobp, size_t *capp, const void *buf, size_t n) {
+    size_t used = *blobp ? (*blobp)->len : 0;
+    uint32_t len = n;
+
+    if (used + sizeof(len) + n > *capp) {
+        size_t cap = *capp ? *capp : 16384;
+        while (cap < used + sizeof(len) + n)
+            cap *= 2;
+        if (cap > DUMP_BLOB_MAX)
+            return 0;
+        dump_blob_t *blob = realloc(*blobp, sizeof(*blob) + cap);
+        if (!blob)
+            return 0;
+        if (!*blobp) {
+            blob->refs = 1;
+            blob->len = 0;
+        }
+        *blobp = blob;
+        *capp = cap;
+    }
+    memcpy((*blobp)->data + used, &len, sizeof(len));
+    memcpy((*blobp)->data + used + sizeof(len), buf, n);
+    (*blobp)->len += sizeof(len) + n;
+    return 1;
+}
+
+// Feed one datagram the kernel delivered on an rtnetlink socket
+static void dump_cache_record(int fd, const void *buf, size_t n, int truncated) {
+    if (dump_ttl_ns == 0)
+        return;
+
+    const struct nlmsghdr *nlh = buf;
+    int left = n, ours = 0, done = 0, failed = truncated, changes = 0;
+
+    pthread_mutex_lock(&dump_lock);
+    dump_pending_t *p = dump_find_pending(fd);
+    if (p && p->mode != DUMP_RECORDING)
+        p = NULL;
+
+    for (; NLMSG_OK(nlh, left); nlh = NLMSG_NEXT(nlh, left)) {
+        if (nlh->nlmsg_seq == 0 && is_rtm_change(nlh->nlmsg_type))
+            changes = 1;  // Multicast notification
+        if (p && nlh->nlmsg_seq == p->seq) {
+            ours = 1;
+            done |= nlh->nlmsg_type == NLMSG_DONE;
+            failed |= nlh->nlmsg_type == NLMSG_ERROR;
+        }
+    }
+
+    if (changes)
+        dump_invalidate_locked();
+    if (p && ours) {
+        if (failed || !blob_add(&p->blob, &p->cap, buf, n)) {
+            dump_release_pending(p);
+        } else if (done) {
+            if (p->generation == dump_generation) {
+                dump_entry_t *e = &dump_cache[dump_key_hash(&p->key)];
+                dump_blob_put(e->blob);
+                e->key = p->key;
+                e->blob = p->blob;
+                e->stored_ns = monotonic_ns();
+                p->blob = NULL;
             }
+            dump_release_pending(p);
+        }
+    }
+    pthread_mutex_unlock(&dump_lock);
+}
 
-            return result;
+// Write n bytes at offset pos of the caller's scatter list, clipped to it
+static void copy_to_iov(const struct iovec *iov, size_t iovlen, size_t pos,
+                        const void *src, size_t n) {
+    for (size_t i = 0; i < iovlen && n > 0; i++) {
+        if (pos >= iov[i].iov_len) {
+            pos -= iov[i].iov_len;
+            continue;
         }
+        size_t chunk = iov[i].iov_len - pos < n ? iov[i].iov_len - pos : n;
+        memcpy((char *)iov[i].iov_base + pos, src, chunk);
+        src = (const char *)src + chunk;
+        n -= chunk;
+        pos = 0;
     }
+}
 
-    // Default: pass through
-    return real_ioctl(fd, request, argp);
+// Serve the next recorded datagram if fd is replaying a cached dump.
+// Returns -2 when it isn't, so the caller receives from the kernel.
+static ssize_t dump_cache_replay(int fd, const struct iovec *iov, size_t iovlen, int flags,
+                                 struct sockaddr *src_addr, socklen_t *addrlen, int *msg_flags) {
+    pthread_mutex_lock(&dump_lock);
+    dump_pending_t *p = dump_find_pending(fd);
+    if (!p || p->mode != DUMP_REPLAYING) {
+        pthread_mutex_unlock(&dump_lock);
+        return -2;
+    }
+
+    uint32_t len;
+    memcpy(&len, p->blob->data + p->off, sizeof(len));
+    const unsigned char *dgram = p->blob->data + p->off + sizeof(len);
+    size_t cap = 0;
+    for (size_t i = 0; i < iovlen; i++)
+        cap += iov[i].iov_len;
+
+    copy_to_iov(iov, iovlen, 0, dgram, len);
+    for (size_t off = 0; off + NLMSG_HDRLEN <= len;) {
+        struct nlmsghdr h;
+        memcpy(&h, dgram + off, sizeof(h));
+        copy_to_iov(iov, iovlen, off + offsetof(struct nlmsghdr, nlmsg_seq), &p->seq, sizeof(p->seq));
+        copy_to_iov(iov, iovlen, off + offsetof(struct nlmsghdr, nlmsg_pid), &p->portid, sizeof(p->portid));
+        if (h.nlmsg_len < NLMSG_HDRLEN)
+            break;
+        off += NLMSG_ALIGN(h.nlmsg_len);
+    }
+
+    if (len > cap && msg_flags)
+        *msg_flags |= MSG_TRUNC;
+    if (src_addr && addrlen) {
+        struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+        memcpy(src_addr, &kernel, *addrlen < sizeof(kernel) ? *addrlen : sizeof(kernel));
+        *addrlen = sizeof(kernel);
+    }
+    if (!(flags & MSG_PEEK)) {
+        p->off += sizeof(len) + len;
+        if (p->off >= p->blob->len)
+            dump_release_pending(p);
+    }
+    pthread_mutex_unlock(&dump_lock);
+
+    return (flags & MSG_TRUNC) || len < cap ? (ssize_t)len : (ssize_t)cap;
+}
+
+static void dump_cache_atfork_child(void) {
+    pthread_mutex_init(&dump_lock, NULL);
+}
+
+static void dump_cache_init(void) {
+    const char *ttl = getenv("NETLINK_DUMP_CACHE_TTL_MS");
+    if (ttl)
+        dump_ttl_ns = atoll(ttl) * 1000000LL;
+    for (int i = 0; i < DUMP_PENDING_MAX; i++)
+        dump_pending[i].fd = -1;
+    pthread_atfork(NULL, NULL, dump_cache_atfork_child);
+}
+
+__attribute__((destructor))
+static void release_stats(void) {
+    istats_close();
+}
+
+__attribute__((destructor))
+static void dump_cache_report(void) {
+    unsigned long long total = dump_hits + dump_misses;
+    if (total == 0)
+        return;
+    fprintf(stderr, "[netlink_v3] dump cache: %llu hits, %llu misses (%.1f%% hit rate), "
+            "%llu expired, %llu invalidations\n", dump_hits, dump_misses,
+            100.0 * dump_hits / total, dump_expired, dump_invalidations);
+}
+
+// Multicast subscriptions: gVisor refuses rtnetlink groups, so subscribers
+// used to hear nothing and fell back to polling with full dumps. A socket
+// whose groups the kernel won't take is subscribed here instead. The
+// netlink socket stays on its fd, so requests, replies and any call we
+// don't hook reach the kernel as before; its events queue on a private
+// datagram socketpair. Receiving on the fd takes whichever is ready, and
+// poll(), ppoll() and epoll watch the socketpair alongside it, so waiting
+// for events or for a reply wakes up for both. Changes the process makes
+// through the hooked calls - links created, removed, flagged or enslaved,
+// addresses added or removed - are turned into the RTM_NEWLINK/DELLINK
+// and RTM_NEWADDR/DELADDR notifications the kernel would multicast, and
+// written to every socket subscribed to their group. A change the kernel
+// still has to accept is announced when it acks the request. Only this
+// process's own changes are seen; other processes' changes still need a
+// dump, and select() isn't told about events.
+#define SUB_MAX 16
+#define SUB_PENDING_MAX 16
+#define SUB_MSG_MAX 1024
+#define SUB_WATCH_MAX 32
+#define SUB_POLL_STACK 64    // pollfds poll() copies on the stack; more are malloc()ed
+
+typedef struct {
+    int fd;                  // The subscriber's fd, -1 when the slot is free
+    int wait_fd;             // Where its events queue
+    int event_fd;            // The other end, that events are written to
+    uint64_t groups;         // Bit g - 1 for each RTNLGRP_* g joined
+} sub_t;
+
+typedef struct {
+    int fd;                  // Socket the request went out on, -1 if free
+    uint32_t seq;
+    int group;
+    size_t len;
+    unsigned char msg[SUB_MSG_MAX];
+} sub_pending_t;
+
+// An epoll set watching an rtnetlink socket, kept from before it
+// subscribes: sd-netlink joins groups after adding its socket to epoll
+typedef struct {
+    int epfd;                // -1 when the slot is free
+    int fd;
+    struct epoll_event event;
+} sub_watch_t;
+
+static sub_t subs[SUB_MAX];
+static sub_pending_t sub_pending[SUB_PENDING_MAX];
+static unsigned int sub_pending_next;
+static sub_watch_t sub_watches[SUB_WATCH_MAX];
+static unsigned int sub_watch_next;
+static pthread_mutex_t sub_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sub_count;        // Subscribed sockets; while 0 no I/O hook takes sub_lock
+static unsigned long long sub_events, sub_dropped;
+
+static inline int sub_active(void) {
+    return __atomic_load_n(&sub_count, __ATOMIC_RELAXED) > 0;
+}
+
+static sub_t *sub_find(int fd) {
+    for (int i = 0; i < SUB_MAX; i++)
+        if (subs[i].fd == fd)
+            return &subs[i];
+    return NULL;
+}
+
+// Make epfd watch wait_fd the way the caller asked it to watch the socket,
+// with the caller's data, so its events look like the socket's own
+static void sub_watch_mirror(int epfd, int op, int wait_fd, const struct epoll_event *event) {
+    struct epoll_event ev = { 0 };
+    if (event) {
+        ev = *event;
+        ev.events &= EPOLLIN | EPOLLRDNORM | EPOLLET | EPOLLONESHOT | EPOLLWAKEUP | EPOLLEXCLUSIVE;
+    }
+    REAL(epoll_ctl)(epfd, op, wait_fd, &ev);
+}
+
+// Take over fd's subscription to groups (an nl_groups style mask)
+static int sub_subscribe(int fd, uint64_t groups) {
+    pthread_mutex_lock(&sub_lock);
+    sub_t *s = sub_find(fd);
+    if (s) {
+        s->groups |= groups;
+        pthread_mutex_unlock(&sub_lock);
+        return 0;
+    }
+
+    int pair[2] = { -1, -1 };
+    s = sub_find(-1);
+    if (!s || REAL(socketpair)(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) < 0) {
+        fprintf(stderr, "[netlink_v3] Can't emulate groups on fd=%d: %s\n",
+                fd, s ? strerror(errno) : "too many subscribers");
+        pthread_mutex_unlock(&sub_lock);
+        return -1;
+    }
+
+    // Both are ours: clear any stale bit so no hook treats them as netlink
+    for (int i = 0; i < 2; i++) {
+        set_fd_bit(real_table.netlink_fds, pair[i], 0);
+        set_fd_bit(real_table.rtnl_fds, pair[i], 0);
+    }
+
+    *s = (sub_t){ .fd = fd, .wait_fd = pair[0], .event_fd = pair[1], .groups = groups };
+    for (int i = 0; i < SUB_WATCH_MAX; i++)
+        if (sub_watches[i].epfd >= 0 && sub_watches[i].fd == fd)
+            sub_watch_mirror(sub_watches[i].epfd, EPOLL_CTL_ADD, s->wait_fd, &sub_watches[i].event);
+    __atomic_fetch_add(&sub_count, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&sub_lock);
+    return 0;
+}
+
+// Leaving groups keeps the socketpair in place; the socket just hears less
+static void sub_unsubscribe(int fd, uint64_t groups) {
+    if (!sub_active())
+        return;
+    pthread_mutex_lock(&sub_lock);
+    sub_t *s = sub_find(fd);
+    if (s)
+        s->groups &= ~groups;
+    pthread_mutex_unlock(&sub_lock);
+}
+
+// fd is being closed or replaced: drop its subscription, its epoll
+// registrations and our fds. Closing wait_fd takes it out of epoll sets.
+static void sub_forget(int fd) {
+    pthread_mutex_lock(&sub_lock);
+    for (int i = 0; i < SUB_WATCH_MAX; i++)
+        if (sub_watches[i].fd == fd)
+            sub_watches[i].epfd = -1;
+    sub_t *s = sub_active() ? sub_find(fd) : NULL;
+    if (s) {
+        REAL(close)(s->wait_fd);
+        REAL(close)(s->event_fd);
+        s->fd = -1;
+        __atomic_fetch_sub(&sub_count, 1, __ATOMIC_RELAXED);
+        for (int i = 0; i < SUB_PENDING_MAX; i++)
+            if (sub_pending[i].fd == fd)
+                sub_pending[i].fd = -1;
+    }
+    pthread_mutex_unlock(&sub_lock);
+}
+
+// epfd's watch on rtnetlink socket fd changed (op succeeded): remember it
+// for a later subscription, and mirror it onto the socketpair of a current one
+static void sub_epoll_ctl(int epfd, int op, int fd, const struct epoll_event *event) {
+    pthread_mutex_lock(&sub_lock);
+    sub_watch_t *w = NULL, *free_slot = NULL;
+    for (int i = 0; i < SUB_WATCH_MAX && !w; i++) {
+        if (sub_watches[i].epfd == epfd && sub_watches[i].fd == fd)
+            w = &sub_watches[i];
+        else if (sub_watches[i].epfd < 0 && !free_slot)
+            free_slot = &sub_watches[i];
+    }
+    if (op == EPOLL_CTL_DEL) {
+        if (w)
+            w->epfd = -1;
+    } else if (event) {
+        // The oldest watch gives way if the table is full
+        if (!w)
+            w = free_slot ? free_slot : &sub_watches[sub_watch_next++ % SUB_WATCH_MAX];
+        *w = (sub_watch_t){ .epfd = epfd, .fd = fd, .event = *event };
+    }
+
+    sub_t *s = sub_active() ? sub_find(fd) : NULL;
+    if (s)
+        sub_watch_mirror(epfd, op, s->wait_fd, event);
+    pthread_mutex_unlock(&sub_lock);
+}
+
+// Poll fds, also waiting on the socketpair of each subscribed socket
+// polled for input and reporting an event there as input on the socket.
+// Returns -2 when none of them is subscribed.
+static int sub_poll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout,
+                    const sigset_t *sigmask) {
+    if (!sub_active())
+        return -2;
+    nfds_t owner[SUB_MAX];
+    int wait_fd[SUB_MAX], n = 0;
+    pthread_mutex_lock(&sub_lock);
+    for (nfds_t i = 0; i < nfds && n < SUB_MAX; i++) {
+        if (fds[i].fd < 0 || !(fds[i].events & (POLLIN | POLLRDNORM)) || !is_rtnl_fd(fds[i].fd))
+            continue;
+        sub_t *s = sub_find(fds[i].fd);
+        if (s) {
+            owner[n] = i;
+            wait_fd[n++] = s->wait_fd;
+        }
+    }
+    pthread_mutex_unlock(&sub_lock);
+    if (n == 0)
+        return -2;
+
+    struct pollfd stack[SUB_POLL_STACK];
+    struct pollfd *all = nfds + n <= SUB_POLL_STACK ? stack : malloc((nfds + n) * sizeof(*all));
+    if (!all)
+        return -2;
+    memcpy(all, fds, nfds * sizeof(*fds));
+    for (int j = 0; j < n; j++)
+        all[nfds + j] = (struct pollfd){ .fd = wait_fd[j], .events = POLLIN };
+
+    int result = REAL(ppoll)(all, nfds + n, timeout, sigmask);
+    if (result >= 0) {
+        for (nfds_t i = 0; i < nfds; i++)
+            fds[i].revents = all[i].revents;
+        for (int j = 0; j < n; j++)
+            if (all[nfds + j].revents & POLLIN)
+                fds[owner[j]].revents |= fds[owner[j]].events & (POLLIN | POLLRDNORM);
+        result = 0;
+        for (nfds_t i = 0; i < nfds; i++)
+            result += fds[i].revents != 0;
+    }
+    if (all != stack)
+        free(all);
+    return result;
+}
+
+// A subscribed socket reports the groups it joined, so callers checking
+// their bind are happy
+static int sub_getsockname(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    uint64_t groups = 0;
+    if (sub_active()) {
+        pthread_mutex_lock(&sub_lock);
+        sub_t *s = sub_find(fd);
+        if (s)
+            groups = s->groups;
+        pthread_mutex_unlock(&sub_lock);
+    }
+
+    socklen_t room = addrlen ? *addrlen : 0;
+    int result = REAL(getsockname)(fd, addr, addrlen);
+    if (result == 0 && groups && room >= sizeof(struct sockaddr_nl))
+        ((struct sockaddr_nl *)addr)->nl_groups = (uint32_t)groups;
+    return result;
+}
+
+// Receive on a subscribed socket: replies to its own requests wait on the
+// socket, events on the socketpair, so wait for either. Returns -2 when
+// fd isn't subscribed.
+static ssize_t sub_recvmsg(int fd, struct msghdr *msg, int flags) {
+    if (!sub_active())
+        return -2;
+    pthread_mutex_lock(&sub_lock);
+    sub_t *s = sub_find(fd);
+    int wait_fd = s ? s->wait_fd : -1;
+    pthread_mutex_unlock(&sub_lock);
+    if (wait_fd < 0)
+        return -2;
+
+    struct pollfd pfd[2] = { { .fd = fd, .events = POLLIN }, { .fd = wait_fd, .events = POLLIN } };
+    int nonblock = (flags & MSG_DONTWAIT) || (REAL(fcntl)(fd, F_GETFL) & O_NONBLOCK);
+    int ready = REAL(poll)(pfd, 2, nonblock ? 0 : -1);
+    if (ready <= 0) {
+        if (ready == 0)
+            errno = EAGAIN;
+        return -1;
+    }
+    if (pfd[0].revents || !(pfd[1].revents & POLLIN))
+        return REAL(recvmsg)(fd, msg, flags);
+
+    // An event: it comes from the kernel as far as the caller can tell
+    void *name = msg->msg_name;
+    socklen_t namelen = msg->msg_namelen;
+    msg->msg_name = NULL;
+    msg->msg_namelen = 0;
+    ssize_t result = REAL(recvmsg)(wait_fd, msg, flags | MSG_DONTWAIT);
+    msg->msg_name = name;
+    msg->msg_namelen = namelen;
+    if (result >= 0)
+        istats_hit(RULE_MULTICAST);
+    if (result >= 0 && name) {
+        struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+        memcpy(name, &kernel, namelen < sizeof(kernel) ? namelen : sizeof(kernel));
+        msg->msg_namelen = sizeof(kernel);
+    }
+    return result;
+}
+
+static void sub_notify_locked(int group, const void *msg, size_t len) {
+    for (int i = 0; i < SUB_MAX; i++) {
+        if (subs[i].fd < 0 || !(subs[i].groups & (1ULL << (group - 1))))
+            continue;
+        // Like a full kernel socket buffer, a subscriber that doesn't read loses events
+        if (REAL(send)(subs[i].event_fd, msg, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+            sub_dropped++;
+        else
+            sub_events++;
+    }
+}
+
+// Announce msg, a notification for RTNLGRP_* group, now or, when the
+// kernel will ack the request req sent on fd, once it has acked it
+static void sub_announce(int fd, const struct nlmsghdr *req, int group, void *msg, size_t len, int now) {
+    struct nlmsghdr *nlh = msg;
+    if (!sub_active() || len > SUB_MSG_MAX)
+        return;
+    nlh->nlmsg_flags = 0;
+    nlh->nlmsg_seq = 0;
+    nlh->nlmsg_pid = 0;
+
+    pthread_mutex_lock(&sub_lock);
+    if (now || !req || !(req->nlmsg_flags & NLM_F_ACK)) {
+        sub_notify_locked(group, msg, len);
+    } else {
+        // The oldest unanswered request gives way if the table is full
+        sub_pending_t *p = NULL;
+        for (int i = 0; i < SUB_PENDING_MAX && !p; i++)
+            if (sub_pending[i].fd < 0)
+                p = &sub_pending[i];
+        if (!p)
+            p = &sub_pending[sub_pending_next++ % SUB_PENDING_MAX];
+        p->fd = fd;
+        p->seq = req->nlmsg_seq;
+        p->group = group;
+        p->len = len;
+        memcpy(p->msg, msg, len);
+    }
+    pthread_mutex_unlock(&sub_lock);
+}
+
+// Announce an outgoing request as its own notification: RTM_NEWADDR,
+// RTM_DELADDR and changes to links the table doesn't model
+static void sub_announce_request(int fd, const struct nlmsghdr *req, int group) {
+    unsigned char msg[SUB_MSG_MAX];
+    if (!sub_active() || req->nlmsg_len > sizeof(msg))
+        return;
+    memcpy(msg, req, req->nlmsg_len);
+    if (req->nlmsg_type == RTM_SETLINK)
+        ((struct nlmsghdr *)msg)->nlmsg_type = RTM_NEWLINK;
+    sub_announce(fd, req, group, msg, req->nlmsg_len, 0);
+}
+
+// The kernel answered request seq on fd: announce its change if it worked
+static void sub_ack(int fd, uint32_t seq, int error) {
+    if (!sub_active())
+        return;
+    pthread_mutex_lock(&sub_lock);
+    for (int i = 0; i < SUB_PENDING_MAX; i++) {
+        sub_pending_t *p = &sub_pending[i];
+        if (p->fd != fd || p->seq != seq)
+            continue;
+        if (error == 0)
+            sub_notify_locked(p->group, p->msg, p->len);
+        p->fd = -1;
+    }
+    pthread_mutex_unlock(&sub_lock);
+}
+
+static void sub_atfork_child(void) {
+    pthread_mutex_init(&sub_lock, NULL);
+}
+
+static void sub_init(void) {
+    const char *always = getenv("NETLINK_EMULATE_GROUPS");
+    sub_emulate_always = always && atoi(always) > 0;
+    for (int i = 0; i < SUB_MAX; i++)
+        subs[i].fd = -1;
+    for (int i = 0; i < SUB_PENDING_MAX; i++)
+        sub_pending[i].fd = -1;
+    for (int i = 0; i < SUB_WATCH_MAX; i++)
+        sub_watches[i].epfd = -1;
+    pthread_atfork(NULL, NULL, sub_atfork_child);
+}
+
+__attribute__((destructor))
+static void sub_report(void) {
+    if (sub_events + sub_dropped == 0)
+        return;
+    fprintf(stderr, "[netlink_v3] emulated multicast: %llu events delivered, %llu dropped\n",
+            sub_events, sub_dropped);
+}
+
+// Link table: bridges the process created (SIOCBRADDBR, or RTM_NEWLINK
+// with IFLA_INFO_KIND "bridge") and the ports enslaved to them. gVisor
+// answers flag and bridge queries for these inconsistently or not at all,
+// and Docker retries until the picture adds up, so SIOCGIF*, the brctl
+// ioctls and RTM_GETLINK for modelled links are answered here without a
+// round trip. A bridge the kernel refused to create is kept as emulated:
+// its creation reports success, it gets a synthetic ifindex, and later
+// changes to it are acknowledged locally instead of failing with ENODEV.
+#define LINK_TABLE_SIZE 64
+#define EMULATED_IFINDEX_BASE 10000
+#define LINK_MSG_SIZE 1024
+
+typedef struct {
+    char name[IFNAMSIZ];     // Empty when the slot is free
+    int ifindex;             // 0 until the kernel (or emulation) assigns one
+    int master;              // ifindex of the bridge this is a port of
+    unsigned int flags;      // IFF_*
+    unsigned int mtu;
+    unsigned char mac[ETH_ALEN];
+    int is_bridge;
+    int emulated;            // The kernel doesn't have it
+    int create_fd;           // In-flight RTM_NEWLINK: socket and seq, -1 if none
+    uint32_t create_seq;
+} link_t;
+
+typedef struct {
+    char name[IFNAMSIZ];
+    char kind[16];
+    uint32_t master, mtu;
+    int has_master, has_mtu;
+} link_req_t;
+
+static link_t links[LINK_TABLE_SIZE];
+static pthread_mutex_t link_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_emulated_ifindex = EMULATED_IFINDEX_BASE;
+
+// ioctl on a throwaway socket, bypassing every hook
+static int kernel_ioctl(unsigned long request, struct ifreq *ifr) {
+    int s = REAL(socket)(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (s < 0)
+        return -1;
+    int result = REAL(ioctl)(s, request, ifr);
+    REAL(close)(s);
+    return result;
+}
+
+static int link_ifindex(link_t *l) {
+    if (l->ifindex == 0) {
+        struct ifreq ifr = { 0 };
+        memcpy(ifr.ifr_name, l->name, IFNAMSIZ);
+        if (!l->emulated && kernel_ioctl(SIOCGIFINDEX, &ifr) == 0)
+            l->ifindex = ifr.ifr_ifindex;
+        else if (l->emulated)
+            l->ifindex = next_emulated_ifindex++;
+    }
+    return l->ifindex;
+}
+
+static link_t *link_find(const char *name) {
+    for (int i = 0; i < LINK_TABLE_SIZE; i++)
+        if (links[i].name[0] && strncmp(links[i].name, name, IFNAMSIZ) == 0)
+            return &links[i];
+    return NULL;
+}
+
+static link_t *link_find_index(int ifindex) {
+    for (int i = 0; i < LINK_TABLE_SIZE && ifindex > 0; i++)
+        if (links[i].name[0] && link_ifindex(&links[i]) == ifindex)
+            return &links[i];
+    return NULL;
+}
+
+static link_t *link_add(const char *name, int is_bridge) {
+    link_t *l = link_find(name);
+    if (l) {
+        l->is_bridge |= is_bridge;
+        return l;
+    }
+    for (int i = 0; i < LINK_TABLE_SIZE; i++) {
+        if (links[i].name[0])
+            continue;
+        l = &links[i];
+        memset(l, 0, sizeof(*l));
+        strncpy(l->name, name, IFNAMSIZ - 1);
+        l->is_bridge = is_bridge;
+        l->flags = IFF_BROADCAST | IFF_MULTICAST;
+        l->mtu = 1500;
+        l->create_fd = -1;
+
+        // Locally administered address derived from the name, like Docker's 02:42:...
+        uint32_t h = 2166136261u;
+        for (const char *c = name; *c; c++)
+            h = (h ^ (unsigned char)*c) * 16777619u;
+        unsigned char mac[ETH_ALEN] = { 0x02, 0x42, h >> 24, h >> 16, h >> 8, h };
+        memcpy(l->mac, mac, ETH_ALEN);
+        return l;
+    }
+    fprintf(stderr, "[netlink_v3] Link table full, not tracking %s\n", name);
+    return NULL;
+}
+
+static void link_remove(link_t *l) {
+    int ifindex = l->ifindex;
+    for (int i = 0; i < LINK_TABLE_SIZE && ifindex; i++)
+        if (links[i].master == ifindex)
+            links[i].master = 0;
+    l->name[0] = '\0';
+}
+
+static void link_set_flags(link_t *l, unsigned int flags, unsigned int change) {
+    l->flags = (l->flags & ~change) | (flags & change);
+    if (l->flags & IFF_UP)
+        l->flags |= IFF_RUNNING | IFF_LOWER_UP;
+    else
+        l->flags &= ~(IFF_RUNNING | IFF_LOWER_UP);
+}
+
+static void link_enslave(link_t *bridge, int port_ifindex, int add) {
+    link_t *port = link_find_index(port_ifindex);
+    if (!port && add) {
+        struct ifreq ifr = { .ifr_ifindex = port_ifindex };
+        if (kernel_ioctl(SIOCGIFNAME, &ifr) == 0 && (port = link_add(ifr.ifr_name, 0)))
+            port->ifindex = port_ifindex;
+    }
+    if (port)
+        port->master = add ? link_ifindex(bridge) : 0;
+}
+
+static void parse_link_req(const struct nlmsghdr *nlh, link_req_t *req) {
+    memset(req, 0, sizeof(*req));
+    int len = IFLA_PAYLOAD(nlh);
+    for (struct rtattr *rta = IFLA_RTA(NLMSG_DATA(nlh)); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        size_t n = RTA_PAYLOAD(rta);
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            memcpy(req->name, RTA_DATA(rta), n < IFNAMSIZ - 1 ? n : IFNAMSIZ - 1);
+            break;
+        case IFLA_MASTER:
+            req->has_master = n >= sizeof(uint32_t);
+            if (req->has_master)
+                memcpy(&req->master, RTA_DATA(rta), sizeof(uint32_t));
+            break;
+        case IFLA_MTU:
+            req->has_mtu = n >= sizeof(uint32_t);
+            if (req->has_mtu)
+                memcpy(&req->mtu, RTA_DATA(rta), sizeof(uint32_t));
+            break;
+        case IFLA_LINKINFO: {
+            int ilen = n;
+            for (struct rtattr *info = RTA_DATA(rta); RTA_OK(info, ilen); info = RTA_NEXT(info, ilen))
+                if (info->rta_type == IFLA_INFO_KIND) {
+                    size_t k = RTA_PAYLOAD(info);
+                    memcpy(req->kind, RTA_DATA(info), k < sizeof(req->kind) - 1 ? k : sizeof(req->kind) - 1);
+                }
+            break;
+        }
+        }
+    }
+}
+
+static void nl_put_attr(struct nlmsghdr *nlh, uint16_t type, const void *data, size_t len) {
+    struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    if (len)
+        memcpy(RTA_DATA(rta), data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+// RTM_NEWLINK describing l, as the kernel would answer RTM_GETLINK
+static size_t link_build_msg(link_t *l, void *buf) {
+    struct nlmsghdr *nlh = buf;
+    memset(buf, 0, LINK_MSG_SIZE);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    nlh->nlmsg_type = RTM_NEWLINK;
+
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_type = ARPHRD_ETHER;
+    ifi->ifi_index = link_ifindex(l);
+    ifi->ifi_flags = l->flags;
+
+    uint32_t txqlen = 1000, master = l->master;
+    unsigned char operstate = (l->flags & IFF_UP) ? IF_OPER_UP : IF_OPER_DOWN;
+    unsigned char broadcast[ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    nl_put_attr(nlh, IFLA_IFNAME, l->name, strlen(l->name) + 1);
+    nl_put_attr(nlh, IFLA_TXQLEN, &txqlen, sizeof(txqlen));
+    nl_put_attr(nlh, IFLA_OPERSTATE, &operstate, sizeof(operstate));
+    nl_put_attr(nlh, IFLA_MTU, &l->mtu, sizeof(l->mtu));
+    nl_put_attr(nlh, IFLA_ADDRESS, l->mac, ETH_ALEN);
+    nl_put_attr(nlh, IFLA_BROADCAST, broadcast, ETH_ALEN);
+    if (master)
+        nl_put_attr(nlh, IFLA_MASTER, &master, sizeof(master));
+
+    if (l->is_bridge) {
+        struct rtattr *linkinfo = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+        size_t start = nlh->nlmsg_len;
+        nl_put_attr(nlh, IFLA_LINKINFO, NULL, 0);
+        nl_put_attr(nlh, IFLA_INFO_KIND, "bridge", sizeof("bridge"));
+        linkinfo->rta_len = nlh->nlmsg_len - start;
+    }
+    return nlh->nlmsg_len;
+}
+
+static size_t build_ack(const struct nlmsghdr *req, void *buf) {
+    struct nlmsghdr *nlh = buf;
+    memset(buf, 0, NLMSG_LENGTH(sizeof(struct nlmsgerr)));
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct nlmsgerr));
+    nlh->nlmsg_type = NLMSG_ERROR;
+    nlh->nlmsg_flags = NLM_F_CAPPED;
+    struct nlmsgerr *err = NLMSG_DATA(nlh);
+    err->error = 0;
+    err->msg = *req;
+    return nlh->nlmsg_len;
+}
+
+// Tell subscribers about l, as RTM_NEWLINK or RTM_DELLINK (see sub_announce)
+static void link_announce(link_t *l, uint16_t type, int fd, const struct nlmsghdr *req, int now) {
+    unsigned char msg[LINK_MSG_SIZE];
+    if (!sub_active())
+        return;
+    size_t len = link_build_msg(l, msg);
+    ((struct nlmsghdr *)msg)->nlmsg_type = type;
+    sub_announce(fd, req, RTNLGRP_LINK, msg, len, now);
+}
+
+// Queue datagrams on fd as if the kernel had sent them
+static int queue_reply(int fd, uint32_t seq, const void *msg, size_t msg_len, const void *ack, size_t ack_len) {
+    dump_blob_t *blob = NULL;
+    size_t cap = 0;
+
+    if (!msg_len && !ack_len)
+        return 1;  // Nothing to say: no reply asked for
+
+    uint32_t portid = netlink_portid(fd);
+    if (portid == 0 || (msg_len && !blob_add(&blob, &cap, msg, msg_len)) ||
+        (ack_len && !blob_add(&blob, &cap, ack, ack_len))) {
+        dump_blob_put(blob);
+        return 0;
+    }
+
+    pthread_mutex_lock(&dump_lock);
+    dump_pending_t *p = dump_find_pending(fd);
+    if (p)
+        dump_release_pending(p);
+    p = dump_find_pending(-1);
+    if (p)
+        *p = (dump_pending_t){ .fd = fd, .mode = DUMP_REPLAYING, .seq = seq,
+                               .portid = portid, .blob = blob };
+    else
+        dump_blob_put(blob);
+    pthread_mutex_unlock(&dump_lock);
+    return p != NULL;
+}
+
+// Update the table from one outgoing RTM_*LINK message. Returns 1 when
+// the message was answered locally and must not reach the kernel.
+static int link_request(int fd, const struct nlmsghdr *nlh, int lone) {
+    if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK &&
+        nlh->nlmsg_type != RTM_SETLINK && nlh->nlmsg_type != RTM_GETLINK)
+        return 0;
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)) ||
+        (nlh->nlmsg_type == RTM_GETLINK && (nlh->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP))
+        return 0;
+
+    const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    link_req_t req;
+    parse_link_req(nlh, &req);
+
+    pthread_mutex_lock(&link_lock);
+    link_t *l = ifi->ifi_index > 0 ? link_find_index(ifi->ifi_index) :
+                req.name[0] ? link_find(req.name) : NULL;
+
+    if (nlh->nlmsg_type == RTM_NEWLINK && !l && strcmp(req.kind, "bridge") == 0 &&
+        (nlh->nlmsg_flags & NLM_F_CREATE) && req.name[0]) {
+        // Watch the kernel's answer; link_recv() flips it to emulated on failure
+        if ((l = link_add(req.name, 1))) {
+            l->create_fd = fd;
+            l->create_seq = nlh->nlmsg_seq;
+            fprintf(stderr, "[netlink_v3] Tracking bridge %s\n", l->name);
+        }
+        pthread_mutex_unlock(&link_lock);
+        return 0;
+    }
+
+    unsigned char msg[LINK_MSG_SIZE], ack[NLMSG_SPACE(sizeof(struct nlmsgerr))];
+    size_t msg_len = 0, ack_len = (nlh->nlmsg_flags & NLM_F_ACK) ? build_ack(nlh, ack) : 0;
+
+    // Enslaving a port we don't model yet to a bridge we do
+    link_t *bridge = req.has_master ? link_find_index(req.master) : NULL;
+    if (!l && bridge && ifi->ifi_index > 0 && nlh->nlmsg_type != RTM_GETLINK) {
+        int local = bridge->emulated && lone;
+        link_enslave(bridge, ifi->ifi_index, 1);
+        if ((l = link_find_index(ifi->ifi_index)))
+            link_announce(l, RTM_NEWLINK, fd, nlh, local);
+        pthread_mutex_unlock(&link_lock);
+        return local && queue_reply(fd, nlh->nlmsg_seq, NULL, 0, ack, ack_len);
+    }
+
+    if (!l) {
+        pthread_mutex_unlock(&link_lock);
+        if (nlh->nlmsg_type != RTM_GETLINK)
+            sub_announce_request(fd, nlh, RTNLGRP_LINK);
+        return 0;
+    }
+
+    // Real links are left to the kernel once recorded; only emulated
+    // ones, which the kernel would answer with ENODEV, are answered here
+    int local = l->emulated;
+
+    switch (nlh->nlmsg_type) {
+    case RTM_GETLINK:
+        if (local)
+            msg_len = link_build_msg(l, msg);
+        break;
+    case RTM_DELLINK:
+        link_announce(l, RTM_DELLINK, fd, nlh, local && lone);
+        link_remove(l);
+        break;
+    default:
+        if (ifi->ifi_flags || ifi->ifi_change)
+            link_set_flags(l, ifi->ifi_flags, ifi->ifi_change ? ifi->ifi_change : ~0u);
+        if (req.has_mtu)
+            l->mtu = req.mtu;
+        if (req.has_master) {
+            l->master = bridge ? link_ifindex(bridge) : (int)req.master;
+            local |= bridge && bridge->emulated;
+        }
+        link_announce(l, RTM_NEWLINK, fd, nlh, local && lone);
+        break;
+    }
+    pthread_mutex_unlock(&link_lock);
+
+    return local && lone && queue_reply(fd, nlh->nlmsg_seq, msg, msg_len, ack, ack_len);
+}
+
+// Watch the kernel's answers to bridge creation: a failure becomes an
+// emulated bridge and the caller sees success. Every answer settles any
+// notification waiting on it.
+static void link_recv(int fd, void *buf, size_t n) {
+    struct nlmsghdr *nlh = buf;
+    int left = n;
+
+    for (; NLMSG_OK(nlh, left); nlh = NLMSG_NEXT(nlh, left)) {
+        if (nlh->nlmsg_type != NLMSG_ERROR || nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+            continue;
+        struct nlmsgerr *err = NLMSG_DATA(nlh);
+
+        pthread_mutex_lock(&link_lock);
+        for (int i = 0; i < LINK_TABLE_SIZE; i++) {
+            link_t *l = &links[i];
+            if (!l->name[0] || l->create_fd != fd || l->create_seq != nlh->nlmsg_seq)
+                continue;
+            l->create_fd = -1;
+            if (err->error == -EEXIST)
+                break;
+            if (err->error != 0) {
+                fprintf(stderr, "[netlink_v3] Kernel refused bridge %s (%s) - emulating it\n",
+                        l->name, strerror(-err->error));
+                l->emulated = 1;
+                err->error = 0;
+            }
+            link_announce(l, RTM_NEWLINK, fd, NULL, 1);
+            break;
+        }
+        pthread_mutex_unlock(&link_lock);
+        sub_ack(fd, nlh->nlmsg_seq, err->error);
+    }
+}
+
+// The brctl ioctl API: args[0] is the command, the rest its arguments
+static int link_brctl(link_t *bridge, unsigned long *args) {
+    switch (args[0]) {
+    case BRCTL_GET_BRIDGE_INFO: {
+        struct __bridge_info *info = (struct __bridge_info *)args[1];
+        memset(info, 0, sizeof(*info));
+        memcpy((unsigned char *)&info->bridge_id + 2, bridge->mac, ETH_ALEN);
+        info->designated_root = info->bridge_id;
+        info->forward_delay = info->bridge_forward_delay = 15 * 100;
+        info->hello_time = info->bridge_hello_time = 2 * 100;
+        info->max_age = info->bridge_max_age = 20 * 100;
+        info->ageing_time = 300 * 100;
+        return 0;
+    }
+    case BRCTL_GET_PORT_LIST: {
+        int *indices = (int *)args[1];
+        unsigned long num = args[2], port = 1;
+        memset(indices, 0, num * sizeof(int));
+        for (int i = 0; i < LINK_TABLE_SIZE && port < num; i++)
+            if (links[i].name[0] && links[i].master == link_ifindex(bridge))
+                indices[port++] = link_ifindex(&links[i]);
+        return 0;
+    }
+    case BRCTL_ADD_IF:
+    case BRCTL_DEL_IF:
+        link_enslave(bridge, args[1], args[0] == BRCTL_ADD_IF);
+        return 0;
+    }
+    return 1;
+}
+
+// Keep the table in step with an ifreq ioctl on l. With from_kernel set
+// the kernel has already answered and the table learns from it;
+// otherwise the table answers. Returns 1 for requests it doesn't model.
+static int link_ioctl_apply(link_t *l, unsigned long request, struct ifreq *ifr, int from_kernel) {
+    switch (request) {
+    case SIOCGIFFLAGS:
+        if (from_kernel)
+            l->flags = (l->flags & ~0xffffu) | (unsigned short)ifr->ifr_flags;
+        else
+            ifr->ifr_flags = l->flags;
+        return 0;
+    case SIOCGIFINDEX:
+        if (from_kernel)
+            l->ifindex = ifr->ifr_ifindex;
+        else if (!(ifr->ifr_ifindex = link_ifindex(l)))
+            return 1;
+        return 0;
+    case SIOCGIFMTU:
+        if (from_kernel)
+            l->mtu = ifr->ifr_mtu;
+        else
+            ifr->ifr_mtu = l->mtu;
+        return 0;
+    case SIOCGIFHWADDR:
+        if (from_kernel) {
+            memcpy(l->mac, ifr->ifr_hwaddr.sa_data, ETH_ALEN);
+        } else {
+            ifr->ifr_hwaddr.sa_family = ARPHRD_ETHER;
+            memcpy(ifr->ifr_hwaddr.sa_data, l->mac, ETH_ALEN);
+        }
+        return 0;
+    case SIOCSIFFLAGS:
+        // The device's nature and carrier aren't the caller's to change
+        link_set_flags(l, (unsigned short)ifr->ifr_flags,
+                       0xffff & ~(IFF_BROADCAST | IFF_LOOPBACK | IFF_POINTOPOINT | IFF_RUNNING));
+        return 0;
+    case SIOCSIFMTU:
+        l->mtu = ifr->ifr_mtu;
+        return 0;
+    case SIOCBRADDIF:
+    case SIOCBRDELIF:
+        if (!l->is_bridge)
+            return 1;
+        link_enslave(l, ifr->ifr_ifindex, request == SIOCBRADDIF);
+        return 0;
+    case SIOCDEVPRIVATE: {
+        unsigned long *args = (unsigned long *)ifr->ifr_data;
+        if (!l->is_bridge || !args)
+            return 1;
+        if (from_kernel) {
+            if (args[0] == BRCTL_ADD_IF || args[0] == BRCTL_DEL_IF)
+                link_enslave(l, args[1], args[0] == BRCTL_ADD_IF);
+            return 0;
+        }
+        return link_brctl(l, args);
+    }
+    }
+    return 1;
+}
+
+// Announce what a successful ifreq ioctl on l changed
+static void link_ioctl_announce(link_t *l, unsigned long request, struct ifreq *ifr) {
+    int port = 0;
+    switch (request) {
+    case SIOCSIFFLAGS:
+    case SIOCSIFMTU:
+        link_announce(l, RTM_NEWLINK, -1, NULL, 1);
+        return;
+    case SIOCBRADDIF:
+    case SIOCBRDELIF:
+        port = ifr->ifr_ifindex;
+        break;
+    case SIOCDEVPRIVATE: {
+        unsigned long *args = (unsigned long *)ifr->ifr_data;
+        if (l->is_bridge && args && (args[0] == BRCTL_ADD_IF || args[0] == BRCTL_DEL_IF))
+            port = args[1];
+        break;
+    }
+    }
+    link_t *p = port ? link_find_index(port) : NULL;
+    if (p)
+        link_announce(p, RTM_NEWLINK, -1, NULL, 1);
+}
+
+// Bridge and interface ioctls. Real links ask the kernel first and fall
+// back to the table when it fails; emulated links are answered from the
+// table alone. Returns -2 when the request isn't about a modelled link.
+__attribute__((noinline))
+static int link_ioctl(int fd, unsigned long request, void *argp) {
+    struct ifreq *ifr = argp;
+    int result, saved_errno;
+
+    if (!argp)
+        return -2;
+
+    if (request == SIOCBRADDBR || request == SIOCBRDELBR) {
+        result = REAL(ioctl)(fd, request, argp);
+        saved_errno = errno;
+        pthread_mutex_lock(&link_lock);
+        link_t *bridge = request == SIOCBRADDBR ? NULL : link_find(argp);
+        if (request == SIOCBRADDBR && (result == 0 || saved_errno != EEXIST) &&
+            (bridge = link_add(argp, 1)) && result < 0) {
+            fprintf(stderr, "[netlink_v3] SIOCBRADDBR %s failed (%s) - emulating it\n",
+                    (char *)argp, strerror(saved_errno));
+            bridge->emulated = 1;
+            result = 0;
+        } else if (request == SIOCBRDELBR && bridge && (result == 0 || bridge->emulated)) {
+            result = 0;
+            link_announce(bridge, RTM_DELLINK, -1, NULL, 1);
+            link_remove(bridge);
+            bridge = NULL;
+        }
+        if (result == 0 && bridge)
+            link_announce(bridge, RTM_NEWLINK, -1, NULL, 1);
+        pthread_mutex_unlock(&link_lock);
+        errno = saved_errno;
+        return result;
+    }
+
+    // Everything else names the interface in an ifreq
+    pthread_mutex_lock(&link_lock);
+    link_t *l = link_find(ifr->ifr_name);
+    if (!l) {
+        pthread_mutex_unlock(&link_lock);
+        return -2;
+    }
+
+    result = l->emulated ? -1 : REAL(ioctl)(fd, request, argp);
+    saved_errno = errno;
+    if (result == 0)
+        link_ioctl_apply(l, request, ifr, 1);
+    else if (link_ioctl_apply(l, request, ifr, 0) == 0)
+        result = 0;
+    else if (l->emulated)
+        result = -2;  // Not modelled: let the kernel say ENODEV
+    if (result == 0 && sub_active())
+        link_ioctl_announce(l, request, ifr);
+    pthread_mutex_unlock(&link_lock);
+    errno = saved_errno;
+    return result;
+}
+
+static void link_table_atfork_child(void) {
+    pthread_mutex_init(&link_lock, NULL);
+}
+
+// Every outgoing rtnetlink buffer: the link table sees each message, then
+// the dump cache. Address changes are announced to subscribers as they
+// go. Returns 1 when the buffer was answered locally.
+static int rtnl_request(int fd, const void *buf, size_t len, size_t total) {
+    const struct nlmsghdr *nlh = buf;
+    int left = len, count = 0;
+
+    for (const struct nlmsghdr *h = nlh; NLMSG_OK(h, left); h = NLMSG_NEXT(h, left))
+        count++;
+    left = len;
+    for (; NLMSG_OK(nlh, left); nlh = NLMSG_NEXT(nlh, left)) {
+        if (link_request(fd, nlh, count == 1 && total == len)) {
+            istats_hit(RULE_LINK_TABLE);
+            if (is_rtm_change(nlh->nlmsg_type))
+                dump_cache_invalidate();  // dump_cache_send() never sees it
+            return 1;
+        }
+        if ((nlh->nlmsg_type == RTM_NEWADDR || nlh->nlmsg_type == RTM_DELADDR) &&
+            nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(struct ifaddrmsg))) {
+            const struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+            sub_announce_request(fd, nlh, ifa->ifa_family == AF_INET6 ?
+                                 RTNLGRP_IPV6_IFADDR : RTNLGRP_IPV4_IFADDR);
+        }
+    }
+
+    return dump_cache_send(fd, buf, len, total);
+}
+
+// Socket I/O hooks. Every entry point sits on the data plane of whatever
+// the process does, so the non-netlink path is a single bitmap test and a
+// tail call with no copies or logging; the netlink work is kept out of
+// line in the netlink_* helpers.
+#define NETLINK_FD(fd) __builtin_expect(is_netlink_fd(fd), 0)
+
+// Send side: the dump cache sees each rtnetlink request before the kernel
+__attribute__((noinline))
+static ssize_t netlink_send(int sockfd, const void *buf, size_t len, int flags,
+                            const struct sockaddr *dest_addr, socklen_t addrlen) {
+    istats_call();
+    fprintf(stderr, "[netlink_v3] sendto() on netlink fd=%d, len=%zu\n", sockfd, len);
+    if (is_rtnl_fd(sockfd) && rtnl_request(sockfd, buf, len, len))
+        return len;
+
+    return REAL(sendto)(sockfd, buf, len, flags, dest_addr, addrlen);
+}
+
+__attribute__((noinline))
+static ssize_t netlink_sendmsg(int sockfd, const struct msghdr *msg, int flags) {
+    istats_call();
+    if (is_rtnl_fd(sockfd)) {
+        unsigned char buf[DUMP_SEND_INSPECT];
+        size_t len = 0, total = 0;
+
+        for (size_t i = 0; i < msg->msg_iovlen; i++) {
+            size_t n = msg->msg_iov[i].iov_len;
+            if (len < sizeof(buf)) {
+                size_t chunk = n < sizeof(buf) - len ? n : sizeof(buf) - len;
+                memcpy(buf + len, msg->msg_iov[i].iov_base, chunk);
+                len += chunk;
+            }
+            total += n;
+        }
+        if (rtnl_request(sockfd, buf, len, total))
+            return total;
+    }
+
+    return REAL(sendmsg)(sockfd, msg, flags);
+}
+
+// One message at a time, so the dump cache sees each request
+__attribute__((noinline))
+static int netlink_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+    unsigned int i;
+    for (i = 0; i < vlen; i++) {
+        ssize_t n = netlink_sendmsg(sockfd, &msgvec[i].msg_hdr, flags);
+        if (n < 0)
+            return i ? (int)i : -1;
+        msgvec[i].msg_len = n;
+    }
+    return i;
 }
 
-// Intercept sendto for netlink
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
                const struct sockaddr *dest_addr, socklen_t addrlen) {
-    if (sockfd < 1024 && is_netlink_fd[sockfd]) {
-        fprintf(stderr, "[netlink_v3] sendto() on netlink fd=%d, len=%zu\n", sockfd, len);
+    if (NETLINK_FD(sockfd))
+        return netlink_send(sockfd, buf, len, flags, dest_addr, addrlen);
+    return REAL(sendto)(sockfd, buf, len, flags, dest_addr, addrlen);
+}
+
+ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
+    if (NETLINK_FD(sockfd))
+        return netlink_send(sockfd, buf, len, flags, NULL, 0);
+    return REAL(send)(sockfd, buf, len, flags);
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
+    if (NETLINK_FD(sockfd))
+        return netlink_sendmsg(sockfd, msg, flags);
+    return REAL(sendmsg)(sockfd, msg, flags);
+}
+
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+    if (NETLINK_FD(sockfd))
+        return netlink_sendmmsg(sockfd, msgvec, vlen, flags);
+    return REAL(sendmmsg)(sockfd, msgvec, vlen, flags);
+}
+
+// Receive side: replay a cached dump, or record the kernel's answer
+__attribute__((noinline))
+static ssize_t netlink_recv(int sockfd, void *buf, size_t len, int flags,
+                            struct sockaddr *src_addr, socklen_t *addrlen) {
+    istats_call();
+    struct iovec iov = { buf, len };
+    ssize_t result = is_rtnl_fd(sockfd) ?
+        dump_cache_replay(sockfd, &iov, 1, flags, src_addr, addrlen, NULL) : -2;
+    if (result == -2) {
+        struct msghdr msg = { .msg_name = addrlen ? src_addr : NULL,
+                              .msg_namelen = addrlen ? *addrlen : 0,
+                              .msg_iov = &iov, .msg_iovlen = 1 };
+        result = is_rtnl_fd(sockfd) ? sub_recvmsg(sockfd, &msg, flags) : -2;
+        if (result == -2)
+            result = REAL(recvfrom)(sockfd, buf, len, flags, src_addr, addrlen);
+        else if (result >= 0 && addrlen)
+            *addrlen = msg.msg_namelen;
+        if (result > 0 && !(flags & MSG_PEEK) && is_rtnl_fd(sockfd)) {
+            link_recv(sockfd, buf, (size_t)result < len ? (size_t)result : len);
+            dump_cache_record(sockfd, buf, (size_t)result < len ? (size_t)result : len,
+                              (size_t)result >= len);
+        }
+    }
+    fprintf(stderr, "[netlink_v3] recvfrom() on netlink fd=%d, result=%zd\n", sockfd, result);
+    return result;
+}
+
+__attribute__((noinline))
+static ssize_t netlink_recvmsg(int sockfd, struct msghdr *msg, int flags) {
+    istats_call();
+    if (!is_rtnl_fd(sockfd))
+        return REAL(recvmsg)(sockfd, msg, flags);
+
+    int msg_flags = 0;
+    ssize_t result = dump_cache_replay(sockfd, msg->msg_iov, msg->msg_iovlen, flags,
+                                       msg->msg_name, &msg->msg_namelen, &msg_flags);
+    if (result != -2) {
+        msg->msg_flags = msg_flags;
+        msg->msg_controllen = 0;
+        return result;
     }
+    result = sub_recvmsg(sockfd, msg, flags);
+    if (result == -2)
+        result = REAL(recvmsg)(sockfd, msg, flags);
 
-    return real_sendto(sockfd, buf, len, flags, dest_addr, addrlen);
+    // Only whole datagrams landing in the first buffer are inspected,
+    // which is how every rtnetlink library receives
+    if (result > 0 && !(flags & MSG_PEEK) && msg->msg_iovlen > 0) {
+        if ((size_t)result <= msg->msg_iov[0].iov_len) {
+            link_recv(sockfd, msg->msg_iov[0].iov_base, result);
+            dump_cache_record(sockfd, msg->msg_iov[0].iov_base, result,
+                              msg->msg_flags & MSG_TRUNC);
+        }
+        else
+            dump_cache_drop_fd(sockfd);
+    }
+    return result;
+}
+
+// One datagram at a time through netlink_recvmsg(), so replays and
+// recordings stay in step. After the first, MSG_WAITFORONE or a timeout
+// stops at the first empty read instead of honouring the timeout exactly.
+__attribute__((noinline))
+static int netlink_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+                            struct timespec *timeout) {
+    unsigned int i;
+    for (i = 0; i < vlen; i++) {
+        int f = flags & ~MSG_WAITFORONE;
+        if (i > 0 && ((flags & MSG_WAITFORONE) || timeout))
+            f |= MSG_DONTWAIT;
+        ssize_t n = netlink_recvmsg(sockfd, &msgvec[i].msg_hdr, f);
+        if (n < 0)
+            return i ? (int)i : -1;
+        msgvec[i].msg_len = n;
+    }
+    return i;
 }
 
-// Intercept recvfrom for netlink
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
                  struct sockaddr *src_addr, socklen_t *addrlen) {
-    if (sockfd < 1024 && is_netlink_fd[sockfd]) {
-        ssize_t result = real_recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
-        fprintf(stderr, "[netlink_v3] recvfrom() on netlink fd=%d, result=%zd\n", sockfd, result);
+    if (NETLINK_FD(sockfd))
+        return netlink_recv(sockfd, buf, len, flags, src_addr, addrlen);
+    return REAL(recvfrom)(sockfd, buf, len, flags, src_addr, addrlen);
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    if (NETLINK_FD(sockfd))
+        return netlink_recv(sockfd, buf, len, flags, NULL, NULL);
+    return REAL(recv)(sockfd, buf, len, flags);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+    if (NETLINK_FD(sockfd))
+        return netlink_recvmsg(sockfd, msg, flags);
+    return REAL(recvmsg)(sockfd, msg, flags);
+}
+
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+             struct timespec *timeout) {
+    if (NETLINK_FD(sockfd))
+        return netlink_recvmmsg(sockfd, msgvec, vlen, flags, timeout);
+    return REAL(recvmmsg)(sockfd, msgvec, vlen, flags, timeout);
+}
+
+// _FORTIFY_SOURCE builds call these instead of recv/recvfrom, and glibc's
+// versions reach the syscall without going back through the PLT
+ssize_t __recv_chk(int sockfd, void *buf, size_t len, size_t buflen, int flags) {
+    if (NETLINK_FD(sockfd) && len <= buflen)
+        return netlink_recv(sockfd, buf, len, flags, NULL, NULL);
+    return REAL(__recv_chk)(sockfd, buf, len, buflen, flags);
+}
+
+ssize_t __recvfrom_chk(int sockfd, void *buf, size_t len, size_t buflen, int flags,
+                       struct sockaddr *src_addr, socklen_t *addrlen) {
+    if (NETLINK_FD(sockfd) && len <= buflen)
+        return netlink_recv(sockfd, buf, len, flags, src_addr, addrlen);
+    return REAL(__recvfrom_chk)(sockfd, buf, len, buflen, flags, src_addr, addrlen);
+}
+
+// A read() of a netlink socket is a recv() without flags
+ssize_t read(int fd, void *buf, size_t count) {
+    if (NETLINK_FD(fd))
+        return netlink_recv(fd, buf, count, 0, NULL, NULL);
+    return REAL(read)(fd, buf, count);
+}
+
+ssize_t __read_chk(int fd, void *buf, size_t count, size_t buflen) {
+    if (NETLINK_FD(fd) && count <= buflen)
+        return netlink_recv(fd, buf, count, 0, NULL, NULL);
+    return REAL(__read_chk)(fd, buf, count, buflen);
+}
+
+// Waiting calls: only while a socket is subscribed do they look at the set
+#define SUB_ACTIVE() __builtin_expect(sub_active(), 0)
+
+__attribute__((noinline))
+static int netlink_poll(struct pollfd *fds, nfds_t nfds, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    return sub_poll(fds, nfds, timeout_ms < 0 ? NULL : &ts, NULL);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    int result;
+    if (SUB_ACTIVE() && (result = netlink_poll(fds, nfds, timeout)) != -2)
         return result;
-    }
+    return REAL(poll)(fds, nfds, timeout);
+}
+
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout, const sigset_t *sigmask) {
+    int result;
+    if (SUB_ACTIVE() && (result = sub_poll(fds, nfds, timeout, sigmask)) != -2)
+        return result;
+    return REAL(ppoll)(fds, nfds, timeout, sigmask);
+}
+
+int __poll_chk(struct pollfd *fds, nfds_t nfds, int timeout, size_t fdslen) {
+    int result;
+    if (SUB_ACTIVE() && nfds <= fdslen / sizeof(*fds) &&
+        (result = netlink_poll(fds, nfds, timeout)) != -2)
+        return result;
+    return REAL(__poll_chk)(fds, nfds, timeout, fdslen);
+}
+
+int __ppoll_chk(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout,
+                const sigset_t *sigmask, size_t fdslen) {
+    int result;
+    if (SUB_ACTIVE() && nfds <= fdslen / sizeof(*fds) &&
+        (result = sub_poll(fds, nfds, timeout, sigmask)) != -2)
+        return result;
+    return REAL(__ppoll_chk)(fds, nfds, timeout, sigmask, fdslen);
+}
 
-    return real_recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
+// epoll sets watching an rtnetlink socket are remembered, to watch its
+// events too once it subscribes
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    int result = REAL(epoll_ctl)(epfd, op, fd, event);
+    if (result == 0 && NETLINK_FD(fd) && is_rtnl_fd(fd))
+        sub_epoll_ctl(epfd, op, fd, event);
+    return result;
 }
 
 // Intercept close to cleanup tracking
 int close(int fd) {
-    static int (*real_close)(int) = NULL;
-    if (!real_close) real_close = dlsym(RTLD_NEXT, "close");
-
-    if (fd >= 0 && fd < 1024 && is_netlink_fd[fd]) {
+    if (is_netlink_fd(fd)) {
         fprintf(stderr, "[netlink_v3] Closing netlink socket fd=%d\n", fd);
-        is_netlink_fd[fd] = 0;
+        set_netlink_fd(fd, -1);
     }
 
-    return real_close(fd);
+    return REAL(close)(fd);
 }
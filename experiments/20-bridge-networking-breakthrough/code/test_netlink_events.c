@@ -0,0 +1,224 @@
+/*
+ * Check that link and address changes reach a multicast subscriber
+ *
+ * Subscribes one rtnetlink socket to RTMGRP_LINK and RTMGRP_IPV4_IFADDR,
+ * then, on a second socket and through the bridge ioctls, creates a
+ * bridge, brings it up, gives it an address, removes the address and
+ * deletes the bridge. Every notification the subscriber receives is
+ * printed; under netlink_intercept_v3.so with the groups emulated they
+ * are generated by the interceptor. The subscriber sits in an epoll set
+ * from before it joins, which must wake for its events, and finally
+ * sends a request of its own, whose reply must wake poll and epoll. Needs CAP_NET_ADMIN for the kernel
+ * to do the changes; without it the interceptor emulates the bridge.
+ *
+ * Build: gcc -O2 -Wall test_netlink_events.c -o test_netlink_events
+ * Usage: NETLINK_EMULATE_GROUPS=1 LD_PRELOAD=/tmp/netlink_intercept_v3.so \
+ *            ./test_netlink_events [bridge-name]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sockios.h>
+
+typedef struct {
+    struct nlmsghdr nlh;
+    union {
+        struct ifinfomsg ifi;
+        struct ifaddrmsg ifa;
+    };
+    char attrs[256];
+} request_t;
+
+static uint32_t seq = 1;
+
+static void add_attr(struct nlmsghdr *nlh, int type, const void *data, size_t len) {
+    struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+// Send a request and wait for its ack; returns the kernel's error
+static int talk(int fd, request_t *req) {
+    char buf[8192];
+    req->nlh.nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+    req->nlh.nlmsg_seq = ++seq;
+    if (send(fd, req, req->nlh.nlmsg_len, 0) < 0)
+        return -errno;
+
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0)
+            return -errno;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh = NLMSG_NEXT(nlh, n))
+            if (nlh->nlmsg_seq == req->nlh.nlmsg_seq && nlh->nlmsg_type == NLMSG_ERROR)
+                return ((struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+    }
+}
+
+static const char *type_name(int type) {
+    switch (type) {
+    case RTM_NEWLINK: return "RTM_NEWLINK";
+    case RTM_DELLINK: return "RTM_DELLINK";
+    case RTM_NEWADDR: return "RTM_NEWADDR";
+    case RTM_DELADDR: return "RTM_DELADDR";
+    }
+    return "other";
+}
+
+// Print every notification waiting on the subscriber
+static int drain(int fd) {
+    char buf[8192];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int count = 0;
+
+    while (poll(&pfd, 1, 200) > 0) {
+        struct sockaddr_nl from;
+        socklen_t fromlen = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen);
+        if (n <= 0)
+            break;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh = NLMSG_NEXT(nlh, n)) {
+            count++;
+            printf("  event %-12s seq=%u from pid=%u", type_name(nlh->nlmsg_type),
+                   nlh->nlmsg_seq, from.nl_pid);
+            if (nlh->nlmsg_type == RTM_NEWLINK || nlh->nlmsg_type == RTM_DELLINK) {
+                struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+                int len = IFLA_PAYLOAD(nlh);
+                printf(" ifindex=%d flags=0x%x", ifi->ifi_index, ifi->ifi_flags);
+                for (struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+                    if (rta->rta_type == IFLA_IFNAME)
+                        printf(" name=%s", (char *)RTA_DATA(rta));
+            } else if (nlh->nlmsg_type == RTM_NEWADDR || nlh->nlmsg_type == RTM_DELADDR) {
+                struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+                int len = IFA_PAYLOAD(nlh);
+                char addr[INET6_ADDRSTRLEN] = "?";
+                for (struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+                    if (rta->rta_type == IFA_LOCAL)
+                        inet_ntop(ifa->ifa_family, RTA_DATA(rta), addr, sizeof(addr));
+                printf(" ifindex=%u addr=%s/%u", ifa->ifa_index, addr, ifa->ifa_prefixlen);
+            }
+            printf("\n");
+        }
+    }
+    return count;
+}
+
+// A request sent on the subscriber itself: its reply must wake poll and
+// epoll like the events do
+static int own_request(int fd, int epfd) {
+    char buf[8192];
+    request_t req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nlh.nlmsg_type = RTM_GETLINK;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST;
+    req.nlh.nlmsg_seq = ++seq;
+    req.ifi.ifi_index = 1;
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+        perror("send on subscriber");
+        return 0;
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct epoll_event ev;
+    int polled = poll(&pfd, 1, 1000) > 0;
+    int epolled = epoll_wait(epfd, &ev, 1, 1000) > 0;
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    int replied = n > 0 && NLMSG_OK(nlh, n) && nlh->nlmsg_seq == req.nlh.nlmsg_seq &&
+                  nlh->nlmsg_type == RTM_NEWLINK;
+    printf("request on subscriber: poll %s, epoll %s, reply %s\n", polled ? "woke" : "timed out",
+           epolled ? "woke" : "timed out", replied ? "received" : "missing");
+    return polled && epolled && replied;
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = argc > 1 ? argv[1] : "evbr0";
+    request_t req;
+    int events = 0;
+
+    int sub = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    int nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    int ctl = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event watch = { .events = EPOLLIN };
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR };
+    socklen_t addrlen = sizeof(addr);
+    if (sub < 0 || nl < 0 || ctl < 0 || epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sub, &watch) < 0 ||
+        bind(sub, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(sub, (struct sockaddr *)&addr, &addrlen) < 0) {
+        perror("subscribe");
+        return 1;
+    }
+    printf("subscriber bound: family=%d pid=%u groups=0x%x\n", addr.nl_family, addr.nl_pid, addr.nl_groups);
+
+    // Create the bridge over netlink
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nlh.nlmsg_type = RTM_NEWLINK;
+    req.nlh.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+    add_attr(&req.nlh, IFLA_IFNAME, name, strlen(name) + 1);
+    struct rtattr *linkinfo = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nlh.nlmsg_len));
+    add_attr(&req.nlh, IFLA_LINKINFO, "", 0);
+    add_attr(&req.nlh, IFLA_INFO_KIND, "bridge", 6);
+    linkinfo->rta_len = (char *)&req + req.nlh.nlmsg_len - (char *)linkinfo;
+    printf("create %s: %s\n", name, strerror(-talk(nl, &req)));
+    printf("epoll: %s\n", epoll_wait(epfd, &watch, 1, 1000) > 0 ? "woke" : "timed out");
+    events += drain(sub);
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(ctl, SIOCGIFINDEX, &ifr) < 0) {
+        perror("SIOCGIFINDEX");
+        return 1;
+    }
+    int ifindex = ifr.ifr_ifindex;
+
+    // Bring it up with the ioctl
+    ifr.ifr_flags = IFF_UP;
+    printf("SIOCSIFFLAGS up: %s\n", ioctl(ctl, SIOCSIFFLAGS, &ifr) < 0 ? strerror(errno) : "Success");
+    events += drain(sub);
+
+    // Add and remove an address
+    for (int type = RTM_NEWADDR; type <= RTM_DELADDR; type++) {
+        struct in_addr ip;
+        inet_pton(AF_INET, "10.99.0.1", &ip);
+        memset(&req, 0, sizeof(req));
+        req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+        req.nlh.nlmsg_type = type;
+        req.nlh.nlmsg_flags = type == RTM_NEWADDR ? NLM_F_CREATE | NLM_F_EXCL : 0;
+        req.ifa.ifa_family = AF_INET;
+        req.ifa.ifa_prefixlen = 24;
+        req.ifa.ifa_index = ifindex;
+        add_attr(&req.nlh, IFA_LOCAL, &ip, sizeof(ip));
+        add_attr(&req.nlh, IFA_ADDRESS, &ip, sizeof(ip));
+        printf("%s 10.99.0.1/24: %s\n", type_name(type), strerror(-talk(nl, &req)));
+        events += drain(sub);
+    }
+
+    // And delete the bridge
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nlh.nlmsg_type = RTM_DELLINK;
+    req.ifi.ifi_index = ifindex;
+    printf("delete %s: %s\n", name, strerror(-talk(nl, &req)));
+    events += drain(sub);
+
+    printf("%d events\n", events);
+    int answered = own_request(sub, epfd);
+    return events && answered ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+ * Concurrent ADD/DEL benchmark for CNI plugins
+ *
+ * Starts N plugin processes at once with CNI_COMMAND=ADD, one container
+ * ID each, and checks that every one got an address and that no address
+ * was handed out twice. Then DELs them all at once, and ADDs them again:
+ * with a subnet barely larger than N, an address leaked by DEL shows up
+ * as an exhausted pool on the second round. Reports wall time, calls/s
+ * and per-call latency for each round.
+ *
+ * Each child gets the config on stdin from a file and its stdout in a
+ * file of its own, so N is not limited by the fd table.
+ *
+ * Build: gcc -O2 -Wall bench_cni.c -o bench_cni
+ * Usage: ./bench_cni [-n 1000] [-s 10.99.0.0/22] [-d /tmp/bench-cni] ./noop
+ *        ./bench_cni -n 1000 ./noop-cni-plugin.sh     # the old script, for comparison
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+typedef struct {
+    pid_t pid;
+    long long start_ns;
+    long long latency_ns;
+    int status;
+} call_t;
+
+static const char *plugin, *work_dir;
+static int n_calls = 1000;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void output_path(char *buf, size_t size, const char *command, int i) {
+    snprintf(buf, size, "%s/out/%s-%d", work_dir, command, i);
+}
+
+// Run the plugin for every container at once; returns the failure count
+static int run_round(const char *label, const char *command, call_t *calls) {
+    char path[PATH_MAX], config[PATH_MAX];
+    snprintf(config, sizeof(config), "%s/config.json", work_dir);
+
+    long long start = monotonic_ns();
+    for (int i = 0; i < n_calls; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "bench%06d", i);
+        output_path(path, sizeof(path), command, i);
+
+        calls[i].start_ns = monotonic_ns();
+        calls[i].pid = fork();
+        if (calls[i].pid == 0) {
+            int in = open(config, O_RDONLY);
+            int out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (in < 0 || out < 0 || dup2(in, 0) < 0 || dup2(out, 1) < 0)
+                _exit(126);
+            setenv("CNI_COMMAND", command, 1);
+            setenv("CNI_CONTAINERID", id, 1);
+            setenv("CNI_NETNS", "/var/run/netns/bench", 1);
+            setenv("CNI_IFNAME", "eth0", 1);
+            setenv("CNI_PATH", "/opt/cni/bin", 1);
+            execl(plugin, plugin, (char *)NULL);
+            _exit(127);
+        }
+        if (calls[i].pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+    }
+
+    // Reap in completion order so latencies are per call
+    for (int done = 0; done < n_calls; done++) {
+        int status;
+        pid_t pid = wait(&status);
+        long long now = monotonic_ns();
+        for (int i = 0; i < n_calls; i++) {
+            if (calls[i].pid == pid) {
+                calls[i].latency_ns = now - calls[i].start_ns;
+                calls[i].status = status;
+                break;
+            }
+        }
+    }
+    long long wall = monotonic_ns() - start;
+
+    long long *lat = malloc(n_calls * sizeof(long long));
+    int failures = 0;
+    for (int i = 0; i < n_calls; i++) {
+        lat[i] = calls[i].latency_ns;
+        failures += !WIFEXITED(calls[i].status) || WEXITSTATUS(calls[i].status) != 0;
+    }
+    qsort(lat, n_calls, sizeof(long long), compare_ll);
+    printf("%-6s %d calls in %.1f ms: %.0f calls/s, p50 %.2f ms, p99 %.2f ms, max %.2f ms, %d failed\n",
+           label, n_calls, wall / 1e6, n_calls / (wall / 1e9), lat[n_calls / 2] / 1e6,
+           lat[n_calls * 99 / 100] / 1e6, lat[n_calls - 1] / 1e6, failures);
+    free(lat);
+    return failures;
+}
+
+// Check the ADD results: every call answered, no address twice
+static int check_addresses(void) {
+    char path[PATH_MAX], buf[4096];
+    char **seen = calloc(n_calls, sizeof(char *));
+    int missing = 0, duplicates = 0;
+
+    for (int i = 0; i < n_calls; i++) {
+        output_path(path, sizeof(path), "ADD", i);
+        int fd = open(path, O_RDONLY);
+        ssize_t len = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+        if (fd >= 0)
+            close(fd);
+        buf[len > 0 ? len : 0] = '\0';
+
+        char *addr = strstr(buf, "\"address\"");
+        char ip[64];
+        if (!addr || sscanf(addr, "\"address\"%*[ :\t\r\n]\"%63[^\"/]", ip) != 1) {
+            missing++;
+            continue;
+        }
+        for (int j = 0; j < i; j++) {
+            if (seen[j] && strcmp(seen[j], ip) == 0) {
+                if (duplicates++ < 5)
+                    printf("  %s handed to bench%06d and bench%06d\n", ip, j, i);
+                break;
+            }
+        }
+        seen[i] = strdup(ip);
+    }
+
+    printf("       %d addresses, %d missing, %d duplicates\n", n_calls - missing, missing, duplicates);
+    for (int i = 0; i < n_calls; i++)
+        free(seen[i]);
+    free(seen);
+    return missing + duplicates;
+}
+
+int main(int argc, char *argv[]) {
+    const char *subnet = "10.99.0.0/22";
+    char path[PATH_MAX];
+    int opt;
+
+    work_dir = "/tmp/bench-cni";
+    while ((opt = getopt(argc, argv, "n:s:d:")) != -1) {
+        switch (opt) {
+        case 'n': n_calls = atoi(optarg); break;
+        case 's': subnet = optarg; break;
+        case 'd': work_dir = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n calls] [-s subnet] [-d work-dir] <plugin>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || n_calls <= 0) {
+        fprintf(stderr, "Usage: %s [-n calls] [-s subnet] [-d work-dir] <plugin>\n", argv[0]);
+        return 1;
+    }
+    plugin = argv[optind];
+
+    // Fresh state: the plugin's dataDir lives in the work dir
+    snprintf(path, sizeof(path), "rm -rf '%s'", work_dir);
+    if (system(path) != 0 || mkdir(work_dir, 0755) < 0) {
+        perror(work_dir);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/out", work_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/config.json", work_dir);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    fprintf(f, "{\"cniVersion\":\"1.0.0\",\"name\":\"bench\",\"type\":\"noop\",\"subnet\":\"%s\","
+               "\"dataDir\":\"%s/data\"}\n", subnet, work_dir);
+    fclose(f);
+
+    call_t *calls = calloc(n_calls, sizeof(call_t));
+    int errors = 0;
+    printf("%s, %d concurrent calls per round, subnet %s\n", plugin, n_calls, subnet);
+
+    errors += run_round("ADD", "ADD", calls);
+    errors += check_addresses();
+    errors += run_round("DEL", "DEL", calls);
+    errors += run_round("ADD", "ADD", calls);
+    errors += check_addresses();
+
+    printf("%s\n", errors ? "FAIL" : "PASS");
+    free(calls);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,424 @@
+/*
+ * No-op CNI plugin with IPAM, native replacement for noop-cni-plugin.sh
+ *
+ * Like the script it configures nothing (gVisor refuses the bridge,
+ * promiscuous mode and route operations), but every pod gets its own
+ * address from a configurable subnet instead of all sharing 10.88.0.2.
+ *
+ * Allocations live in <dataDir>/<network>.state, a bitmap over the subnet
+ * that is mmap()ed and serialised with flock(). Above the address bitmap
+ * sit two summary levels with one bit per full word of the level below,
+ * so finding the next free address after the cursor reads at most a few
+ * words whatever the subnet size, and release is three bit clears. After
+ * the bitmap, each address has the hash of the container ID and ifname
+ * holding it. The container's address is kept in
+ * <dataDir>/<container-id>.<ifname> for DEL and CHECK, and only counts
+ * while the state agrees it owns it. The result goes to stdout with a
+ * single write().
+ *
+ * Top-level network config keys: "subnet" (default 10.88.0.0/16, /12 to /30),
+ * "dataDir" (default /var/lib/cni/noop), "name", "cniVersion".
+ *
+ * Build: gcc -O2 -Wall noop_cni.c -o /opt/cni/bin/noop
+ * Usage: run by containerd; by hand:
+ *        CNI_COMMAND=ADD CNI_CONTAINERID=c1 CNI_NETNS=/proc/1/ns/net CNI_IFNAME=eth0 \
+ *            /opt/cni/bin/noop < cni-config.json
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DEFAULT_SUBNET "10.88.0.0/16"
+#define DEFAULT_DATA_DIR "/var/lib/cni/noop"
+#define STATE_MAGIC 0x4e4f4f5049504d32ULL  // "NOOPIPM2"
+#define MIN_PREFIX 12
+#define MAX_PREFIX 30
+
+// CNI error codes (spec section "Error")
+#define CNI_ERR_UNKNOWN_CONTAINER 3
+#define CNI_ERR_ENV 4
+#define CNI_ERR_IO 5
+#define CNI_ERR_CONFIG 7
+#define CNI_ERR_EXHAUSTED 100  // Plugin-specific range starts at 100
+
+// State file layout: header, the three bitmap levels back to back, then
+// one owner per address (0 when free or reserved)
+typedef struct {
+    uint64_t magic;
+    uint32_t base;       // Subnet address, host order
+    uint32_t prefix;
+    uint32_t size;       // Addresses in the subnet
+    uint32_t next;       // Where the next search starts
+    uint32_t allocated;
+    uint32_t words[3];   // Words per level
+    uint64_t bits[];     // Level 0: 1 = address in use; levels 1, 2: 1 = word below full
+} state_t;
+
+static char cni_version[32] = "1.0.0";
+
+static void reply(const char *buf, size_t len) {
+    if (write(STDOUT_FILENO, buf, len) != (ssize_t)len)
+        exit(1);
+}
+
+// Copy in to out as the inside of a JSON string. Returns 0 if it had to
+// be cut short to fit.
+static int json_escape(const char *in, char *out, size_t size) {
+    size_t n = 0;
+    for (; *in; in++) {
+        unsigned char c = *in;
+        char esc[8];
+        if (c == '"' || c == '\\')
+            snprintf(esc, sizeof(esc), "\\%c", c);
+        else if (c < 0x20)
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+        else
+            esc[0] = c, esc[1] = '\0';
+        size_t len = strlen(esc);
+        if (n + len >= size) {
+            out[n] = '\0';
+            return 0;
+        }
+        memcpy(out + n, esc, len);
+        n += len;
+    }
+    out[n] = '\0';
+    return 1;
+}
+
+static void fail(int code, const char *fmt, const char *arg) {
+    char text[512], msg[1024], buf[1536];
+    snprintf(text, sizeof(text), fmt, arg);
+    json_escape(text, msg, sizeof(msg));
+    int len = snprintf(buf, sizeof(buf), "{\"cniVersion\":\"%s\",\"code\":%d,\"msg\":\"%s\"}\n",
+                       cni_version, code, msg);
+    reply(buf, len < (int)sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+    exit(1);
+}
+
+// Skip the JSON string whose opening quote is at p; returns what follows
+// its closing quote, or NULL if it doesn't end
+static const char *skip_string(const char *p) {
+    for (p++; *p; p++) {
+        if (*p == '\\' && !*++p)
+            return NULL;
+        if (*p == '"')
+            return p + 1;
+    }
+    return NULL;
+}
+
+// String value of "key" in the config's top-level object, or 0 if there
+// is none. Keys of nested objects (ipam, runtimeConfig, ...) don't count.
+// The value is copied as it appears, escapes included.
+static int json_string(const char *json, const char *key, char *out, size_t size) {
+    size_t key_len = strlen(key);
+    int depth = 0;
+    for (const char *p = json; *p;) {
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            depth--;
+        } else if (*p == '"') {
+            const char *name = p + 1;
+            if (!(p = skip_string(p)))
+                return 0;
+            const char *v = p + strspn(p, " \t\r\n");
+            if (depth != 1 || *v != ':' || (size_t)(p - 1 - name) != key_len ||
+                memcmp(name, key, key_len) != 0)
+                continue;
+            v++;
+            v += strspn(v, " \t\r\n");
+            const char *end = *v == '"' ? skip_string(v) : NULL;
+            if (!end || (size_t)(end - v - 2) >= size)
+                return 0;
+            memcpy(out, v + 1, end - v - 2);
+            out[end - v - 2] = '\0';
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+static uint64_t *level(state_t *s, int l) {
+    uint64_t *bits = s->bits;
+    for (int i = 0; i < l; i++)
+        bits += s->words[i];
+    return bits;
+}
+
+// Level 3 is where the owners start
+static uint64_t *owners(state_t *s) {
+    return level(s, 3);
+}
+
+static size_t state_size(uint32_t size) {
+    uint32_t w0 = (size + 63) / 64, w1 = (w0 + 63) / 64, w2 = (w1 + 63) / 64;
+    return sizeof(state_t) + ((size_t)w0 + w1 + w2 + size) * sizeof(uint64_t);
+}
+
+static int in_use(state_t *s, uint32_t idx) {
+    return (s->bits[idx / 64] >> (idx % 64)) & 1;
+}
+
+// Owner value for a container's interface: FNV-1a, never 0
+static uint64_t owner_id(const char *container, const char *ifname) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const char *p = container; *p; p++)
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+    h = (h ^ '/') * 0x100000001b3ULL;
+    for (const char *p = ifname; *p; p++)
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+    return h ? h : 1;
+}
+
+static void mark_used(state_t *s, uint32_t idx) {
+    for (int l = 0; l < 3; l++) {
+        uint64_t *bits = level(s, l);
+        bits[idx / 64] |= 1ULL << (idx % 64);
+        if (bits[idx / 64] != ~0ULL)
+            return;
+        idx /= 64;
+    }
+}
+
+static void mark_free(state_t *s, uint32_t idx) {
+    for (int l = 0; l < 3; l++) {
+        level(s, l)[idx / 64] &= ~(1ULL << (idx % 64));
+        idx /= 64;
+    }
+}
+
+static void init_state(state_t *s, uint32_t base, uint32_t prefix) {
+    s->magic = STATE_MAGIC;
+    s->base = base;
+    s->prefix = prefix;
+    s->size = 1U << (32 - prefix);
+    s->words[0] = (s->size + 63) / 64;
+    s->words[1] = (s->words[0] + 63) / 64;
+    s->words[2] = (s->words[1] + 63) / 64;
+
+    // Bits past the end of each level count as full, so they're never picked
+    uint32_t count = s->size;
+    for (int l = 0; l < 3; l++) {
+        uint64_t *bits = level(s, l);
+        for (uint32_t i = count; i < s->words[l] * 64; i++)
+            bits[i / 64] |= 1ULL << (i % 64);
+        count = s->words[l];
+    }
+
+    // Network, gateway and broadcast addresses
+    mark_used(s, 0);
+    mark_used(s, 1);
+    mark_used(s, s->size - 1);
+    s->next = 2;
+}
+
+// First zero bit at or after bit 'from' within one word, or -1
+static int free_bit(uint64_t word, uint32_t from) {
+    uint64_t m = ~word & (from < 64 ? ~0ULL << from : 0);
+    return m ? __builtin_ctzll(m) : -1;
+}
+
+// Lowest free address at or after idx, or -1. Descends from the first
+// level with a non-full word ahead of idx, so at most one word is read
+// per level, plus the (at most 4) words of level 2.
+static int64_t find_free(state_t *s, uint32_t idx) {
+    uint64_t *l0 = level(s, 0), *l1 = level(s, 1), *l2 = level(s, 2);
+    uint32_t w0 = idx / 64, w1, w2;
+    int b;
+
+    if (w0 >= s->words[0])
+        return -1;
+    if ((b = free_bit(l0[w0], idx % 64)) >= 0)
+        return (int64_t)w0 * 64 + b;
+
+    // The next level-0 word with room, from level 1
+    w0++;
+    w1 = w0 / 64;
+    if (w1 < s->words[1] && (b = free_bit(l1[w1], w0 % 64)) >= 0) {
+        w0 = w1 * 64 + b;
+        return (int64_t)w0 * 64 + __builtin_ctzll(~l0[w0]);
+    }
+
+    // The next level-1 word with room, from level 2
+    w1++;
+    for (w2 = w1 / 64; w2 < s->words[2]; w2++) {
+        if ((b = free_bit(l2[w2], w2 == w1 / 64 ? w1 % 64 : 0)) >= 0) {
+            w1 = w2 * 64 + b;
+            w0 = w1 * 64 + __builtin_ctzll(~l1[w1]);
+            return (int64_t)w0 * 64 + __builtin_ctzll(~l0[w0]);
+        }
+    }
+    return -1;
+}
+
+// Open, lock and map the state for the subnet. Returns the mapping.
+static state_t *open_state(const char *dir, const char *name, uint32_t base, uint32_t prefix, size_t *len) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+        fail(CNI_ERR_IO, "cannot create data dir %s", dir);
+    snprintf(path, sizeof(path), "%s/%s.state", dir, name);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0)
+        fail(CNI_ERR_IO, "cannot lock %s", path);
+
+    *len = state_size(1U << (32 - prefix));
+    int fresh = st.st_size == 0;
+    if (fresh && ftruncate(fd, *len) < 0)
+        fail(CNI_ERR_IO, "cannot size %s", path);
+    if (!fresh && (size_t)st.st_size != *len)
+        fail(CNI_ERR_CONFIG, "%s belongs to another subnet or plugin version; remove it to start over", path);
+
+    state_t *s = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (s == MAP_FAILED)
+        fail(CNI_ERR_IO, "cannot map %s", path);
+    if (fresh)
+        init_state(s, base, prefix);
+    else if (s->magic != STATE_MAGIC || s->base != base || s->prefix != prefix)
+        fail(CNI_ERR_CONFIG, "%s belongs to another subnet or plugin version; remove it to start over", path);
+
+    // The lock stays held through the fd until exit
+    return s;
+}
+
+static void format_ip(uint32_t addr, char *out) {
+    struct in_addr in = { htonl(addr) };
+    inet_ntop(AF_INET, &in, out, INET_ADDRSTRLEN);
+}
+
+int main(void) {
+    const char *command = getenv("CNI_COMMAND");
+    const char *container = getenv("CNI_CONTAINERID");
+    const char *netns = getenv("CNI_NETNS") ? getenv("CNI_NETNS") : "";
+    const char *ifname = getenv("CNI_IFNAME") ? getenv("CNI_IFNAME") : "eth0";
+    char config[65536], subnet[64] = DEFAULT_SUBNET, dir[PATH_MAX] = DEFAULT_DATA_DIR;
+    char name[128] = "noop", buf[2048];
+    size_t n = 0;
+    ssize_t r;
+    int len;
+
+    if (!command)
+        fail(CNI_ERR_ENV, "CNI_COMMAND is not set%s", "");
+    if (strcmp(command, "VERSION") == 0) {
+        len = snprintf(buf, sizeof(buf),
+                       "{\"cniVersion\":\"1.0.0\",\"supportedVersions\":[\"0.3.0\",\"0.3.1\",\"0.4.0\",\"1.0.0\"]}\n");
+        reply(buf, len);
+        return 0;
+    }
+
+    while (n < sizeof(config) - 1 && (r = read(STDIN_FILENO, config + n, sizeof(config) - 1 - n)) > 0)
+        n += r;
+    config[n] = '\0';
+    json_string(config, "cniVersion", cni_version, sizeof(cni_version));
+    json_string(config, "subnet", subnet, sizeof(subnet));
+    json_string(config, "dataDir", dir, sizeof(dir));
+    json_string(config, "name", name, sizeof(name));
+
+    if (!container || !*container || strchr(container, '/') || strchr(ifname, '/'))
+        fail(CNI_ERR_ENV, "bad CNI_CONTAINERID or CNI_IFNAME%s", "");
+    if (strchr(name, '/'))
+        fail(CNI_ERR_CONFIG, "bad network name %s", name);
+
+    char addr[64];
+    struct in_addr in;
+    int prefix = -1;
+    if (sscanf(subnet, "%63[0-9.]/%d", addr, &prefix) != 2 || inet_pton(AF_INET, addr, &in) != 1 ||
+        prefix < MIN_PREFIX || prefix > MAX_PREFIX)
+        fail(CNI_ERR_CONFIG, "subnet must be an IPv4 CIDR from /12 to /30, got %s", subnet);
+    uint32_t base = ntohl(in.s_addr) & ~((1U << (32 - prefix)) - 1);
+
+    size_t map_len;
+    state_t *s = open_state(dir, name, base, prefix, &map_len);
+
+    char record[PATH_MAX], ip[INET_ADDRSTRLEN], gateway[INET_ADDRSTRLEN];
+    snprintf(record, sizeof(record), "%s/%s.%s", dir, container, ifname);
+    format_ip(base + 1, gateway);
+
+    // The container's current address, if it has one
+    int64_t idx = -1;
+    int fd = open(record, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        char saved[32] = "";
+        if (read(fd, saved, sizeof(saved) - 1) > 0 && inet_pton(AF_INET, saved, &in) == 1)
+            idx = ntohl(in.s_addr) - base;
+        close(fd);
+        if (idx < 0 || idx >= s->size)
+            idx = -1;
+    }
+
+    // A record that outlived its state file can name an address handed to
+    // another container since: it's only ours if the state says so
+    uint64_t me = owner_id(container, ifname);
+    int held = idx >= 0 && in_use(s, idx) && owners(s)[idx] == me;
+
+    if (strcmp(command, "ADD") == 0) {
+        if (idx >= 0 && !in_use(s, idx)) {
+            // Record left from an older state file: take the address back
+            mark_used(s, idx);
+            owners(s)[idx] = me;
+            s->allocated++;
+        } else if (!held) {
+            idx = find_free(s, s->next);
+            if (idx < 0)
+                idx = find_free(s, 0);
+            if (idx < 0)
+                fail(CNI_ERR_EXHAUSTED, "no free addresses left in %s", subnet);
+            mark_used(s, idx);
+            owners(s)[idx] = me;
+            s->allocated++;
+            s->next = idx + 1 < s->size ? idx + 1 : 0;
+
+            format_ip(base + idx, ip);
+            fd = open(record, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0 || write(fd, ip, strlen(ip)) != (ssize_t)strlen(ip))
+                fail(CNI_ERR_IO, "cannot write %s", record);
+            close(fd);
+        }
+        format_ip(base + idx, ip);
+        char sandbox[1024], iface[64];
+        if (!json_escape(netns, sandbox, sizeof(sandbox)) || !json_escape(ifname, iface, sizeof(iface)))
+            fail(CNI_ERR_ENV, "CNI_NETNS or CNI_IFNAME too long%s", "");
+
+        // 0.x results carry "version" per address, 1.0 dropped it
+        len = snprintf(buf, sizeof(buf),
+                       "{\"cniVersion\":\"%s\",\"interfaces\":[{\"name\":\"%s\",\"sandbox\":\"%s\"}],"
+                       "\"ips\":[{%s\"interface\":0,\"address\":\"%s/%d\",\"gateway\":\"%s\"}],\"dns\":{}}\n",
+                       cni_version, iface, sandbox, cni_version[0] == '0' ? "\"version\":\"4\"," : "",
+                       ip, prefix, gateway);
+        if (len >= (int)sizeof(buf))
+            fail(CNI_ERR_ENV, "CNI_NETNS too long%s", "");
+        reply(buf, len);
+    } else if (strcmp(command, "DEL") == 0) {
+        // Releasing something that isn't there succeeds, as the spec asks
+        if (held) {
+            mark_free(s, idx);
+            owners(s)[idx] = 0;
+            s->allocated--;
+        }
+        if (idx >= 0)
+            unlink(record);
+    } else if (strcmp(command, "CHECK") == 0) {
+        if (!held)
+            fail(CNI_ERR_UNKNOWN_CONTAINER, "no address allocated for %s", container);
+    } else {
+        fail(CNI_ERR_ENV, "unknown CNI_COMMAND %s", command);
+    }
+
+    munmap(s, map_len);
+    return 0;
+}
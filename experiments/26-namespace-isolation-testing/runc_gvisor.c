@@ -0,0 +1,302 @@
+/*
+ * Native runc wrapper for gVisor: strips the cgroup namespace from the OCI spec
+ *
+ * Drop-in replacement for runc-gvisor-wrapper.sh without the bash, jq,
+ * sed and mv processes it started on every container operation. For
+ * create and run, linux.namespaces in <bundle>/config.json is located by
+ * a scanner that skips over every other value without building a tree.
+ * Only if a cgroup entry is there is it cut out of the buffer and the
+ * file rewritten in place with a single pwrite(). Every other command
+ * goes straight to execve() of the real runc. LD_PRELOAD is set to
+ * /tmp/runc-preload.so when that exists, as before.
+ *
+ * Global options ahead of the command (containerd-shim passes --root,
+ * --log and --log-format) are skipped; the script only looked at $1 and
+ * so never rewrote the spec of a shim-driven create.
+ *
+ * Each create/run is timed and appended to $RUNC_GVISOR_LOG, or to
+ * /run/runc-gvisor.log if that file exists.
+ *
+ * Build: gcc -O2 -Wall runc_gvisor.c -o runc-gvisor
+ * Usage: install as /usr/bin/runc-gvisor; runs /usr/bin/runc.real (or $RUNC_REAL)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define RUNC_REAL "/usr/bin/runc.real"
+#define PRELOAD_LIB "/tmp/runc-preload.so"
+#define DEFAULT_LOG "/run/runc-gvisor.log"
+#define MAX_CUTS 16
+
+// runc global options that take a value
+static const char *global_value_opts[] = { "root", "log", "log-format", "criu", "rootless", NULL };
+
+typedef struct {
+    const char *p, *end;
+} scan_t;
+
+typedef struct {
+    size_t start, end;
+} cut_t;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void skip_ws(scan_t *s) {
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+        s->p++;
+}
+
+// Skip a string, s at its opening quote
+static int skip_string(scan_t *s) {
+    if (s->p >= s->end || *s->p != '"')
+        return -1;
+    for (s->p++; s->p < s->end; s->p++) {
+        if (*s->p == '\\')
+            s->p++;
+        else if (*s->p == '"') {
+            s->p++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Skip any value. Containers are skipped by bracket depth, strings aside.
+static int skip_value(scan_t *s) {
+    skip_ws(s);
+    if (s->p >= s->end)
+        return -1;
+    if (*s->p == '"')
+        return skip_string(s);
+    if (*s->p != '{' && *s->p != '[') {
+        while (s->p < s->end && !memchr(",}] \t\r\n", *s->p, 8))
+            s->p++;
+        return 0;
+    }
+
+    int depth = 0;
+    while (s->p < s->end) {
+        char c = *s->p;
+        if (c == '"') {
+            if (skip_string(s) < 0)
+                return -1;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            s->p++;
+            return 0;
+        }
+        s->p++;
+    }
+    return -1;
+}
+
+// Move s from the object it points at to the value of its member key.
+// Returns 0 when found, 1 when absent, -1 if the JSON is malformed.
+static int find_member(scan_t *s, const char *key) {
+    size_t klen = strlen(key);
+
+    skip_ws(s);
+    if (s->p >= s->end || *s->p != '{')
+        return -1;
+    s->p++;
+    for (;;) {
+        skip_ws(s);
+        if (s->p < s->end && *s->p == '}')
+            return 1;
+        const char *name = s->p + 1;
+        if (skip_string(s) < 0)
+            return -1;
+        int match = (size_t)(s->p - 1 - name) == klen && memcmp(name, key, klen) == 0;
+
+        skip_ws(s);
+        if (s->p >= s->end || *s->p != ':')
+            return -1;
+        s->p++;
+        skip_ws(s);
+        if (match)
+            return 0;
+
+        if (skip_value(s) < 0)
+            return -1;
+        skip_ws(s);
+        if (s->p < s->end && *s->p == ',')
+            s->p++;
+        else
+            return s->p < s->end && *s->p == '}' ? 1 : -1;
+    }
+}
+
+static void add_cut(cut_t *cuts, int *n, const char *buf, const char *start, const char *end) {
+    size_t a = start - buf, b = end - buf;
+    if (*n > 0 && a <= cuts[*n - 1].end)
+        cuts[*n - 1].end = b;
+    else if (*n < MAX_CUTS)
+        cuts[(*n)++] = (cut_t){ a, b };
+}
+
+// Byte ranges of the cgroup entries in linux.namespaces, each with one
+// adjoining comma so what's left stays valid JSON. Returns the count.
+static int find_cgroup_ns(const char *buf, size_t len, cut_t *cuts) {
+    scan_t s = { buf, buf + len };
+    int n = 0;
+
+    if (find_member(&s, "linux") != 0 || find_member(&s, "namespaces") != 0 ||
+        s.p >= s.end || *s.p != '[')
+        return 0;
+    s.p++;
+
+    const char *prev_end = NULL;  // End of the last element kept
+    for (;;) {
+        skip_ws(&s);
+        if (s.p >= s.end || *s.p == ']')
+            break;
+
+        const char *start = s.p;
+        scan_t type = s;
+        int cgroup = find_member(&type, "type") == 0 && type.end - type.p >= 8 &&
+                     memcmp(type.p, "\"cgroup\"", 8) == 0;
+        if (skip_value(&s) < 0)
+            return 0;
+        const char *end = s.p;
+        skip_ws(&s);
+        int more = s.p < s.end && *s.p == ',';
+        if (more) {
+            s.p++;
+            skip_ws(&s);
+        }
+
+        if (!cgroup)
+            prev_end = end;
+        else if (prev_end)
+            add_cut(cuts, &n, buf, prev_end, end);
+        else
+            add_cut(cuts, &n, buf, start, more ? s.p : end);
+        if (!more)
+            break;
+    }
+    return n;
+}
+
+static void log_timing(const char *cmd, const char *bundle, int removed, size_t before, size_t after,
+                       long long scan_ns, long long write_ns) {
+    const char *path = getenv("RUNC_GVISOR_LOG");
+    int fd = path ? open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)
+                  : open(DEFAULT_LOG, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    // One write per line: concurrent creates append whole lines
+    char line[PATH_MAX + 128];
+    int len = snprintf(line, sizeof(line), "%s %s removed=%d bytes=%zu->%zu scan_us=%.1f write_us=%.1f\n",
+                       cmd, bundle, removed, before, after, scan_ns / 1000.0, write_ns / 1000.0);
+    if (len > (int)sizeof(line) - 1)
+        len = sizeof(line) - 1;
+    (void) !write(fd, line, len);
+    close(fd);
+}
+
+// Cut the cgroup namespace out of <bundle>/config.json
+static void strip_cgroup_namespace(const char *cmd, const char *bundle) {
+    char path[PATH_MAX];
+    struct stat st;
+    cut_t cuts[MAX_CUTS];
+    long long start = monotonic_ns();
+
+    snprintf(path, sizeof(path), "%s/config.json", bundle);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return;  // runc reports the missing spec itself
+    }
+
+    char *buf = malloc(st.st_size + 1);
+    ssize_t len = buf ? pread(fd, buf, st.st_size, 0) : -1;
+    if (len != st.st_size) {
+        free(buf);
+        close(fd);
+        return;
+    }
+
+    int n = find_cgroup_ns(buf, len, cuts);
+    long long scanned = monotonic_ns();
+    size_t out = 0, from = 0;
+    if (n > 0) {
+        for (int i = 0; i < n; i++) {
+            memmove(buf + out, buf + from, cuts[i].start - from);
+            out += cuts[i].start - from;
+            from = cuts[i].end;
+        }
+        memmove(buf + out, buf + from, len - from);
+        out += len - from;
+
+        if (pwrite(fd, buf, out, 0) != (ssize_t)out || ftruncate(fd, out) < 0)
+            fprintf(stderr, "runc-gvisor: rewriting %s: %s\n", path, strerror(errno));
+    }
+    close(fd);
+    free(buf);
+
+    log_timing(cmd, bundle, n, len, n > 0 ? out : (size_t)len, scanned - start,
+               n > 0 ? monotonic_ns() - scanned : 0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *real = getenv("RUNC_REAL") ? getenv("RUNC_REAL") : RUNC_REAL;
+    int i;
+
+    // Find the command past the global options
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        const char *opt = argv[i] + strspn(argv[i], "-");
+        if (strchr(opt, '='))
+            continue;
+        for (const char **v = global_value_opts; *v; v++) {
+            if (strcmp(opt, *v) == 0) {
+                i++;
+                break;
+            }
+        }
+    }
+
+    if (i < argc && (strcmp(argv[i], "create") == 0 || strcmp(argv[i], "run") == 0)) {
+        const char *cmd = argv[i], *bundle = ".";
+        for (int j = i + 1; j < argc; j++) {
+            const char *opt = argv[j] + strspn(argv[j], "-");
+            if (argv[j][0] != '-')
+                continue;
+            if ((strcmp(opt, "bundle") == 0 || strcmp(opt, "b") == 0) && j + 1 < argc) {
+                bundle = argv[j + 1];
+                break;
+            }
+            if (strncmp(opt, "bundle=", 7) == 0 || strncmp(opt, "b=", 2) == 0) {
+                bundle = strchr(opt, '=') + 1;
+                break;
+            }
+        }
+        strip_cgroup_namespace(cmd, bundle);
+    }
+
+    // /proc/sys/* redirection for the runc parent process
+    if (access(PRELOAD_LIB, F_OK) == 0)
+        setenv("LD_PRELOAD", PRELOAD_LIB, 1);
+
+    argv[0] = (char *)real;
+    execv(real, argv);
+    fprintf(stderr, "runc-gvisor: %s: %s\n", real, strerror(errno));
+    return 127;
+}
@@ -0,0 +1,96 @@
+#!/bin/bash
+#
+# Check runc_gvisor.c against the jq rewrite and time it against the script
+#
+# Runs both wrappers with a stub runc (/bin/true), so no container starts
+# and only the wrapper's own cost is measured.
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+TEST_DIR="/tmp/native-wrapper-test"
+ITERATIONS=${ITERATIONS:-200}
+
+rm -rf "$TEST_DIR"
+mkdir -p "$TEST_DIR"
+gcc -O2 -Wall "$SCRIPT_DIR/runc_gvisor.c" -o "$TEST_DIR/runc-gvisor"
+sed "s|^RUNC_REAL=.*|RUNC_REAL=/bin/true|" "$SCRIPT_DIR/runc-gvisor-wrapper.sh" > "$TEST_DIR/runc-gvisor-wrapper.sh"
+export RUNC_REAL=/bin/true
+
+echo "=== Spec rewriting (compared with jq) ==="
+
+# name|namespaces array
+cat > "$TEST_DIR/cases" <<'EOF'
+last|[{"type":"pid"},{"type":"ipc"},{"type":"uts"},{"type":"mount"},{"type":"cgroup"}]
+first|[{"type":"cgroup"},{"type":"pid"},{"type":"network","path":"/var/run/netns/cni-1"}]
+middle|[{"type":"pid"},{"type":"cgroup"},{"type":"network"}]
+only|[{"type":"cgroup"}]
+twice|[{"type":"cgroup"},{"type":"cgroup"},{"type":"pid"}]
+none|[{"type":"pid"},{"type":"ipc","path":"/proc/1/ns/ipc"}]
+tricky|[{"path":"/x/\"cgroup\"","type":"uts"},{"type":"cgroup","path":"{[}"}]
+EOF
+
+failed=0
+while IFS='|' read -r name namespaces; do
+    for style in compact pretty; do
+        bundle="$TEST_DIR/$name-$style"
+        mkdir -p "$bundle"
+        spec='{"ociVersion":"1.0.2","process":{"args":["/pause"],"env":["A={\"type\":\"cgroup\"}"]},"root":{"path":"rootfs"},"linux":{"resources":{"devices":[{"allow":false,"access":"rwm"}]},"namespaces":'"$namespaces"',"maskedPaths":["/proc/kcore"]}}'
+        if [ "$style" = pretty ]; then
+            echo "$spec" | jq . > "$bundle/config.json"
+        else
+            echo "$spec" > "$bundle/config.json"
+        fi
+
+        jq -S 'del(.linux.namespaces[] | select(.type == "cgroup"))' "$bundle/config.json" > "$bundle/expected"
+        "$TEST_DIR/runc-gvisor" --root /run/containerd/runc/k8s.io --log "$bundle/log.json" \
+            --log-format json create --bundle "$bundle" --pid-file "$bundle/pid" test
+        if jq -S . "$bundle/config.json" | cmp -s - "$bundle/expected"; then
+            echo "  ✓ $name ($style)"
+        else
+            echo "  ✗ $name ($style)"
+            cat "$bundle/config.json"
+            failed=1
+        fi
+    done
+done < "$TEST_DIR/cases"
+
+echo ""
+echo "=== Per-invocation cost ($ITERATIONS creates, stub runc) ==="
+
+# A containerd-generated pod sandbox spec is ~10 KiB; pad the env to match
+bundle="$TEST_DIR/bench"
+mkdir -p "$bundle"
+env_pad=$(for i in $(seq 1 120); do printf '"VAR_%03d=value-%064d",' "$i" 0; done)
+template='{"ociVersion":"1.0.2","process":{"args":["/pause"],"env":['"${env_pad%,}"']},"root":{"path":"rootfs"},"linux":{"namespaces":[{"type":"pid"},{"type":"ipc"},{"type":"uts"},{"type":"mount"},{"type":"network"},{"type":"cgroup"}]}}'
+echo "$template" | jq . > "$TEST_DIR/bench.json"
+echo "  spec: $(stat -c %s "$TEST_DIR/bench.json") bytes"
+
+for wrapper in "bash $TEST_DIR/runc-gvisor-wrapper.sh" "$TEST_DIR/runc-gvisor"; do
+    start=$(date +%s%N)
+    for i in $(seq 1 "$ITERATIONS"); do
+        cp "$TEST_DIR/bench.json" "$bundle/config.json"
+        $wrapper create --bundle "$bundle" bench
+    done
+    end=$(date +%s%N)
+
+    # The same loop without the wrapper, to subtract cp and the stub
+    base_start=$(date +%s%N)
+    for i in $(seq 1 "$ITERATIONS"); do
+        cp "$TEST_DIR/bench.json" "$bundle/config.json"
+        /bin/true create --bundle "$bundle" bench
+    done
+    base_end=$(date +%s%N)
+
+    echo "  ${wrapper##*/}: $(( (end - start - (base_end - base_start)) / ITERATIONS / 1000 )) us per create"
+done
+
+echo ""
+echo "=== Rewrite timing log ==="
+RUNC_GVISOR_LOG="$TEST_DIR/timing.log" "$TEST_DIR/runc-gvisor" create --bundle "$TEST_DIR/last-pretty" test
+cp "$TEST_DIR/bench.json" "$bundle/config.json"
+RUNC_GVISOR_LOG="$TEST_DIR/timing.log" "$TEST_DIR/runc-gvisor" create -b "$bundle" bench
+sed 's/^/  /' "$TEST_DIR/timing.log"
+
+exit $failed
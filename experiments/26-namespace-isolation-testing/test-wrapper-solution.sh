@@ -14,8 +14,7 @@ if [ ! -f /usr/bin/runc.real ]; then
 fi
 
 echo "Installing wrapper..."
-cp experiments/26-namespace-isolation-testing/runc-gvisor-wrapper.sh /usr/bin/runc-gvisor
-chmod +x /usr/bin/runc-gvisor
+gcc -O2 -Wall experiments/26-namespace-isolation-testing/runc_gvisor.c -o /usr/bin/runc-gvisor
 
 echo "✓ Wrapper installed at /usr/bin/runc-gvisor"
 echo ""
@@ -0,0 +1,604 @@
+/*
+ * Parallel, content-addressed preloader for the airgap images directory
+ *
+ * k3s imports every tar in agent/images at startup, and containerd writes
+ * each layer into its content store again, through 9p. This tool runs
+ * before containerd starts and stages the blobs of those tars directly in
+ * the content store layout (<root>/io.containerd.content.v1.content/
+ * blobs/sha256/<hex>), so the import finds every blob already present and
+ * only records it (the default "shared" content policy).
+ *
+ * - Tar headers are scanned without reading member data; every layer,
+ *   config and manifest becomes a job, and a pool of threads copies them
+ *   in parallel.
+ * - Blobs are deduped by digest, across the input tars and against what
+ *   the content store already holds.
+ * - Members named by their digest (podman's <hex>.tar / <hex>.json,
+ *   OCI blobs/sha256/<hex>) are copied with copy_file_range(), which
+ *   stays in the kernel and reflinks where the filesystem can. Others
+ *   (old docker-archive <id>/layer.tar) are hashed while copied; -V
+ *   hashes everything.
+ * - <root>/image-preload.index records each tar's size, mtime and blobs,
+ *   so on the next start unchanged tars are skipped without being read.
+ *
+ * Layers are not unpacked into the native snapshotter: its snapshots are
+ * tracked in containerd's bolt metadata, which only containerd writes.
+ * With the content in place, unpack is all that's left of the import.
+ *
+ * Build: gcc -O2 -Wall image_preload.c -o image_preload -lpthread
+ * Usage: ./image_preload [-j threads] [-V] [-r /var/lib/rancher/k3s/agent/containerd] \
+ *            /var/lib/rancher/k3s/agent/images
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define DEFAULT_ROOT "/var/lib/rancher/k3s/agent/containerd"
+#define CONTENT_DIR "io.containerd.content.v1.content"
+#define INDEX_NAME "image-preload.index"
+#define COPY_CHUNK (1 << 20)
+
+typedef struct {
+    char *path;
+    int fd;
+    struct stat st;
+    int skipped;         // Unchanged since the index was written
+    size_t first_blob, n_blobs;
+} tar_t;
+
+typedef struct {
+    size_t tar;
+    off_t offset, size;
+    char hex[65];        // Empty until hashed, for members not named by digest
+    int duplicate;       // Same digest as an earlier job
+    int copied;
+} blob_t;
+
+typedef struct {
+    char *path;
+    long long size, mtime_ns;
+    char **hexes;
+    size_t n_hexes;
+} index_entry_t;
+
+static tar_t *tars;
+static size_t n_tars;
+static blob_t *blobs;
+static size_t n_blobs, cap_blobs;
+static index_entry_t *old_index;
+static size_t n_old_index;
+
+// Room left in the paths for "/<hex>" and "/preload-<pid>-<job>"
+static char blob_dir[PATH_MAX - 128], ingest_dir[PATH_MAX - 128], index_path[PATH_MAX - 128];
+static int verify_all;
+
+static size_t next_job;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long bytes_copied, n_copied, n_present, n_duplicate, n_failed;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* SHA-256 (FIPS 180-4) */
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t len;
+    unsigned char buf[64];
+    size_t used;
+} sha256_t;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(sha256_t *c, const unsigned char *p) {
+    uint32_t w[64], a, b, d, e, f, g, h, cc, t1, t2;
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++)
+        w[i] = (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+               (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+
+    a = c->h[0]; b = c->h[1]; cc = c->h[2]; d = c->h[3];
+    e = c->h[4]; f = c->h[5]; g = c->h[6]; h = c->h[7];
+    for (int i = 0; i < 64; i++) {
+        t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & cc) ^ (b & cc));
+        h = g; g = f; f = e; e = d + t1;
+        d = cc; cc = b; b = a; a = t1 + t2;
+    }
+    c->h[0] += a; c->h[1] += b; c->h[2] += cc; c->h[3] += d;
+    c->h[4] += e; c->h[5] += f; c->h[6] += g; c->h[7] += h;
+}
+
+static void sha256_init(sha256_t *c) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(c->h, init, sizeof(init));
+    c->len = 0;
+    c->used = 0;
+}
+
+static void sha256_update(sha256_t *c, const unsigned char *p, size_t n) {
+    c->len += n;
+    if (c->used) {
+        size_t take = n < 64 - c->used ? n : 64 - c->used;
+        memcpy(c->buf + c->used, p, take);
+        c->used += take;
+        p += take;
+        n -= take;
+        if (c->used < 64)
+            return;
+        sha256_block(c, c->buf);
+        c->used = 0;
+    }
+    for (; n >= 64; p += 64, n -= 64)
+        sha256_block(c, p);
+    memcpy(c->buf, p, n);
+    c->used = n;
+}
+
+static void sha256_hex(sha256_t *c, char *hex) {
+    uint64_t bits = c->len * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t n = (c->used < 56 ? 56 : 120) - c->used;
+    for (int i = 0; i < 8; i++)
+        pad[n + i] = bits >> (56 - 8 * i);
+    sha256_update(c, pad, n + 8);
+    for (int i = 0; i < 8; i++)
+        sprintf(hex + 8 * i, "%08x", c->h[i]);
+}
+
+/* Tar scanning */
+
+static int is_hex64(const char *s, size_t n) {
+    if (n != 64)
+        return 0;
+    for (size_t i = 0; i < n; i++)
+        if (!((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f')))
+            return 0;
+    return 1;
+}
+
+static long long tar_number(const char *field, size_t len) {
+    long long v = 0;
+    if ((unsigned char)field[0] & 0x80) {  // base-256
+        for (size_t i = 1; i < len; i++)
+            v = v << 8 | (unsigned char)field[i];
+        return v;
+    }
+    for (size_t i = 0; i < len && field[i]; i++)
+        if (field[i] >= '0' && field[i] <= '7')
+            v = v * 8 + field[i] - '0';
+    return v;
+}
+
+// Queue a member if it is a blob; hex is filled when the name is a digest
+static void consider_member(size_t tar, const char *name, off_t offset, off_t size) {
+    const char *base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    size_t len = strlen(base);
+    char hex[65] = "";
+
+    if (strncmp(name, "blobs/sha256/", 13) == 0 && is_hex64(base, len))
+        memcpy(hex, base, 64);
+    else if (!strchr(name, '/') && is_hex64(base, 64) &&
+             (strcmp(base + 64, ".tar") == 0 || strcmp(base + 64, ".json") == 0))
+        memcpy(hex, base, 64);
+    else if (strcmp(base, "layer.tar") != 0)
+        return;
+
+    if (n_blobs == cap_blobs) {
+        cap_blobs = cap_blobs ? cap_blobs * 2 : 256;
+        blobs = realloc(blobs, cap_blobs * sizeof(blob_t));
+        if (!blobs) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    blob_t *b = &blobs[n_blobs++];
+    memset(b, 0, sizeof(*b));
+    b->tar = tar;
+    b->offset = offset;
+    b->size = size;
+    memcpy(b->hex, hex, sizeof(hex));
+}
+
+// Walk the headers of a tar, reading 512 bytes per member
+static int scan_tar(size_t t) {
+    char hdr[512], long_name[PATH_MAX] = "";
+    off_t off = 0;
+
+    tars[t].first_blob = n_blobs;
+    while (pread(tars[t].fd, hdr, 512, off) == 512 && hdr[0]) {
+        long long size = tar_number(hdr + 124, 12);
+        char type = hdr[156], name[PATH_MAX];
+        off_t data = off + 512;
+
+        if (long_name[0]) {
+            snprintf(name, sizeof(name), "%s", long_name);
+            long_name[0] = '\0';
+        } else if (memcmp(hdr + 257, "ustar", 5) == 0 && hdr[345]) {
+            snprintf(name, sizeof(name), "%.155s/%.100s", hdr + 345, hdr);
+        } else {
+            snprintf(name, sizeof(name), "%.100s", hdr);
+        }
+
+        if (type == 'L') {
+            // GNU long name: the data is the next member's name
+            size_t n = size < (long long)sizeof(long_name) - 1 ? (size_t)size : sizeof(long_name) - 1;
+            if (pread(tars[t].fd, long_name, n, data) != (ssize_t)n)
+                return -1;
+            long_name[n] = '\0';
+        } else if (type == 'x') {
+            // PAX header: only path= matters here
+            char pax[4096];
+            size_t n = size < (long long)sizeof(pax) - 1 ? (size_t)size : sizeof(pax) - 1;
+            if (pread(tars[t].fd, pax, n, data) != (ssize_t)n)
+                return -1;
+            pax[n] = '\0';
+            char *p = strstr(pax, " path=");
+            if (p) {
+                p += 6;
+                snprintf(long_name, sizeof(long_name), "%.*s", (int)strcspn(p, "\n"), p);
+            }
+        } else if (type == '0' || type == '\0') {
+            consider_member(t, name, data, size);
+        }
+        off = data + (size + 511) / 512 * 512;
+    }
+    tars[t].n_blobs = n_blobs - tars[t].first_blob;
+    return 0;
+}
+
+/* Index */
+
+static void load_index(void) {
+    FILE *f = fopen(index_path, "r");
+    char line[PATH_MAX + 64];
+    if (!f)
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        long long size, mtime;
+        int pos;
+        if (sscanf(line, "tar %lld %lld %n", &size, &mtime, &pos) == 2) {
+            old_index = realloc(old_index, (n_old_index + 1) * sizeof(index_entry_t));
+            index_entry_t *e = &old_index[n_old_index++];
+            memset(e, 0, sizeof(*e));
+            e->path = strdup(line + pos);
+            e->size = size;
+            e->mtime_ns = mtime;
+        } else if (strncmp(line, "blob ", 5) == 0 && n_old_index) {
+            index_entry_t *e = &old_index[n_old_index - 1];
+            e->hexes = realloc(e->hexes, (e->n_hexes + 1) * sizeof(char *));
+            e->hexes[e->n_hexes++] = strdup(line + 5);
+        }
+    }
+    fclose(f);
+}
+
+static int blob_present(const char *hex) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", blob_dir, hex);
+    return access(path, F_OK) == 0;
+}
+
+// A tar is skipped when it is unchanged and all its blobs are still there
+static int unchanged(const tar_t *t) {
+    long long mtime = t->st.st_mtim.tv_sec * 1000000000LL + t->st.st_mtim.tv_nsec;
+    for (size_t i = 0; i < n_old_index; i++) {
+        index_entry_t *e = &old_index[i];
+        if (strcmp(e->path, t->path) != 0 || e->size != t->st.st_size || e->mtime_ns != mtime)
+            continue;
+        for (size_t j = 0; j < e->n_hexes; j++)
+            if (!blob_present(e->hexes[j]))
+                return 0;
+        return 1;
+    }
+    return 0;
+}
+
+// Whether every blob of a scanned tar made it into the store
+static int complete(const tar_t *t) {
+    for (size_t b = t->first_blob; b < t->first_blob + t->n_blobs; b++)
+        if (!blobs[b].hex[0] || !blob_present(blobs[b].hex))
+            return 0;
+    return 1;
+}
+
+static const index_entry_t *find_entry(const char *path) {
+    for (size_t i = 0; i < n_old_index; i++)
+        if (strcmp(old_index[i].path, path) == 0)
+            return &old_index[i];
+    return NULL;
+}
+
+// Rewrite the index with one write and a rename; incomplete tars are left out
+static void write_index(void) {
+    size_t cap = 4096, len = 0;
+    char *buf = malloc(cap), tmp[PATH_MAX + 8];
+
+    for (size_t t = 0; t < n_tars; t++) {
+        const tar_t *tar = &tars[t];
+        const index_entry_t *old = tar->skipped ? find_entry(tar->path) : NULL;
+        size_t n = old ? old->n_hexes : tar->n_blobs;
+        if (!old && !complete(tar))
+            continue;
+
+        while (len + strlen(tar->path) + 64 + n * 70 >= cap)
+            buf = realloc(buf, cap *= 2);
+        len += sprintf(buf + len, "tar %lld %lld %s\n", (long long)tar->st.st_size,
+                       tar->st.st_mtim.tv_sec * 1000000000LL + tar->st.st_mtim.tv_nsec, tar->path);
+        for (size_t i = 0; i < n; i++)
+            len += sprintf(buf + len, "blob %s\n", old ? old->hexes[i] : blobs[tar->first_blob + i].hex);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", index_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, buf, len) != (ssize_t)len || rename(tmp, index_path) < 0)
+        perror(index_path);
+    if (fd >= 0)
+        close(fd);
+    free(buf);
+}
+
+/* Copying */
+
+// Copy one member into the store. Returns bytes written or -1.
+static long long copy_blob(blob_t *b, size_t job, unsigned char *buf) {
+    int in = tars[b->tar].fd;
+    char tmp[PATH_MAX], target[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/preload-%d-%zu", ingest_dir, getpid(), job);
+
+    // Read-only like the blobs containerd commits
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0444);
+    if (out < 0)
+        return -1;
+
+    off_t in_off = b->offset, left = b->size;
+    int hash = verify_all || !b->hex[0];
+    sha256_t sha;
+    sha256_init(&sha);
+
+    // Digest-named members go through the kernel; the rest are hashed on the way
+    while (!hash && left > 0) {
+        ssize_t n = copy_file_range(in, &in_off, out, NULL, left, 0);
+        if (n <= 0) {
+            if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+                break;
+            goto fail;
+        }
+        left -= n;
+    }
+    while (left > 0) {
+        ssize_t n = pread(in, buf, left < COPY_CHUNK ? left : COPY_CHUNK, in_off);
+        if (n <= 0 || write(out, buf, n) != n)
+            goto fail;
+        if (hash)
+            sha256_update(&sha, buf, n);
+        in_off += n;
+        left -= n;
+    }
+    close(out);
+    out = -1;
+
+    if (hash) {
+        char hex[65];
+        sha256_hex(&sha, hex);
+        if (b->hex[0] && strcmp(b->hex, hex) != 0) {
+            unlink(tmp);
+            errno = EBADMSG;  // Member doesn't match the digest it is named by
+            return -1;
+        }
+        memcpy(b->hex, hex, sizeof(hex));
+    }
+
+    snprintf(target, sizeof(target), "%s/%s", blob_dir, b->hex);
+    if (access(target, F_OK) == 0) {
+        // Another job hashed its way to the same digest
+        unlink(tmp);
+        return 0;
+    }
+    if (rename(tmp, target) < 0)
+        goto fail;
+    return b->size;
+
+fail:
+    if (out >= 0)
+        close(out);
+    unlink(tmp);
+    return -1;
+}
+
+static void *worker(void *arg) {
+    (void) arg;
+    unsigned char *buf = malloc(COPY_CHUNK);
+
+    for (;;) {
+        pthread_mutex_lock(&job_lock);
+        size_t job = next_job++;
+        pthread_mutex_unlock(&job_lock);
+        if (job >= n_blobs)
+            break;
+
+        blob_t *b = &blobs[job];
+        if (tars[b->tar].skipped)
+            continue;
+        if (b->duplicate) {
+            __atomic_add_fetch(&n_duplicate, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (b->hex[0] && blob_present(b->hex)) {
+            __atomic_add_fetch(&n_present, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        long long n = copy_blob(b, job, buf);
+        if (n < 0) {
+            fprintf(stderr, "%s: copying member at offset %lld: %s\n", tars[b->tar].path,
+                    (long long)b->offset, strerror(errno));
+            __atomic_add_fetch(&n_failed, 1, __ATOMIC_RELAXED);
+            b->hex[0] = '\0';
+            continue;
+        }
+        b->copied = 1;
+        __atomic_add_fetch(&n_copied, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bytes_copied, n, __ATOMIC_RELAXED);
+    }
+    free(buf);
+    return NULL;
+}
+
+static int compare_hex(const void *a, const void *b) {
+    const blob_t *x = *(blob_t *const *)a, *y = *(blob_t *const *)b;
+    int c = strcmp(x->hex, y->hex);
+    return c ? c : (x < y ? -1 : x > y);
+}
+
+static void add_tar(const char *path) {
+    tars = realloc(tars, (n_tars + 1) * sizeof(tar_t));
+    tar_t *t = &tars[n_tars];
+    memset(t, 0, sizeof(*t));
+    t->path = realpath(path, NULL);
+    t->fd = t->path ? open(t->path, O_RDONLY | O_CLOEXEC) : -1;
+    if (t->fd < 0 || fstat(t->fd, &t->st) < 0) {
+        perror(path);
+        return;
+    }
+    n_tars++;
+}
+
+static int mkdirs(const char *path) {
+    char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = buf + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buf, 0711) < 0 && errno != EEXIST)
+                return -1;
+            *p = '/';
+        }
+    }
+    return mkdir(buf, 0711) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *root = DEFAULT_ROOT;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:j:V")) != -1) {
+        switch (opt) {
+        case 'r': root = optarg; break;
+        case 'j': threads = atoi(optarg); break;
+        case 'V': verify_all = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-j threads] [-V] [-r containerd-root] <images-dir|image.tar>...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, "Usage: %s [-j threads] [-V] [-r containerd-root] <images-dir|image.tar>...\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1)
+        threads = 1;
+    long long start = monotonic_ns();
+
+    snprintf(blob_dir, sizeof(blob_dir), "%s/%s/blobs/sha256", root, CONTENT_DIR);
+    snprintf(ingest_dir, sizeof(ingest_dir), "%s/%s/ingest", root, CONTENT_DIR);
+    snprintf(index_path, sizeof(index_path), "%s/%s", root, INDEX_NAME);
+    if (mkdirs(blob_dir) < 0 || mkdirs(ingest_dir) < 0) {
+        perror(root);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+        DIR *d = stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode) ? opendir(argv[i]) : NULL;
+        if (!d) {
+            add_tar(argv[i]);
+            continue;
+        }
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            size_t len = strlen(de->d_name);
+            if (len > 4 && strcmp(de->d_name + len - 4, ".tar") == 0) {
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "%s/%s", argv[i], de->d_name);
+                add_tar(path);
+            }
+        }
+        closedir(d);
+    }
+
+    load_index();
+    size_t n_skipped = 0;
+    for (size_t t = 0; t < n_tars; t++) {
+        if (!verify_all && unchanged(&tars[t])) {
+            tars[t].skipped = 1;
+            tars[t].first_blob = n_blobs;
+            n_skipped++;
+        } else if (scan_tar(t) < 0) {
+            fprintf(stderr, "%s: truncated tar\n", tars[t].path);
+        }
+    }
+
+    // Mark repeats of a digest so only one job copies it
+    blob_t **sorted = malloc(n_blobs * sizeof(blob_t *));
+    size_t n_sorted = 0;
+    for (size_t i = 0; i < n_blobs; i++)
+        if (blobs[i].hex[0])
+            sorted[n_sorted++] = &blobs[i];
+    qsort(sorted, n_sorted, sizeof(blob_t *), compare_hex);
+    for (size_t i = 1; i < n_sorted; i++)
+        sorted[i]->duplicate = strcmp(sorted[i]->hex, sorted[i - 1]->hex) == 0;
+    free(sorted);
+
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    for (long i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, worker, NULL);
+    for (long i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+
+    // Duplicates share the digest of the job that copied them
+    for (size_t i = 0; i < n_blobs; i++)
+        if (blobs[i].duplicate && !blob_present(blobs[i].hex))
+            blobs[i].hex[0] = '\0';
+
+    write_index();
+
+    double ms = (monotonic_ns() - start) / 1e6;
+    printf("[image_preload] %zu tars (%zu unchanged), %zu blobs: %llu copied (%.1f MiB), "
+           "%llu already in store, %llu duplicates, %llu failed, %.1f ms\n",
+           n_tars, n_skipped, n_blobs, n_copied, bytes_copied / 1048576.0, n_present, n_duplicate,
+           n_failed, ms);
+    return n_failed ? 1 : 0;
+}
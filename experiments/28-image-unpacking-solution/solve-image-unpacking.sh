@@ -10,6 +10,7 @@ pkill -f "k3s server" 2>/dev/null
 sleep 3
 
 # Setup
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 DATA_DIR="/tmp/k3s-100"
 rm -rf $DATA_DIR
 mkdir -p $DATA_DIR/agent/{etc/containerd,images}
@@ -32,6 +33,11 @@ if podman images | grep -q "rancher/k3s"; then
     echo "✓ k3s image exported"
 fi
 
+# Stage the blobs in containerd's content store before it starts, so the
+# import at startup finds them there instead of writing them again
+[ -x "$SCRIPT_DIR/image_preload" ] || gcc -O2 -Wall "$SCRIPT_DIR/image_preload.c" -o "$SCRIPT_DIR/image_preload" -lpthread
+"$SCRIPT_DIR/image_preload" -r $DATA_DIR/agent/containerd $DATA_DIR/agent/images
+
 echo ""
 echo "Step 2: Configuring containerd..."
 
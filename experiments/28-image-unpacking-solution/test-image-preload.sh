@@ -0,0 +1,157 @@
+#!/bin/bash
+#
+# Check image_preload.c on synthetic image tars and time a cold and warm run
+#
+# No podman in the test environment, so the archives are put together
+# with tar in the three layouts the preloader reads:
+#   podman docker-archive   <hex>.tar layers, <hex>.json config
+#   OCI archive             blobs/sha256/<hex>
+#   old docker save         <id>/layer.tar (not named by digest)
+# Two images share their base layer, so dedupe across tars is exercised.
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+TEST_DIR="/tmp/image-preload-test"
+LAYER_MB=${LAYER_MB:-64}
+ROOT="$TEST_DIR/containerd"
+BLOBS="$ROOT/io.containerd.content.v1.content/blobs/sha256"
+
+rm -rf "$TEST_DIR"
+mkdir -p "$TEST_DIR/build" "$TEST_DIR/images"
+gcc -O2 -Wall "$SCRIPT_DIR/image_preload.c" -o "$TEST_DIR/image_preload" -lpthread
+
+sha() { sha256sum "$1" | cut -d' ' -f1; }
+
+# A layer tar of random content, $2 MiB, named by its digest
+make_layer() {
+    local dir="$TEST_DIR/build/src-$1"
+    mkdir -p "$dir/usr/lib"
+    head -c "$(( $2 * 1048576 ))" /dev/urandom > "$dir/usr/lib/$1.so"
+    tar -C "$dir" -cf "$TEST_DIR/build/$1.layer" .
+    sha "$TEST_DIR/build/$1.layer"
+}
+
+base=$(make_layer base "$LAYER_MB")
+app=$(make_layer app "$LAYER_MB")
+tool=$(make_layer tool "$(( LAYER_MB / 4 ))")
+old=$(make_layer old "$(( LAYER_MB / 4 ))")
+
+# podman docker-archive: base + app
+d="$TEST_DIR/build/docker"
+mkdir -p "$d"
+cp "$TEST_DIR/build/base.layer" "$d/$base.tar"
+cp "$TEST_DIR/build/app.layer" "$d/$app.tar"
+echo '{"architecture":"amd64","os":"linux","rootfs":{"type":"layers","diff_ids":["sha256:'"$base"'","sha256:'"$app"'"]}}' > "$d/config"
+config=$(sha "$d/config")
+mv "$d/config" "$d/$config.json"
+echo '[{"Config":"'"$config"'.json","RepoTags":["docker.io/library/app:latest"],"Layers":["'"$base"'.tar","'"$app"'.tar"]}]' > "$d/manifest.json"
+tar -C "$d" -cf "$TEST_DIR/images/app.tar" manifest.json "$config.json" "$base.tar" "$app.tar"
+
+# OCI archive: base + tool, base shared with the image above
+o="$TEST_DIR/build/oci"
+mkdir -p "$o/blobs/sha256"
+cp "$TEST_DIR/build/base.layer" "$o/blobs/sha256/$base"
+cp "$TEST_DIR/build/tool.layer" "$o/blobs/sha256/$tool"
+echo '{"architecture":"amd64","os":"linux","rootfs":{"type":"layers","diff_ids":["sha256:'"$base"'","sha256:'"$tool"'"]}}' > "$o/config"
+oci_config=$(sha "$o/config")
+mv "$o/config" "$o/blobs/sha256/$oci_config"
+echo '{"schemaVersion":2,"config":{"digest":"sha256:'"$oci_config"'"},"layers":[{"digest":"sha256:'"$base"'"},{"digest":"sha256:'"$tool"'"}]}' > "$o/manifest"
+oci_manifest=$(sha "$o/manifest")
+mv "$o/manifest" "$o/blobs/sha256/$oci_manifest"
+echo '{"schemaVersion":2,"manifests":[{"digest":"sha256:'"$oci_manifest"'"}]}' > "$o/index.json"
+echo '{"imageLayoutVersion":"1.0.0"}' > "$o/oci-layout"
+tar -C "$o" -cf "$TEST_DIR/images/tool.tar" oci-layout index.json blobs
+
+# Old docker save: <id>/layer.tar, digest only known after hashing
+l="$TEST_DIR/build/legacy"
+mkdir -p "$l/0123456789abcdef"
+cp "$TEST_DIR/build/old.layer" "$l/0123456789abcdef/layer.tar"
+echo '[{"Config":"x.json","Layers":["0123456789abcdef/layer.tar"]}]' > "$l/manifest.json"
+tar -C "$l" -cf "$TEST_DIR/images/legacy.tar" manifest.json 0123456789abcdef
+
+expected="$base $app $tool $old $config $oci_config $oci_manifest"
+failed=0
+check() {
+    if eval "$2"; then
+        echo "  ✓ $1"
+    else
+        echo "  ✗ $1"
+        failed=1
+    fi
+}
+
+store_ok() {
+    for hex in $expected; do
+        [ -f "$BLOBS/$hex" ] && [ "$(sha "$BLOBS/$hex")" = "$hex" ] || return 1
+    done
+    [ "$(ls "$BLOBS" | wc -l)" -eq 7 ] && [ -z "$(ls "$ROOT/io.containerd.content.v1.content/ingest")" ]
+}
+
+echo "=== Correctness ==="
+drop_caches() { sync; echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true; }
+
+drop_caches
+out=$("$TEST_DIR/image_preload" -r "$ROOT" "$TEST_DIR/images")
+echo "  $out"
+check "every blob in the store under its digest" store_ok
+check "shared base layer copied once" '[[ "$out" == *"7 copied"* && "$out" == *"1 duplicates"* ]]'
+check "blobs read-only like containerd's" '[ "$(stat -c %a "$BLOBS/$base")" = 444 ]'
+
+out=$("$TEST_DIR/image_preload" -r "$ROOT" "$TEST_DIR/images")
+check "unchanged tars skipped on restart" '[[ "$out" == *"(3 unchanged), 0 blobs"* ]]'
+
+touch "$TEST_DIR/images/tool.tar"
+out=$("$TEST_DIR/image_preload" -r "$ROOT" "$TEST_DIR/images")
+check "touched tar rescanned, blobs found in store" '[[ "$out" == *"(2 unchanged)"* && "$out" == *"0 copied"* && "$out" == *"4 already in store"* ]]'
+
+rm -f "$BLOBS/$app"
+out=$("$TEST_DIR/image_preload" -r "$ROOT" "$TEST_DIR/images")
+check "blob removed from store copied again" '[[ "$out" == *"(2 unchanged)"* && "$out" == *"1 copied"* ]] && store_ok'
+
+# A member whose content doesn't match its name
+cp "$TEST_DIR/images/app.tar" "$TEST_DIR/build/bad.tar"
+printf 'X' | dd of="$TEST_DIR/build/bad.tar" bs=1 seek=$(( 3 * 512 + 4096 )) conv=notrunc status=none
+rm -rf "$TEST_DIR/bad-root"
+set +e
+"$TEST_DIR/image_preload" -V -r "$TEST_DIR/bad-root" "$TEST_DIR/build/bad.tar" > /dev/null 2>&1
+status=$?
+set -e
+check "-V rejects a member that doesn't match its digest" '[ $status -ne 0 ] && [ ! -s "$TEST_DIR/bad-root/image-preload.index" ]'
+
+echo ""
+echo "=== Timing ($(du -sh "$TEST_DIR/images" | cut -f1) of image tars) ==="
+
+# What the import does today for the blobs: read every member and write it
+baseline() {
+    rm -rf "$TEST_DIR/cp-store" && mkdir -p "$TEST_DIR/cp-store"
+    for tarball in "$TEST_DIR"/images/*.tar; do
+        tar -C "$TEST_DIR/cp-store" -xf "$tarball"
+    done
+}
+drop_caches
+start=$(date +%s%N); baseline; end=$(date +%s%N)
+echo "  sequential tar -x of every tar:  $(( (end - start) / 1000000 )) ms"
+
+for threads in 1 4; do
+    rm -rf "$ROOT"
+    drop_caches
+    start=$(date +%s%N)
+    "$TEST_DIR/image_preload" -j "$threads" -r "$ROOT" "$TEST_DIR/images" > /dev/null
+    end=$(date +%s%N)
+    echo "  image_preload -j $threads, cold store: $(( (end - start) / 1000000 )) ms"
+done
+
+rm -rf "$ROOT"
+start=$(date +%s%N)
+"$TEST_DIR/image_preload" -V -r "$ROOT" "$TEST_DIR/images" > /dev/null
+end=$(date +%s%N)
+echo "  image_preload -V, cold store:    $(( (end - start) / 1000000 )) ms"
+
+start=$(date +%s%N)
+"$TEST_DIR/image_preload" -r "$ROOT" "$TEST_DIR/images" > /dev/null
+end=$(date +%s%N)
+echo "  image_preload, restart:          $(( (end - start) / 1000000 )) ms"
+
+exit $failed
@@ -22,16 +22,10 @@ rm -rf $WORK_DIR
 mkdir -p $WORK_DIR/{containerd,k3s}
 
 echo "Step 2: Setting up prerequisites"
-mkdir -p /tmp/fake-procsys/kernel /tmp/fake-procsys/vm /run/exp32-containerd /opt/cni/bin /etc/cni/net.d
+mkdir -p /run/exp32-containerd /opt/cni/bin /etc/cni/net.d
 
 # Fake proc/sys files
-echo "40" > /tmp/fake-procsys/kernel/cap_last_cap
-echo "0" > /tmp/fake-procsys/kernel/panic
-echo "0" > /tmp/fake-procsys/kernel/panic_on_oops
-echo "999999" > /tmp/fake-procsys/kernel/keys/root_maxkeys
-echo "25000000" > /tmp/fake-procsys/kernel/keys/root_maxbytes
-echo "1" > /tmp/fake-procsys/vm/overcommit_memory
-echo "0" > /tmp/fake-procsys/vm/panic_on_oom
+"$(dirname "${BASH_SOURCE[0]}")"/../34-fake-tree-spec/fake-tree.sh -q /proc/sys=/tmp/fake-procsys
 
 touch /dev/kmsg 2>/dev/null
 mount --bind /dev/null /dev/kmsg 2>/dev/null || true
@@ -77,6 +71,18 @@ EOF
 echo "✓ Config created"
 echo ""
 
+# Stage the image blobs in the content store while containerd is down;
+# the import in step 5 then only records them
+if [ ! -f /tmp/pause-image.tar ]; then
+    echo "Exporting pause image..."
+    podman pull docker.io/rancher/mirrored-pause:3.6 2>/dev/null
+    podman save docker.io/rancher/mirrored-pause:3.6 -o /tmp/pause-image.tar
+fi
+PRELOAD="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)/../28-image-unpacking-solution/image_preload"
+[ -x "$PRELOAD" ] || gcc -O2 -Wall "$PRELOAD.c" -o "$PRELOAD" -lpthread
+"$PRELOAD" -r $WORK_DIR/containerd/root /tmp/pause-image.tar
+echo ""
+
 # Start containerd
 echo "Step 4: Starting patched containerd"
 /usr/bin/containerd-gvisor-patched --config $WORK_DIR/containerd/config.toml > $WORK_DIR/containerd.log 2>&1 &
@@ -95,12 +101,6 @@ echo ""
 
 # Import pause image
 echo "Step 5: Pre-loading pause image"
-if [ ! -f /tmp/pause-image.tar ]; then
-    echo "Exporting pause image..."
-    podman pull docker.io/rancher/mirrored-pause:3.6 2>/dev/null
-    podman save docker.io/rancher/mirrored-pause:3.6 -o /tmp/pause-image.tar
-fi
-
 echo "Importing pause image into containerd..."
 ctr --address /run/exp32-containerd/containerd.sock images import /tmp/pause-image.tar
 
@@ -0,0 +1,248 @@
+/*
+ * In-memory virtual file store for fake /proc/sys and cgroup content
+ *
+ * Loads the fake trees (as built by fake_tree from experiment 34) into one
+ * memfd per file and hands those memfds out over a Unix socket, so
+ * interceptors never reopen the 9p-backed copies under /tmp. Clients
+ * reopen the received fd through /proc/self/fd/<n>, getting their own
+ * offset on the shared memfd: a write from kubelet (overcommit_memory,
+ * panic_on_oom, ...) is seen by every later reader.
+ *
+ * Protocol (SOCK_SEQPACKET): the request is a virtual path such as
+ * "/proc/sys/vm/overcommit_memory". The reply is an int errno (0 on
+ * success), plus the memfd as SCM_RIGHTS on success.
+ *
+ * Build: gcc -O2 -Wall vfile_store.c -o vfile_store
+ * Usage: ./vfile_store [-s /run/vfile-store.sock] [-f] \
+ *            /proc/sys=/tmp/fake-procsys /sys/fs/cgroup=/tmp/fake-cgroup
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DEFAULT_SOCKET "/run/vfile-store.sock"
+#define MAX_PATH 4096
+#define HASH_SIZE 4096
+
+typedef struct vfile {
+    char *path;         // Virtual path, e.g. /proc/sys/vm/overcommit_memory
+    int fd;             // memfd holding the content
+    struct vfile *next;
+} vfile_t;
+
+static vfile_t *files[HASH_SIZE];
+static size_t n_files, n_bytes;
+static unsigned long long n_requests, n_misses;
+static const char *socket_path = DEFAULT_SOCKET;
+static volatile sig_atomic_t running = 1;
+
+static uint32_t path_hash(const char *path) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (; *path; path++)
+        h = (h ^ (unsigned char)*path) * 16777619u;
+    return h % HASH_SIZE;
+}
+
+static vfile_t *find_file(const char *path) {
+    for (vfile_t *f = files[path_hash(path)]; f; f = f->next)
+        if (strcmp(f->path, path) == 0)
+            return f;
+    return NULL;
+}
+
+// Copy one on-disk file into a new memfd under its virtual path
+static int load_file(const char *vpath, const char *src) {
+    char buf[65536];
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return -1;
+
+    const char *name = strrchr(vpath, '/');
+    int fd = memfd_create(name ? name + 1 : vpath, MFD_CLOEXEC);
+    if (fd < 0) {
+        close(in);
+        return -1;
+    }
+
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(fd, buf, n) != n) {
+            n = -1;
+            break;
+        }
+        n_bytes += n;
+    }
+    close(in);
+
+    vfile_t *f = n < 0 ? NULL : calloc(1, sizeof(vfile_t));
+    if (!f || !(f->path = strdup(vpath))) {
+        free(f);
+        close(fd);
+        return -1;
+    }
+    f->fd = fd;
+
+    uint32_t h = path_hash(vpath);
+    f->next = files[h];
+    files[h] = f;
+    n_files++;
+    return 0;
+}
+
+// Load a source directory recursively under a virtual prefix
+static void load_tree(const char *vprefix, const char *src) {
+    DIR *d = opendir(src);
+    struct dirent *de;
+    if (!d) {
+        perror(src);
+        return;
+    }
+
+    while ((de = readdir(d)) != NULL) {
+        char vpath[MAX_PATH], spath[MAX_PATH];
+        struct stat st;
+
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        snprintf(vpath, sizeof(vpath), "%s/%s", vprefix, de->d_name);
+        snprintf(spath, sizeof(spath), "%s/%s", src, de->d_name);
+        if (stat(spath, &st) < 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode))
+            load_tree(vpath, spath);
+        else if (S_ISREG(st.st_mode) && !find_file(vpath) && load_file(vpath, spath) < 0)
+            fprintf(stderr, "[vfile_store] Failed to load %s: %s\n", spath, strerror(errno));
+    }
+    closedir(d);
+}
+
+// Answer one request: errno, plus the memfd when found
+static void serve_request(int conn) {
+    char path[MAX_PATH];
+    ssize_t n = recv(conn, path, sizeof(path) - 1, 0);
+    if (n <= 0)
+        return;
+    path[n] = '\0';
+    n_requests++;
+
+    vfile_t *f = find_file(path);
+    int err = f ? 0 : ENOENT;
+    if (!f)
+        n_misses++;
+
+    struct iovec iov = { &err, sizeof(err) };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (f) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &f->fd, sizeof(int));
+    }
+    sendmsg(conn, &msg, MSG_NOSIGNAL);
+}
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static void report(int sig) {
+    (void)sig;
+    fprintf(stderr, "[vfile_store] %zu files, %zu bytes, %llu requests, %llu misses\n",
+            n_files, n_bytes, n_requests, n_misses);
+}
+
+int main(int argc, char *argv[]) {
+    int foreground = 0, opt;
+
+    while ((opt = getopt(argc, argv, "s:f")) != -1) {
+        switch (opt) {
+        case 's': socket_path = optarg; break;
+        case 'f': foreground = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-s socket] [-f] <virtual=source>...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, "Usage: %s [-s socket] [-f] <virtual=source>...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        char *eq = strchr(argv[i], '=');
+        if (!eq) {
+            fprintf(stderr, "Bad mapping (want virtual=source): %s\n", argv[i]);
+            return 1;
+        }
+        *eq = '\0';
+        load_tree(argv[i], eq + 1);
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int lfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    unlink(socket_path);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 128) < 0) {
+        perror(socket_path);
+        return 1;
+    }
+    chmod(socket_path, 0666);
+
+    report(0);
+    if (!foreground && daemon(0, 1) < 0) {
+        perror("daemon");
+        return 1;
+    }
+
+    struct sigaction sa = { .sa_handler = handle_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = report;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (running) {
+        int conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0)
+            continue;
+
+        // One request per connection; don't let an idle client stall others
+        struct timeval tv = { 0, 100000 };
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        serve_request(conn);
+        close(conn);
+    }
+
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#!/bin/bash
+#
+# Build fake-tree.spec with fake_tree, compiling it first if needed
+#
+# Usage: fake-tree.sh [-c] /proc/sys=/tmp/fake-procsys /sys/fs/cgroup=/tmp/fake-cgroup ...
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+FAKE_TREE="$SCRIPT_DIR/fake_tree"
+
+if [ ! -x "$FAKE_TREE" ] || [ "$SCRIPT_DIR/fake_tree.c" -nt "$FAKE_TREE" ]; then
+    gcc -O2 -Wall "$SCRIPT_DIR/fake_tree.c" -o "$FAKE_TREE"
+fi
+
+flags=()
+while [ "${1#-}" != "$1" ]; do
+    flags+=("$1")
+    shift
+done
+exec "$FAKE_TREE" "${flags[@]}" "$SCRIPT_DIR/fake-tree.spec" "$@"
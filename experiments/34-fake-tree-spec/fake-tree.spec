@@ -0,0 +1,91 @@
+# Fake /proc/sys, cgroup and /proc files served to k3s inside gVisor
+#
+# One entry per line, by virtual path; fake_tree maps virtual prefixes to
+# real directories (e.g. /proc/sys=/tmp/fake-procsys). Parents are created
+# as needed.
+#
+#   dir   <path> [mode]                  directory
+#   file  <path> <mode> <value>          value plus a newline ("file x 0644" alone: empty)
+#   text  <path> <mode> <<TAG            the lines up to TAG
+#   gen   <path> <mode> <generator>      realtime_ns, monotonic_ns, ncpus, cpu_list
+#
+# The sysctls use the values kubelet's --protect-kernel-defaults checks for
+# (kernel.panic=10, kernel.panic_on_oops=1, vm.overcommit_memory=1,
+# vm.panic_on_oom=0, kernel.keys.root_max*); the setup scripts disagreed.
+
+# /proc/sys
+file /proc/sys/kernel/panic                               0644 10
+file /proc/sys/kernel/panic_on_oops                       0644 1
+file /proc/sys/kernel/pid_max                             0644 65536
+file /proc/sys/kernel/threads-max                         0644 262144
+file /proc/sys/kernel/cap_last_cap                        0444 40
+file /proc/sys/kernel/keys/root_maxkeys                   0644 1000000
+file /proc/sys/kernel/keys/root_maxbytes                  0644 25000000
+file /proc/sys/vm/overcommit_memory                       0644 1
+file /proc/sys/vm/panic_on_oom                            0644 0
+file /proc/sys/net/core/rmem_max                          0644 212992
+file /proc/sys/net/core/wmem_max                          0644 212992
+file /proc/sys/net/ipv4/ip_forward                        0644 1
+file /proc/sys/net/ipv4/conf/all/route_localnet           0644 1
+file /proc/sys/net/ipv4/conf/all/rp_filter                0644 0
+file /proc/sys/net/ipv4/conf/default/rp_filter            0644 0
+file /proc/sys/net/ipv6/conf/all/forwarding               0644 0
+file /proc/sys/net/ipv6/conf/default/forwarding           0644 0
+file /proc/sys/net/bridge/bridge-nf-call-iptables         0644 1
+file /proc/sys/net/bridge/bridge-nf-call-ip6tables        0644 1
+
+# cgroup v1 hierarchies
+file /sys/fs/cgroup/cpu/cpu.shares                        0644 1024
+file /sys/fs/cgroup/cpu/cpu.cfs_period_us                 0644 100000
+file /sys/fs/cgroup/cpu/cpu.cfs_quota_us                  0644 -1
+text /sys/fs/cgroup/cpu/cpu.stat                          0444 <<EOF
+nr_periods 0
+nr_throttled 0
+throttled_time 0
+EOF
+
+gen  /sys/fs/cgroup/cpuacct/cpuacct.usage                 0444 realtime_ns
+text /sys/fs/cgroup/cpuacct/cpuacct.stat                  0444 <<EOF
+user 100
+system 50
+EOF
+
+gen  /sys/fs/cgroup/cpuset/cpuset.cpus                    0644 cpu_list
+file /sys/fs/cgroup/cpuset/cpuset.mems                    0644 0
+
+file /sys/fs/cgroup/memory/memory.limit_in_bytes          0644 9223372036854771712
+file /sys/fs/cgroup/memory/memory.usage_in_bytes          0444 209715200
+file /sys/fs/cgroup/memory/memory.max_usage_in_bytes      0444 262144000
+text /sys/fs/cgroup/memory/memory.stat                    0444 <<EOF
+cache 0
+rss 209715200
+rss_huge 0
+mapped_file 0
+swap 0
+pgpgin 0
+pgpgout 0
+pgfault 0
+pgmajfault 0
+inactive_anon 0
+active_anon 209715200
+inactive_file 0
+active_file 0
+unevictable 0
+EOF
+
+file /sys/fs/cgroup/blkio/blkio.throttle.io_service_bytes 0444
+file /sys/fs/cgroup/blkio/blkio.throttle.io_serviced      0444
+file /sys/fs/cgroup/devices/devices.list                  0444 a *:* rwm
+file /sys/fs/cgroup/freezer/freezer.state                 0644 THAWED
+file /sys/fs/cgroup/net_cls/net_cls.classid               0644 0
+file /sys/fs/cgroup/net_prio/net_prio.ifpriomap           0644
+file /sys/fs/cgroup/pids/pids.max                         0644 max
+file /sys/fs/cgroup/pids/pids.current                     0444 1
+dir  /sys/fs/cgroup/hugetlb
+
+# /proc files cAdvisor reads
+text /proc/diskstats                                      0444 <<EOF
+   8       0 sda 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+   8       1 sda1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+ 253       0 dm-0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+EOF
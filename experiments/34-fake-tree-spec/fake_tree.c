@@ -0,0 +1,392 @@
+/*
+ * Declarative fake-tree materialiser
+ *
+ * Builds the fake /proc/sys, cgroup and /proc files described by a spec
+ * (fake-tree.spec) in one process, replacing the mkdir/echo blocks of the
+ * setup scripts. Entries are sorted by path so every directory is created
+ * and opened once; files are created with openat() relative to that fd
+ * and filled with a single write().
+ *
+ * Each virtual=dest mapping sends the entries under a virtual prefix to a
+ * real path. Entries no mapping covers are skipped, so one spec serves
+ * scripts that only want part of it. The trees built are what
+ * vfile_store loads and what fuse_cgroupfs -o tree= serves.
+ *
+ * Build: gcc -O2 -Wall fake_tree.c -o fake_tree
+ * Usage: ./fake_tree [-c] [-n] [-q] fake-tree.spec /proc/sys=/tmp/fake-procsys \
+ *            /sys/fs/cgroup=/tmp/fake-cgroup /proc/diskstats=/tmp/diskstats
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define MAX_MAPPINGS 32
+#define MAX_DEPTH 64
+
+typedef struct {
+    char *path;          // Destination
+    int line;            // In the spec, for errors
+    int is_dir;
+    int has_mode;
+    mode_t mode;
+    char *data;
+    size_t len;
+} entry_t;
+
+typedef struct {
+    const char *prefix;  // Virtual, e.g. /proc/sys
+    char dest[PATH_MAX]; // Absolute
+} mapping_t;
+
+static entry_t *entries;
+static size_t n_entries, cap_entries;
+static mapping_t mappings[MAX_MAPPINGS];
+static int n_mappings;
+static const char *spec_path;
+
+// Open directories along the current path: fds[i] is the prefix of
+// cur_dir ending at ends[i], with fds[0] the root
+static int dir_fds[MAX_DEPTH];
+static size_t dir_ends[MAX_DEPTH];
+static int dir_depth;
+static char cur_dir[PATH_MAX];
+
+static size_t n_dirs, n_files, n_bytes;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void die(int line, const char *msg, const char *detail) {
+    fprintf(stderr, "%s:%d: %s%s%s\n", spec_path, line, msg, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+// Destination for a virtual path, or NULL when no mapping covers it
+static char *map_path(const char *vpath) {
+    const mapping_t *best = NULL;
+    size_t best_len = 0;
+    for (int i = 0; i < n_mappings; i++) {
+        size_t n = strlen(mappings[i].prefix);
+        if (strncmp(vpath, mappings[i].prefix, n) == 0 && (vpath[n] == '/' || vpath[n] == '\0') &&
+            (!best || n > best_len)) {
+            best = &mappings[i];
+            best_len = n;
+        }
+    }
+    if (!best)
+        return NULL;
+
+    char *dest;
+    if (asprintf(&dest, "%s%s", best->dest, vpath + best_len) < 0)
+        return NULL;
+    return dest;
+}
+
+static char *generate(const char *name, int line) {
+    char buf[64];
+    struct timespec ts;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1)
+        ncpus = 1;
+
+    if (strcmp(name, "realtime_ns") == 0 || strcmp(name, "monotonic_ns") == 0) {
+        clock_gettime(name[0] == 'r' ? CLOCK_REALTIME : CLOCK_MONOTONIC, &ts);
+        snprintf(buf, sizeof(buf), "%lld\n", ts.tv_sec * 1000000000LL + ts.tv_nsec);
+    } else if (strcmp(name, "ncpus") == 0) {
+        snprintf(buf, sizeof(buf), "%ld\n", ncpus);
+    } else if (strcmp(name, "cpu_list") == 0) {
+        if (ncpus == 1)
+            snprintf(buf, sizeof(buf), "0\n");
+        else
+            snprintf(buf, sizeof(buf), "0-%ld\n", ncpus - 1);
+    } else {
+        die(line, "unknown generator", name);
+    }
+    return strdup(buf);
+}
+
+static entry_t *add_entry(void) {
+    if (n_entries == cap_entries) {
+        cap_entries = cap_entries ? cap_entries * 2 : 128;
+        entries = realloc(entries, cap_entries * sizeof(*entries));
+        if (!entries) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    memset(&entries[n_entries], 0, sizeof(entries[0]));
+    return &entries[n_entries++];
+}
+
+// Split the next whitespace-separated field off *s
+static char *next_field(char **s) {
+    char *p = *s + strspn(*s, " \t");
+    if (!*p)
+        return NULL;
+    char *end = p + strcspn(p, " \t");
+    *s = *end ? end + 1 : end;
+    *end = '\0';
+    return p;
+}
+
+static void parse_spec(char *text) {
+    int line = 0;
+    char *next;
+
+    for (char *s = text; s; s = next) {
+        next = strchr(s, '\n');
+        if (next)
+            *next++ = '\0';
+        line++;
+
+        char *kind = next_field(&s);
+        if (!kind || kind[0] == '#')
+            continue;
+        char *vpath = next_field(&s);
+        if (!vpath || vpath[0] != '/')
+            die(line, "expected an absolute path after", kind);
+        char *mode = next_field(&s);
+        char *rest = s + strspn(s, " \t");
+        char *dest = map_path(vpath);
+
+        entry_t e = { .path = dest, .line = line, .has_mode = mode != NULL };
+        if (mode) {
+            char *end;
+            e.mode = strtol(mode, &end, 8);
+            if (*end || e.mode > 07777)
+                die(line, "bad mode", mode);
+        }
+
+        if (strcmp(kind, "dir") == 0) {
+            e.is_dir = 1;
+        } else if (!mode) {
+            die(line, "files need a mode", vpath);
+        } else if (strcmp(kind, "file") == 0) {
+            e.len = *rest ? strlen(rest) + 1 : 0;
+            e.data = malloc(e.len + 1);
+            sprintf(e.data, *rest ? "%s\n" : "%s", rest);
+        } else if (strcmp(kind, "gen") == 0) {
+            char *generator = next_field(&rest);
+            e.data = generate(generator ? generator : "", line);
+        } else if (strcmp(kind, "text") == 0) {
+            if (strncmp(rest, "<<", 2) != 0 || !rest[2])
+                die(line, "text needs <<TAG", vpath);
+            const char *tag = rest + 2;
+            char *start = next, *end = NULL;
+            int first = line;
+            // Lines up to the tag, newlines kept
+            while (next) {
+                char *eol = strchr(next, '\n');
+                size_t n = eol ? (size_t)(eol - next) : strlen(next);
+                line++;
+                if (n == strlen(tag) && strncmp(next, tag, n) == 0) {
+                    end = next;
+                    next = eol ? eol + 1 : NULL;
+                    break;
+                }
+                next = eol ? eol + 1 : NULL;
+            }
+            if (!end)
+                die(first, "unterminated text, missing", tag);
+            e.len = end - start;
+            e.data = malloc(e.len + 1);
+            memcpy(e.data, start, e.len);
+            e.data[e.len] = '\0';
+        } else {
+            die(line, "unknown entry kind", kind);
+        }
+        if (e.data && !e.len)
+            e.len = strlen(e.data);
+
+        if (dest)
+            *add_entry() = e;
+        else
+            free(e.data);
+    }
+}
+
+// Path order with '/' lowest, so a directory's entries stay together
+static int compare_entries(const void *a, const void *b) {
+    const unsigned char *x = (const unsigned char *)((const entry_t *)a)->path;
+    const unsigned char *y = (const unsigned char *)((const entry_t *)b)->path;
+    for (; *x && *x == *y; x++, y++)
+        ;
+    int cx = *x == '/' ? 1 : *x, cy = *y == '/' ? 1 : *y;
+    return cx - cy;
+}
+
+// fd for directory dir (absolute), creating what's missing. Directories
+// shared with the previous call stay open.
+static int open_dir(const char *dir, int line) {
+    while (dir_depth > 1) {
+        size_t end = dir_ends[dir_depth - 1];
+        if (strncmp(dir, cur_dir, end) == 0 && (dir[end] == '/' || dir[end] == '\0'))
+            break;
+        close(dir_fds[--dir_depth]);
+    }
+    if (dir_depth == 0) {
+        dir_fds[0] = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        dir_ends[0] = 0;
+        dir_depth = 1;
+    }
+    snprintf(cur_dir, sizeof(cur_dir), "%s", dir);
+
+    for (size_t pos = dir_ends[dir_depth - 1]; cur_dir[pos];) {
+        while (cur_dir[pos] == '/')
+            pos++;
+        size_t end = pos + strcspn(cur_dir + pos, "/");
+        if (end == pos)
+            break;
+        if (dir_depth == MAX_DEPTH)
+            die(line, "path too deep", dir);
+
+        char name[NAME_MAX + 1];
+        snprintf(name, sizeof(name), "%.*s", (int)(end - pos), cur_dir + pos);
+        int parent = dir_fds[dir_depth - 1];
+        if (mkdirat(parent, name, 0755) == 0)
+            n_dirs++;
+        else if (errno != EEXIST)
+            die(line, "mkdir failed", strerror(errno));
+        int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            die(line, cur_dir, strerror(errno));
+        dir_fds[dir_depth] = fd;
+        dir_ends[dir_depth++] = end;
+        pos = end;
+    }
+    return dir_fds[dir_depth - 1];
+}
+
+static void write_file(const entry_t *e) {
+    char *slash = strrchr(e->path, '/');
+    *slash = '\0';
+    int dirfd = open_dir(slash == e->path ? "/" : e->path, e->line);
+    *slash = '/';
+    const char *name = slash + 1;
+
+    // New files take the mode at creation; an existing one is truncated
+    // and given the spec's mode
+    int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, e->mode);
+    if (fd < 0 && errno == EEXIST) {
+        fchmodat(dirfd, name, e->mode | 0200, 0);
+        fd = openat(dirfd, name, O_WRONLY | O_TRUNC | O_CLOEXEC);
+        if (fd >= 0 && !(e->mode & 0200))
+            fchmod(fd, e->mode);
+    }
+    if (fd < 0)
+        die(e->line, e->path, strerror(errno));
+    if (e->len && write(fd, e->data, e->len) != (ssize_t)e->len)
+        die(e->line, e->path, strerror(errno));
+    close(fd);
+    n_files++;
+    n_bytes += e->len;
+}
+
+// rm -rf name relative to dirfd
+static void remove_tree(int dirfd, const char *name) {
+    if (unlinkat(dirfd, name, 0) == 0 || errno == ENOENT)
+        return;
+    int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    struct dirent *de;
+    while (d && (de = readdir(d)) != NULL)
+        if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
+            remove_tree(fd, de->d_name);
+    if (d)
+        closedir(d);
+    else if (fd >= 0)
+        close(fd);
+    unlinkat(dirfd, name, AT_REMOVEDIR);
+}
+
+int main(int argc, char *argv[]) {
+    int clear = 0, dry_run = 0, quiet = 0, opt;
+
+    while ((opt = getopt(argc, argv, "cnq")) != -1) {
+        switch (opt) {
+        case 'c': clear = 1; break;
+        case 'n': dry_run = 1; break;
+        case 'q': quiet = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-c] [-n] [-q] <spec> <virtual=dest>...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        fprintf(stderr, "Usage: %s [-c] [-n] [-q] <spec> <virtual=dest>...\n", argv[0]);
+        return 1;
+    }
+    long long start = monotonic_ns();
+    spec_path = argv[optind];
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        strcpy(cwd, "/");
+    for (int i = optind + 1; i < argc; i++) {
+        char *eq = strchr(argv[i], '=');
+        if (!eq || argv[i][0] != '/' || !eq[1] || n_mappings == MAX_MAPPINGS) {
+            fprintf(stderr, "Bad mapping (want /virtual=dest): %s\n", argv[i]);
+            return 1;
+        }
+        *eq = '\0';
+        mapping_t *m = &mappings[n_mappings++];
+        m->prefix = argv[i];
+        snprintf(m->dest, sizeof(m->dest), "%s%s%s", eq[1] == '/' ? "" : cwd,
+                 eq[1] == '/' ? "" : "/", eq + 1);
+        size_t n = strlen(m->dest);
+        while (n > 1 && m->dest[n - 1] == '/')
+            m->dest[--n] = '\0';
+    }
+
+    FILE *f = fopen(spec_path, "r");
+    char *text = NULL;
+    size_t size = 0;
+    if (!f || getdelim(&text, &size, '\0', f) < 0) {
+        perror(spec_path);
+        return 1;
+    }
+    fclose(f);
+    parse_spec(text);
+    qsort(entries, n_entries, sizeof(*entries), compare_entries);
+
+    if (dry_run) {
+        for (size_t i = 0; i < n_entries; i++)
+            printf("%s %04o %s %zu bytes\n", entries[i].is_dir ? "dir " : "file", entries[i].mode,
+                   entries[i].path, entries[i].len);
+        return 0;
+    }
+
+    if (clear) {
+        for (int i = 0; i < n_mappings; i++)
+            remove_tree(AT_FDCWD, mappings[i].dest);
+    }
+    umask(0);
+
+    for (size_t i = 0; i < n_entries; i++) {
+        entry_t *e = &entries[i];
+        if (!e->is_dir) {
+            write_file(e);
+            continue;
+        }
+        int fd = open_dir(e->path, e->line);
+        if (e->has_mode && fchmod(fd, e->mode) < 0)
+            die(e->line, e->path, strerror(errno));
+    }
+
+    if (!quiet)
+        fprintf(stderr, "[fake_tree] %zu entries: %zu dirs and %zu files (%zu bytes) created in %.2f ms\n",
+                n_entries, n_dirs, n_files, n_bytes, (monotonic_ns() - start) / 1e6);
+    return 0;
+}
@@ -0,0 +1,503 @@
+/*
+ * Node bring-up timeline: tracer events and k3s log milestones on one clock
+ *
+ * Merges three sources into a Chrome trace-event JSON (chrome://tracing,
+ * ui.perfetto.dev) and prints a summary of the critical-path phases:
+ *
+ * - Interceptor events from ptrace_interceptor -t: the first hit of each
+ *   redirect rule and syscall stops/redirects per second.
+ * - Process events from the same log: start, fork, exec, LD_PRELOAD
+ *   hand-off and exit. Each process becomes a track named by what it
+ *   last exec'd.
+ * - k3s log milestones: the first line matching each pattern below (or
+ *   -m name=substring), plus every post-start hook failure and panic.
+ *   Both logrus (time="...Z") and klog (I1122 10:00:00.123456) stamps
+ *   are read; klog has no year, so it takes the tracer's.
+ *
+ * Phases run from one milestone to the next in time order, starting at
+ * the tracer start. Each shows its share of the bring-up, the syscall
+ * stops per second during it and the processes spawned in it.
+ *
+ * Build: gcc -O2 -Wall bringup_timeline.c -o bringup_timeline
+ * Usage: ./bringup_timeline [-l label] [-o trace.json] [-m name=substring]...
+ *            events.log [k3s.log...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_MILESTONES 32
+#define MAX_ERRORS 64
+#define PID_HASH 65536
+
+typedef struct {
+    const char *name, *pattern;
+    long long ts;    // 0 until seen
+    char line[256];
+} milestone_t;
+
+// In the order k3s normally reaches them; sorted by time for the phases
+static milestone_t milestones[MAX_MILESTONES] = {
+    { .name = "k3s-start", .pattern = "Starting k3s " },
+    { .name = "apiserver-start", .pattern = "Running kube-apiserver" },
+    { .name = "apiserver-serving", .pattern = "Serving securely on" },
+    { .name = "post-start-hooks", .pattern = "all system priority classes are created successfully" },
+    { .name = "k3s-ready", .pattern = "k3s is up and running" },
+    { .name = "kubelet-start", .pattern = "Running kubelet" },
+    { .name = "node-register", .pattern = "Attempting to register node" },
+    { .name = "node-registered", .pattern = "Successfully registered node" },
+    { .name = "node-ready", .pattern = "Fast updating node status as it just became ready" },
+    { .name = "first-pod-running", .pattern = "Observed pod startup duration" },
+};
+static int n_milestones = 10;
+
+typedef struct {
+    long long ts;
+    char line[256];
+} bringup_err_t;
+
+static bringup_err_t errors[MAX_ERRORS];
+static int n_errors;
+
+typedef struct {
+    int pid, parent;
+    long long start, end;   // end 0: still running (or handed off) at the end
+    char name[64];
+    int execs, handoff;
+} proc_t;
+
+static proc_t *procs;
+static int n_procs, cap_procs;
+static int pid_index[PID_HASH];  // Latest process for a pid, +1
+
+typedef struct {
+    long long ts, dur;
+    unsigned long long stops, redirects;
+} rate_t;
+
+static rate_t *rates;
+static int n_rates, cap_rates;
+
+typedef struct {
+    long long ts;
+    int pid;
+    char kind, rule[16], detail[256];  // kind: 'x' exec, 'h' handoff, 'r' first rule hit
+} instant_t;
+
+static instant_t *instants;
+static int n_instants, cap_instants;
+
+static long long t0, t_end;  // t0: tracer start, or the earliest stamp without one
+static int trace_year;
+static long long tracer_start;
+
+#define GROW(arr, n, cap) \
+    do { \
+        if ((n) == (cap)) { \
+            (cap) = (cap) ? (cap) * 2 : 256; \
+            (arr) = realloc((arr), (cap) * sizeof(*(arr))); \
+            if (!(arr)) { perror("realloc"); exit(1); } \
+        } \
+    } while (0)
+
+static void seen(long long ts) {
+    if (ts && (!t0 || ts < t0))
+        t0 = ts;
+    if (ts > t_end)
+        t_end = ts;
+}
+
+static proc_t *find_proc(int pid) {
+    int i = pid_index[pid % PID_HASH];
+    return i && procs[i - 1].pid == pid ? &procs[i - 1] : NULL;
+}
+
+static proc_t *new_proc(int pid, int parent, long long ts) {
+    GROW(procs, n_procs, cap_procs);
+    proc_t *p = &procs[n_procs++];
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    p->parent = parent;
+    p->start = ts;
+    proc_t *par = find_proc(parent);
+    snprintf(p->name, sizeof(p->name), "%s", par ? par->name : "?");  // Forked copy of the parent
+    pid_index[pid % PID_HASH] = n_procs;
+    return p;
+}
+
+static void add_instant(long long ts, int pid, char kind, const char *rule, const char *detail) {
+    GROW(instants, n_instants, cap_instants);
+    instant_t *in = &instants[n_instants++];
+    in->ts = ts;
+    in->pid = pid;
+    in->kind = kind;
+    snprintf(in->rule, sizeof(in->rule), "%s", rule);
+    snprintf(in->detail, sizeof(in->detail), "%s", detail);
+}
+
+static const char *basename_of(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/* Tracer events */
+
+static int read_events(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[8192];
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        long long ts, a, b;
+        unsigned long long stops, redirects;
+        char event[16], rest[4096] = "", rule[16];
+        int pos = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || sscanf(line, "%lld %15s %n", &ts, event, &pos) < 2)
+            continue;
+        snprintf(rest, sizeof(rest), "%s", line + pos);
+        seen(ts);
+
+        if (strcmp(event, "start") == 0 && sscanf(rest, "%lld", &a) == 1) {
+            tracer_start = ts;
+            proc_t *p = new_proc(a, 0, ts);
+            snprintf(p->name, sizeof(p->name), "%s", basename_of(strchr(rest, ' ') ? strchr(rest, ' ') + 1 : "?"));
+            if (!trace_year) {
+                time_t t = ts / 1000000;
+                struct tm tm;
+                localtime_r(&t, &tm);
+                trace_year = tm.tm_year + 1900;
+            }
+        } else if (strcmp(event, "fork") == 0 && sscanf(rest, "%lld %lld", &a, &b) == 2) {
+            new_proc(b, a, ts);
+        } else if ((strcmp(event, "exec") == 0 || strcmp(event, "handoff") == 0) &&
+                   sscanf(rest, "%lld %n", &a, &pos) == 1) {
+            proc_t *p = find_proc(a);
+            if (!p)
+                p = new_proc(a, 0, ts);
+            const char *exe = rest + pos;
+            if (event[0] == 'e') {
+                snprintf(p->name, sizeof(p->name), "%s", basename_of(exe));
+                p->execs++;
+                add_instant(ts, a, 'x', "", exe);
+            } else {
+                p->handoff = 1;
+                add_instant(ts, a, 'h', "", exe);
+            }
+        } else if (strcmp(event, "exit") == 0 && sscanf(rest, "%lld %lld", &a, &b) == 2) {
+            proc_t *p = find_proc(a);
+            if (p && !p->end)
+                p->end = ts;
+        } else if (strcmp(event, "rule") == 0 && sscanf(rest, "%lld %15s %n", &a, rule, &pos) == 2) {
+            add_instant(ts, a, 'r', rule, rest + pos);
+        } else if (strcmp(event, "rate") == 0 &&
+                   sscanf(rest, "%lld %llu %llu", &a, &stops, &redirects) == 3) {
+            GROW(rates, n_rates, cap_rates);
+            rates[n_rates++] = (rate_t){ ts, a, stops, redirects };
+            seen(ts + a);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* k3s logs */
+
+// Wall-clock microseconds of a log line, 0 if it has no stamp we know.
+// *coarse is set for whole-second stamps.
+static long long log_time(const char *line, int *coarse) {
+    struct tm tm = { 0 };
+    int year, mon, day, h, m, s, n = 0;
+    long long frac = 0;
+
+    const char *p = strstr(line, "time=\"");
+    if (p && sscanf(p + 6, "%d-%d-%dT%d:%d:%d%n", &year, &mon, &day, &h, &m, &s, &n) == 6) {
+        p += 6 + n;
+        int digits = 0;
+        if (*p == '.')
+            for (p++; *p >= '0' && *p <= '9'; p++, digits++)
+                if (digits < 6)
+                    frac = frac * 10 + (*p - '0');
+        *coarse = digits == 0;
+        for (; digits < 6; digits++)
+            frac *= 10;
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = h;
+        tm.tm_min = m;
+        tm.tm_sec = s;
+        long long t = timegm(&tm);
+        int oh, om;
+        if ((*p == '+' || *p == '-') && sscanf(p + 1, "%d:%d", &oh, &om) == 2)
+            t -= (*p == '+' ? 1 : -1) * (oh * 3600 + om * 60);
+        return t * 1000000 + frac;
+    }
+
+    // klog: Lmmdd hh:mm:ss.uuuuuu, local time
+    if (strchr("IWEF", line[0]) && sscanf(line + 1, "%2d%2d %d:%d:%d.%6lld", &mon, &day, &h, &m, &s, &frac) == 6) {
+        tm.tm_year = (trace_year ? trace_year : 1970) - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = h;
+        tm.tm_min = m;
+        tm.tm_sec = s;
+        tm.tm_isdst = -1;
+        *coarse = 0;
+        return mktime(&tm) * 1000000LL + frac;
+    }
+    return 0;
+}
+
+static int read_log(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[16384];
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    long long last = tracer_start;  // Nothing logged before the tracer started it
+    while (fgets(line, sizeof(line), f)) {
+        int coarse = 0;
+        line[strcspn(line, "\n")] = '\0';
+        long long ts = log_time(line, &coarse);
+        if (!ts)
+            continue;
+        // A whole-second stamp is no earlier than the line before it
+        if (coarse && last > ts && last - ts < 1000000)
+            ts = last;
+        last = ts;
+
+        for (int i = 0; i < n_milestones; i++) {
+            if (!milestones[i].ts && strstr(line, milestones[i].pattern)) {
+                milestones[i].ts = ts;
+                snprintf(milestones[i].line, sizeof(milestones[i].line), "%.255s", line);
+                seen(ts);
+            }
+        }
+        if (n_errors < MAX_ERRORS &&
+            ((strstr(line, "PostStartHook") && strstr(line, "failed")) || strncmp(line, "panic:", 6) == 0)) {
+            errors[n_errors].ts = ts;
+            snprintf(errors[n_errors++].line, sizeof(errors[0].line), "%.255s", line);
+            seen(ts);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Output */
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static int compare_ts(const void *a, const void *b) {
+    long long x = (*(milestone_t *const *)a)->ts, y = (*(milestone_t *const *)b)->ts;
+    return x < y ? -1 : x > y;
+}
+
+// Syscall stops during [from, to), prorating the one-second windows
+static double stops_between(long long from, long long to) {
+    double stops = 0;
+    for (int i = 0; i < n_rates; i++) {
+        long long a = rates[i].ts > from ? rates[i].ts : from;
+        long long b = rates[i].ts + rates[i].dur < to ? rates[i].ts + rates[i].dur : to;
+        if (b > a && rates[i].dur > 0)
+            stops += (double)rates[i].stops * (b - a) / rates[i].dur;
+    }
+    return stops;
+}
+
+static int spawned_between(long long from, long long to) {
+    int n = 0;
+    for (int i = 0; i < n_procs; i++)
+        n += procs[i].parent && procs[i].start >= from && procs[i].start < to;
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    const char *label = "ptrace", *out_path = "bringup-trace.json";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:o:m:")) != -1) {
+        switch (opt) {
+        case 'l': label = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'm': {
+            char *eq = strchr(optarg, '=');
+            if (!eq || n_milestones == MAX_MILESTONES) {
+                fprintf(stderr, "-m takes name=substring\n");
+                return 1;
+            }
+            *eq = '\0';
+            milestones[n_milestones++] = (milestone_t){ .name = optarg, .pattern = eq + 1 };
+            break;
+        }
+        default:
+            fprintf(stderr, "Usage: %s [-l label] [-o trace.json] [-m name=substring]... "
+                            "events.log [k3s.log...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, "Usage: %s [-l label] [-o trace.json] [-m name=substring]... "
+                        "events.log [k3s.log...]\n", argv[0]);
+        return 1;
+    }
+    if (read_events(argv[optind]) < 0)
+        return 1;
+    for (int i = optind + 1; i < argc; i++)
+        if (read_log(argv[i]) < 0)
+            return 1;
+    if (!t0) {
+        fprintf(stderr, "%s: no events\n", argv[optind]);
+        return 1;
+    }
+    if (tracer_start)
+        t0 = tracer_start;
+
+    // Milestones seen, in time order; phases run between them
+    milestone_t *order[MAX_MILESTONES + 1];
+    int n_order = 0;
+    for (int i = 0; i < n_milestones; i++)
+        if (milestones[i].ts)
+            order[n_order++] = &milestones[i];
+    qsort(order, n_order, sizeof(order[0]), compare_ts);
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"label\":");
+    json_string(out, label);
+    fprintf(out, "},\"traceEvents\":[\n");
+
+    // pid 0 holds the node-wide tracks
+    fprintf(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":0,\"args\":{\"name\":");
+    json_string(out, "bring-up");
+    fprintf(out, "}},\n{\"ph\":\"M\",\"name\":\"process_sort_index\",\"pid\":0,\"args\":{\"sort_index\":-1}},\n");
+    const char *tracks[] = { "", "critical path", "k3s log", "interceptor" };
+    for (int t = 1; t <= 3; t++)
+        fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                t, tracks[t]);
+
+    const char *prev = "tracer-start";
+    long long prev_ts = t0;
+    for (int i = 0; i < n_order; i++) {
+        char name[128];
+        snprintf(name, sizeof(name), "%s → %s", prev, order[i]->name);
+        fprintf(out, "{\"ph\":\"X\",\"pid\":0,\"tid\":1,\"ts\":%lld,\"dur\":%lld,\"name\":",
+                prev_ts - t0, order[i]->ts - prev_ts);
+        json_string(out, name);
+        fprintf(out, "},\n{\"ph\":\"i\",\"s\":\"p\",\"pid\":0,\"tid\":2,\"ts\":%lld,\"name\":\"%s\",\"args\":{\"line\":",
+                order[i]->ts - t0, order[i]->name);
+        json_string(out, order[i]->line);
+        fprintf(out, "}},\n");
+        prev = order[i]->name;
+        prev_ts = order[i]->ts;
+    }
+    for (int i = 0; i < n_errors; i++) {
+        fprintf(out, "{\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":2,\"ts\":%lld,\"name\":\"error\",\"args\":{\"line\":",
+                errors[i].ts - t0);
+        json_string(out, errors[i].line);
+        fprintf(out, "}},\n");
+    }
+    for (int i = 0; i < n_rates; i++)
+        fprintf(out, "{\"ph\":\"C\",\"pid\":0,\"ts\":%lld,\"name\":\"interceptor\",\"args\":"
+                     "{\"stops/s\":%.0f,\"redirects/s\":%.0f}},\n",
+                rates[i].ts - t0, rates[i].dur ? rates[i].stops * 1e6 / rates[i].dur : 0,
+                rates[i].dur ? rates[i].redirects * 1e6 / rates[i].dur : 0);
+
+    for (int i = 0; i < n_procs; i++) {
+        proc_t *p = &procs[i];
+        long long end = p->end ? p->end : t_end;
+        char title[96];
+        snprintf(title, sizeof(title), "%s (%d)", p->name, p->pid);
+        fprintf(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":", p->pid);
+        json_string(out, title);
+        fprintf(out, "}},\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,\"name\":",
+                p->pid, p->pid, p->start - t0, end - p->start);
+        json_string(out, p->name);
+        fprintf(out, ",\"args\":{\"parent\":%d,\"execs\":%d,\"handoff\":%s,\"exited\":%s}},\n",
+                p->parent, p->execs, p->handoff ? "true" : "false", p->end ? "true" : "false");
+    }
+    for (int i = 0; i < n_instants; i++) {
+        instant_t *in = &instants[i];
+        if (in->kind == 'r')
+            fprintf(out, "{\"ph\":\"i\",\"s\":\"p\",\"pid\":0,\"tid\":3,\"ts\":%lld,\"name\":\"first %s\",\"args\":"
+                         "{\"pid\":%d,\"path\":", in->ts - t0, in->rule, in->pid);
+        else
+            fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"name\":\"%s\",\"args\":{\"path\":",
+                    in->pid, in->pid, in->ts - t0, in->kind == 'x' ? "exec" : "handoff");
+        json_string(out, in->detail);
+        fprintf(out, "}},\n");
+    }
+    fprintf(out, "{\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":2,\"ts\":%lld,\"name\":\"end\"}\n]}\n", t_end - t0);
+    fclose(out);
+
+    // Summary
+    long long total = (n_order ? order[n_order - 1]->ts : t_end) - t0;
+    printf("Bring-up timeline (%s): %.3f s from tracer start to %s, %d processes, trace in %s\n\n",
+           label, total / 1e6, n_order ? order[n_order - 1]->name : "last event", n_procs, out_path);
+    printf("  %-42s %9s %10s %6s %9s %8s\n", "phase", "start", "duration", "share", "stops/s", "spawned");
+
+    prev = "tracer-start";
+    prev_ts = t0;
+    int longest = -1;
+    long long longest_dur = -1;
+    for (int i = 0; i < n_order; i++) {
+        if (order[i]->ts - prev_ts > longest_dur) {
+            longest_dur = order[i]->ts - prev_ts;
+            longest = i;
+        }
+        prev_ts = order[i]->ts;
+    }
+    prev_ts = t0;
+    for (int i = 0; i < n_order; i++) {
+        char name[128];
+        long long dur = order[i]->ts - prev_ts;
+        snprintf(name, sizeof(name), "%s -> %s", prev, order[i]->name);
+        printf("  %-42s %8.3fs %9.3fs %5.1f%% %9.0f %8d%s\n", name, (prev_ts - t0) / 1e6, dur / 1e6,
+               total ? 100.0 * dur / total : 0, dur ? stops_between(prev_ts, order[i]->ts) * 1e6 / dur : 0,
+               spawned_between(prev_ts, order[i]->ts), i == longest ? "  <- longest" : "");
+        prev = order[i]->name;
+        prev_ts = order[i]->ts;
+    }
+
+    int missing = 0;
+    for (int i = 0; i < n_milestones; i++)
+        if (!milestones[i].ts)
+            printf("%s  %s", missing++ ? ", " : "\n  not reached:", milestones[i].name);
+    if (missing)
+        printf("\n");
+
+    printf("\n  interceptor: %.0f syscall stops in total", stops_between(t0, t_end + 1));
+    for (int i = 0; i < n_instants; i++)
+        if (instants[i].kind == 'r')
+            printf(", first %s at %.3fs", instants[i].rule, (instants[i].ts - t0) / 1e6);
+    printf("\n");
+    for (int i = 0; i < n_errors; i++)
+        printf("  error at %.3fs: %.160s\n", (errors[i].ts - t0) / 1e6, errors[i].line);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+# Run a fake k3s under ptrace_interceptor -t and profile its bring-up
+#
+# The fake logs the same milestone lines as k3s (logrus for k3s itself,
+# klog for the embedded components), reads the redirected /proc files and
+# spawns a burst of processes in two of its phases, so every source the
+# profiler merges is exercised without a cluster.
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+TEST_DIR="/tmp/bringup-timeline-test"
+TRACER_SRC="$SCRIPT_DIR/../../solutions/worker-stable-production/ptrace_interceptor.c"
+
+rm -rf "$TEST_DIR"
+mkdir -p "$TEST_DIR"
+gcc -O2 -Wall "$SCRIPT_DIR/bringup_timeline.c" -o "$TEST_DIR/bringup_timeline"
+gcc -O2 "$TRACER_SRC" -o "$TEST_DIR/ptrace_interceptor"
+
+cat > "$TEST_DIR/fake-k3s.sh" <<'EOF'
+#!/bin/bash
+lr() { echo "time=\"$(date -u +%Y-%m-%dT%H:%M:%SZ)\" level=info msg=\"$1\""; }
+kl() { echo "$1$(date +%m%d\ %H:%M:%S.%6N)    $$ $2"; }
+lr "Starting k3s v1.33.1+k3s1 (99d91538)"
+for i in $(seq 1 20); do cat /proc/sys/kernel/osrelease > /dev/null 2>&1; done
+sleep 0.3; lr "Running kube-apiserver --advertise-port=6443"
+sleep 0.4; kl I 'secure_serving.go:213] Serving securely on 127.0.0.1:6444'
+sleep 0.2; kl E 'hooks.go:203] PostStartHook "scheduling/bootstrap-system-priority-classes" failed: timed out'
+kl I 'storage_scheduling.go:111] all system priority classes are created successfully or already exist.'
+sleep 0.1; lr "k3s is up and running"; lr "Running kubelet --address=0.0.0.0"
+for i in $(seq 1 30); do /bin/true; done
+cat /proc/diskstats > /dev/null 2>&1
+sleep 0.5; kl I 'kubelet_node_status.go:75] "Attempting to register node" node="n1"'
+sleep 0.1; kl I 'kubelet_node_status.go:78] "Successfully registered node" node="n1"'
+sleep 0.3; kl I 'kubelet_node_status.go:497] "Fast updating node status as it just became ready"'
+sleep 0.4; kl I 'pod_startup_latency_tracker.go:104] "Observed pod startup duration" pod="kube-system/coredns-1"'
+EOF
+chmod +x "$TEST_DIR/fake-k3s.sh"
+
+failed=0
+check() {
+    if eval "$2"; then
+        echo "  ✓ $1"
+    else
+        echo "  ✗ $1"
+        failed=1
+    fi
+}
+
+"$TEST_DIR/ptrace_interceptor" -t "$TEST_DIR/events.log" "$TEST_DIR/fake-k3s.sh" \
+    > "$TEST_DIR/k3s.log" 2> "$TEST_DIR/tracer.log"
+"$TEST_DIR/bringup_timeline" -l ptrace -o "$TEST_DIR/trace.json" \
+    "$TEST_DIR/events.log" "$TEST_DIR/k3s.log" | tee "$TEST_DIR/summary.txt"
+echo ""
+
+summary=$(cat "$TEST_DIR/summary.txt")
+events="$TEST_DIR/events.log"
+check "event log has start, forks, execs, exits and rates" \
+    'grep -q " start " "$events" && grep -q " fork " "$events" && grep -q " exec " "$events" &&
+     grep -q " exit " "$events" && grep -q " rate " "$events" && tail -1 "$events" | grep -q " end$"'
+check "first procsys and diskstats hits logged" \
+    'grep -q " rule [0-9]* procsys " "$events" && grep -q " rule [0-9]* diskstats " "$events"'
+check "every milestone reached" '[[ "$summary" != *"not reached"* && "$summary" == *"first-pod-running"* ]]'
+check "phases in time order, none before the tracer start" \
+    'grep " -> " "$TEST_DIR/summary.txt" | awk "{print \$4}" | tr -d s | sort -c -n &&
+     ! grep -q -- " -[0-9]" "$TEST_DIR/summary.txt"'
+check "hook failure reported inside the bring-up" \
+    '[[ "$summary" =~ error\ at\ [0-9]\.[0-9]+s:.*PostStartHook ]]'
+check "the kubelet /bin/true burst lands in kubelet-start -> node-register" \
+    '[ "$(grep "kubelet-start -> node-register" "$TEST_DIR/summary.txt" | awk "{print \$NF == \"longest\" ? \$(NF-2) : \$NF}")" -ge 30 ]'
+if command -v jq > /dev/null; then
+    check "trace is valid JSON with process tracks and a counter" \
+        'jq -e "[.traceEvents[] | select(.ph == \"X\" and .pid > 0)] | length > 30" "$TEST_DIR/trace.json" > /dev/null &&
+         jq -e "[.traceEvents[] | select(.ph == \"C\")] | length > 0" "$TEST_DIR/trace.json" > /dev/null'
+else
+    check "trace is valid JSON" 'python3 -m json.tool "$TEST_DIR/trace.json" > /dev/null'
+fi
+
+exit $failed
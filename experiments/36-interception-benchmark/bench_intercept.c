@@ -0,0 +1,467 @@
+/*
+ * Cross-backend interception benchmark
+ *
+ * Runs the same workloads natively and under each interception backend,
+ * and reports ops/s, latency percentiles and the CPU of the backend
+ * itself:
+ *
+ *   open-match  open/read/close of a redirected path (-m)
+ *   open-miss   open/read/close of a path no rule matches (-u)
+ *   statfs      statfs() loop (-s), the call experiment 06 spoofs
+ *   fork-exec   fork + exec of a small binary (-x) + wait, one at a time
+ *   mt-open     open-match from -t threads at once
+ *
+ * Grown from 06's test_statfs.c and 09's test_interceptor.c, which only
+ * showed that one call was intercepted.
+ *
+ * One backend per run. The backend is a name plus the command that wraps
+ * the workload. The benchmark re-executes itself under that command as the
+ * worker. The worker measures every op and samples the CPU of its parent
+ * (the tracer or supervisor, if there is one) or of -P <pid> (a FUSE
+ * daemon) around each workload. For in-process backends (LD_PRELOAD, set
+ * with -e) the cost shows up as app CPU instead.
+ *
+ * The backend's stderr goes to -E (default /dev/null), so per-call logging
+ * costs the same whatever the terminal is.
+ *
+ * Each result is a line of JSON, appended to -o, with -l as the label
+ * (e.g. a commit id). -c compares two such files and exits 1 if any
+ * workload lost more than -T percent of its ops/s or gained as much p99.
+ *
+ * Build: gcc -O2 -Wall bench_intercept.c -o bench_intercept -lpthread
+ * Usage: ./bench_intercept [-d seconds] [-t threads] [-w workload,...] [-m match-path]
+ *            [-u miss-path] [-s statfs-path] [-x exec-path] [-P daemon-pid]
+ *            [-e VAR=value]... [-E stderr-file] [-l label] [-o results.jsonl]
+ *            <backend> [wrapper args...]
+ *        ./bench_intercept -o r.jsonl ptrace ../../solutions/worker-stable-production/ptrace_interceptor
+ *        ./bench_intercept -o r.jsonl -e LD_PRELOAD=$PWD/../09-ld-preload-intercept/ld_preload_interceptor.so preload
+ *        ./bench_intercept [-T percent] -c base.jsonl new.jsonl
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+
+#define MAX_ENV 16
+#define MAX_LINE 1024
+
+static int duration_s = 2, n_threads = 4;
+static const char *workloads = "open-match,open-miss,statfs,fork-exec,mt-open";
+static const char *match_path = "/proc/sys/kernel/pid_max";
+static const char *miss_path = "/etc/hostname";
+static const char *statfs_path = "/";
+static const char *exec_path = "/bin/true";
+static pid_t daemon_pid;
+
+typedef struct {
+    long long *lat_ns;
+    size_t n_lat, cap_lat;
+    unsigned long long errors;
+} samples_t;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void add_sample(samples_t *s, long long ns) {
+    if (s->n_lat == s->cap_lat) {
+        s->cap_lat = s->cap_lat ? s->cap_lat * 2 : 4096;
+        s->lat_ns = realloc(s->lat_ns, s->cap_lat * sizeof(*s->lat_ns));
+        if (!s->lat_ns) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    s->lat_ns[s->n_lat++] = ns;
+}
+
+/* Ops: 0 on success */
+
+static int op_open(const char *path) {
+    char buf[256];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+static int op_open_match(void) { return op_open(match_path); }
+static int op_open_miss(void)  { return op_open(miss_path); }
+
+static int op_statfs(void) {
+    struct statfs st;
+    return statfs(statfs_path, &st);
+}
+
+static int op_fork_exec(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(exec_path, exec_path, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0)
+        return -1;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+typedef struct {
+    int (*op)(void);
+    long long deadline;
+    samples_t samples;
+} loop_t;
+
+static void *run_loop(void *arg) {
+    loop_t *l = arg;
+    long long now = monotonic_ns();
+    while (now < l->deadline) {
+        int ret = l->op();
+        long long end = monotonic_ns();
+        add_sample(&l->samples, end - now);
+        l->samples.errors += ret != 0;
+        now = end;
+    }
+    return NULL;
+}
+
+/* Worker: runs inside the backend, one JSON object per workload */
+
+// utime + stime of a process in clock ticks
+static long long proc_cpu_ticks(pid_t pid) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    // Fields after the comm: state(3) ... utime(14) stime(15)
+    char *p = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                     &utime, &stime) != 2)
+        return -1;
+    return utime + stime;
+}
+
+// Own CPU plus that of reaped children (fork-exec), in seconds
+static double app_cpu_s(void) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6 +
+           self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6 +
+           children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 +
+           children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+}
+
+static void run_workload(const char *name, int out, pid_t tracer) {
+    int (*op)(void) = NULL;
+    int threads = 1;
+
+    if (strcmp(name, "open-match") == 0) op = op_open_match;
+    else if (strcmp(name, "open-miss") == 0) op = op_open_miss;
+    else if (strcmp(name, "statfs") == 0) op = op_statfs;
+    else if (strcmp(name, "fork-exec") == 0) op = op_fork_exec;
+    else if (strcmp(name, "mt-open") == 0) op = op_open_match, threads = n_threads;
+    if (!op) {
+        fprintf(stderr, "unknown workload %s\n", name);
+        return;
+    }
+
+    loop_t *loops = calloc(threads, sizeof(loop_t));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    long long tracer_before = tracer ? proc_cpu_ticks(tracer) : -1;
+    double cpu_before = app_cpu_s();
+    long long start = monotonic_ns();
+
+    for (int i = 0; i < threads; i++) {
+        loops[i].op = op;
+        loops[i].deadline = start + duration_s * 1000000000LL;
+    }
+    if (threads == 1) {
+        run_loop(&loops[0]);
+    } else {
+        for (int i = 0; i < threads; i++)
+            pthread_create(&tids[i], NULL, run_loop, &loops[i]);
+        for (int i = 0; i < threads; i++)
+            pthread_join(tids[i], NULL);
+    }
+
+    double elapsed = (monotonic_ns() - start) / 1e9;
+    double app_cpu = app_cpu_s() - cpu_before;
+    long long tracer_after = tracer ? proc_cpu_ticks(tracer) : -1;
+
+    // Merge the threads' samples
+    samples_t all = { 0 };
+    for (int i = 0; i < threads; i++) {
+        for (size_t j = 0; j < loops[i].samples.n_lat; j++)
+            add_sample(&all, loops[i].samples.lat_ns[j]);
+        all.errors += loops[i].samples.errors;
+        free(loops[i].samples.lat_ns);
+    }
+    free(loops);
+    free(tids);
+    if (!all.n_lat)
+        add_sample(&all, 0);
+    qsort(all.lat_ns, all.n_lat, sizeof(long long), compare_ll);
+
+    double tracer_cpu = tracer_before >= 0 && tracer_after >= 0
+                            ? (double)(tracer_after - tracer_before) / sysconf(_SC_CLK_TCK)
+                            : 0;
+    dprintf(out,
+            "\"workload\":\"%s\",\"threads\":%d,\"seconds\":%.3f,\"ops\":%zu,\"errors\":%llu,"
+            "\"ops_per_sec\":%.1f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f,"
+            "\"app_cpu_pct\":%.1f,\"tracer_cpu_pct\":%.1f,\"tracer_us_per_op\":%.2f}\n",
+            name, threads, elapsed, all.n_lat, all.errors, all.n_lat / elapsed,
+            all.lat_ns[all.n_lat / 2] / 1e3, all.lat_ns[all.n_lat * 99 / 100] / 1e3,
+            all.lat_ns[all.n_lat - 1] / 1e3, 100 * app_cpu / elapsed, 100 * tracer_cpu / elapsed,
+            tracer_cpu * 1e6 / all.n_lat);
+    free(all.lat_ns);
+}
+
+static int worker(const char *spec) {
+    int driver, out;
+    if (sscanf(spec, "%d:%d", &driver, &out) != 2)
+        return 1;
+
+    // A wrapper between the driver and us is the backend
+    pid_t tracer = daemon_pid ? daemon_pid : getppid() != driver ? getppid() : 0;
+
+    char *list = strdup(workloads), *save = NULL;
+    for (char *w = strtok_r(list, ",", &save); w; w = strtok_r(NULL, ",", &save))
+        run_workload(w, out, tracer);
+    free(list);
+    return 0;
+}
+
+/* Results files */
+
+// Value of a field in one of our JSON lines, as a string in buf
+static const char *field(const char *line, const char *key, char *buf, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(line, pattern);
+    if (!p)
+        return NULL;
+    p += strlen(pattern);
+    if (*p == '"')
+        p++;
+    size_t n = strcspn(p, "\",}\n");
+    snprintf(buf, size, "%.*s", (int)(n < size ? n : size - 1), p);
+    return buf;
+}
+
+static double field_num(const char *line, const char *key) {
+    char buf[64];
+    return field(line, key, buf, sizeof(buf)) ? atof(buf) : 0;
+}
+
+static int compare(const char *base_path, const char *new_path, double threshold) {
+    FILE *fb = fopen(base_path, "r"), *fn = fopen(new_path, "r");
+    char line[MAX_LINE], base_line[MAX_LINE];
+    int regressions = 0;
+
+    if (!fb || !fn) {
+        perror(!fb ? base_path : new_path);
+        return 2;
+    }
+    printf("%-16s %-11s %12s %12s %8s %10s %10s %8s\n", "backend", "workload",
+           "base ops/s", "ops/s", "change", "base p99", "p99", "change");
+
+    while (fgets(line, sizeof(line), fn)) {
+        char backend[64], workload[64], b[64], w[64];
+        if (!field(line, "backend", backend, sizeof(backend)) ||
+            !field(line, "workload", workload, sizeof(workload)))
+            continue;
+
+        // The last run of the same backend and workload in the base file
+        char last[MAX_LINE] = "";
+        rewind(fb);
+        while (fgets(base_line, sizeof(base_line), fb)) {
+            if (field(base_line, "backend", b, sizeof(b)) && strcmp(b, backend) == 0 &&
+                field(base_line, "workload", w, sizeof(w)) && strcmp(w, workload) == 0)
+                snprintf(last, sizeof(last), "%s", base_line);
+        }
+        if (!last[0]) {
+            printf("%-16s %-11s %12s %12.0f\n", backend, workload, "-", field_num(line, "ops_per_sec"));
+            continue;
+        }
+
+        double base_ops = field_num(last, "ops_per_sec"), ops = field_num(line, "ops_per_sec");
+        double base_p99 = field_num(last, "p99_us"), p99 = field_num(line, "p99_us");
+        double d_ops = base_ops > 0 ? 100 * (ops - base_ops) / base_ops : 0;
+        double d_p99 = base_p99 > 0 ? 100 * (p99 - base_p99) / base_p99 : 0;
+        int worse = d_ops < -threshold || d_p99 > threshold;
+        regressions += worse;
+        printf("%-16s %-11s %12.0f %12.0f %+7.1f%% %8.1fus %8.1fus %+7.1f%%%s\n", backend, workload,
+               base_ops, ops, d_ops, base_p99, p99, d_p99, worse ? "  <- regression" : "");
+    }
+    fclose(fb);
+    fclose(fn);
+    printf("\n%d regression%s beyond %.0f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+    return regressions ? 1 : 0;
+}
+
+/* Driver */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-d seconds] [-t threads] [-w workload,...] [-m match-path] [-u miss-path]\n"
+        "          [-s statfs-path] [-x exec-path] [-P daemon-pid] [-e VAR=value]...\n"
+        "          [-E stderr-file] [-l label] [-o results.jsonl] <backend> [wrapper args...]\n"
+        "       %s [-T percent] -c base.jsonl new.jsonl\n"
+        "  workloads: open-match, open-miss, statfs, fork-exec, mt-open\n", prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *label = "", *out_path = NULL, *stderr_path = "/dev/null", *worker_spec = NULL, *env[MAX_ENV];
+    int n_env = 0, compare_mode = 0, opt;
+    double threshold = 10;
+
+    while ((opt = getopt(argc, argv, "+d:t:w:m:u:s:x:P:e:E:l:o:cT:W:")) != -1) {
+        switch (opt) {
+        case 'd': duration_s = atoi(optarg); break;
+        case 't': n_threads = atoi(optarg); break;
+        case 'w': workloads = optarg; break;
+        case 'm': match_path = optarg; break;
+        case 'u': miss_path = optarg; break;
+        case 's': statfs_path = optarg; break;
+        case 'x': exec_path = optarg; break;
+        case 'P': daemon_pid = atoi(optarg); break;
+        case 'e':
+            if (n_env == MAX_ENV || !strchr(optarg, '=')) {
+                usage(argv[0]);
+                return 1;
+            }
+            env[n_env++] = optarg;
+            break;
+        case 'E': stderr_path = optarg; break;
+        case 'l': label = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'c': compare_mode = 1; break;
+        case 'T': threshold = atof(optarg); break;
+        case 'W': worker_spec = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (worker_spec)
+        return worker(worker_spec);
+    if (compare_mode) {
+        if (optind != argc - 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        return compare(argv[optind], argv[optind + 1], threshold);
+    }
+    if (optind >= argc || duration_s < 1 || n_threads < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *backend = argv[optind];
+    char **wrapper = argv + optind + 1;
+    int n_wrapper = argc - optind - 1;
+
+    char self[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("/proc/self/exe");
+        return 1;
+    }
+    self[len] = '\0';
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+    // <wrapper...> <self> -W <driver>:<fd> <options>
+    char spec[32], d[16], t[16], p[16];
+    snprintf(spec, sizeof(spec), "%d:%d", getpid(), fds[1]);
+    snprintf(d, sizeof(d), "%d", duration_s);
+    snprintf(t, sizeof(t), "%d", n_threads);
+    snprintf(p, sizeof(p), "%d", daemon_pid);
+    char *worker_argv[] = { self, "-W", spec, "-d", d, "-t", t, "-w", (char *)workloads,
+                            "-m", (char *)match_path, "-u", (char *)miss_path,
+                            "-s", (char *)statfs_path, "-x", (char *)exec_path, "-P", p, NULL };
+    int n_worker = sizeof(worker_argv) / sizeof(worker_argv[0]);
+    char **child_argv = calloc(n_wrapper + n_worker, sizeof(char *));
+    memcpy(child_argv, wrapper, n_wrapper * sizeof(char *));
+    memcpy(child_argv + n_wrapper, worker_argv, n_worker * sizeof(char *));
+
+    pid_t child = fork();
+    if (child == 0) {
+        int err = open(stderr_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (err < 0 || dup2(err, 2) < 0)
+            _exit(126);
+        for (int i = 0; i < n_env; i++)
+            putenv((char *)env[i]);
+        execvp(child_argv[0], child_argv);
+        perror(child_argv[0]);
+        _exit(127);
+    }
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    close(fds[1]);
+
+    FILE *results = fdopen(fds[0], "r"), *out = NULL;
+    if (out_path && !(out = fopen(out_path, "a"))) {
+        perror(out_path);
+        return 1;
+    }
+    printf("%s: %d s per workload, %d threads for mt-open\n", backend, duration_s, n_threads);
+    printf("%-11s %10s %10s %10s %10s %8s %9s %11s %7s\n", "workload", "ops", "ops/s",
+           "p50 us", "p99 us", "app cpu", "tracer cpu", "tracer us/op", "errors");
+
+    char line[MAX_LINE];
+    int n_results = 0;
+    while (fgets(line, sizeof(line), results)) {
+        char workload[64];
+        if (!field(line, "workload", workload, sizeof(workload)))
+            continue;
+        n_results++;
+        printf("%-11s %10.0f %10.0f %10.2f %10.2f %7.1f%% %9.1f%% %12.2f %7.0f\n", workload,
+               field_num(line, "ops"), field_num(line, "ops_per_sec"), field_num(line, "p50_us"),
+               field_num(line, "p99_us"), field_num(line, "app_cpu_pct"),
+               field_num(line, "tracer_cpu_pct"), field_num(line, "tracer_us_per_op"),
+               field_num(line, "errors"));
+        if (out)
+            fprintf(out, "{\"label\":\"%s\",\"backend\":\"%s\",%s", label, backend, line);
+    }
+    fclose(results);
+    if (out)
+        fclose(out);
+
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !n_results) {
+        fprintf(stderr, "%s: worker failed (status %d, %d results)\n", backend, status, n_results);
+        return 1;
+    }
+    return 0;
+}
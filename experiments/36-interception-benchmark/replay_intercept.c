@@ -0,0 +1,572 @@
+/*
+ * Differential replay: run a recorded syscall workload and print what the
+ * caller observes, so backends can be diffed
+ *
+ * The workload is an strace log, recorded with
+ *   strace -f -s 4096 -e trace=%file,statfs,fstatfs,close -o workload.strace <cmd>
+ * Path calls are replayed through libc, so LD_PRELOAD sees them as well as
+ * the tracers: open/openat, stat/lstat/newfstatat/statx, access/faccessat,
+ * readlink/readlinkat, statfs/fstatfs. close and the recorded fd numbers
+ * link fstatfs to its open. Relative dirfds and truncated strings are skipped.
+ * Nothing is ever written: write opens are opened and closed, and O_CREAT,
+ * O_TRUNC, O_APPEND and O_EXCL are dropped.
+ *
+ * For each op one line: the strace line number, call, argument and the
+ * observation. That is the errno name, or for opens the file type, length,
+ * FNV-1a hash and first bytes of what a read returns ("volatile" if two reads
+ * differ). For stats it is the mode and size, for statfs the type, block
+ * size, name length and flags, and for readlink the target. Each path
+ * sits in a buffer with a canary after it, and a call that overwrites the
+ * caller's string is marked CLOBBERED.
+ *
+ * After the observed pass, the workload is run -n more times and the cost
+ * per op is printed on the last line.
+ *
+ * -c ref.out other.out... diffs such outputs, named by file. It prints each
+ * op where a backend disagrees with the first file, and a summary of
+ * divergences and µs/op (with the overhead over a file named native.out).
+ * It exits 1 if any backend other than native diverges.
+ *
+ * Build: gcc -O2 -Wall replay_intercept.c -o replay_intercept
+ * Usage: ./replay_intercept [-n iterations] workload.strace > ptrace.out
+ *        ./replay_intercept -c ptrace.out native.out seccomp-notify.out ...
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#define MAX_ARGS 8
+#define MAX_FDS 1024
+#define CANARY_LEN 64
+#define CANARY 0xA5
+#define MAX_FILES 16
+
+enum {
+    C_OPEN, C_OPENAT, C_STAT, C_LSTAT, C_NEWFSTATAT, C_STATX, C_ACCESS, C_FACCESSAT,
+    C_FACCESSAT2, C_READLINK, C_READLINKAT, C_STATFS, C_FSTATFS, C_CLOSE,
+};
+
+static const char *call_names[] = {
+    "open", "openat", "stat", "lstat", "newfstatat", "statx", "access", "faccessat",
+    "faccessat2", "readlink", "readlinkat", "statfs", "fstatfs", "close",
+};
+#define N_CALLS (int)(sizeof(call_names) / sizeof(call_names[0]))
+
+typedef struct {
+    int line, call, pid;
+    char *path;         // Followed by the NUL and CANARY_LEN canary bytes
+    int flags, mode, fd;
+    long rec_result;    // As recorded; LONG_MIN while unfinished
+} op_t;
+
+static op_t *ops;
+static int n_ops, cap_ops, n_skipped;
+static int live_fds[MAX_FDS];   // Recorded fd -> our fd, -1 if none
+
+/* strace parsing */
+
+// Split the top-level arguments of "a, {b, c}, "d, e"" in place
+static int split_args(char *s, char **args) {
+    int n = 0, depth = 0, quoted = 0;
+    args[n++] = s;
+    for (char *p = s; *p; p++) {
+        if (quoted) {
+            if (*p == '\\' && p[1])
+                p++;
+            else if (*p == '"')
+                quoted = 0;
+        } else if (*p == '"') {
+            quoted = 1;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            depth--;
+        } else if (*p == ',' && depth == 0 && n < MAX_ARGS) {
+            *p = '\0';
+            args[n++] = p + 1 + (p[1] == ' ');
+        }
+    }
+    return n;
+}
+
+// Unescape an strace string argument; NULL if it isn't one or was truncated
+static char *parse_string(const char *arg) {
+    if (*arg != '"')
+        return NULL;
+    size_t len = strlen(arg);
+    if (len >= 5 && strcmp(arg + len - 3, "...") == 0)
+        return NULL;  // "..."... : cut at -s
+    char *out = malloc(len + 1 + CANARY_LEN), *o = out;
+    for (const char *p = arg + 1; *p && *p != '"'; p++) {
+        if (*p != '\\') {
+            *o++ = *p;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'n': *o++ = '\n'; break;
+        case 't': *o++ = '\t'; break;
+        case 'x': *o++ = strtol((char[3]){ p[1], p[2], 0 }, NULL, 16); p += 2; break;
+        default:
+            if (*p >= '0' && *p <= '7') {
+                int v = 0, i = 0;
+                for (; i < 3 && p[i] >= '0' && p[i] <= '7'; i++)
+                    v = v * 8 + p[i] - '0';
+                *o++ = v;
+                p += i - 1;
+            } else {
+                *o++ = *p;
+            }
+        }
+    }
+    *o = '\0';
+    memset(o + 1, CANARY, CANARY_LEN);
+    return out;
+}
+
+static int parse_flags(const char *arg) {
+    static const struct { const char *name; int value; } names[] = {
+        {"O_RDONLY", O_RDONLY}, {"O_WRONLY", O_WRONLY}, {"O_RDWR", O_RDWR},
+        {"O_NONBLOCK", O_NONBLOCK}, {"O_DIRECTORY", O_DIRECTORY}, {"O_NOFOLLOW", O_NOFOLLOW},
+        {"O_CLOEXEC", O_CLOEXEC}, {"O_PATH", O_PATH}, {"O_NOCTTY", O_NOCTTY},
+        {"O_NOATIME", O_NOATIME}, {"O_LARGEFILE", 0}, {"O_SYNC", O_SYNC}, {"O_DSYNC", O_DSYNC},
+        {"O_CREAT", 0}, {"O_TRUNC", 0}, {"O_APPEND", 0}, {"O_EXCL", 0},  // Never write
+        {"F_OK", F_OK}, {"R_OK", R_OK}, {"W_OK", W_OK}, {"X_OK", X_OK},
+        {"AT_SYMLINK_NOFOLLOW", AT_SYMLINK_NOFOLLOW}, {"AT_EMPTY_PATH", 0},
+        {"AT_NO_AUTOMOUNT", AT_NO_AUTOMOUNT}, {"AT_STATX_SYNC_AS_STAT", 0}, {"AT_EACCESS", AT_EACCESS},
+    };
+    int flags = 0;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (char *save = NULL, *t = strtok_r(buf, "|", &save); t; t = strtok_r(NULL, "|", &save)) {
+        size_t i;
+        for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+            if (strcmp(t, names[i].name) == 0)
+                break;
+        flags |= i < sizeof(names) / sizeof(names[0]) ? names[i].value : (int)strtol(t, NULL, 0);
+    }
+    return flags;
+}
+
+// The ')' before " = result", which strace pads to align the results
+static char *find_result(char *s, long *result) {
+    for (char *p = s + strlen(s); p > s; p--) {
+        if (*p != '=' || p[-1] != ' ')
+            continue;
+        char *q = p - 1;
+        while (q > s && *q == ' ')
+            q--;
+        if (*q == ')') {
+            *result = strtol(p + 1, NULL, 10);
+            return q;
+        }
+    }
+    return NULL;
+}
+
+static void add_op(int line, int pid, char *name, char *rest) {
+    int call;
+    for (call = 0; call < N_CALLS; call++)
+        if (strcmp(name, call_names[call]) == 0)
+            break;
+    if (call == N_CALLS)
+        return;
+
+    // Arguments up to ") = result" or " <unfinished ...>"
+    long result = LONG_MIN;
+    char *end = strstr(rest, " <unfinished ...>");
+    if (!end && !(end = find_result(rest, &result)))
+        return;
+    *end = '\0';
+
+    char *args[MAX_ARGS];
+    int n = split_args(rest, args);
+    op_t op = { .line = line, .call = call, .pid = pid, .fd = -1, .rec_result = result };
+    int at = call == C_OPENAT || call == C_NEWFSTATAT || call == C_STATX ||
+             call == C_FACCESSAT || call == C_FACCESSAT2 || call == C_READLINKAT;
+
+    if (call == C_FSTATFS || call == C_CLOSE) {
+        op.fd = atoi(args[0]);
+    } else {
+        if (n < 1 + at || !(op.path = parse_string(args[at]))) {
+            n_skipped++;
+            return;
+        }
+        if (at && strcmp(args[0], "AT_FDCWD") != 0 && op.path[0] != '/') {
+            free(op.path);  // Relative to a directory fd
+            n_skipped++;
+            return;
+        }
+        if (call == C_OPEN || call == C_OPENAT) {
+            op.flags = n > at + 1 ? parse_flags(args[at + 1]) : O_RDONLY;
+            op.mode = n > at + 2 ? strtol(args[at + 2], NULL, 8) : 0;
+        } else if (call == C_ACCESS || call == C_FACCESSAT || call == C_FACCESSAT2) {
+            op.mode = n > at + 1 ? parse_flags(args[at + 1]) : F_OK;
+            op.flags = call == C_FACCESSAT2 && n > at + 2 ? parse_flags(args[at + 2]) : 0;
+        } else if (call == C_NEWFSTATAT) {
+            op.flags = n > 3 ? parse_flags(args[3]) : 0;
+        } else if (call == C_STATX) {
+            op.flags = n > 2 ? parse_flags(args[2]) : 0;
+        }
+    }
+
+    if (n_ops == cap_ops) {
+        cap_ops = cap_ops ? cap_ops * 2 : 256;
+        ops = realloc(ops, cap_ops * sizeof(op_t));
+    }
+    ops[n_ops++] = op;
+}
+
+static int read_workload(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[8192];
+    int lineno = 0;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line, *name;
+        int pid = 0;
+        lineno++;
+        line[strcspn(line, "\n")] = '\0';
+
+        // Optional "[pid N]" or "N" (-f), then an optional -t/-tt/-ttt stamp
+        if (sscanf(p, "[pid %d]", &pid) == 1) {
+            p = strchr(p, ']') + 1;
+        } else if (isdigit((unsigned char)*p)) {
+            char *e;
+            long v = strtol(p, &e, 10);
+            if (*e == ' ') {
+                pid = v;
+                p = e;
+            }
+        }
+        p += strspn(p, " ");
+        size_t stamp = strspn(p, "0123456789:.");
+        if (stamp && p[stamp] == ' ')
+            p += stamp + strspn(p + stamp, " ");
+
+        if (strncmp(p, "<... ", 5) == 0) {
+            // "<... openat resumed>) = 3": the result of an unfinished call
+            char call[32];
+            long result;
+            if (sscanf(p, "<... %31s resumed>", call) != 1 || !find_result(p, &result))
+                continue;
+            for (int i = n_ops - 1; i >= 0; i--) {
+                if (ops[i].pid == pid && ops[i].rec_result == LONG_MIN &&
+                    strcmp(call_names[ops[i].call], call) == 0) {
+                    ops[i].rec_result = result;
+                    break;
+                }
+            }
+            continue;
+        }
+        char *paren = strchr(p, '(');
+        if (!paren)
+            continue;
+        *paren = '\0';
+        name = p;
+        add_op(lineno, pid, name, paren + 1);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Replay */
+
+static const char *errno_name(int err) {
+    const char *name = strerrorname_np(err);
+    return name ? name : "E?";
+}
+
+static const char *type_name(mode_t mode) {
+    return S_ISREG(mode) ? "reg" : S_ISDIR(mode) ? "dir" : S_ISCHR(mode) ? "chr" :
+           S_ISLNK(mode) ? "lnk" : S_ISFIFO(mode) ? "fifo" : S_ISSOCK(mode) ? "sock" : "blk";
+}
+
+static unsigned fnv1a(const char *buf, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)buf[i]) * 16777619u;
+    return h;
+}
+
+static void describe_fd(int fd, char *out, size_t size) {
+    char a[4096], b[4096], preview[80], *o = preview;
+    struct stat st;
+    fstat(fd, &st);
+    ssize_t n = read(fd, a, sizeof(a));
+    if (n < 0) {
+        snprintf(out, size, "%s unreadable %s", type_name(st.st_mode), errno_name(errno));
+        return;
+    }
+    ssize_t m = pread(fd, b, sizeof(b), 0);
+    if (m != n || memcmp(a, b, n) != 0) {
+        snprintf(out, size, "%s volatile", type_name(st.st_mode));
+        return;
+    }
+    for (ssize_t i = 0; i < n && o < preview + sizeof(preview) - 5; i++) {
+        unsigned char c = a[i];
+        o += isprint(c) && c != '"' && c != '\\' ? snprintf(o, 2, "%c", c)
+             : c == '\n' ? snprintf(o, 3, "\\n") : snprintf(o, 5, "\\x%02x", c);
+    }
+    *o = '\0';
+    snprintf(out, size, "%s len=%zd fnv=%08x \"%s\"", type_name(st.st_mode), n, fnv1a(a, n), preview);
+}
+
+static void describe_stat(const struct stat *st, char *out, size_t size) {
+    if (S_ISREG(st->st_mode))
+        snprintf(out, size, "%s %04o size=%lld", type_name(st->st_mode), st->st_mode & 07777,
+                 (long long)st->st_size);
+    else
+        snprintf(out, size, "%s %04o", type_name(st->st_mode), st->st_mode & 07777);
+}
+
+// Run one op; with out, describe what the caller saw
+static void run_op(op_t *op, char *out, size_t size) {
+    struct stat st;
+    struct statx stx;
+    struct statfs sfs;
+    char link[PATH_MAX];
+    int ret = 0, fd, flags = op->flags & ~(O_CREAT | O_TRUNC | O_APPEND | O_EXCL);
+    ssize_t len = 0;
+
+    errno = 0;
+    switch (op->call) {
+    case C_OPEN:
+    case C_OPENAT:
+        fd = op->call == C_OPEN ? open(op->path, flags) : openat(AT_FDCWD, op->path, flags);
+        ret = fd < 0 ? -1 : 0;
+        if (fd >= 0 && out)
+            describe_fd(fd, out, size);
+        if (op->rec_result >= 0 && op->rec_result < MAX_FDS) {
+            if (live_fds[op->rec_result] >= 0)
+                close(live_fds[op->rec_result]);
+            live_fds[op->rec_result] = fd;
+        } else if (fd >= 0) {
+            close(fd);
+        }
+        break;
+    case C_STAT:       ret = stat(op->path, &st); break;
+    case C_LSTAT:      ret = lstat(op->path, &st); break;
+    case C_NEWFSTATAT: ret = fstatat(AT_FDCWD, op->path, &st, op->flags); break;
+    case C_STATX:
+        ret = statx(AT_FDCWD, op->path, op->flags, STATX_BASIC_STATS, &stx);
+        st.st_mode = stx.stx_mode;
+        st.st_size = stx.stx_size;
+        break;
+    case C_ACCESS:      ret = access(op->path, op->mode); break;
+    case C_FACCESSAT:
+    case C_FACCESSAT2:  ret = faccessat(AT_FDCWD, op->path, op->mode, op->flags); break;
+    case C_READLINK:    ret = len = readlink(op->path, link, sizeof(link) - 1); break;
+    case C_READLINKAT:  ret = len = readlinkat(AT_FDCWD, op->path, link, sizeof(link) - 1); break;
+    case C_STATFS:      ret = statfs(op->path, &sfs); break;
+    case C_FSTATFS:
+        fd = op->fd >= 0 && op->fd < MAX_FDS ? live_fds[op->fd] : -1;
+        if (fd < 0)
+            return;  // The open it belongs to failed or wasn't recorded
+        ret = fstatfs(fd, &sfs);
+        break;
+    case C_CLOSE:
+        if (op->fd >= 0 && op->fd < MAX_FDS && live_fds[op->fd] >= 0) {
+            close(live_fds[op->fd]);
+            live_fds[op->fd] = -1;
+        }
+        return;
+    }
+    if (!out)
+        return;
+
+    if (ret < 0) {
+        snprintf(out, size, "-1 %s", errno_name(errno));
+    } else if (op->call == C_STAT || op->call == C_LSTAT || op->call == C_NEWFSTATAT ||
+               op->call == C_STATX) {
+        describe_stat(&st, out, size);
+    } else if (op->call == C_READLINK || op->call == C_READLINKAT) {
+        link[len] = '\0';
+        snprintf(out, size, "-> %.400s", link);
+    } else if (op->call == C_STATFS || op->call == C_FSTATFS) {
+        snprintf(out, size, "type=0x%lx bsize=%ld namelen=%ld flags=0x%lx", (long)sfs.f_type,
+                 (long)sfs.f_bsize, (long)sfs.f_namelen, (long)sfs.f_flags);
+    } else if (op->call != C_OPEN && op->call != C_OPENAT) {
+        snprintf(out, size, "ok");
+    }
+
+    if (op->path) {
+        const unsigned char *c = (unsigned char *)op->path + strlen(op->path) + 1;
+        for (int i = 0; i < CANARY_LEN; i++) {
+            if (c[i] != CANARY) {
+                size_t used = strlen(out);
+                snprintf(out + used, size - used, " CLOBBERED");
+                memset((char *)c, CANARY, CANARY_LEN);
+                break;
+            }
+        }
+    }
+}
+
+static void close_all(void) {
+    for (int i = 0; i < MAX_FDS; i++) {
+        if (live_fds[i] >= 0)
+            close(live_fds[i]);
+        live_fds[i] = -1;
+    }
+}
+
+static int replay(const char *workload, int iterations) {
+    char out[512];
+    if (read_workload(workload) < 0)
+        return 1;
+    memset(live_fds, -1, sizeof(live_fds));
+
+    printf("# replay_intercept v1 %s\n", workload);
+    for (int i = 0; i < n_ops; i++) {
+        out[0] = '\0';
+        run_op(&ops[i], out, sizeof(out));
+        if (ops[i].call == C_CLOSE || (ops[i].call == C_FSTATFS && !out[0]))
+            continue;
+        if (ops[i].path)
+            printf("%d\t%s\t%s\t%s\n", ops[i].line, call_names[ops[i].call], ops[i].path, out);
+        else
+            printf("%d\t%s\tfd %d\t%s\n", ops[i].line, call_names[ops[i].call], ops[i].fd, out);
+    }
+    close_all();
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int it = 0; it < iterations; it++) {
+        for (int i = 0; i < n_ops; i++)
+            run_op(&ops[i], NULL, 0);
+        close_all();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3;
+    printf("# cost ops=%d skipped=%d iterations=%d us_per_op=%.2f\n", n_ops, n_skipped,
+           iterations, iterations && n_ops ? us / iterations / n_ops : 0);
+    return 0;
+}
+
+/* Compare */
+
+typedef struct {
+    char name[64];
+    char **rows;    // By line number, NULL where the op wasn't printed
+    int n_rows, divergent;
+    double us_per_op;
+} file_t;
+
+static int load(file_t *f, const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[1024];
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    const char *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    snprintf(f->name, sizeof(f->name), "%.*s", (int)strcspn(base, "."), base);
+    while (fgets(line, sizeof(line), fp)) {
+        int n;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "# cost %*s %*s %*s us_per_op=%lf", &f->us_per_op) == 1 || line[0] == '#')
+            continue;
+        if ((n = atoi(line)) <= 0)
+            continue;
+        if (n >= f->n_rows) {
+            f->rows = realloc(f->rows, (n + 1) * sizeof(char *));
+            memset(f->rows + f->n_rows, 0, (n + 1 - f->n_rows) * sizeof(char *));
+            f->n_rows = n + 1;
+        }
+        f->rows[n] = strdup(line);
+    }
+    fclose(fp);
+    return 0;
+}
+
+// The observation: everything after the third tab
+static const char *observation(const char *row) {
+    for (int i = 0; row && i < 3; i++)
+        row = strchr(row, '\t') ? strchr(row, '\t') + 1 : NULL;
+    return row ? row : "(not replayed)";
+}
+
+static int compare(char **paths, int n) {
+    file_t files[MAX_FILES] = { 0 };
+    int rows = 0, shown = 0, native = -1, failed = 0;
+    if (n > MAX_FILES)
+        n = MAX_FILES;
+    for (int i = 0; i < n; i++) {
+        if (load(&files[i], paths[i]) < 0)
+            return 2;
+        if (files[i].n_rows > rows)
+            rows = files[i].n_rows;
+        if (strcmp(files[i].name, "native") == 0)
+            native = i;
+    }
+
+    for (int r = 0; r < rows; r++) {
+        const char *ref = r < files[0].n_rows ? files[0].rows[r] : NULL;
+        int differs = 0;
+        for (int i = 1; i < n; i++) {
+            const char *row = r < files[i].n_rows ? files[i].rows[r] : NULL;
+            if ((ref || row) && strcmp(observation(ref), observation(row)) != 0) {
+                files[i].divergent++;
+                differs = 1;
+            }
+        }
+        if (!differs)
+            continue;
+
+        // "12  openat /proc/sys/...", then every backend's observation
+        const char *any = ref;
+        for (int i = 1; !any && i < n; i++)
+            any = r < files[i].n_rows ? files[i].rows[r] : NULL;
+        printf("%s%.*s\n", shown++ ? "\n" : "", (int)(observation(any) - any - 1), any);
+        for (int i = 0; i < n; i++) {
+            const char *row = r < files[i].n_rows ? files[i].rows[r] : NULL;
+            int same = i > 0 && strcmp(observation(ref), observation(row)) == 0;
+            printf("  %-20s %s\n", files[i].name, same ? "=" : observation(row));
+        }
+    }
+
+    printf("%s%-20s %10s %10s %10s\n", shown ? "\n" : "", "backend", "divergent", "us/op", "overhead");
+    for (int i = 0; i < n; i++) {
+        char overhead[32] = "-";
+        if (native >= 0 && files[native].us_per_op > 0)
+            snprintf(overhead, sizeof(overhead), "%.1fx", files[i].us_per_op / files[native].us_per_op);
+        char divergent[16] = "reference";
+        if (i)
+            snprintf(divergent, sizeof(divergent), "%d", files[i].divergent);
+        printf("%-20s %10s %10.2f %10s\n", files[i].name, divergent, files[i].us_per_op, overhead);
+        failed |= i != native && files[i].divergent;
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 100, compare_mode = 0, bad = 0, opt;
+    while ((opt = getopt(argc, argv, "n:c")) != -1) {
+        switch (opt) {
+        case 'n': iterations = atoi(optarg); break;
+        case 'c': compare_mode = 1; break;
+        default: bad = 1; break;
+        }
+    }
+    if (!bad && compare_mode && optind < argc - 1)
+        return compare(argv + optind, argc - optind);
+    if (!bad && !compare_mode && optind == argc - 1)
+        return replay(argv[optind], iterations);
+    fprintf(stderr, "Usage: %s [-n iterations] workload.strace\n"
+                    "       %s -c ref.out other.out...\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# Build every interception backend and run bench_intercept under each
+#
+# Results are appended to results/<label>.jsonl, label defaulting to the
+# short commit id (plus -dirty), so two commits compare with:
+#   ./bench_intercept -c results/<old>.jsonl results/<new>.jsonl
+#
+# Backends that can't be built or started here (no libfuse, no seccomp user
+# notification) are skipped with a note.
+#
+# Usage: ./run-bench.sh [-l label] [-d seconds] [-t threads] [backend...]
+#   backends: native ptrace ptrace-hybrid seccomp-trace seccomp-notify preload fuse
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO="$(cd "$SCRIPT_DIR/../.." && pwd)"
+BUILD="/tmp/intercept-bench"
+FUSE_MNT="/tmp/intercept-bench-fuse"
+
+label=$(git -C "$REPO" rev-parse --short HEAD 2>/dev/null || echo unknown)
+git -C "$REPO" diff --quiet HEAD 2>/dev/null || label="$label-dirty"
+bench_args=()
+while getopts "l:d:t:" opt; do
+    case $opt in
+        l) label=$OPTARG ;;
+        d|t) bench_args+=("-$opt" "$OPTARG") ;;
+        *) sed -n 12,13p "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+backends=("$@")
+[ ${#backends[@]} -gt 0 ] || backends=(native ptrace ptrace-hybrid seccomp-trace seccomp-notify preload fuse)
+
+mkdir -p "$BUILD" "$SCRIPT_DIR/results"
+RESULTS="$SCRIPT_DIR/results/$label.jsonl"
+
+gcc -O2 -Wall "$SCRIPT_DIR/bench_intercept.c" -o "$SCRIPT_DIR/bench_intercept" -lpthread
+gcc -O2 -Wall "$SCRIPT_DIR/seccomp_intercept.c" -o "$BUILD/seccomp_intercept"
+gcc -O2 "$REPO/solutions/worker-stable-production/ptrace_interceptor.c" -o "$BUILD/ptrace_interceptor" -lpthread
+gcc -shared -fPIC -O2 "$REPO/experiments/09-ld-preload-intercept/ld_preload_interceptor.c" \
+    -o "$BUILD/ld_preload_interceptor.so" -ldl -lpthread
+fuse_built=0
+gcc -O2 "$REPO/experiments/07-fuse-cgroup-emulation/fuse_cgroupfs.c" -o "$BUILD/fuse_cgroupfs" \
+    -lpthread $(pkg-config fuse --cflags --libs 2>/dev/null) 2>/dev/null && fuse_built=1
+
+# Redirect targets for the matched paths, from the shared spec
+"$REPO/experiments/34-fake-tree-spec/fake-tree.sh" -c /proc/sys=/tmp/fake-procsys \
+    /sys/fs/cgroup=/tmp/fake-cgroup > /dev/null
+
+bench() {
+    "$SCRIPT_DIR/bench_intercept" "${bench_args[@]}" -l "$label" -o "$RESULTS" \
+        -E "$BUILD/$1.stderr" "$@"
+    echo ""
+}
+
+for backend in "${backends[@]}"; do
+    case $backend in
+        native)
+            bench native ;;
+        ptrace)
+            bench ptrace "$BUILD/ptrace_interceptor" ;;
+        ptrace-hybrid)
+            # Dynamic children (here /bin/true) are handed to the library
+            bench ptrace-hybrid "$BUILD/ptrace_interceptor" -p "$BUILD/ld_preload_interceptor.so" ;;
+        seccomp-trace)
+            bench seccomp-trace "$BUILD/seccomp_intercept" -m trace ;;
+        seccomp-notify)
+            bench seccomp-notify "$BUILD/seccomp_intercept" -m notify || echo "seccomp-notify: skipped" ;;
+        preload)
+            bench -e LD_PRELOAD="$BUILD/ld_preload_interceptor.so" preload ;;
+        fuse)
+            if [ $fuse_built = 0 ]; then
+                echo "fuse: skipped, fuse_cgroupfs doesn't build here (no libfuse)"
+                continue
+            fi
+            mkdir -p "$FUSE_MNT"
+            "$BUILD/fuse_cgroupfs" "$FUSE_MNT" -o tree=/tmp/fake-cgroup &
+            fuse_pid=$!
+            for _ in $(seq 50); do [ -e "$FUSE_MNT/cpu/cpu.shares" ] && break; sleep 0.1; done
+            # The matched path is a file in the mount; statfs hits the mount too
+            bench -P "$fuse_pid" -m "$FUSE_MNT/cpu/cpu.shares" -s "$FUSE_MNT" fuse || true
+            fusermount -u "$FUSE_MNT" 2>/dev/null || umount "$FUSE_MNT" 2>/dev/null || true
+            kill "$fuse_pid" 2>/dev/null || true
+            wait "$fuse_pid" 2>/dev/null || true
+            ;;
+        *)
+            echo "unknown backend $backend" >&2
+            exit 1 ;;
+    esac
+done
+
+echo "Results: $RESULTS"
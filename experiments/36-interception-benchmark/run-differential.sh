@@ -0,0 +1,89 @@
+#!/bin/bash
+#
+# Replay a recorded workload under every interceptor copy and diff them
+#
+# Each backend's observations go to out/<backend>.out, and are compared
+# against the stable ptrace tracer (the one the workers run):
+#   ./replay_intercept -c out/ptrace.out out/*.out
+# Exits 1 if any backend other than native diverges from it.
+#
+# FUSE only serves its mount, not the recorded paths, so it isn't replayed.
+#
+# Usage: ./run-differential.sh [-w workload.strace] [-n iterations] [backend...]
+#   backends: native ptrace ptrace-experimental ptrace-enhanced ptrace-optimized
+#             ptrace-statfs seccomp-trace seccomp-notify preload
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO="$(cd "$SCRIPT_DIR/../.." && pwd)"
+BUILD="/tmp/intercept-bench"
+OUT="$SCRIPT_DIR/out"
+
+workload="$SCRIPT_DIR/k3s-node.strace"
+iterations=100
+while getopts "w:n:" opt; do
+    case $opt in
+        w) workload=$OPTARG ;;
+        n) iterations=$OPTARG ;;
+        *) sed -n 12,14p "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+backends=("$@")
+[ ${#backends[@]} -gt 0 ] || backends=(ptrace native ptrace-experimental ptrace-enhanced
+    ptrace-optimized ptrace-statfs seccomp-trace seccomp-notify preload)
+
+mkdir -p "$BUILD" "$OUT"
+rm -f "$OUT"/*.out
+
+gcc -O2 -Wall "$SCRIPT_DIR/replay_intercept.c" -o "$SCRIPT_DIR/replay_intercept"
+gcc -O2 -Wall "$SCRIPT_DIR/seccomp_intercept.c" -o "$BUILD/seccomp_intercept"
+gcc -O2 "$REPO/solutions/worker-stable-production/ptrace_interceptor.c" -o "$BUILD/ptrace_interceptor" -lpthread
+gcc -O2 "$REPO/solutions/worker-ptrace-experimental/ptrace_interceptor.c" -o "$BUILD/ptrace_experimental"
+gcc -O2 "$REPO/experiments/13-ultimate-solution/ptrace_interceptor_enhanced.c" -o "$BUILD/ptrace_enhanced"
+gcc -O2 "$REPO/experiments/14-timing-optimization/ptrace_interceptor_optimized.c" -o "$BUILD/ptrace_optimized"
+gcc -O2 "$REPO/experiments/06-enhanced-ptrace-statfs/enhanced_ptrace_interceptor.c" -o "$BUILD/ptrace_statfs"
+gcc -shared -fPIC -O2 "$REPO/experiments/09-ld-preload-intercept/ld_preload_interceptor.c" \
+    -o "$BUILD/ld_preload_interceptor.so" -ldl -lpthread
+
+# Redirect targets for every copy's rules, from the shared spec
+"$REPO/experiments/34-fake-tree-spec/fake-tree.sh" -c /proc/sys=/tmp/fake-procsys \
+    /sys/fs/cgroup=/tmp/fake-cgroup /proc/diskstats=/tmp/fake-diskstats > /dev/null
+[ -e /tmp/fake-cpuacct-usage-percpu ] || echo "0 0 0 0" > /tmp/fake-cpuacct-usage-percpu
+
+replay() {
+    local name=$1
+    shift
+    if "$@" "$SCRIPT_DIR/replay_intercept" -n "$iterations" "$workload" \
+        > "$OUT/$name.out" 2> "$BUILD/$name.stderr"; then
+        echo "$name: $(tail -1 "$OUT/$name.out")"
+    else
+        echo "$name: failed, see $BUILD/$name.stderr"
+        rm -f "$OUT/$name.out"
+    fi
+}
+
+for backend in "${backends[@]}"; do
+    case $backend in
+        native)              replay native ;;
+        ptrace)              replay ptrace "$BUILD/ptrace_interceptor" ;;
+        ptrace-experimental) replay ptrace-experimental "$BUILD/ptrace_experimental" ;;
+        ptrace-enhanced)     replay ptrace-enhanced "$BUILD/ptrace_enhanced" ;;
+        ptrace-optimized)    replay ptrace-optimized "$BUILD/ptrace_optimized" ;;
+        ptrace-statfs)       replay ptrace-statfs "$BUILD/ptrace_statfs" ;;
+        seccomp-trace)       replay seccomp-trace "$BUILD/seccomp_intercept" -m trace ;;
+        seccomp-notify)      replay seccomp-notify "$BUILD/seccomp_intercept" -m notify ;;
+        preload)             replay preload env LD_PRELOAD="$BUILD/ld_preload_interceptor.so" ;;
+        *)
+            echo "unknown backend $backend" >&2
+            exit 1 ;;
+    esac
+done
+
+echo ""
+outs=("$OUT"/*.out)
+ref="$OUT/ptrace.out"
+[ -e "$ref" ] || ref=${outs[0]}
+"$SCRIPT_DIR/replay_intercept" -c "$ref" $(ls "$OUT"/*.out | grep -v "^$ref$")
@@ -0,0 +1,457 @@
+/*
+ * seccomp-based redirect interceptor, for comparison with the ptrace tracer
+ *
+ * Applies the redirect rules of solutions/worker-stable-production/
+ * ptrace_interceptor (/proc/sys to /tmp/fake-procsys, /proc/diskstats and
+ * cpuacct.usage_percpu to their /tmp fakes) and the statfs spoof of
+ * experiment 06 (9p reported as ext4), but only open, openat, statfs and
+ * fstatfs ever leave the kernel. The other syscalls run at full speed.
+ *
+ * -m trace:  SECCOMP_RET_TRACE. The tracer stops on the filtered calls only.
+ *            A redirected path is written below the tracee's stack red zone,
+ *            and the argument is pointed at it until the syscall-exit stop,
+ *            where statfs results are fixed up too.
+ * -m notify: SECCOMP_RET_USER_NOTIF, no ptrace. The supervisor opens the
+ *            redirect target itself and installs the fd in the caller
+ *            (SECCOMP_IOCTL_NOTIF_ADDFD, Linux 5.14+). statfs is done on
+ *            the caller's behalf and copied out through /proc/<pid>/mem.
+ *            Calls that match no rule are sent back with
+ *            SECCOMP_USER_NOTIF_FLAG_CONTINUE.
+ *
+ * The filter is inherited by every child and thread, so both modes follow
+ * forks the way the ptrace tracer does. x86_64 only, like the tracer.
+ *
+ * Build: gcc -O2 -Wall seccomp_intercept.c -o seccomp_intercept
+ * Usage: ./seccomp_intercept [-m trace|notify] [-v] <program> [args...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+
+#define MAX_STRING 4096
+#define NINE_P_FS_MAGIC 0x01021997
+#define EXT4_SUPER_MAGIC 0xEF53
+#define MAX_PENDING 256
+
+static int verbose;
+
+// Trace mode: threads resumed to their syscall-exit stop, with the path
+// argument to put back (0 for statfs, whose result is fixed up instead)
+typedef struct {
+    pid_t pid;
+    unsigned long long path_addr;
+} pending_t;
+
+static pending_t pending[MAX_PENDING];
+static int n_pending;
+
+static pending_t *find_pending(pid_t pid) {
+    for (int i = 0; i < n_pending; i++)
+        if (pending[i].pid == pid)
+            return &pending[i];
+    return NULL;
+}
+
+/* Rules, as in the ptrace tracer */
+
+static const char *redirect_target(const char *path, char *buf, size_t size) {
+    const char *suffix = strstr(path, "/proc/sys/");
+    if (suffix) {
+        snprintf(buf, size, "/tmp/fake-procsys/%s", suffix + strlen("/proc/sys/"));
+        return buf;
+    }
+    if (strstr(path, "/proc/diskstats"))
+        return "/tmp/fake-diskstats";
+    if (strstr(path, "/sys/fs/cgroup/cpuacct/cpuacct.usage_percpu"))
+        return "/tmp/fake-cpuacct-usage-percpu";
+    return NULL;
+}
+
+static void spoof_statfs(struct statfs *st) {
+    if (st->f_type == NINE_P_FS_MAGIC)
+        st->f_type = EXT4_SUPER_MAGIC;
+}
+
+/* Tracee memory */
+
+static int read_path(pid_t pid, unsigned long addr, char *buf) {
+    struct iovec local = { buf, MAX_STRING - 1 }, remote = { (void *)addr, MAX_STRING - 1 };
+    ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if (n <= 0) {
+        // The string may end just before an unmapped page: read up to the boundary
+        remote.iov_len = local.iov_len = 4096 - (addr & 4095);
+        n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (n <= 0)
+            return -1;
+    }
+    buf[n] = '\0';
+    return memchr(buf, '\0', n) ? 0 : -1;
+}
+
+static int write_mem(pid_t pid, unsigned long addr, const void *data, size_t len) {
+    struct iovec local = { (void *)data, len }, remote = { (void *)addr, len };
+    return process_vm_writev(pid, &local, 1, &remote, 1, 0) == (ssize_t)len ? 0 : -1;
+}
+
+/* Filter */
+
+static int install_filter(unsigned int action, unsigned int flags) {
+    struct sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_open, 4, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_openat, 3, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_statfs, 2, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_fstatfs, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        BPF_STMT(BPF_RET | BPF_K, action),
+    };
+    struct sock_fprog prog = { sizeof(filter) / sizeof(filter[0]), filter };
+
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+        return -1;
+    return syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+}
+
+/* -m trace */
+
+static void trace_entry(pid_t pid) {
+    struct user_regs_struct regs;
+    char path[MAX_STRING], target[MAX_STRING];
+    if (ptrace(PTRACE_GETREGS, pid, 0, &regs) < 0)
+        return;
+
+    if (regs.orig_rax == __NR_statfs || regs.orig_rax == __NR_fstatfs) {
+        if (n_pending < MAX_PENDING) {
+            pending[n_pending++] = (pending_t){ pid, 0 };
+            ptrace(PTRACE_SYSCALL, pid, 0, 0);
+        } else {
+            ptrace(PTRACE_CONT, pid, 0, 0);
+        }
+        return;
+    }
+
+    unsigned long long *arg = regs.orig_rax == __NR_open ? &regs.rdi : &regs.rsi;
+    const char *redirect;
+    if (read_path(pid, *arg, path) == 0 &&
+        (redirect = redirect_target(path, target, sizeof(target))) != NULL) {
+        // Below the red zone, as handle_exec() in the ptrace tracer
+        size_t len = strlen(redirect) + 1;
+        unsigned long addr = (regs.rsp - 128 - len) & ~15UL;
+        if (n_pending < MAX_PENDING && write_mem(pid, addr, redirect, len) == 0) {
+            pending[n_pending++] = (pending_t){ pid, *arg };
+            *arg = addr;
+            ptrace(PTRACE_SETREGS, pid, 0, &regs);
+            if (verbose)
+                fprintf(stderr, "[SECCOMP:%d] %s -> %s\n", pid, path, redirect);
+            ptrace(PTRACE_SYSCALL, pid, 0, 0);
+            return;
+        }
+    }
+    ptrace(PTRACE_CONT, pid, 0, 0);
+}
+
+static void trace_exit(pid_t pid, pending_t *p) {
+    struct user_regs_struct regs;
+    struct statfs st;
+    if (ptrace(PTRACE_GETREGS, pid, 0, &regs) < 0)
+        return;
+    if ((long long)regs.rax == -ENOSYS) {
+        // Entry stop on kernels that report one after the seccomp stop
+        ptrace(PTRACE_SYSCALL, pid, 0, 0);
+        return;
+    }
+    unsigned long long path_addr = p->path_addr;
+    *p = pending[--n_pending];
+
+    if (path_addr) {
+        // Redirected open: the caller gets its own pointer back
+        if (regs.orig_rax == __NR_open)
+            regs.rdi = path_addr;
+        else
+            regs.rsi = path_addr;
+        ptrace(PTRACE_SETREGS, pid, 0, &regs);
+    } else if (regs.rax == 0) {
+        struct iovec local = { &st, sizeof(st) }, remote = { (void *)regs.rsi, sizeof(st) };
+        if (process_vm_readv(pid, &local, 1, &remote, 1, 0) == sizeof(st) &&
+            st.f_type == NINE_P_FS_MAGIC) {
+            spoof_statfs(&st);
+            write_mem(pid, regs.rsi, &st, sizeof(st));
+        }
+    }
+    ptrace(PTRACE_CONT, pid, 0, 0);
+}
+
+static int run_trace(char **argv) {
+    pid_t child = fork();
+    if (child == 0) {
+        ptrace(PTRACE_TRACEME, 0, 0, 0);
+        raise(SIGSTOP);
+        if (install_filter(SECCOMP_RET_TRACE, 0) < 0) {
+            perror("seccomp");
+            _exit(126);
+        }
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+
+    int status, exit_code = 0;
+    waitpid(child, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, child, 0,
+           PTRACE_O_TRACESECCOMP | PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK |
+           PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_CONT, child, 0, 0);
+
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, __WALL)) > 0) {
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (pid == child)
+                exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            pending_t *p = find_pending(pid);
+            if (p)
+                *p = pending[--n_pending];
+            continue;
+        }
+        if (!WIFSTOPPED(status))
+            continue;
+
+        int sig = WSTOPSIG(status);
+        pending_t *p;
+        if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8)))
+            trace_entry(pid);
+        else if (sig == (SIGTRAP | 0x80) && (p = find_pending(pid)) != NULL)
+            trace_exit(pid, p);
+        else if (sig == SIGTRAP || (sig == SIGSTOP && status >> 16))
+            ptrace(PTRACE_CONT, pid, 0, 0);  // Fork/clone events
+        else
+            ptrace(PTRACE_CONT, pid, 0, sig == SIGSTOP ? 0 : sig);  // New children start stopped
+    }
+    return exit_code;
+}
+
+/* -m notify */
+
+static int send_fd(int sock, int fd) {
+    char ctrl[CMSG_SPACE(sizeof(int))] = { 0 }, byte = 0;
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl,
+                          .msg_controllen = sizeof(ctrl) };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sock, &msg, 0) == 1 ? 0 : -1;
+}
+
+static int recv_fd(int sock) {
+    char ctrl[CMSG_SPACE(sizeof(int))], byte;
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl,
+                          .msg_controllen = sizeof(ctrl) };
+    if (recvmsg(sock, &msg, 0) != 1)
+        return -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    int fd;
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+        return -1;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+// statfs/fstatfs on the caller's behalf; 0 if it must run in the caller
+static int notify_statfs(int listener, struct seccomp_notif *req, struct seccomp_notif_resp *resp) {
+    struct statfs st;
+    char path[MAX_STRING];
+    int ret;
+
+    if (req->data.nr == __NR_statfs) {
+        // Relative paths depend on the caller's cwd: leave them to it
+        if (read_path(req->pid, req->data.args[0], path) < 0 || path[0] != '/')
+            return 0;
+        if (ioctl(listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &req->id) < 0)
+            return 0;
+        ret = statfs(path, &st);
+    } else {
+        int pidfd = syscall(SYS_pidfd_open, req->pid, 0);
+        int fd = pidfd >= 0 ? syscall(SYS_pidfd_getfd, pidfd, (int)req->data.args[0], 0) : -1;
+        if (pidfd >= 0)
+            close(pidfd);
+        if (fd < 0)
+            return 0;
+        ret = fstatfs(fd, &st);
+        close(fd);
+    }
+
+    if (ret < 0) {
+        resp->error = -errno;
+        return 1;
+    }
+    spoof_statfs(&st);
+    char mem[64];
+    snprintf(mem, sizeof(mem), "/proc/%d/mem", req->pid);
+    int memfd = open(mem, O_WRONLY | O_CLOEXEC);
+    if (memfd < 0)
+        return 0;
+    ret = pwrite(memfd, &st, sizeof(st), req->data.args[1]);
+    close(memfd);
+    if (ret != sizeof(st))
+        resp->error = -EFAULT;
+    return 1;
+}
+
+// Returns 1 if the open was done and the fd installed in the caller
+static int notify_open(int listener, struct seccomp_notif *req, struct seccomp_notif_resp *resp) {
+    char path[MAX_STRING], target[MAX_STRING];
+    int is_open = req->data.nr == __NR_open;
+    int flags = is_open ? req->data.args[1] : req->data.args[2];
+    mode_t mode = is_open ? req->data.args[2] : req->data.args[3];
+    const char *redirect;
+
+    if (read_path(req->pid, req->data.args[is_open ? 0 : 1], path) < 0 ||
+        (redirect = redirect_target(path, target, sizeof(target))) == NULL)
+        return 0;
+    // The caller may have died and its pid been reused while we read
+    if (ioctl(listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &req->id) < 0)
+        return 0;
+
+    int fd = open(redirect, flags | O_CLOEXEC, mode);
+    if (fd < 0) {
+        resp->error = -errno;
+        return 1;
+    }
+    struct seccomp_notif_addfd addfd = {
+        .id = req->id,
+        .flags = SECCOMP_ADDFD_FLAG_SEND,
+        .srcfd = fd,
+        .newfd_flags = flags & O_CLOEXEC,
+    };
+    // Installs the fd and answers the call with its number
+    int ret = ioctl(listener, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+    close(fd);
+    if (verbose)
+        fprintf(stderr, "[SECCOMP:%d] %s -> %s\n", req->pid, path, redirect);
+    if (ret < 0 && errno != ENOENT) {
+        resp->error = -errno;
+        return 1;
+    }
+    return -1;  // Answered by ADDFD (or the caller is gone)
+}
+
+static int run_notify(char **argv) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(sv[0]);
+        int listener = install_filter(SECCOMP_RET_USER_NOTIF, SECCOMP_FILTER_FLAG_NEW_LISTENER);
+        if (listener < 0 || send_fd(sv[1], listener) < 0) {
+            perror("seccomp");
+            _exit(126);
+        }
+        close(listener);
+        close(sv[1]);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    close(sv[1]);
+    int listener = recv_fd(sv[0]);
+    close(sv[0]);
+    if (listener < 0) {
+        int status;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+
+    struct seccomp_notif_sizes sizes;
+    if (syscall(__NR_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) < 0) {
+        perror("SECCOMP_GET_NOTIF_SIZES");
+        return 1;
+    }
+    struct seccomp_notif *req = malloc(sizes.seccomp_notif);
+    struct seccomp_notif_resp *resp = malloc(sizes.seccomp_notif_resp);
+
+    // The listener hangs up once every process holding the filter is gone
+    struct pollfd pfd = { listener, POLLIN, 0 };
+    for (;;) {
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            break;
+        if (!(pfd.revents & POLLIN)) {
+            if (pfd.revents & (POLLHUP | POLLERR))
+                break;
+            continue;
+        }
+        memset(req, 0, sizes.seccomp_notif);
+        if (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, req) < 0)
+            continue;  // EINTR, or the caller died (ENOENT)
+        memset(resp, 0, sizes.seccomp_notif_resp);
+        resp->id = req->id;
+
+        int handled = req->data.nr == __NR_statfs || req->data.nr == __NR_fstatfs
+                          ? notify_statfs(listener, req, resp)
+                          : notify_open(listener, req, resp);
+        if (handled < 0)
+            continue;
+        if (!handled)
+            resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+        ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+int main(int argc, char *argv[]) {
+    const char *mode = "trace";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+m:v")) != -1) {
+        switch (opt) {
+        case 'm': mode = optarg; break;
+        case 'v': verbose = 1; break;
+        default: optind = argc; break;
+        }
+    }
+    if (optind >= argc || (strcmp(mode, "trace") != 0 && strcmp(mode, "notify") != 0)) {
+        fprintf(stderr, "Usage: %s [-m trace|notify] [-v] <program> [args...]\n", argv[0]);
+        return 1;
+    }
+    return strcmp(mode, "trace") == 0 ? run_trace(argv + optind) : run_notify(argv + optind);
+}
@@ -0,0 +1,376 @@
+/*
+ * Live interception stats: a shared-memory segment every interceptor
+ * publishes its counters into, read by intercept_top
+ *
+ * The segment is a file in /dev/shm (INTERCEPT_STATS=<path> moves it,
+ * INTERCEPT_STATS=off turns publishing off). It holds a header and
+ * ISTATS_SLOTS fixed-size slots. Each process claims one slot per backend
+ * when it starts. The hooks then bump that slot's counters with relaxed
+ * atomic adds. Only the owning process writes a slot's counters, and the
+ * counters sit on cache lines of their own, so hundreds of processes
+ * publish without sharing a line.
+ *
+ * Counters, as each backend fills them in:
+ *   calls   intercepted calls examined (ptrace: syscall stops)
+ *   hits    calls a rule acted on, also counted per rule in rule_hits
+ *   errors  calls the backend failed to handle
+ *   ns      time spent handling calls, where the backend measures it
+ *   gauge   a backend-specific level (ptrace: traced processes)
+ *
+ * Claiming is lock-free. A slot goes FREE -> CLAIMING -> LIVE by
+ * compare-and-swap, and gen is odd while the identity is being written, so
+ * readers skip slots that change under them. A page of owner pids lets a
+ * claim find its slot without faulting in every slot. A process that execs
+ * takes over its own slot for the same backend. Slots of processes that
+ * died without releasing are reclaimed when no free slot is left. Whenever
+ * a slot is released, taken over or reclaimed, its counts are first added
+ * to its backend's retired totals, so short-lived processes still show up
+ * in the backend's rates.
+ *
+ * Readers and writers check the magic, version and layout before use: a
+ * segment left by another layout is never written to. Remove it to start
+ * over.
+ *
+ * Include after the system headers; everything here is static. The
+ * viewer uses only the mapping half.
+ */
+
+#ifndef INTERCEPT_STATS_H
+#define INTERCEPT_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define ISTATS_DEFAULT_PATH "/dev/shm/intercept-stats"
+#define ISTATS_MAGIC 0x5354415453504349ULL  // "ICPSTATS"
+#define ISTATS_VERSION 1
+#define ISTATS_SLOTS 1024
+#define ISTATS_RULES 16
+#define ISTATS_BACKENDS 16
+#define ISTATS_NAME 24
+#define ISTATS_LINE 64
+
+enum { ISTATS_FREE, ISTATS_CLAIMING, ISTATS_LIVE };
+
+typedef struct {
+    uint64_t magic;                 // Stored last by the creator
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t nslots;
+    uint32_t nrules;
+    uint32_t nbackends;
+} __attribute__((aligned(ISTATS_LINE))) istats_header_t;
+
+typedef struct {
+    // Identity, written while claiming
+    uint32_t state;
+    uint32_t gen;                   // Odd while the identity is being written
+    int32_t pid;
+    uint32_t nrules;
+    uint64_t start_time;            // /proc/<pid>/stat starttime, to spot pid reuse
+    char backend[16];
+    char comm[16];
+
+    // Counters, written only by the owning process
+    uint64_t calls __attribute__((aligned(ISTATS_LINE)));
+    uint64_t hits;
+    uint64_t errors;
+    uint64_t ns;
+    int64_t gauge;
+
+    uint64_t rule_hits[ISTATS_RULES] __attribute__((aligned(ISTATS_LINE)));
+
+    // Rule names, written while claiming
+    char rules[ISTATS_RULES][ISTATS_NAME] __attribute__((aligned(ISTATS_LINE)));
+} istats_slot_t;
+
+typedef struct {
+    istats_header_t header;
+    // Owner pid of each live slot, 0 if free. Only a hint: the slot's
+    // state decides. It lets a claim look at one page instead of every slot.
+    int32_t pids[ISTATS_SLOTS] __attribute__((aligned(ISTATS_LINE)));
+    istats_slot_t slots[ISTATS_SLOTS];
+    istats_slot_t retired[ISTATS_BACKENDS];  // Totals of released slots, pid 0
+} istats_segment_t;
+
+_Static_assert(sizeof(istats_slot_t) % ISTATS_LINE == 0, "slots must not share cache lines");
+
+// This process's segment and slot, NULL when not publishing
+static istats_segment_t *istats_segment;
+static istats_slot_t *istats_slot;
+
+// What istats_open() was called with, for re-claiming after fork()
+static const char *istats_backend;
+static const char *const *istats_rule_names;
+static int istats_nrules;
+
+// Path of the segment, NULL if publishing is off
+static const char *istats_path(void) {
+    const char *path = getenv("INTERCEPT_STATS");
+    if (!path || !*path)
+        return ISTATS_DEFAULT_PATH;
+    return strcmp(path, "off") == 0 ? NULL : path;
+}
+
+// Raw syscalls: the LD_PRELOAD libraries hook open() and close()
+static ssize_t istats_read_file(const char *path, char *buf, size_t size) {
+    int fd = syscall(SYS_openat, AT_FDCWD, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = syscall(SYS_read, fd, buf, size - 1);
+    syscall(SYS_close, fd);
+    buf[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+// starttime (field 22) of /proc/<pid>/stat, 0 if the process is gone
+static uint64_t istats_start_time(pid_t pid) {
+    char path[32], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (istats_read_file(path, buf, sizeof(buf)) <= 0)
+        return 0;
+    char *p = strrchr(buf, ')');  // comm may contain spaces
+    for (int field = 2; p && field < 22; field++)
+        p = strchr(p + 1, ' ');
+    return p ? strtoull(p + 1, NULL, 10) : 0;
+}
+
+// Map the segment, creating it if needed. Returns NULL and sets *err on
+// failure; a segment with another layout is an error, not overwritten.
+static istats_segment_t *istats_map(const char *path, int writable, const char **err) {
+    size_t size = sizeof(istats_segment_t);
+    int created = 0;
+    int fd = syscall(SYS_openat, AT_FDCWD, path, (writable ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY) |
+                     O_CLOEXEC, 0666);
+    if (fd >= 0 && writable) {
+        created = 1;
+        fchmod(fd, 0666);  // Shared by every user on the node, whatever the umask
+        if (ftruncate(fd, size) != 0) {
+            syscall(SYS_close, fd);
+            *err = "cannot size segment";
+            return NULL;
+        }
+    } else if (writable && errno == EEXIST) {
+        fd = syscall(SYS_openat, AT_FDCWD, path, O_RDWR | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        *err = "cannot open segment";
+        return NULL;
+    }
+
+    // Another process may be creating it: wait up to 100 ms for the size
+    struct stat st;
+    for (int i = 0; !created && fstat(fd, &st) == 0 && (size_t)st.st_size < size; i++) {
+        if (i == 100) {
+            syscall(SYS_close, fd);
+            *err = "segment is smaller than this layout";
+            return NULL;
+        }
+        nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+    }
+
+    istats_segment_t *seg = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                                 MAP_SHARED, fd, 0);
+    syscall(SYS_close, fd);
+    if (seg == MAP_FAILED) {
+        *err = "cannot map segment";
+        return NULL;
+    }
+
+    if (created) {
+        seg->header.version = ISTATS_VERSION;
+        seg->header.slot_size = sizeof(istats_slot_t);
+        seg->header.nslots = ISTATS_SLOTS;
+        seg->header.nrules = ISTATS_RULES;
+        seg->header.nbackends = ISTATS_BACKENDS;
+        __atomic_store_n(&seg->header.magic, ISTATS_MAGIC, __ATOMIC_RELEASE);
+    }
+    for (int i = 0; __atomic_load_n(&seg->header.magic, __ATOMIC_ACQUIRE) == 0; i++) {
+        if (i == 100) {
+            *err = "segment was never initialized";
+            munmap(seg, size);
+            return NULL;
+        }
+        nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+    }
+    if (seg->header.magic != ISTATS_MAGIC || seg->header.version != ISTATS_VERSION ||
+        seg->header.slot_size != sizeof(istats_slot_t) || seg->header.nslots != ISTATS_SLOTS ||
+        seg->header.nrules != ISTATS_RULES || seg->header.nbackends != ISTATS_BACKENDS) {
+        *err = "segment has another version or layout";
+        munmap(seg, size);
+        return NULL;
+    }
+    return seg;
+}
+
+// Add a slot's counts to its backend's retired totals (slot not LIVE)
+static void istats_retire(istats_segment_t *seg, istats_slot_t *slot) {
+    istats_slot_t *r = NULL;
+
+    for (int pass = 0; pass < 2 && !r; pass++) {
+        for (int i = 0; i < ISTATS_BACKENDS && !r; i++) {
+            istats_slot_t *s = &seg->retired[i];
+            uint32_t expect = pass == 0 ? ISTATS_LIVE : ISTATS_FREE;
+            if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != expect)
+                continue;
+            if (pass == 0 && strncmp(s->backend, slot->backend, sizeof(s->backend)) == 0)
+                r = s;
+            if (pass == 1 && __atomic_compare_exchange_n(&s->state, &expect, ISTATS_CLAIMING, 0,
+                                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                memcpy(s->backend, slot->backend, sizeof(s->backend));
+                memcpy(s->rules, slot->rules, sizeof(s->rules));
+                s->nrules = slot->nrules;
+                __atomic_store_n(&s->state, ISTATS_LIVE, __ATOMIC_RELEASE);
+                r = s;
+            }
+        }
+    }
+    if (!r)
+        return;  // More backends than ISTATS_BACKENDS: the counts are lost
+
+    __atomic_add_fetch(&r->calls, __atomic_load_n(&slot->calls, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&r->hits, __atomic_load_n(&slot->hits, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&r->errors, __atomic_load_n(&slot->errors, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&r->ns, __atomic_load_n(&slot->ns, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    for (int i = 0; i < ISTATS_RULES; i++)
+        __atomic_add_fetch(&r->rule_hits[i], __atomic_load_n(&slot->rule_hits[i], __ATOMIC_RELAXED),
+                           __ATOMIC_RELAXED);
+}
+
+// Take a slot for (pid, backend): the pid's own slot after an exec, else
+// a free one, else one whose process is gone (or whose pid was reused)
+static istats_slot_t *istats_claim(istats_segment_t *seg, pid_t pid) {
+    istats_slot_t *slot = NULL;
+    uint32_t expect = ISTATS_FREE;
+
+    int index = -1;
+
+    for (int pass = 0; pass < 3 && !slot; pass++) {
+        for (int i = 0; i < ISTATS_SLOTS && !slot; i++) {
+            int32_t owner = __atomic_load_n(&seg->pids[i], __ATOMIC_RELAXED);
+            if ((pass == 0 && owner != pid) || (pass == 1 && owner != 0))
+                continue;
+            istats_slot_t *s = &seg->slots[i];
+            expect = pass == 1 ? ISTATS_FREE : ISTATS_LIVE;
+            if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != expect)
+                continue;
+            if (pass == 0 && (s->pid != pid || strncmp(s->backend, istats_backend, sizeof(s->backend))))
+                continue;
+            if (pass == 2 && istats_start_time(s->pid) == s->start_time)
+                continue;
+            if (__atomic_compare_exchange_n(&s->state, &expect, ISTATS_CLAIMING, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                slot = s;
+                index = i;
+            }
+        }
+    }
+    if (!slot)
+        return NULL;
+    if (expect == ISTATS_LIVE)
+        istats_retire(seg, slot);
+
+    char comm[32] = "";
+    istats_read_file("/proc/self/comm", comm, sizeof(comm));
+    comm[strcspn(comm, "\n")] = '\0';
+
+    __atomic_add_fetch(&slot->gen, 1, __ATOMIC_RELEASE);
+    slot->pid = pid;
+    slot->start_time = istats_start_time(pid);
+    snprintf(slot->backend, sizeof(slot->backend), "%.15s", istats_backend);
+    snprintf(slot->comm, sizeof(slot->comm), "%.15s", comm);
+    slot->nrules = istats_nrules;
+    memset(slot->rules, 0, sizeof(slot->rules));
+    for (int i = 0; i < istats_nrules; i++)
+        snprintf(slot->rules[i], ISTATS_NAME, "%.23s", istats_rule_names[i]);
+    __atomic_store_n(&slot->calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->hits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->errors, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->gauge, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < ISTATS_RULES; i++)
+        __atomic_store_n(&slot->rule_hits[i], 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&slot->gen, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->state, ISTATS_LIVE, __ATOMIC_RELEASE);
+    __atomic_store_n(&seg->pids[index], pid, __ATOMIC_RELAXED);
+    return slot;
+}
+
+// A forked child counts in a slot of its own. posix_spawn() and vfork()
+// children skip this and count in the parent's slot until they exec.
+static void istats_atfork_child(void) {
+    if (istats_segment)
+        __atomic_store_n(&istats_slot, istats_claim(istats_segment, getpid()), __ATOMIC_RELAXED);
+}
+
+// Start publishing as backend, with up to ISTATS_RULES named rules.
+// Returns 0, or -1 if publishing is off or the segment is unusable, in
+// which case every istats_*() call below does nothing.
+__attribute__((unused))
+static int istats_open(const char *backend, const char *const *rules, int nrules, int follow_fork) {
+    const char *path = istats_path(), *err;
+    if (!path || !(istats_segment = istats_map(path, 1, &err)))
+        return -1;
+
+    istats_backend = backend;
+    istats_rule_names = rules;
+    istats_nrules = nrules < ISTATS_RULES ? nrules : ISTATS_RULES;
+    __atomic_store_n(&istats_slot, istats_claim(istats_segment, getpid()), __ATOMIC_RELAXED);
+    if (follow_fork)
+        pthread_atfork(NULL, NULL, istats_atfork_child);
+    return istats_slot ? 0 : -1;
+}
+
+// Give the slot back (at exit; counts from threads still running are lost)
+__attribute__((unused))
+static void istats_close(void) {
+    istats_slot_t *slot = __atomic_exchange_n(&istats_slot, NULL, __ATOMIC_RELAXED);
+    uint32_t expect = ISTATS_LIVE;
+    if (slot && __atomic_compare_exchange_n(&slot->state, &expect, ISTATS_CLAIMING, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        istats_retire(istats_segment, slot);
+        __atomic_store_n(&istats_segment->pids[slot - istats_segment->slots], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->state, ISTATS_FREE, __ATOMIC_RELEASE);
+    }
+}
+
+#define ISTATS_ADD(field, n) do { \
+        istats_slot_t *s_ = __atomic_load_n(&istats_slot, __ATOMIC_RELAXED); \
+        if (s_) \
+            __atomic_add_fetch(&s_->field, (n), __ATOMIC_RELAXED); \
+    } while (0)
+
+static inline void istats_call(void) { ISTATS_ADD(calls, 1); }
+static inline void istats_error(void) { ISTATS_ADD(errors, 1); }
+static inline void istats_time(uint64_t ns) { ISTATS_ADD(ns, ns); }
+
+static inline void istats_hit(int rule) {
+    ISTATS_ADD(hits, 1);
+    if ((unsigned)rule < ISTATS_RULES)
+        ISTATS_ADD(rule_hits[rule], 1);
+}
+
+static inline void istats_gauge(int64_t value) {
+    istats_slot_t *s = __atomic_load_n(&istats_slot, __ATOMIC_RELAXED);
+    if (s)
+        __atomic_store_n(&s->gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t istats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * intercept_top: live interception rates from the shared stats segment
+ *
+ * Every interceptor (the ptrace tracer, the LD_PRELOAD library, the
+ * netlink shim and the FUSE emulator) publishes counters into
+ * /dev/shm/intercept-stats, one slot per process and backend; see
+ * intercept_stats.h. This samples all slots every -d seconds and prints
+ * rates over the interval:
+ *
+ *   - one line per backend: processes, calls/s, hits/s, errors/s, µs per
+ *     call (where the backend times its calls) and calls since start
+ *   - then one line per process, busiest first, with its busiest rule,
+ *     and an "(exited)" line per backend for processes that released
+ *     their slot during the interval; or with -r one line per backend and
+ *     rule
+ *
+ * Backend and rule rates include the retired totals of released slots, so
+ * short-lived processes (a cat of a /proc/sys file) are counted. A process
+ * that died without releasing its slot (killed, _exit(), exec into a
+ * binary without the library) is not shown, and its last counts are
+ * added to the retired totals only when the slot is reclaimed.
+ *
+ * The screen is redrawn like top(1) on a terminal. With -b, or when stdout
+ * is not a terminal, each sample is appended instead.
+ *
+ * Build: gcc -O2 -Wall intercept_top.c -o intercept_top
+ * Usage: ./intercept_top [-d seconds] [-n samples] [-l lines] [-f backend] [-r] [-b]
+ *                        [-s segment]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include "intercept_stats.h"
+
+// A consistent copy of one slot
+typedef struct {
+    int live;
+    uint32_t gen;
+    pid_t pid;
+    char backend[16], comm[16];
+    int nrules;
+    char rules[ISTATS_RULES][ISTATS_NAME];
+    uint64_t calls, hits, errors, ns;
+    int64_t gauge;
+    uint64_t rule_hits[ISTATS_RULES];
+} sample_t;
+
+// Interval rates of one process
+typedef struct {
+    const sample_t *s;
+    double calls, hits, errors, ns;
+    int top_rule;
+} proc_row_t;
+
+// Interval rates of a backend, or of one of its rules
+typedef struct {
+    char backend[16];
+    const char *rule;
+    int procs;
+    double calls, hits, errors, ns;
+    double proc_calls, proc_hits, proc_errors, proc_ns;  // Sum of the process rows
+    uint64_t total;
+} agg_row_t;
+
+#define N_SAMPLES (ISTATS_SLOTS + ISTATS_BACKENDS)
+
+static sample_t prev[N_SAMPLES], cur[N_SAMPLES];
+static proc_row_t procs[ISTATS_SLOTS];
+#define MAX_BACKEND_ROWS 64
+#define MAX_RULE_ROWS (MAX_BACKEND_ROWS * ISTATS_RULES)
+
+static agg_row_t backends[MAX_BACKEND_ROWS];
+static agg_row_t rules[MAX_RULE_ROWS];
+static int n_backends, n_rules;
+
+// Copy a slot if it is live and didn't change while being read
+static int read_slot(const istats_slot_t *slot, sample_t *out) {
+    uint32_t gen = __atomic_load_n(&slot->gen, __ATOMIC_ACQUIRE);
+    out->live = 0;
+    if ((gen & 1) || __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != ISTATS_LIVE)
+        return 0;
+
+    out->gen = gen;
+    out->pid = slot->pid;
+    memcpy(out->backend, slot->backend, sizeof(out->backend));
+    memcpy(out->comm, slot->comm, sizeof(out->comm));
+    out->backend[sizeof(out->backend) - 1] = out->comm[sizeof(out->comm) - 1] = '\0';
+    out->nrules = slot->nrules < ISTATS_RULES ? slot->nrules : ISTATS_RULES;
+    memcpy(out->rules, slot->rules, sizeof(out->rules));
+    for (int i = 0; i < ISTATS_RULES; i++) {
+        out->rules[i][ISTATS_NAME - 1] = '\0';
+        out->rule_hits[i] = __atomic_load_n(&slot->rule_hits[i], __ATOMIC_RELAXED);
+    }
+    out->calls = __atomic_load_n(&slot->calls, __ATOMIC_RELAXED);
+    out->hits = __atomic_load_n(&slot->hits, __ATOMIC_RELAXED);
+    out->errors = __atomic_load_n(&slot->errors, __ATOMIC_RELAXED);
+    out->ns = __atomic_load_n(&slot->ns, __ATOMIC_RELAXED);
+    out->gauge = __atomic_load_n(&slot->gauge, __ATOMIC_RELAXED);
+    uint64_t start_time = slot->start_time;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->gen, __ATOMIC_RELAXED) != gen ||
+        __atomic_load_n(&slot->state, __ATOMIC_RELAXED) != ISTATS_LIVE)
+        return 0;
+    // Died without releasing, or the pid now belongs to someone else
+    if (out->pid != 0 && istats_start_time(out->pid) != start_time)
+        return 0;
+    out->live = 1;
+    return 1;
+}
+
+static void sample_all(const istats_segment_t *seg, sample_t *out) {
+    for (int i = 0; i < ISTATS_SLOTS; i++)
+        read_slot(&seg->slots[i], &out[i]);
+    for (int i = 0; i < ISTATS_BACKENDS; i++)
+        read_slot(&seg->retired[i], &out[ISTATS_SLOTS + i]);
+}
+
+// Row for a backend (rule NULL) or one of its rules; past max rows, the
+// last row collects the rest
+static agg_row_t *find_row(agg_row_t *table, int *n, int max, const char *backend, const char *rule) {
+    for (int i = 0; i < *n; i++)
+        if (strcmp(table[i].backend, backend) == 0 && (!rule || strcmp(table[i].rule, rule) == 0))
+            return &table[i];
+    if (*n == max)
+        return &table[max - 1];
+    agg_row_t *r = &table[(*n)++];
+    memset(r, 0, sizeof(*r));
+    memcpy(r->backend, backend, sizeof(r->backend));
+    r->rule = rule;
+    return r;
+}
+
+// Add (sign 1) or take away (sign -1) a sample's cumulative counts. The
+// interval's growth is the current sum minus the previous one, which stays
+// right when a slot's counts move to its backend's retired totals.
+static void accumulate(const sample_t *s, int sign, double secs) {
+    agg_row_t *b = find_row(backends, &n_backends, MAX_BACKEND_ROWS, s->backend, NULL);
+    b->calls += sign * (double)s->calls / secs;
+    b->hits += sign * (double)s->hits / secs;
+    b->errors += sign * (double)s->errors / secs;
+    b->ns += sign * (double)s->ns;
+    if (sign > 0) {
+        b->procs += s->pid != 0;
+        b->total += s->calls;
+    }
+    for (int k = 0; k < s->nrules; k++) {
+        agg_row_t *r = find_row(rules, &n_rules, MAX_RULE_ROWS, s->backend, s->rules[k]);
+        r->hits += sign * (double)s->rule_hits[k] / secs;
+        if (sign > 0) {
+            r->procs += s->pid != 0 && s->rule_hits[k] > 0;
+            r->total += s->rule_hits[k];
+        }
+    }
+}
+
+// Counter growth of a process over the interval; a slot claimed since
+// counts from zero
+#define DELTA(i, field) (cur[i].field - (prev[i].live && prev[i].gen == cur[i].gen ? prev[i].field : 0))
+
+static int proc_by_calls(const void *a, const void *b) {
+    const proc_row_t *x = a, *y = b;
+    if (x->calls != y->calls)
+        return x->calls < y->calls ? 1 : -1;
+    return x->s->calls < y->s->calls ? 1 : x->s->calls > y->s->calls ? -1 : 0;
+}
+
+static int agg_by_calls(const void *a, const void *b) {
+    const agg_row_t *x = a, *y = b;
+    if (x->calls != y->calls)
+        return x->calls < y->calls ? 1 : -1;
+    if (x->hits != y->hits)
+        return x->hits < y->hits ? 1 : -1;
+    return x->total < y->total ? 1 : x->total > y->total ? -1 : 0;
+}
+
+static void print_us(double ns, double calls) {
+    if (ns > 0.5 && calls > 0.5)
+        printf(" %8.2f", ns / calls / 1000);
+    else
+        printf(" %8s", "-");
+}
+
+// Rates below half an op per interval are rounding noise from the sums
+static double rate(double r, double secs) {
+    return r * secs < 0.5 ? 0 : r;
+}
+
+static void show(const char *path, double secs, int lines, const char *filter, int rule_view) {
+    int n_procs = 0;
+    n_backends = n_rules = 0;
+
+    for (int i = 0; i < N_SAMPLES; i++) {
+        if (filter && strcmp(cur[i].backend, filter) != 0)
+            cur[i].live = 0;
+        if (prev[i].live && (!filter || strcmp(prev[i].backend, filter) == 0))
+            accumulate(&prev[i], -1, secs);
+        if (cur[i].live)
+            accumulate(&cur[i], 1, secs);
+    }
+
+    for (int i = 0; i < ISTATS_SLOTS; i++) {
+        if (!cur[i].live)
+            continue;
+        proc_row_t *p = &procs[n_procs++];
+        p->s = &cur[i];
+        p->calls = DELTA(i, calls) / secs;
+        p->hits = DELTA(i, hits) / secs;
+        p->errors = DELTA(i, errors) / secs;
+        p->ns = DELTA(i, ns);
+        p->top_rule = -1;
+        uint64_t best = 0;
+        for (int k = 0; k < cur[i].nrules; k++) {
+            uint64_t d = DELTA(i, rule_hits[k]);
+            if (d > best) {
+                best = d;
+                p->top_rule = k;
+            }
+        }
+        agg_row_t *b = find_row(backends, &n_backends, MAX_BACKEND_ROWS, cur[i].backend, NULL);
+        b->proc_calls += p->calls;
+        b->proc_hits += p->hits;
+        b->proc_errors += p->errors;
+        b->proc_ns += p->ns;
+    }
+    qsort(procs, n_procs, sizeof(proc_row_t), proc_by_calls);
+    qsort(backends, n_backends, sizeof(agg_row_t), agg_by_calls);
+
+    time_t now = time(NULL);
+    char stamp[16];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+    printf("intercept_top - %s  %s  interval %.1fs  %d processes\n\n", stamp, path, secs, n_procs);
+    printf("%-10s %6s %11s %10s %8s %8s %14s\n", "BACKEND", "PROCS", "CALLS/s", "HITS/s",
+           "ERR/s", "US/CALL", "CALLS");
+    for (int j = 0; j < n_backends; j++) {
+        agg_row_t *b = &backends[j];
+        printf("%-10s %6d %11.0f %10.0f %8.0f", b->backend, b->procs, rate(b->calls, secs),
+               rate(b->hits, secs), rate(b->errors, secs));
+        print_us(b->ns, b->calls * secs);
+        printf(" %14llu\n", (unsigned long long)b->total);
+    }
+    printf("\n");
+
+    if (rule_view) {
+        qsort(rules, n_rules, sizeof(agg_row_t), agg_by_calls);
+        printf("%-10s %-24s %6s %10s %14s\n", "BACKEND", "RULE", "PROCS", "HITS/s", "HITS");
+        for (int j = 0; j < n_rules && (lines == 0 || j < lines); j++)
+            printf("%-10s %-24s %6d %10.0f %14llu\n", rules[j].backend, rules[j].rule, rules[j].procs,
+                   rate(rules[j].hits, secs), (unsigned long long)rules[j].total);
+        return;
+    }
+
+    printf("%7s %-10s %-15s %11s %10s %8s %8s %8s  %s\n", "PID", "BACKEND", "COMMAND", "CALLS/s",
+           "HITS/s", "ERR/s", "US/CALL", "GAUGE", "TOP RULE");
+    for (int j = 0; j < n_procs && (lines == 0 || j < lines); j++) {
+        const proc_row_t *p = &procs[j];
+        printf("%7d %-10s %-15s %11.0f %10.0f %8.0f", p->s->pid, p->s->backend, p->s->comm, p->calls,
+               p->hits, p->errors);
+        print_us(p->ns, p->calls * secs);
+        printf(" %8lld  %s\n", (long long)p->s->gauge, p->top_rule >= 0 ? p->s->rules[p->top_rule] : "-");
+    }
+    if (lines && n_procs > lines)
+        printf("%7s (%d more)\n", "", n_procs - lines);
+
+    // What processes that released their slot did this interval
+    for (int j = 0; j < n_backends; j++) {
+        agg_row_t *b = &backends[j];
+        double calls = rate(b->calls - b->proc_calls, secs);
+        if (calls == 0)
+            continue;
+        printf("%7s %-10s %-15s %11.0f %10.0f %8.0f", "-", b->backend, "(exited)", calls,
+               rate(b->hits - b->proc_hits, secs), rate(b->errors - b->proc_errors, secs));
+        print_us(b->ns - b->proc_ns, calls * secs);
+        printf(" %8s  %s\n", "-", "-");
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-d seconds] [-n samples] [-l lines] [-f backend] [-r] [-b] [-s segment]\n"
+                    "  -d  interval (default 1)\n"
+                    "  -n  stop after this many samples (default: run until interrupted)\n"
+                    "  -l  process or rule lines per sample (default 20, 0 for all)\n"
+                    "  -f  only this backend (ptrace, preload, netlink, fuse)\n"
+                    "  -r  per-rule lines instead of per-process\n"
+                    "  -b  batch: append samples instead of redrawing\n"
+                    "  -s  segment (default $INTERCEPT_STATS or " ISTATS_DEFAULT_PATH ")\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    double secs = 1;
+    int samples = 0, lines = 20, rule_view = 0, batch = !isatty(STDOUT_FILENO), opt;
+    const char *filter = NULL, *path = istats_path(), *err;
+
+    while ((opt = getopt(argc, argv, "d:n:l:f:rbs:")) != -1) {
+        switch (opt) {
+        case 'd': secs = atof(optarg); break;
+        case 'n': samples = atoi(optarg); break;
+        case 'l': lines = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 'r': rule_view = 1; break;
+        case 'b': batch = 1; break;
+        case 's': path = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc || secs <= 0 || !path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const istats_segment_t *seg = istats_map(path, 0, &err);
+    if (!seg) {
+        fprintf(stderr, "%s: %s\n", path, err);
+        return 1;
+    }
+
+    sample_all(seg, prev);
+    for (int i = 0; samples == 0 || i < samples; i++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        nanosleep(&(struct timespec){ (time_t)secs, (long)((secs - (time_t)secs) * 1e9) }, NULL);
+        sample_all(seg, cur);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        if (!batch)
+            printf("\033[H\033[2J");
+        show(path, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, lines, filter, rule_view);
+        if (batch)
+            printf("\n");
+        fflush(stdout);
+        memcpy(prev, cur, sizeof(cur));
+    }
+    return 0;
+}
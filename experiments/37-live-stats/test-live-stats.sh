@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Run the tracer, the LD_PRELOAD library and the netlink shim against a
+# private stats segment and check what intercept_top reads back
+#
+# FUSE needs libfuse and a mount, so it isn't exercised here.
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO="$(cd "$SCRIPT_DIR/../.." && pwd)"
+TEST_DIR="/tmp/live-stats-test"
+export INTERCEPT_STATS="$TEST_DIR/segment"
+
+rm -rf "$TEST_DIR"
+mkdir -p "$TEST_DIR"
+gcc -O2 -Wall "$SCRIPT_DIR/intercept_top.c" -o "$TEST_DIR/intercept_top"
+gcc -O2 "$REPO/solutions/worker-stable-production/ptrace_interceptor.c" \
+    -o "$TEST_DIR/ptrace_interceptor" -lpthread
+gcc -shared -fPIC -O2 "$REPO/experiments/09-ld-preload-intercept/ld_preload_interceptor.c" \
+    -o "$TEST_DIR/ld_preload_interceptor.so" -ldl -lpthread
+gcc -shared -fPIC -O2 "$REPO/experiments/20-bridge-networking-breakthrough/code/netlink_intercept_v3.c" \
+    -o "$TEST_DIR/netlink_intercept.so" -ldl -lpthread
+
+failed=0
+check() {
+    if eval "$2"; then
+        echo "  ✓ $1"
+    else
+        echo "  ✗ $1"
+        failed=1
+    fi
+}
+
+top() {
+    "$TEST_DIR/intercept_top" -b -n 1 -d 1 "$@" 2>&1
+}
+
+# A long-running tracee reading redirected /proc/sys files, and a stream
+# of short-lived preloaded processes next to it
+"$TEST_DIR/ptrace_interceptor" sh -c \
+    'for i in $(seq 5000); do cat /proc/sys/kernel/pid_max; done' > /dev/null 2>&1 &
+tracer=$!
+(for i in $(seq 300); do
+    LD_PRELOAD="$TEST_DIR/ld_preload_interceptor.so" cat /sys/fs/cgroup/cpu.max > /dev/null 2>&1 || true
+done) &
+spawner=$!
+sleep 0.3
+top | tee "$TEST_DIR/top.txt"
+top -r > "$TEST_DIR/rules.txt"
+echo ""
+
+check "the tracer publishes one live slot" \
+    "grep -Eq '^ +$tracer +ptrace +ptrace_intercep' '$TEST_DIR/top.txt'"
+check "the tracer counts procsys hits" \
+    "grep -Eq '^ +$tracer +ptrace .* procsys\$' '$TEST_DIR/top.txt'"
+check "the traced-process gauge is set" \
+    "awk '\$1 == $tracer { exit !(\$(NF-1) >= 1) }' '$TEST_DIR/top.txt'"
+check "exited preload processes still show in the backend rate" \
+    "awk '\$1 == \"preload\" { exit !(\$3 > 0) }' '$TEST_DIR/top.txt'"
+check "exited preload processes get an (exited) row" \
+    "grep -Eq -- '- +preload +\\(exited\\)' '$TEST_DIR/top.txt'"
+check "the rule view names the preload cgroup rule" \
+    "grep -Eq 'preload +cgroup' '$TEST_DIR/rules.txt'"
+wait $tracer $spawner || true
+
+LD_PRELOAD="$TEST_DIR/netlink_intercept.so" ip link show > /dev/null 2>&1 || true
+top -r -f netlink > "$TEST_DIR/netlink.txt"
+check "netlink calls are counted after the process exits" \
+    "grep -Eq '^netlink +0 ' '$TEST_DIR/netlink.txt' && awk '\$1 == \"netlink\" { exit !(\$NF > 0) }' '$TEST_DIR/netlink.txt'"
+check "the filter hides other backends" \
+    "! grep -q '^ptrace' '$TEST_DIR/netlink.txt'"
+
+preload_calls() {
+    top -d 0.2 -f preload | awk '$1 == "preload" { print $NF }'
+}
+before=$(preload_calls)
+INTERCEPT_STATS=off LD_PRELOAD="$TEST_DIR/ld_preload_interceptor.so" \
+    cat /sys/fs/cgroup/cpu.max > /dev/null 2>&1 || true
+check "INTERCEPT_STATS=off publishes nothing" \
+    "[ -n '$before' ] && [ '$(preload_calls)' = '$before' ] && [ ! -e off ]"
+
+# Bump the version field and make sure nothing reads or writes it
+cp "$INTERCEPT_STATS" "$TEST_DIR/other"
+printf '\x63' | dd of="$TEST_DIR/other" bs=1 seek=8 conv=notrunc 2> /dev/null
+cp "$TEST_DIR/other" "$TEST_DIR/other.orig"
+INTERCEPT_STATS="$TEST_DIR/other" LD_PRELOAD="$TEST_DIR/ld_preload_interceptor.so" \
+    cat /sys/fs/cgroup/cpu.max > /dev/null 2>&1 || true
+check "the viewer rejects a segment of another layout" \
+    "top -s '$TEST_DIR/other' | grep -q 'another version or layout'"
+check "publishers leave a segment of another layout alone" \
+    "cmp -s '$TEST_DIR/other' '$TEST_DIR/other.orig'"
+
+echo ""
+if [ $failed -eq 0 ]; then
+    echo "All checks passed"
+else
+    echo "Some checks failed, output in $TEST_DIR"
+fi
+exit $failed
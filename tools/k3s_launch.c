@@ -0,0 +1,724 @@
+/*
+ * Event-driven k3s launcher: start k3s and report each readiness milestone
+ *
+ * Replaces the sleep/poll loops of start-k3s.sh (PID file every 0.5 s,
+ * kubeconfig every 1 s, a kubectl fork per healthz and per node check):
+ *
+ * - k3s is a direct child, started in its own session with output to the
+ *   log. With -n (or -T) it first gets a private mount namespace set up
+ *   like start-k3s.sh's unshare block: /dev/kmsg on /dev/null, / made
+ *   rshared, an optional tmpfs data dir, /tmp/diskstats on
+ *   /proc/diskstats. Its PID is known at once; a pidfd reports its exit
+ *   (before Linux 5.3, waitpid(WNOHANG) every 100 ms instead).
+ * - The kubeconfig is waited for with inotify, watching the deepest
+ *   directory that exists so far and moving down as k3s creates the
+ *   rest. Inside a namespace it is read through /proc/<pid>/root.
+ * - One TLS connection (OpenSSL, client certificate from the
+ *   kubeconfig) checks /healthz and then stays open on a node watch,
+ *   GET /api/v1/nodes?watch=1, read as a chunked HTTP/1.1 stream. The
+ *   node registering and turning Ready arrive as events, not polls.
+ *   Until the API server listens, connect() is retried with a backoff
+ *   from 1 ms to 50 ms; nothing announces the listen socket.
+ *
+ * Milestones go to stdout with microsecond timestamps from launch:
+ *   exec, kubeconfig, apiserver-tcp, apiserver-tls, healthz,
+ *   node-registered, node-ready (then node-not-ready/k3s-exit with -f)
+ *
+ * Exits 0 once a node is Ready, leaving k3s running. With -f it keeps
+ * following the node watch until the timeout (0: success if k3s is
+ * still up) or k3s exits (1).
+ *
+ * Build: gcc -O2 -Wall k3s_launch.c -o k3s_launch -lssl -lcrypto
+ * Usage: ./k3s_launch [-n] [-T /mnt/k3s-tmpfs] [-k kubeconfig] [-l /var/log/k3s.log]
+ *            [-p pidfile]... [-t 180] [-f] [-i] -- k3s server [args...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/inotify.h>
+#include <sys/mount.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#define DEFAULT_KUBECONFIG "/etc/rancher/k3s/k3s.yaml"
+#define DEFAULT_LOG "/var/log/k3s.log"
+#define DISKSTATS_SOURCE "/tmp/diskstats"
+#define MAX_PIDFILES 4
+#define BACKOFF_MIN_US 1000
+#define BACKOFF_MAX_US 50000
+#define EXIT_POLL_MS 100  // Exit check interval without a pidfd
+
+typedef enum {
+    WAIT_KUBECONFIG,
+    WAIT_RETRY,     // Backing off before the next connect()
+    CONNECTING,
+    HANDSHAKE,
+    HEALTHZ,
+    WATCH,
+} state_t;
+
+typedef struct {
+    char host[256], port[16];
+    char *ca, *cert, *key;  // PEM
+} kubeconfig_t;
+
+static long long launch_us;
+static int follow, insecure;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void milestone(const char *name, const char *fmt, ...) {
+    long long t = now_us() - launch_us;
+    char detail[512] = "";
+    if (fmt) {
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(detail, sizeof(detail), fmt, ap);
+        va_end(ap);
+    }
+    printf("[k3s_launch] +%lld.%06llds %-16s %s\n", t / 1000000, t % 1000000, name, detail);
+    fflush(stdout);
+}
+
+/* Kubeconfig */
+
+static char *read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    char *buf = malloc(st.st_size + 1);
+    ssize_t n = buf ? read(fd, buf, st.st_size) : -1;
+    close(fd);
+    if (n != st.st_size) {
+        free(buf);
+        return NULL;
+    }
+    buf[n] = '\0';
+    if (len)
+        *len = n;
+    return buf;
+}
+
+// Value of the first "key: value" line for key, in a static buffer
+static const char *yaml_value(const char *yaml, const char *key) {
+    static char value[16384];
+    size_t klen = strlen(key);
+    for (const char *p = yaml; p && *p; p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL) {
+        const char *k = p + strspn(p, " \t-");
+        if (strncmp(k, key, klen) != 0 || k[klen] != ':')
+            continue;
+        const char *v = k + klen + 1;
+        v += strspn(v, " \t\"");
+        size_t n = strcspn(v, "\"\r\n");
+        if (n >= sizeof(value))
+            return NULL;
+        memcpy(value, v, n);
+        value[n] = '\0';
+        return value;
+    }
+    return NULL;
+}
+
+// PEM for key from <key>-data (base64) or <key> (a path, under root)
+static char *yaml_pem(const char *yaml, const char *key, const char *root) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s-data", key);
+    const char *v = yaml_value(yaml, name);
+    if (v) {
+        size_t n = strlen(v);
+        unsigned char *pem = malloc(n / 4 * 3 + 4);
+        int len = EVP_DecodeBlock(pem, (const unsigned char *)v, n);
+        if (len < 0) {
+            free(pem);
+            return NULL;
+        }
+        pem[len] = '\0';
+        return (char *)pem;
+    }
+    if ((v = yaml_value(yaml, key)) != NULL) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s%s", v[0] == '/' ? root : "", v);
+        return read_file(path, NULL);
+    }
+    return NULL;
+}
+
+static void free_kubeconfig(kubeconfig_t *kc) {
+    free(kc->ca);
+    free(kc->cert);
+    free(kc->key);
+    memset(kc, 0, sizeof(*kc));
+}
+
+// Returns 0 once the file has a server and client credentials
+static int load_kubeconfig(const char *path, const char *root, kubeconfig_t *kc) {
+    char *yaml = read_file(path, NULL);
+    if (!yaml)
+        return -1;
+
+    const char *server = yaml_value(yaml, "server");
+    if (!server || sscanf(server, "https://%255[^:/]:%15[0-9]", kc->host, kc->port) < 1) {
+        free(yaml);
+        return -1;
+    }
+    if (!kc->port[0])
+        strcpy(kc->port, "443");
+    kc->ca = yaml_pem(yaml, "certificate-authority", root);
+    kc->cert = yaml_pem(yaml, "client-certificate", root);
+    kc->key = yaml_pem(yaml, "client-key", root);
+    free(yaml);
+    if (!kc->cert || !kc->key || (!kc->ca && !insecure)) {
+        free_kubeconfig(kc);
+        return -1;
+    }
+    return 0;
+}
+
+// Watch the deepest existing directory on the way to path
+static void watch_towards(int ifd, int *wd, const char *path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    do {
+        char *slash = strrchr(dir, '/');
+        if (!slash)
+            return;
+        slash[slash == dir] = '\0';
+    } while (access(dir, F_OK) < 0 && strcmp(dir, "/") != 0);
+
+    if (*wd >= 0)
+        inotify_rm_watch(ifd, *wd);
+    *wd = inotify_add_watch(ifd, dir, IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE);
+}
+
+/* TLS */
+
+static SSL_CTX *make_ctx(const kubeconfig_t *kc) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    BIO *bio;
+    X509 *x;
+
+    bio = BIO_new_mem_buf(kc->cert, -1);
+    x = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    bio = BIO_new_mem_buf(kc->key, -1);
+    EVP_PKEY *pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    if (!x || !pkey || SSL_CTX_use_certificate(ctx, x) != 1 || SSL_CTX_use_PrivateKey(ctx, pkey) != 1) {
+        fprintf(stderr, "k3s_launch: unusable client certificate in kubeconfig\n");
+        exit(1);
+    }
+    X509_free(x);
+    EVP_PKEY_free(pkey);
+
+    if (insecure) {
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+        return ctx;
+    }
+    X509_STORE *store = SSL_CTX_get_cert_store(ctx);
+    bio = BIO_new_mem_buf(kc->ca, -1);
+    while ((x = PEM_read_bio_X509(bio, NULL, NULL, NULL)) != NULL) {
+        X509_STORE_add_cert(store, x);
+        X509_free(x);
+    }
+    BIO_free(bio);
+    ERR_clear_error();
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    return ctx;
+}
+
+/* HTTP over the one connection */
+
+typedef struct {
+    int fd;
+    SSL *ssl;
+    char *in;              // Raw bytes not consumed yet
+    size_t in_len, in_cap;
+    int headers_done, status, chunked;
+    long long body_left;   // Content-Length left, or bytes left of the current chunk
+    char *body;            // De-chunked body not consumed yet
+    size_t body_len, body_cap;
+} conn_t;
+
+static void append(char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+    if (*len + n + 1 > *cap) {
+        *cap = (*len + n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+}
+
+static void consume(char *buf, size_t *len, size_t n) {
+    memmove(buf, buf + n, *len - n);
+    *len -= n;
+    buf[*len] = '\0';
+}
+
+static void close_conn(conn_t *c) {
+    if (c->ssl)
+        SSL_free(c->ssl);
+    if (c->fd >= 0)
+        close(c->fd);
+    c->ssl = NULL;
+    c->fd = -1;
+    c->in_len = c->body_len = 0;
+}
+
+static void reset_response(conn_t *c) {
+    c->headers_done = c->status = c->chunked = 0;
+    c->body_left = -1;
+    c->body_len = 0;
+}
+
+static int send_request(conn_t *c, const kubeconfig_t *kc, const char *path) {
+    char req[1024];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: k3s_launch\r\n"
+                     "Accept: application/json\r\n\r\n", path, kc->host, kc->port);
+    reset_response(c);
+    // A few hundred bytes fit the socket buffer of a fresh connection
+    for (int tries = 0; tries < 1000; tries++) {
+        int r = SSL_write(c->ssl, req, n);
+        if (r == n)
+            return 0;
+        int err = SSL_get_error(c->ssl, r);
+        if (err != SSL_ERROR_WANT_WRITE && err != SSL_ERROR_WANT_READ)
+            return -1;
+        struct pollfd p = { c->fd, err == SSL_ERROR_WANT_WRITE ? POLLOUT : POLLIN, 0 };
+        poll(&p, 1, 10);
+    }
+    return -1;
+}
+
+// Pull what's readable and decode it into c->body. Returns 1 when the
+// response is complete, 0 for more to come, -1 if the connection ended.
+static int read_response(conn_t *c) {
+    char buf[16384];
+    for (;;) {
+        int r = SSL_read(c->ssl, buf, sizeof(buf));
+        if (r > 0) {
+            append(&c->in, &c->in_len, &c->in_cap, buf, r);
+            continue;
+        }
+        int err = SSL_get_error(c->ssl, r);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+            break;
+        return -1;
+    }
+
+    if (!c->headers_done) {
+        char *end = strstr(c->in, "\r\n\r\n");
+        if (!end)
+            return 0;
+        *end = '\0';
+        sscanf(c->in, "HTTP/1.%*d %d", &c->status);
+        for (char *h = strstr(c->in, "\r\n"); h; h = strstr(h + 2, "\r\n")) {
+            if (strncasecmp(h + 2, "transfer-encoding:", 18) == 0 && strcasestr(h + 20, "chunked"))
+                c->chunked = 1;
+            else if (strncasecmp(h + 2, "content-length:", 15) == 0)
+                c->body_left = atoll(h + 17);
+        }
+        if (c->chunked)
+            c->body_left = -1;
+        consume(c->in, &c->in_len, end + 4 - c->in);
+        c->headers_done = 1;
+    }
+
+    if (!c->chunked) {
+        size_t n = c->body_left >= 0 && (long long)c->in_len > c->body_left ? (size_t)c->body_left : c->in_len;
+        append(&c->body, &c->body_len, &c->body_cap, c->in, n);
+        consume(c->in, &c->in_len, n);
+        if (c->body_left >= 0)
+            c->body_left -= n;
+        return c->body_left == 0;
+    }
+
+    for (;;) {
+        if (c->body_left <= 0) {
+            // CRLF closing the last chunk, then the next chunk size line
+            if (c->body_left == 0 && c->in_len >= 2 && memcmp(c->in, "\r\n", 2) == 0) {
+                consume(c->in, &c->in_len, 2);
+                c->body_left = -1;
+            }
+            char *eol = c->body_left < 0 ? strstr(c->in, "\r\n") : NULL;
+            if (!eol)
+                return 0;
+            long long size = strtoll(c->in, NULL, 16);
+            consume(c->in, &c->in_len, eol + 2 - c->in);
+            if (size == 0)
+                return 1;
+            c->body_left = size;
+        }
+        size_t n = (long long)c->in_len < c->body_left ? c->in_len : (size_t)c->body_left;
+        if (n == 0)
+            return 0;
+        append(&c->body, &c->body_len, &c->body_cap, c->in, n);
+        consume(c->in, &c->in_len, n);
+        c->body_left -= n;
+    }
+}
+
+/* Node watch events */
+
+static char ready_node[256];
+static int node_seen, node_ready;
+
+// One watch event: {"type":"ADDED","object":{...Node...}}
+static int handle_event(const char *ev) {
+    char type[32] = "", name[256] = "";
+    const char *p = strstr(ev, "\"type\":\"");
+    if (p)
+        sscanf(p + 8, "%31[^\"]", type);
+    if (strcmp(type, "ERROR") == 0) {
+        milestone("watch-error", "%.200s", ev);
+        return -1;
+    }
+    if ((p = strstr(ev, "\"metadata\":{")) && (p = strstr(p, "\"name\":\"")))
+        sscanf(p + 8, "%255[^\"]", name);
+    int ready = strstr(ev, "\"type\":\"Ready\",\"status\":\"True\"") != NULL;
+
+    if (!node_seen && strcmp(type, "DELETED") != 0) {
+        node_seen = 1;
+        milestone("node-registered", "%s", name);
+    }
+    if (ready && !node_ready) {
+        node_ready = 1;
+        snprintf(ready_node, sizeof(ready_node), "%s", name);
+        milestone("node-ready", "%s", name);
+    } else if (node_ready && strcmp(name, ready_node) == 0 && (!ready || strcmp(type, "DELETED") == 0)) {
+        node_ready = 0;
+        milestone("node-not-ready", "%s %s", name, type);
+    }
+    return 0;
+}
+
+/* Launch */
+
+static void setup_namespace(const char *tmpfs) {
+    if (unshare(CLONE_NEWNS) < 0) {
+        perror("k3s_launch: unshare");
+        _exit(126);
+    }
+    // Fake /dev/kmsg for the kubelet OOM watcher, as kind does
+    int fd = open("/dev/kmsg", O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0)
+        close(fd);
+    if (mount("/dev/null", "/dev/kmsg", NULL, MS_BIND, NULL) < 0)
+        fprintf(stderr, "Note: Could not bind-mount /dev/kmsg\n");
+
+    // Shared propagation lets the kubelet's mounts work
+    mount(NULL, "/", NULL, MS_REC | MS_SHARED, NULL);
+
+    // cAdvisor needs a real filesystem for the data dir, not 9p
+    if (tmpfs) {
+        mkdir(tmpfs, 0755);
+        if (mount("tmpfs", tmpfs, "tmpfs", 0, "size=20G") < 0)
+            fprintf(stderr, "Note: Could not mount tmpfs on %s\n", tmpfs);
+        mount(NULL, tmpfs, NULL, MS_REC | MS_SHARED, NULL);
+    }
+
+    if (access(DISKSTATS_SOURCE, F_OK) == 0 &&
+        mount(DISKSTATS_SOURCE, "/proc/diskstats", NULL, MS_BIND, NULL) < 0)
+        fprintf(stderr, "Note: Could not mount diskstats\n");
+}
+
+// Fork k3s; returns once it has exec'd. Exits if it couldn't.
+static pid_t launch(char **argv, int namespace, const char *tmpfs, const char *log) {
+    int sync[2];
+    if (pipe2(sync, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sync[0]);
+        setsid();
+        int out = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int in = open("/dev/null", O_RDONLY);
+        if (out >= 0) {
+            dup2(out, 1);
+            dup2(out, 2);
+        }
+        if (in >= 0)
+            dup2(in, 0);
+        if (namespace)
+            setup_namespace(tmpfs);
+        execvp(argv[0], argv);
+        int err = errno;
+        (void) !write(sync[1], &err, sizeof(err));
+        _exit(127);
+    }
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    // EOF on the close-on-exec pipe means exec succeeded
+    close(sync[1]);
+    int err = 0;
+    ssize_t n = read(sync[0], &err, sizeof(err));
+    close(sync[0]);
+    if (n == sizeof(err)) {
+        fprintf(stderr, "k3s_launch: %s: %s\n", argv[0], strerror(err));
+        exit(1);
+    }
+    return pid;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n] [-T tmpfs-dir] [-k kubeconfig] [-l log] [-p pidfile]... "
+                    "[-t timeout] [-f] [-i] -- <k3s> server [args...]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *kubeconfig = DEFAULT_KUBECONFIG, *log = DEFAULT_LOG, *tmpfs = NULL;
+    const char *pidfiles[MAX_PIDFILES];
+    int n_pidfiles = 0, namespace = 0, timeout = 180, opt;
+
+    while ((opt = getopt(argc, argv, "nT:k:l:p:t:fi")) != -1) {
+        switch (opt) {
+        case 'n': namespace = 1; break;
+        case 'T': tmpfs = optarg; namespace = 1; break;
+        case 'k': kubeconfig = optarg; break;
+        case 'l': log = optarg; break;
+        case 'p':
+            if (n_pidfiles < MAX_PIDFILES)
+                pidfiles[n_pidfiles++] = optarg;
+            break;
+        case 't': timeout = atoi(optarg); break;
+        case 'f': follow = 1; break;
+        case 'i': insecure = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind == argc)
+        usage(argv[0]);
+    signal(SIGPIPE, SIG_IGN);
+
+    launch_us = now_us();
+    pid_t pid = launch(argv + optind, namespace, tmpfs, log);
+    milestone("exec", "pid %d, log %s", pid, log);
+    for (int i = 0; i < n_pidfiles; i++) {
+        FILE *f = fopen(pidfiles[i], "w");
+        if (f) {
+            fprintf(f, "%d\n", pid);
+            fclose(f);
+        }
+    }
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);  // -1 (ENOSYS) before Linux 5.3: poll() skips it
+
+    // In a private namespace, k3s's files are seen through its root
+    char root[64] = "", kc_path[PATH_MAX];
+    if (namespace)
+        snprintf(root, sizeof(root), "/proc/%d/root", pid);
+    snprintf(kc_path, sizeof(kc_path), "%s%s", kubeconfig[0] == '/' ? root : "", kubeconfig);
+
+    int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC), wd = -1;
+    kubeconfig_t kc = { 0 };
+    SSL_CTX *ctx = NULL;
+    conn_t c = { .fd = -1 };
+    state_t state = WAIT_KUBECONFIG;
+    long long deadline = launch_us + timeout * 1000000LL, retry_at = 0, backoff = BACKOFF_MIN_US;
+    int connects = 0, healthz_tries = 0, tcp_up = 0, tls_up = 0, healthy = 0;
+    struct addrinfo *addr = NULL;
+
+    append(&c.in, &c.in_len, &c.in_cap, "", 0);
+    append(&c.body, &c.body_len, &c.body_cap, "", 0);
+
+    watch_towards(ifd, &wd, kc_path);
+    if (load_kubeconfig(kc_path, root, &kc) == 0)
+        state = WAIT_RETRY;
+
+    for (;;) {
+        if (state == WAIT_RETRY && ctx == NULL) {
+            milestone("kubeconfig", "%s (server %s:%s)", kubeconfig, kc.host, kc.port);
+            ctx = make_ctx(&kc);
+            struct addrinfo hints = { .ai_socktype = SOCK_STREAM };
+            if (getaddrinfo(kc.host, kc.port, &hints, &addr) != 0) {
+                fprintf(stderr, "k3s_launch: cannot resolve %s\n", kc.host);
+                return 1;
+            }
+            close(ifd);
+            ifd = -1;
+            retry_at = now_us();
+        }
+
+        // Start the next connect attempt when the backoff is over
+        if (state == WAIT_RETRY && now_us() >= retry_at) {
+            c.fd = socket(addr->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            connects++;
+            if (connect(c.fd, addr->ai_addr, addr->ai_addrlen) == 0 || errno == EINPROGRESS) {
+                state = CONNECTING;
+            } else {
+                close(c.fd);
+                c.fd = -1;
+                retry_at = now_us() + backoff;
+                backoff = backoff * 2 > BACKOFF_MAX_US ? BACKOFF_MAX_US : backoff * 2;
+            }
+        }
+
+        struct pollfd pfds[3];
+        int n = 0, sock_slot = -1, ino_slot = -1;
+        pfds[n++] = (struct pollfd){ pidfd, POLLIN, 0 };
+        if (ifd >= 0) {
+            ino_slot = n;
+            pfds[n++] = (struct pollfd){ ifd, POLLIN, 0 };
+        }
+        if (c.fd >= 0 && state != WAIT_RETRY) {
+            sock_slot = n;
+            short ev = POLLIN;
+            if (state == CONNECTING || (c.ssl && SSL_want_write(c.ssl)))
+                ev = POLLOUT;
+            pfds[n++] = (struct pollfd){ c.fd, ev, 0 };
+        }
+
+        long long now = now_us(), wake = deadline;
+        if (state == WAIT_RETRY && retry_at < wake)
+            wake = retry_at;
+        int ms = wake > now ? (int)((wake - now + 999) / 1000) : 0;
+        if (pidfd < 0 && ms > EXIT_POLL_MS)
+            ms = EXIT_POLL_MS;
+        if (poll(pfds, n, ms) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+
+        int status;
+        if (pidfd >= 0 ? pfds[0].revents && waitpid(pid, &status, 0) == pid
+                       : waitpid(pid, &status, WNOHANG) == pid) {
+            if (WIFEXITED(status))
+                milestone("k3s-exit", "status %d, see %s", WEXITSTATUS(status), log);
+            else
+                milestone("k3s-exit", "signal %d, see %s", WTERMSIG(status), log);
+            return 1;
+        }
+
+        if (now_us() >= deadline) {
+            if (follow) {
+                milestone("timeout", "k3s still running after %d s, node %s", timeout,
+                          node_ready ? "Ready" : node_seen ? "not Ready" : "not registered");
+                return 0;
+            }
+            milestone("timeout", "after %d s (%d connects, %d healthz checks), see %s",
+                      timeout, connects, healthz_tries, log);
+            return 1;
+        }
+
+        if (ino_slot >= 0 && pfds[ino_slot].revents) {
+            char buf[4096];
+            while (read(ifd, buf, sizeof(buf)) > 0)
+                ;
+            watch_towards(ifd, &wd, kc_path);
+            if (load_kubeconfig(kc_path, root, &kc) == 0)
+                state = WAIT_RETRY;
+            continue;
+        }
+
+        if (sock_slot < 0 || !pfds[sock_slot].revents)
+            continue;
+
+        int failed = 0;
+        if (state == CONNECTING) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) {
+                failed = 1;
+            } else {
+                if (!tcp_up++)
+                    milestone("apiserver-tcp", "after %d connect attempts", connects);
+                c.ssl = SSL_new(ctx);
+                SSL_set_fd(c.ssl, c.fd);
+                SSL_set_tlsext_host_name(c.ssl, kc.host);
+                X509_VERIFY_PARAM *param = SSL_get0_param(c.ssl);
+                if (X509_VERIFY_PARAM_set1_ip_asc(param, kc.host) != 1)
+                    X509_VERIFY_PARAM_set1_host(param, kc.host, 0);
+                state = HANDSHAKE;
+            }
+        }
+
+        if (state == HANDSHAKE && !failed) {
+            int r = SSL_connect(c.ssl);
+            if (r == 1) {
+                if (!tls_up++)
+                    milestone("apiserver-tls", "%s", SSL_get_version(c.ssl));
+                state = healthy ? WATCH : HEALTHZ;
+                healthz_tries += !healthy;
+                failed = send_request(&c, &kc, healthy ? "/api/v1/nodes?watch=1" : "/healthz") < 0;
+            } else {
+                int err = SSL_get_error(c.ssl, r);
+                if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+                    if (ERR_GET_REASON(ERR_peek_error()) == SSL_R_CERTIFICATE_VERIFY_FAILED) {
+                        fprintf(stderr, "k3s_launch: server certificate not trusted by the kubeconfig CA "
+                                        "(-i skips verification)\n");
+                        return 1;
+                    }
+                    failed = 1;
+                }
+            }
+        } else if ((state == HEALTHZ || state == WATCH) && !failed) {
+            int r = read_response(&c);
+            if (state == HEALTHZ && r == 1) {
+                if (c.status == 200) {
+                    healthy = 1;
+                    milestone("healthz", "after %d checks", healthz_tries);
+                    state = WATCH;
+                    failed = send_request(&c, &kc, "/api/v1/nodes?watch=1") < 0;
+                } else {
+                    failed = 1;  // Not ready yet: back off and ask again
+                }
+            } else if (state == WATCH) {
+                if (c.headers_done && c.status != 200) {
+                    milestone("watch-error", "HTTP %d", c.status);
+                    failed = 1;
+                }
+                char *eol;
+                while (!failed && (eol = memchr(c.body, '\n', c.body_len)) != NULL) {
+                    *eol = '\0';
+                    if (handle_event(c.body) < 0)
+                        failed = 1;
+                    consume(c.body, &c.body_len, eol + 1 - c.body);
+                }
+                if (node_ready && !follow)
+                    return 0;
+                failed |= r != 0;  // Watch ended or connection dropped
+            }
+            failed |= r < 0;
+        }
+
+        if (failed) {
+            close_conn(&c);
+            state = WAIT_RETRY;
+            retry_at = now_us() + backoff;
+            backoff = backoff * 2 > BACKOFF_MAX_US ? BACKOFF_MAX_US : backoff * 2;
+        }
+    }
+}